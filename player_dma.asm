@@ -0,0 +1,49 @@
+.ORIG x1000
+    AND R7, R7, #0
+    LD R1, DMA_START
+    LDI R0, MR_BANK_COUNT
+
+    BRz CLIP
+
+    LD R2, WINDOW_START
+    LD R3, WINDOW_SIZE
+    BR SETUP
+
+CLIP
+    LD R2, AUDIO_START
+    LD R3, AUDIO_LENGTH
+SETUP
+    STI R2, MR_DMA_SOURCE
+    STI R3, MR_DMA_LENGTH
+PLAY
+    STI R1, MR_DMA_CONTROL
+WAIT
+    LDI R4, MR_DMA_CONTROL
+    BRzp WAIT
+
+    ADD R0, R0, #0
+    BRz PLAY
+
+    ADD R7, R7, #1
+    NOT R5, R7
+    ADD R5, R5, #1
+    ADD R5, R5, R0
+
+    BRp SELECT
+
+    AND R7, R7, #0
+SELECT
+    STI R7, MR_BANK_SELECT
+    BR PLAY
+
+AUDIO_START .FILL x1500
+AUDIO_LENGTH .FILL xD740
+WINDOW_START .FILL x1500
+WINDOW_SIZE .FILL x4000
+DMA_START .FILL x0001
+MR_DMA_SOURCE .FILL xFE0A
+MR_DMA_LENGTH .FILL xFE0C
+MR_DMA_CONTROL .FILL xFE0E
+MR_BANK_SELECT .FILL xFE06
+MR_BANK_COUNT .FILL xFE08
+.END
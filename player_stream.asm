@@ -0,0 +1,55 @@
+.ORIG x1000
+    AND R7, R7, #0
+    LD R6, DELAY_SKIP_COUNT
+BANK
+    LD R0, WINDOW_START
+    LD R1, WINDOW_END
+LOOP
+    LDR R2, R0, #0
+    STI R2, MR_AUDIO_DATA
+    ADD R0, R0, #1
+
+    NOT R3, R0
+    ADD R3, R3, #1
+    ADD R4, R3, R1
+
+    BRz NEXT_BANK
+
+    ADD R6, R6, #-1
+
+    BRn DELAY
+
+    BR LOOP
+
+NEXT_BANK
+    ADD R7, R7, #1
+    LDI R1, MR_BANK_COUNT
+
+    NOT R3, R7
+    ADD R3, R3, #1
+    ADD R4, R3, R1
+
+    BRp SELECT
+
+    AND R7, R7, #0
+SELECT
+    STI R7, MR_BANK_SELECT
+    BR BANK
+
+DELAY
+    LD R5, DELAY_COUNT
+    LD R6, DELAY_SKIP_COUNT
+DELAY_LOOP
+    ADD R5, R5, #-1
+    BRzp DELAY_LOOP
+
+    BR LOOP
+
+WINDOW_START .FILL x1500
+WINDOW_END .FILL x5500
+MR_AUDIO_DATA .FILL xFE04
+MR_BANK_SELECT .FILL xFE06
+MR_BANK_COUNT .FILL xFE08
+DELAY_SKIP_COUNT .FILL #100
+DELAY_COUNT .FILL #10
+.END
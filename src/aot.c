@@ -0,0 +1,294 @@
+#include "aot.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bulkio.h"
+#include "interpreter.h"
+#include "memory.h"
+#include "predecode.h"
+#include "utils.h"
+
+uint16_t aot_load_obj(aot_image_t* image, const char* path) {
+  FILE* file = fopen(path, "rbe");
+  if (!file) {
+    error_and_exit("Failed to open image");
+  }
+
+  uint16_t origin = 0;
+  if (!fread(&origin, sizeof(origin), 1, file)) {
+    error_and_exit("Unable to read origin from image");
+  }
+  origin = swap16(origin);
+
+  /* same limit as read_image_file */
+  uint16_t max_read = MEMORY_MAX - origin;
+  uint16_t* words = image->words + origin;
+  size_t read = fread(words, sizeof(uint16_t), max_read, file);
+  swap16_buffer(words, (const uint8_t*)words, read);
+  memset(image->loaded + origin, 1, read);
+
+  if (fclose(file) != 0) {
+    error_and_exit("Failed to close image file");
+  }
+  return origin;
+}
+
+/* Queues an address once, if it holds a word from an image. */
+static void visit(const aot_image_t* image, uint8_t* reachable,
+                  uint16_t* stack, size_t* top, uint16_t address) {
+  if (image->loaded[address] && !reachable[address]) {
+    reachable[address] = 1;
+    stack[(*top)++] = address;
+  }
+}
+
+void aot_mark_reachable(const aot_image_t* image, uint16_t entry,
+                        uint8_t* reachable) {
+  static uint16_t stack[MEMORY_MAX + 1];
+  size_t top = 0;
+
+  memset(reachable, 0, MEMORY_MAX + 1);
+  visit(image, reachable, stack, &top, entry);
+
+  while (top > 0) {
+    uint16_t address = stack[--top];
+    decoded_t decoded = predecode_instr(address, image->words[address]);
+    uint16_t next_pc = (uint16_t)(address + 1);
+
+    switch (decoded.handler) {
+      case PD_BR:
+      case PD_JSR:
+        visit(image, reachable, stack, &top, decoded.imm);
+        visit(image, reachable, stack, &top, next_pc);
+        break;
+      case PD_BR_ALWAYS:
+        visit(image, reachable, stack, &top, decoded.imm);
+        break;
+      case PD_JMP:
+        break;
+      case PD_REF:
+        /* traps return to the next instruction, except HALT */
+        if (decoded.instr >> OPCODE_SHIFT == OP_TRAP &&
+            (decoded.instr & FIRST_8BIT_MASK) != TRAP_HALT) {
+          visit(image, reachable, stack, &top, next_pc);
+        }
+        break;
+      default:
+        visit(image, reachable, stack, &top, next_pc);
+        break;
+    }
+  }
+}
+
+/* Jumps to a translated label, or through the dispatcher otherwise. */
+static void emit_goto(FILE* out, const uint8_t* reachable, const char* indent,
+                      uint16_t from, uint16_t target) {
+  if (!reachable[target]) {
+    fprintf(out, "%spc = 0x%04X;\n%sgoto dispatch;\n", indent, target, indent);
+    return;
+  }
+  if (target <= from) {
+    /* backward branches are where long-running loops can be interrupted */
+    fprintf(out,
+            "%sif (interrupt_requested) {\n%s  pc = 0x%04X;\n"
+            "%s  goto leave;\n%s}\n",
+            indent, indent, target, indent, indent);
+  }
+  fprintf(out, "%sgoto L_%04X;\n", indent, target);
+}
+
+/* Runs an instruction through the reference interpreter. */
+static void emit_reference(FILE* out, uint16_t next_pc, uint16_t instr) {
+  fprintf(out,
+          "  pc = 0x%04X;\n  AOT_SPILL();\n"
+          "  execute_instr(vm, 0x%04X, running);\n"
+          "  AOT_RELOAD();\n  if (!*running) {\n    goto leave;\n  }\n",
+          next_pc, instr);
+}
+
+static void emit_flags(FILE* out, uint8_t dst) {
+  fprintf(out, "  cond = flags_for(r%u);\n", dst);
+}
+
+/*
+ * Writes the code for one instruction. Returns 1 if execution can fall
+ * through to the next address.
+ */
+static int emit_instr(FILE* out, const uint8_t* reachable, uint16_t address,
+                      uint16_t instr) {
+  decoded_t decoded = predecode_instr(address, instr);
+  uint16_t next_pc = (uint16_t)(address + 1);
+  unsigned dst = decoded.dr;
+  unsigned src1 = decoded.sr1;
+  unsigned src2 = decoded.sr2;
+  unsigned imm = decoded.imm;
+
+  fprintf(out, "L_%04X: /* x%04X: %04X */\n  ++retired;\n", address, address,
+          instr);
+
+  switch (decoded.handler) {
+    case PD_ADD_REG:
+      fprintf(out, "  r%u = (uint16_t)(r%u + r%u);\n", dst, src1, src2);
+      emit_flags(out, decoded.dr);
+      return 1;
+    case PD_ADD_IMM:
+      fprintf(out, "  r%u = (uint16_t)(r%u + 0x%04XU);\n", dst, src1, imm);
+      emit_flags(out, decoded.dr);
+      return 1;
+    case PD_AND_REG:
+      fprintf(out, "  r%u = (uint16_t)(r%u & r%u);\n", dst, src1, src2);
+      emit_flags(out, decoded.dr);
+      return 1;
+    case PD_AND_IMM:
+      fprintf(out, "  r%u = (uint16_t)(r%u & 0x%04XU);\n", dst, src1, imm);
+      emit_flags(out, decoded.dr);
+      return 1;
+    case PD_NOT:
+      fprintf(out, "  r%u = (uint16_t)~r%u;\n", dst, src1);
+      emit_flags(out, decoded.dr);
+      return 1;
+    case PD_BR:
+      fprintf(out, "  if (cond & 0x%XU) {\n", src2);
+      emit_goto(out, reachable, "    ", address, decoded.imm);
+      fprintf(out, "  }\n");
+      return 1;
+    case PD_BR_ALWAYS:
+      emit_goto(out, reachable, "  ", address, decoded.imm);
+      return 0;
+    case PD_NOP:
+      return 1;
+    case PD_JMP:
+      fprintf(out, "  pc = r%u;\n  goto dispatch;\n", src1);
+      return 0;
+    case PD_JSR:
+      fprintf(out, "  r7 = 0x%04X;\n", next_pc);
+      emit_goto(out, reachable, "  ", address, decoded.imm);
+      return 0;
+    case PD_JSRR:
+      /* R7 is written first, matching jump_register_instr for JSRR R7 */
+      fprintf(out, "  r7 = 0x%04X;\n  pc = r%u;\n  goto dispatch;\n", next_pc,
+              src1);
+      return 0;
+    case PD_LD:
+      fprintf(out, "  r%u = mem_read(vm, 0x%04X);\n", dst, imm);
+      emit_flags(out, decoded.dr);
+      return 1;
+    case PD_LDI:
+      fprintf(out, "  r%u = mem_read(vm, mem_read(vm, 0x%04X));\n", dst,
+              imm);
+      emit_flags(out, decoded.dr);
+      return 1;
+    case PD_LDR:
+      fprintf(out, "  r%u = mem_read(vm, (uint16_t)(r%u + 0x%04XU));\n", dst,
+              src1, imm);
+      emit_flags(out, decoded.dr);
+      return 1;
+    case PD_LEA:
+      fprintf(out, "  r%u = 0x%04X;\n", dst, imm);
+      emit_flags(out, decoded.dr);
+      return 1;
+    case PD_ST:
+      fprintf(out, "  mem_write(vm, 0x%04X, r%u);\n", imm, dst);
+      return 1;
+    case PD_STI:
+      fprintf(out, "  mem_write(vm, mem_read(vm, 0x%04X), r%u);\n", imm,
+              dst);
+      return 1;
+    case PD_STR:
+      fprintf(out, "  mem_write(vm, (uint16_t)(r%u + 0x%04XU), r%u);\n",
+              src1, imm, dst);
+      return 1;
+    default:
+      emit_reference(out, next_pc, instr);
+      return 1;
+  }
+}
+
+static void emit_segments(FILE* out, const aot_image_t* image,
+                          unsigned* num_segments) {
+  unsigned count = 0;
+  uint32_t address = 0;
+
+  while (address <= MEMORY_MAX) {
+    if (!image->loaded[address]) {
+      ++address;
+      continue;
+    }
+    uint32_t start = address;
+    fprintf(out, "static const uint16_t segment_%u[] = {", count);
+    for (; address <= MEMORY_MAX && image->loaded[address]; ++address) {
+      fprintf(out, "%s0x%04X,", (address - start) % 8 ? " " : "\n    ",
+              image->words[address]);
+    }
+    fprintf(out, "\n};\n\n");
+    ++count;
+  }
+
+  fprintf(out, "static const aot_segment_t segments[] = {\n");
+  count = 0;
+  address = 0;
+  while (address <= MEMORY_MAX) {
+    if (!image->loaded[address]) {
+      ++address;
+      continue;
+    }
+    uint32_t start = address;
+    while (address <= MEMORY_MAX && image->loaded[address]) {
+      ++address;
+    }
+    fprintf(out, "    {0x%04X, %u, segment_%u},\n", start, address - start,
+            count++);
+  }
+  fprintf(out, "};\n\n");
+  *num_segments = count;
+}
+
+void aot_emit_program(FILE* out, const aot_image_t* image,
+                      const uint8_t* reachable, uint16_t entry) {
+  unsigned num_segments = 0;
+
+  fprintf(out,
+          "/* Generated by lc3aot. Do not edit. */\n\n#include <stdint.h>\n\n"
+          "#include \"aot_runtime.h\"\n\n");
+  emit_segments(out, image, &num_segments);
+
+  fprintf(out,
+          "static uint64_t run_program(vm_t* vm, int* running) {\n"
+          "  uint16_t r0 = 0, r1 = 0, r2 = 0, r3 = 0, r4 = 0, r5 = 0, r6 = 0,"
+          " r7 = 0;\n  uint16_t pc = 0, cond = 0;\n  uint64_t retired = 0;\n\n"
+          "  AOT_RELOAD();\n  goto dispatch;\n\n");
+
+  for (uint32_t address = 0; address <= MEMORY_MAX; ++address) {
+    if (!reachable[address]) {
+      continue;
+    }
+    uint16_t next_pc = (uint16_t)(address + 1);
+    if (emit_instr(out, reachable, (uint16_t)address, image->words[address]) &&
+        !reachable[next_pc]) {
+      fprintf(out, "  pc = 0x%04X;\n  goto dispatch;\n", next_pc);
+    }
+  }
+
+  fprintf(out, "\ndispatch:\n  if (interrupt_requested) {\n    goto leave;\n"
+               "  }\n  switch (pc) {\n");
+  for (uint32_t address = 0; address <= MEMORY_MAX; ++address) {
+    if (reachable[address]) {
+      fprintf(out, "    case 0x%04X:\n      goto L_%04X;\n", address, address);
+    }
+  }
+  fprintf(out,
+          "    default:\n      break;\n  }\n"
+          "  /* not translated: interpret one instruction */\n"
+          "  AOT_SPILL();\n  vm->reg[R_PC] = (uint16_t)(pc + 1);\n"
+          "  execute_instr(vm, mem_read(vm, pc), running);\n  ++retired;\n"
+          "  AOT_RELOAD();\n  if (!*running) {\n    goto leave;\n  }\n"
+          "  goto dispatch;\n\nleave:\n  AOT_SPILL();\n  return retired;\n}\n\n");
+
+  fprintf(out,
+          "int main(int argc, const char* argv[]) {\n"
+          "  return aot_main(argc, argv, segments, %u, 0x%04X, run_program);\n"
+          "}\n",
+          num_segments, entry);
+}
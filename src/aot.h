@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "memory.h"
+
+// The words of one or more .obj images, as they would be laid out in memory
+typedef struct {
+  uint16_t words[MEMORY_MAX + 1];
+  uint8_t loaded[MEMORY_MAX + 1]; /* 1 where an image placed a word */
+} aot_image_t;
+
+/**
+ * Reads an LC-3 .obj image into an aot_image_t.
+ *
+ * Uses the same format as read_image_file: a big-endian origin followed by
+ * big-endian words. Later images overwrite earlier ones where they overlap.
+ *
+ * @param image The image to add the words to.
+ * @param path Path to the .obj file.
+ *
+ * @return The origin of the image, exits the program on failure.
+ */
+uint16_t aot_load_obj(aot_image_t* image, const char* path);
+
+/**
+ * Marks every instruction statically reachable from an entry address.
+ *
+ * Follows fall-through, BR and JSR targets, and the return address after
+ * JSR/JSRR. JMP/JSRR/RET targets are unknown until run time and are left to
+ * the fallback interpreter in the generated code, as are addresses outside
+ * the loaded images.
+ *
+ * @param image The loaded images.
+ * @param entry The address execution starts at.
+ * @param reachable Output flags, one per address, set to 1 if reachable.
+ */
+void aot_mark_reachable(const aot_image_t* image, uint16_t entry,
+                        uint8_t* reachable);
+
+/**
+ * Writes a C translation unit for the loaded images.
+ *
+ * Every reachable instruction becomes a C label with its own straight-line
+ * code, registers live in locals, and direct branches become gotos. Computed
+ * jumps dispatch through a switch over the translated addresses and fall
+ * back to execute_instr for anything else. The unit embeds the images and
+ * defines main() through aot_main.
+ *
+ * Images are assumed to be fixed: stores into translated code are not seen
+ * by the translated program.
+ *
+ * @param out The stream to write the C source to.
+ * @param image The loaded images.
+ * @param reachable The flags computed by aot_mark_reachable.
+ * @param entry The address execution starts at.
+ */
+void aot_emit_program(FILE* out, const aot_image_t* image,
+                      const uint8_t* reachable, uint16_t entry);
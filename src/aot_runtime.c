@@ -0,0 +1,62 @@
+#include "aot_runtime.h"
+
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio.h"
+#include "memory.h"
+#include "utils.h"
+#include "vm.h"
+
+// NOLINTNEXTLINE(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MEGA 1e6
+
+int aot_main(int argc, const char* argv[], const aot_segment_t* segments,
+             size_t num_segments, uint16_t entry, aot_program_fn program) {
+  int headless = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--headless")) {
+      headless = 1;
+    }
+  }
+
+  if (!headless) {
+    audio_init();
+  }
+
+  vm_t* vm = vm_create(NULL);
+  for (size_t i = 0; i < num_segments; ++i) {
+    memcpy(vm->memory + segments[i].origin, segments[i].words,
+           segments[i].length * sizeof(uint16_t));
+  }
+  for (int i = 1; i < argc; ++i) {
+    if (argv[i][0] != '-' && !vm_load_image(vm, argv[i])) {
+      error_and_exit("Failed to load image\n");
+    }
+  }
+
+  // NOLINTNEXTLINE(cert-err33-c)
+  signal(SIGINT, handle_interrupt);
+  disable_input_buffering();
+
+  vm->reg[R_PC] = entry;
+
+  double start = monotonic_seconds();
+  uint64_t retired = program(vm, &vm->running);
+  double elapsed = monotonic_seconds() - start;
+  double mips = elapsed > 0 ? (double)retired / elapsed / MEGA : 0;
+  // NOLINTNEXTLINE(cert-err33-c)
+  fprintf(stderr, "\naot: %llu instructions in %.3f s (%.2f MIPS)\n",
+          (unsigned long long)retired, elapsed, mips);
+
+  restore_input_buffering();
+  vm_destroy(vm);
+  if (!headless) {
+    audio_close();
+  }
+  return 0;
+}
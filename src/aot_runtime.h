@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "interpreter.h"
+#include "memory.h"
+#include "utils.h"
+#include "vm.h"
+
+// A contiguous run of words embedded into a translated program
+typedef struct {
+  uint16_t origin;
+  uint16_t length;
+  const uint16_t* words;
+} aot_segment_t;
+
+// The translated program: runs vm until HALT or an interrupt and returns the
+// number of instructions retired.
+typedef uint64_t (*aot_program_fn)(vm_t* vm, int* running);
+
+// NOLINTBEGIN(cppcoreguidelines-macro-usage)
+/* Copy the generated code's locals to vm->reg and back around C handlers. */
+#define AOT_SPILL()         \
+  do {                      \
+    vm->reg[R_R0] = r0;     \
+    vm->reg[R_R1] = r1;     \
+    vm->reg[R_R2] = r2;     \
+    vm->reg[R_R3] = r3;     \
+    vm->reg[R_R4] = r4;     \
+    vm->reg[R_R5] = r5;     \
+    vm->reg[R_R6] = r6;     \
+    vm->reg[R_R7] = r7;     \
+    vm->reg[R_PC] = pc;     \
+    vm->reg[R_COND] = cond; \
+  } while (0)
+
+#define AOT_RELOAD()        \
+  do {                      \
+    r0 = vm->reg[R_R0];     \
+    r1 = vm->reg[R_R1];     \
+    r2 = vm->reg[R_R2];     \
+    r3 = vm->reg[R_R3];     \
+    r4 = vm->reg[R_R4];     \
+    r5 = vm->reg[R_R5];     \
+    r6 = vm->reg[R_R6];     \
+    r7 = vm->reg[R_R7];     \
+    pc = vm->reg[R_PC];     \
+    cond = vm->reg[R_COND]; \
+  } while (0)
+// NOLINTEND(cppcoreguidelines-macro-usage)
+
+/**
+ * Entry point shared by every program generated with lc3aot.
+ *
+ * Creates a VM, copies the embedded segments into its memory, loads any extra
+ * images or audio files named on the command line with read_image, opens the
+ * audio device unless --headless is given, and runs the translated program
+ * from entry.
+ * Prints the retired instruction count and MIPS on exit.
+ *
+ * @param argc The argument count passed to main.
+ * @param argv The arguments passed to main.
+ * @param segments The words embedded by lc3aot.
+ * @param num_segments The number of entries in segments.
+ * @param entry The address execution starts at.
+ * @param program The translated program.
+ *
+ * @return The process exit status.
+ */
+int aot_main(int argc, const char* argv[], const aot_segment_t* segments,
+             size_t num_segments, uint16_t entry, aot_program_fn program);
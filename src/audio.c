@@ -2,94 +2,50 @@
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_audio.h>
+#include <stdatomic.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "mixer.h"
+#include "ring.h"
 #include "utils.h"
 
 SDL_AudioDeviceID
     audio_device;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
 
-int process_audio(const char* audio_path, const char* output_pcm) {
+// Samples on their way from the VM thread to SDL's audio thread
+static ring_t*
+    audio_ring;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+static int audio_started;
+// Voices mixed onto the samples in the callback
+static mixer_t*
+    audio_mixer;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+FILE* open_audio_pipe(const char* audio_path, const char* args) {
   const int command_len = 512;
   char command[command_len];
-  int written = snprintf(
-      command, sizeof(command),
-      "ffmpeg -y -i \"%s\" -t 5 -af "
-      "\"aresample=resampler=soxr:precision=28:osf=s16:ocl=mono:dither_method="
-      "none,volume=-3dB,lowpass=f=5000:r=0.1\" -ar 12000 -ac 1 -f s16le \"%s\"",
-      audio_path, output_pcm);
+  int written = snprintf(command, sizeof(command),
+                         "ffmpeg -nostdin -loglevel error -i \"%s\" %s",
+                         audio_path, args);
 
   if (written < 0 || (size_t)written >= sizeof(command)) {
     error_and_exit("Error: snprintf overflow or failed");
   }
 
-  int ret = system(command);  // NOLINT(cert-env33-c, concurrency-mt-unsafe)
-  if (ret != 0) {
-    error_and_exit("Error: ffmpeg command failed");
-  }
-  return 0;
+  // NOLINTNEXTLINE(cert-env33-c, concurrency-mt-unsafe)
+  return popen(command, "re");
 }
 
-void file_close_helper(FILE* file1, FILE* file2) {
-  if (fclose(file1) != 0) {
-    if (fclose(file2) != 0) {
-      error_and_exit("Error closing OBJ file");
-    }
-    error_and_exit("Error closing PCM file");
-  }
-  if (fclose(file2) != 0) {
-    error_and_exit("Error closing OBJ file");
-  }
-}
-
-int pcm_to_obj(const char* output_pcm, const char* output_obj) {
-  FILE* pcm_file = fopen(output_pcm, "rbe");
-  if (!pcm_file) {
-    error_and_exit("Error opening PCM input file");
-  }
-
-  FILE* obj_file = fopen(output_obj, "wbe");
-  if (!obj_file) {
-    if (fclose(pcm_file) != 0) {
-      error_and_exit("Error closing PCM file");
-    }
-    error_and_exit("Error opening OBJ output file");
-  }
-
-  uint16_t address = AUDIO_ADDRESS;
-  address = swap16(address);
-
-  if (fwrite(&address, sizeof(address), 1, obj_file) != 1) {
-    file_close_helper(pcm_file, obj_file);
-    error_and_exit("Error writing start address to OBJ file");
-  }
-
-  uint16_t audio_sample = 0;
-  while (1) {
-    size_t ret = fread(&audio_sample, sizeof(uint16_t), 1, pcm_file);
-
-    if (ret == 0) {
-      if (feof(pcm_file)) {
-        break;  // normal end
-      }
-      file_close_helper(pcm_file, obj_file);
-      error_and_exit("Error reading PCM file");
-    }
-
-    audio_sample = swap16(audio_sample);
-
-    if (fwrite(&audio_sample, sizeof(audio_sample), 1, obj_file) != 1) {
-      file_close_helper(pcm_file, obj_file);
-      error_and_exit("Error writing to OBJ file");
-    }
-  }
-
-  // Close files and check fclose success
-  file_close_helper(pcm_file, obj_file);
+int close_audio_pipe(FILE* pipe) { return pclose(pipe) == 0; }
 
-  return 1;
+/* Runs on SDL's audio thread whenever the device wants len more bytes. */
+static void audio_callback(void* userdata, Uint8* stream, int len) {
+  size_t count = (size_t)len / sizeof(uint16_t);
+  ring_pop_or_repeat(userdata, (uint16_t*)stream, count);
+  mixer_mix(audio_mixer, (uint16_t*)stream, count);
 }
 
 void audio_init(void) {
@@ -97,11 +53,17 @@ void audio_init(void) {
     error_and_exit("SDL_Init failed\n");
     return;
   }
+  audio_ring = ring_create(AUDIO_RING_SIZE);
+  audio_mixer = mixer_create();
+  audio_started = 0;
+
   SDL_AudioSpec want = {0};
   want.freq = AUDIO_FREQUENCY;
   want.format = AUDIO_U16SYS;
   want.channels = 1;
   want.samples = AUDIO_SAMPLES;
+  want.callback = audio_callback;
+  want.userdata = audio_ring;
   audio_device = SDL_OpenAudioDevice(NULL, 0, &want, NULL, 0);
 
   if (audio_device == 0) {
@@ -110,14 +72,82 @@ void audio_init(void) {
   }
 }
 
-int queued_samples;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
-
 void audio_output(uint16_t audio_sample) {
-  SDL_QueueAudio(audio_device, &audio_sample, sizeof(audio_sample));
-  SDL_PauseAudioDevice(audio_device, 0);
+  if (!audio_ring) {
+    return;  // headless run, audio_init was never called
+  }
+  ring_push(audio_ring, audio_sample);
+  if (!audio_started && ring_size(audio_ring) >= AUDIO_QUEUE_LIMIT) {
+    audio_started = 1;
+    SDL_PauseAudioDevice(audio_device, 0);
+  }
+  if (ring_size(audio_ring) >= AUDIO_HIGH_WATERMARK) {
+    ring_wait_below(audio_ring, AUDIO_LOW_WATERMARK, AUDIO_PARK_TIMEOUT_MS);
+  }
+}
+
+void audio_output_buffer(const uint16_t* samples, size_t count) {
+  if (!audio_ring) {
+    return;  // headless run, audio_init was never called
+  }
+  while (count > 0) {
+    /* fill up to the high watermark, then park as audio_output does */
+    size_t buffered = ring_size(audio_ring);
+    size_t room =
+        buffered < AUDIO_HIGH_WATERMARK ? AUDIO_HIGH_WATERMARK - buffered : 0;
+    size_t pushed =
+        ring_push_buffer(audio_ring, samples, count < room ? count : room);
+    samples += pushed;
+    count -= pushed;
+    if (!audio_started && ring_size(audio_ring) >= AUDIO_QUEUE_LIMIT) {
+      audio_started = 1;
+      SDL_PauseAudioDevice(audio_device, 0);
+    }
+    if (count > 0 && !ring_wait_below(audio_ring, AUDIO_LOW_WATERMARK,
+                                      AUDIO_PARK_TIMEOUT_MS)) {
+      /* the device stopped; drop the rest rather than hang the VM */
+      ring_push_buffer(audio_ring, samples, count);
+      return;
+    }
+  }
+}
+
+void audio_voice(const voice_params_t* params) {
+  if (!audio_mixer) {
+    return;  // headless run, nothing would play the voice
+  }
+  mixer_voice(audio_mixer, params);
+}
+
+voice_stats_t audio_voice_stats(uint16_t voice) {
+  voice_stats_t stats = {0};
+  if (audio_mixer) {
+    stats = mixer_voice_stats(audio_mixer, voice);
+  }
+  return stats;
+}
+
+audio_stats_t audio_get_stats(void) {
+  audio_stats_t stats = {0};
+  if (audio_ring) {
+    stats.underruns =
+        atomic_load_explicit(&audio_ring->underruns, memory_order_relaxed);
+    stats.overruns =
+        atomic_load_explicit(&audio_ring->overruns, memory_order_relaxed);
+    stats.parks =
+        atomic_load_explicit(&audio_ring->parks, memory_order_relaxed);
+    stats.buffered = ring_size(audio_ring);
+  }
+  return stats;
 }
 
 void audio_close(void) {
+  /* closing waits for a running callback, so the ring is free afterwards */
   SDL_CloseAudioDevice(audio_device);
+  audio_device = 0;
+  ring_destroy(audio_ring);
+  audio_ring = NULL;
+  mixer_destroy(audio_mixer);
+  audio_mixer = NULL;
   SDL_Quit();
 }
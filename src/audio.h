@@ -1,41 +1,78 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "mixer.h"
+#include "voice.h"
+#include "wav.h"
+
 enum {
   AUDIO_ADDRESS = 0x1500,
   AUDIO_FREQUENCY = 12000,
+  AUDIO_CLIP_SECONDS = 5, /* what fits at AUDIO_ADDRESS, like ffmpeg's -t 5 */
+  /* one pass of the clip players, which wrap at xEC40 before the full five
+     seconds */
+  AUDIO_CLIP_SAMPLES = 0xEC40 - AUDIO_ADDRESS,
   AUDIO_SAMPLES = 5096,
   AUDIO_QUEUE_LIMIT = 5000,
+  AUDIO_RING_SIZE = 16384, /* power of two, over three device buffers */
+  /* a sample that fills the ring past the high watermark parks the VM until
+     the device drains it to the low one, about one device buffer later */
+  AUDIO_HIGH_WATERMARK = 10240,
+  AUDIO_LOW_WATERMARK = 6144,
+  AUDIO_PARK_TIMEOUT_MS = 1000,
 };
 
+// ffmpeg's arguments after the input file: the whole track as 12000Hz mono
+// 16-bit samples, big-endian like an object file, on stdout. Converted images
+// are cached under a hash of the arguments and the input, so any change here
+// also invalidates the cache.
+// NOLINTBEGIN(cppcoreguidelines-macro-usage)
+#define AUDIO_STREAM_ARGS                                                    \
+  "-af "                                                                     \
+  "\"aresample=resampler=soxr:precision=28:osf=s16:ocl=mono:dither_method=" \
+  "none,volume=-3dB,lowpass=f=5000:r=0.1\" -ar 12000 -ac 1 -f s16be -"
+// Only the first five seconds, which fit in memory at AUDIO_ADDRESS
+#define AUDIO_FFMPEG_ARGS "-t 5 " AUDIO_STREAM_ARGS
+// The cache keys of WAV files, which wav_decode converts in-process, leaving
+// the encodings it does not handle to ffmpeg
+#define AUDIO_WAV_STREAM_ARGS WAV_DECODER_PARAMS " " AUDIO_STREAM_ARGS
+#define AUDIO_WAV_CLIP_ARGS "-t 5 " AUDIO_WAV_STREAM_ARGS
+// NOLINTEND(cppcoreguidelines-macro-usage)
+
+// How the ring between the VM and the audio device has fared so far
+typedef struct {
+  uint64_t underruns; /* samples the device wanted before the VM made them */
+  uint64_t overruns;  /* samples the VM made while the ring was full */
+  uint64_t parks;     /* times the VM slept until the device caught up */
+  size_t buffered;    /* samples waiting to be played */
+} audio_stats_t;
+
 /**
- * Converts an audio file to a raw PCM file.
+ * Starts decoding an audio file into a pipe.
  *
- * This function uses `ffmpeg` to extract a 5-second, 8000Hz, mono, uint16_t
- * PCM version of the input audio file and writes it to a specified
- * output file.
+ * This function runs `ffmpeg` to decode the input audio file into 12000Hz
+ * mono 16-bit samples, written big-endian like the words of an object file
+ * to the returned stream. Nothing touches the disk, so concurrent runs do
+ * not share any file.
  *
  * @param audio_path Path to the input audio file (e.g., .mp3, .wav).
- * @param output_pcm Path where the generated PCM file will be written.
- * @return 0 on success, exits the program on failure.
+ * @param args AUDIO_FFMPEG_ARGS for the first five seconds, or
+ *             AUDIO_STREAM_ARGS for the whole track.
+ * @return The read end of the pipe, NULL if ffmpeg could not be started.
  */
-int process_audio(const char* audio_path, const char* output_pcm);
+FILE* open_audio_pipe(const char* audio_path, const char* args);
 
 /**
- * Converts a raw PCM file into a binary object (.obj) file for memory
- * loading.
+ * Waits for the decoder started by open_audio_pipe and closes its pipe.
  *
- * This function reads PCM samples, endian-swaps each uint16_t value, and writes
- * them into an object file starting from a fixed memory address.
- *
- * @param output_pcm Path to the PCM file to read.
- * @param output_obj Path where the generated object file will be written.
- * @return 1 on success, exits the program on failure.
+ * @param pipe The stream open_audio_pipe returned.
+ * @return 1 if ffmpeg succeeded, 0 otherwise.
  */
-int pcm_to_obj(const char* output_pcm, const char* output_obj);
+int close_audio_pipe(FILE* pipe);
 
 /**
  * @brief Initializes SDL audio playback.
@@ -51,14 +88,59 @@ void audio_init(void);
 /**
  * Queues a single uint16_t audio sample for playback.
  *
- * This function queues the provided audio sample to the SDL audio device.
- * Once a certain number of samples are queued (AUDIO_QUEUE_LIMIT),
- * playback automatically starts.
+ * This function appends the sample to a lock-free ring that SDL's audio
+ * callback drains, so it never takes a lock or calls into SDL on the hot
+ * path. Once a certain number of samples are buffered (AUDIO_QUEUE_LIMIT),
+ * playback starts. Above AUDIO_HIGH_WATERMARK the calling thread sleeps
+ * until the device drains the ring, so the VM is paced by the audio clock
+ * rather than by host speed. Samples are dropped silently if audio_init has
+ * not opened a device, as in headless runs. Must only be called from one
+ * thread.
  *
  * @param audio_sample The uint16_t audio sample to queue.
  */
 void audio_output(uint16_t audio_sample);
 
+/**
+ * Queues a buffer of samples for playback, like audio_output on each.
+ *
+ * The samples are copied into the ring in runs up to AUDIO_HIGH_WATERMARK,
+ * sleeping in between while the device drains it, so a long buffer is
+ * paced by the audio clock the same way single samples are. If the device
+ * stops consuming, the samples that do not fit are dropped as overruns.
+ *
+ * @param samples The samples to queue.
+ * @param count The number of samples.
+ */
+void audio_output_buffer(const uint16_t* samples, size_t count);
+
+/**
+ * Starts or stops a voice of the mixer, which the audio callback adds to
+ * the samples queued by audio_output.
+ *
+ * Voices are ignored if audio_init has not opened a device. Must only be
+ * called from the thread that queues samples.
+ *
+ * @param params The voice and its buffer and settings.
+ */
+void audio_voice(const voice_params_t* params);
+
+/**
+ * Returns the cost of mixing a voice so far.
+ *
+ * @param voice The voice, below VOICE_COUNT.
+ *
+ * @return The voice's counters, all zero in headless runs.
+ */
+voice_stats_t audio_voice_stats(uint16_t voice);
+
+/**
+ * Returns the underrun and overrun counts of the audio ring.
+ *
+ * @return The counters, all zero if audio_init was never called.
+ */
+audio_stats_t audio_get_stats(void);
+
 /**
  * Shuts down the SDL audio subsystem.
  *
@@ -0,0 +1,68 @@
+#include "bank.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bulkio.h"
+#include "memory.h"
+#include "utils.h"
+
+void bank_attach(vm_t* vm, mapped_file_t image, uint16_t* owned) {
+  bank_t* bank = calloc(1, sizeof(bank_t));
+  if (!bank) {
+    error_and_exit("Failed to allocate stream");
+  }
+  bank->image = image;
+  bank->owned = owned;
+  bank->samples =
+      image.size > sizeof(uint16_t) ? image.size / sizeof(uint16_t) - 1 : 0;
+  size_t count = (bank->samples + BANK_WINDOW_SIZE - 1) / BANK_WINDOW_SIZE;
+  bank->count = count > UINT16_MAX ? UINT16_MAX : (uint16_t)count;
+
+  vm->bank = bank;
+  vm->memory[MR_BANK_COUNT] = bank->count;
+  vm_mark_dirty(vm, MR_BANK_COUNT);
+  bank_select(vm, 0);
+  bank->switches = 0;
+}
+
+void bank_select(vm_t* vm, uint16_t index) {
+  bank_t* bank = vm->bank;
+  size_t first = (size_t)index * BANK_WINDOW_SIZE;
+  size_t words = 0;
+  if (first < bank->samples) {
+    words = bank->samples - first;
+    words = words > BANK_WINDOW_SIZE ? BANK_WINDOW_SIZE : words;
+  }
+
+  /* one swapping copy per bank, straight from the mapped file */
+  uint16_t* window = vm->memory + BANK_WINDOW_ADDRESS;
+  if (words > 0) {
+    swap16_buffer(window,
+                  bank->image.data + (first + 1) * sizeof(uint16_t), words);
+  }
+  memset(window + words, 0, (BANK_WINDOW_SIZE - words) * sizeof(uint16_t));
+  mem_loaded(vm, BANK_WINDOW_ADDRESS, BANK_WINDOW_SIZE);
+
+  bank->selected = index;
+  ++bank->switches;
+  vm->memory[MR_BANK_SELECT] = index;
+  vm_mark_dirty(vm, MR_BANK_SELECT);
+}
+
+void bank_detach(vm_t* vm) {
+  bank_t* bank = vm->bank;
+  if (!bank) {
+    return;
+  }
+  if (bank->owned) {
+    free(bank->owned);
+  } else {
+    unmap_file(&bank->image);
+  }
+  free(bank);
+  vm->bank = NULL;
+  vm->memory[MR_BANK_COUNT] = 0;
+}
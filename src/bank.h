@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bulkio.h"
+#include "vm.h"
+
+enum {
+  BANK_WINDOW_ADDRESS = 0x1500, /* where the selected bank appears */
+  BANK_WINDOW_SIZE = 0x4000,    /* words per bank, 64 pages */
+};
+
+// A long stream of samples the guest sees one window-sized bank at a time.
+// Storing a bank number to MR_BANK_SELECT copies that bank from the mapped
+// file into the window, so only the window and the pages of the file that
+// were read ever take memory.
+typedef struct bank {
+  mapped_file_t image; /* a big-endian origin word, then the samples */
+  uint16_t* owned;     /* the image when it lives on the heap, else NULL */
+  size_t samples;      /* words after the origin */
+  uint16_t count;      /* banks the samples fill, the last one padded */
+  uint16_t selected;   /* the bank in the window */
+  uint64_t switches;   /* stores to MR_BANK_SELECT */
+} bank_t;
+
+/**
+ * Attaches a stream to a VM and selects its first bank.
+ *
+ * The image has the layout of an .obj file, whose origin is ignored. The VM
+ * takes over the image and releases it in bank_detach or vm_destroy.
+ * MR_BANK_COUNT reads as the number of banks from then on.
+ *
+ * @param vm The VM to attach to, which must not have a stream yet.
+ * @param image The mapped image of samples.
+ * @param owned The heap buffer holding the image to free instead of
+ *              unmapping it, or NULL if the image is a mapped file.
+ */
+void bank_attach(vm_t* vm, mapped_file_t image, uint16_t* owned);
+
+/**
+ * Shows a bank of the stream in the window.
+ *
+ * The bank's samples are stored at BANK_WINDOW_ADDRESS, followed by silence
+ * after the end of the stream, and MR_BANK_SELECT reads as the bank number.
+ * A bank past the end fills the window with silence.
+ *
+ * @param vm The VM with an attached stream.
+ * @param index The bank to show.
+ */
+void bank_select(vm_t* vm, uint16_t index);
+
+/**
+ * Detaches and releases the stream of a VM, if it has one.
+ *
+ * The window keeps the samples it shows.
+ *
+ * @param vm The VM to detach from.
+ */
+void bank_detach(vm_t* vm);
@@ -0,0 +1,358 @@
+#include "batch.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bulkio.h"
+#include "utils.h"
+#include "vm.h"
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define BATCH_SLICE 1000000U /* instructions between interrupt checks */
+#define OUTPUT_MIN_CAP 256U
+#define JOBS_MIN_CAP 16U
+#define MIPS_SCALE 1e6
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+// The jobs a worker still owns, as the index range [head, tail). The owner
+// takes from head and thieves take from tail, both under lock.
+typedef struct {
+  pthread_mutex_t lock;
+  size_t head;
+  size_t tail;
+} job_queue_t;
+
+typedef struct {
+  batch_job_t* jobs;
+  job_queue_t* queues;
+  unsigned threads;
+  uint64_t budget;
+} batch_pool_t;
+
+typedef struct {
+  batch_pool_t* pool;
+  unsigned index;
+} batch_worker_t;
+
+static char* copy_string(const char* str, size_t len) {
+  char* copy = malloc(len + 1);
+  if (!copy) {
+    error_and_exit("Failed to allocate batch job");
+  }
+  memcpy(copy, str, len);
+  copy[len] = '\0';
+  return copy;
+}
+
+batch_job_t* batch_read_jobs(FILE* list, size_t* count) {
+  batch_job_t* jobs = NULL;
+  size_t capacity = 0;
+  *count = 0;
+
+  char* line = NULL;
+  size_t line_cap = 0;
+  while (getline(&line, &line_cap, list) != -1) {
+    const char* whitespace = " \t\r\n";
+    char* image = line + strspn(line, whitespace);
+    if (*image == '\0' || *image == '#') {
+      continue;
+    }
+    size_t image_len = strcspn(image, whitespace);
+    char* input = image + image_len;
+    input += strspn(input, whitespace);
+    size_t input_len = strcspn(input, whitespace);
+
+    if (*count == capacity) {
+      capacity = capacity ? capacity * 2 : JOBS_MIN_CAP;
+      batch_job_t* grown = realloc(jobs, capacity * sizeof(batch_job_t));
+      if (!grown) {
+        error_and_exit("Failed to allocate batch jobs");
+      }
+      jobs = grown;
+    }
+    batch_job_t* job = &jobs[(*count)++];
+    memset(job, 0, sizeof(*job));
+    job->image_path = copy_string(image, image_len);
+    if (input_len) {
+      job->input_path = copy_string(input, input_len);
+    }
+  }
+  free(line);
+  if (ferror(list)) {
+    error_and_exit("Failed to read job list");
+  }
+  return jobs;
+}
+
+static int batch_get_char(void* ctx) {
+  batch_job_t* job = ctx;
+  if (job->input_pos < job->input_len) {
+    return job->input[job->input_pos++];
+  }
+  /* stop the job instead of letting the trap treat EOF as fatal */
+  job->vm->running = 0;
+  job->status = BATCH_INPUT;
+  return 0;
+}
+
+static int batch_put_char(void* ctx, int chr) {
+  batch_job_t* job = ctx;
+  if (job->output_len == job->output_cap) {
+    size_t capacity = job->output_cap ? job->output_cap * 2 : OUTPUT_MIN_CAP;
+    char* grown = realloc(job->output, capacity);
+    if (!grown) {
+      return EOF;
+    }
+    job->output = grown;
+    job->output_cap = capacity;
+  }
+  job->output[job->output_len++] = (char)chr;
+  return chr;
+}
+
+static int batch_flush(void* ctx) {
+  (void)ctx;
+  return 0;
+}
+
+static void batch_audio_sample(void* ctx, uint16_t sample) {
+  (void)ctx;
+  (void)sample;
+}
+
+// Reads a whole file into a new buffer, returns 0 on failure.
+static int read_file(const char* path, uint8_t** data, size_t* len) {
+  FILE* file = fopen(path, "rbe");
+  if (!file) {
+    return 0;
+  }
+  size_t capacity = OUTPUT_MIN_CAP;
+  size_t used = 0;
+  uint8_t* buffer = malloc(capacity);
+  while (buffer) {
+    used += fread(buffer + used, 1, capacity - used, file);
+    if (used < capacity) {
+      break;
+    }
+    capacity *= 2;
+    uint8_t* grown = realloc(buffer, capacity);
+    if (!grown) {
+      free(buffer);
+    }
+    buffer = grown;
+  }
+  int failed = !buffer || ferror(file);
+  // NOLINTNEXTLINE(cert-err33-c)
+  fclose(file);
+  if (failed) {
+    free(buffer);
+    return 0;
+  }
+  *data = buffer;
+  *len = used;
+  return 1;
+}
+
+// Loads an .obj image the way read_image does, but never converts audio
+// files: the conversion cache's counters are unsynchronized globals and its
+// directory is shared, so conversions cannot run on several threads.
+static int load_obj(vm_t* vm, const char* path) {
+  mapped_file_t image;
+  if (!map_file(path, &image)) {
+    return 0;
+  }
+  int loaded = read_image_bytes(vm, image.data, image.size);
+  unmap_file(&image);
+  return loaded;
+}
+
+static void run_job(batch_job_t* job, uint64_t budget) {
+  double start = monotonic_seconds();
+  const vm_io_t io = {
+      .get_char = batch_get_char,
+      .put_char = batch_put_char,
+      .flush = batch_flush,
+      .audio_sample = batch_audio_sample,
+      .ctx = job,
+  };
+  job->vm = vm_create(&io);
+
+  if (!load_obj(job->vm, job->image_path) ||
+      (job->input_path &&
+       !read_file(job->input_path, &job->input, &job->input_len))) {
+    job->status = BATCH_LOAD_FAILED;
+  } else {
+    while (job->vm->running && job->retired < budget &&
+           !interrupt_requested) {
+      uint64_t slice = budget - job->retired;
+      if (slice > BATCH_SLICE) {
+        slice = BATCH_SLICE;
+      }
+      job->retired += vm_run_for(job->vm, slice);
+    }
+    if (job->status == BATCH_PENDING) {
+      if (!job->vm->running) {
+        job->status = BATCH_HALTED;
+      } else if (job->retired >= budget) {
+        job->status = BATCH_BUDGET;
+      } else {
+        job->status = BATCH_INTERRUPTED;
+      }
+    }
+  }
+
+  vm_destroy(job->vm);
+  job->vm = NULL;
+  job->seconds = monotonic_seconds() - start;
+}
+
+// Takes the next job from the front of a queue, or from the back when
+// stealing. Returns 0 once the queue is empty.
+static int take_job(job_queue_t* queue, int steal, size_t* index) {
+  pthread_mutex_lock(&queue->lock);
+  int found = queue->head < queue->tail;
+  if (found) {
+    *index = steal ? --queue->tail : queue->head++;
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return found;
+}
+
+static void* batch_worker(void* arg) {
+  const batch_worker_t* worker = arg;
+  batch_pool_t* pool = worker->pool;
+
+  for (;;) {
+    size_t index = 0;
+    int found = take_job(&pool->queues[worker->index], 0, &index);
+    for (unsigned i = 1; !found && i < pool->threads; ++i) {
+      unsigned victim = (worker->index + i) % pool->threads;
+      found = take_job(&pool->queues[victim], 1, &index);
+    }
+    /* jobs are never added, so an empty sweep means there is no work left */
+    if (!found) {
+      return NULL;
+    }
+    if (interrupt_requested) {
+      pool->jobs[index].status = BATCH_INTERRUPTED;
+    } else {
+      run_job(&pool->jobs[index], pool->budget);
+    }
+  }
+}
+
+unsigned batch_run(batch_job_t* jobs, size_t count, unsigned threads,
+                   uint64_t budget) {
+  if (threads == 0) {
+    threads = 1;
+  }
+  if (threads > count && count > 0) {
+    threads = (unsigned)count;
+  }
+
+  batch_pool_t pool = {
+      .jobs = jobs,
+      .queues = calloc(threads, sizeof(job_queue_t)),
+      .threads = threads,
+      .budget = budget,
+  };
+  batch_worker_t* workers = calloc(threads, sizeof(batch_worker_t));
+  pthread_t* ids = calloc(threads, sizeof(pthread_t));
+  if (!pool.queues || !workers || !ids) {
+    error_and_exit("Failed to allocate batch workers");
+  }
+
+  for (unsigned i = 0; i < threads; ++i) {
+    pthread_mutex_init(&pool.queues[i].lock, NULL);
+    pool.queues[i].head = count * i / threads;
+    pool.queues[i].tail = count * (i + 1) / threads;
+    workers[i].pool = &pool;
+    workers[i].index = i;
+  }
+
+  /* worker 0 is the calling thread */
+  for (unsigned i = 1; i < threads; ++i) {
+    if (pthread_create(&ids[i], NULL, batch_worker, &workers[i]) != 0) {
+      error_and_exit("Failed to start batch worker");
+    }
+  }
+  batch_worker(&workers[0]);
+  for (unsigned i = 1; i < threads; ++i) {
+    pthread_join(ids[i], NULL);
+  }
+
+  for (unsigned i = 0; i < threads; ++i) {
+    pthread_mutex_destroy(&pool.queues[i].lock);
+  }
+  free(ids);
+  free(workers);
+  free(pool.queues);
+  return threads;
+}
+
+const char* batch_status_name(batch_status_t status) {
+  switch (status) {
+    case BATCH_HALTED:
+      return "halted";
+    case BATCH_BUDGET:
+      return "budget";
+    case BATCH_INPUT:
+      return "input";
+    case BATCH_LOAD_FAILED:
+      return "load-failed";
+    case BATCH_INTERRUPTED:
+      return "interrupted";
+    case BATCH_PENDING:
+    default:
+      return "pending";
+  }
+}
+
+void batch_report(FILE* out, const batch_job_t* jobs, size_t count,
+                  unsigned threads, double elapsed) {
+  size_t by_status[BATCH_INTERRUPTED + 1] = {0};
+  uint64_t total = 0;
+  double busy = 0;
+
+  for (size_t i = 0; i < count; ++i) {
+    const batch_job_t* job = &jobs[i];
+    // NOLINTNEXTLINE(cert-err33-c)
+    fprintf(out, "%-11s %12llu instr %8zu bytes %8.3f s  %s\n",
+            batch_status_name(job->status), (unsigned long long)job->retired,
+            job->output_len, job->seconds, job->image_path);
+    ++by_status[job->status];
+    total += job->retired;
+    busy += job->seconds;
+  }
+
+  // NOLINTNEXTLINE(cert-err33-c)
+  fprintf(out,
+          "%zu jobs: %zu halted, %zu budget, %zu input, %zu load-failed, "
+          "%zu interrupted\n",
+          count, by_status[BATCH_HALTED], by_status[BATCH_BUDGET],
+          by_status[BATCH_INPUT], by_status[BATCH_LOAD_FAILED],
+          by_status[BATCH_INTERRUPTED] + by_status[BATCH_PENDING]);
+  double mips = elapsed > 0 ? (double)total / elapsed / MIPS_SCALE : 0;
+  double usage = elapsed > 0 ? busy / (elapsed * threads) * 100 : 0;
+  // NOLINTNEXTLINE(cert-err33-c)
+  fprintf(out,
+          "%llu instructions in %.3f s on %u threads: %.2f MIPS, %.0f%% "
+          "busy\n",
+          (unsigned long long)total, elapsed, threads, mips, usage);
+}
+
+void batch_free_jobs(batch_job_t* jobs, size_t count) {
+  if (!jobs) {
+    return;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    free(jobs[i].image_path);
+    free(jobs[i].input_path);
+    free(jobs[i].input);
+    free(jobs[i].output);
+  }
+  free(jobs);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "vm.h"
+
+// How a batch job ended
+typedef enum {
+  BATCH_PENDING = 0, /* not run yet */
+  BATCH_HALTED,      /* HALT, or an unknown opcode or trap vector */
+  BATCH_BUDGET,      /* ran out of instructions */
+  BATCH_INPUT,       /* read past the end of its input script */
+  BATCH_LOAD_FAILED, /* the image or input script could not be read */
+  BATCH_INTERRUPTED, /* Ctrl+C stopped the batch first */
+} batch_status_t;
+
+// One image to run, with its captured console output
+typedef struct {
+  char* image_path;
+  char* input_path; /* NULL if the job reads no input */
+  uint8_t* input;   /* contents of input_path, fed to GETC and IN */
+  size_t input_len;
+  size_t input_pos;
+  char* output; /* everything the job printed through traps */
+  size_t output_len;
+  size_t output_cap;
+  vm_t* vm; /* only while the job runs */
+  batch_status_t status;
+  uint64_t retired;
+  double seconds;
+} batch_job_t;
+
+/**
+ * Reads a job list, one job per line.
+ *
+ * Each line names an .obj image, optionally followed by whitespace and an
+ * input script whose bytes are returned by GETC and IN. Blank lines and
+ * lines starting with '#' are skipped.
+ *
+ * @param list The stream to read the list from.
+ * @param count Set to the number of jobs read.
+ *
+ * @return The jobs, to be freed with batch_free_jobs. Exits the program if
+ *         it runs out of memory.
+ */
+batch_job_t* batch_read_jobs(FILE* list, size_t* count);
+
+/**
+ * Runs every job on a pool of worker threads.
+ *
+ * Each job gets its own VM with console traps captured into job->output, no
+ * SDL and no terminal setup, and stops at HALT or after budget instructions.
+ * Jobs start out evenly split between per-worker queues; a worker takes
+ * jobs from the front of its own queue and, once that is empty, steals from
+ * the back of the others, so a few long jobs do not leave threads idle.
+ *
+ * @param jobs The jobs to run, updated with their results.
+ * @param count The number of jobs.
+ * @param threads The number of worker threads, at least 1.
+ * @param budget The maximum number of instructions per job.
+ *
+ * @return The number of worker threads used, never more than count.
+ */
+unsigned batch_run(batch_job_t* jobs, size_t count, unsigned threads,
+                   uint64_t budget);
+
+/**
+ * Prints one line per job and a summary with the aggregate throughput.
+ *
+ * @param out The stream to print to.
+ * @param jobs The finished jobs.
+ * @param count The number of jobs.
+ * @param threads The number of worker threads used.
+ * @param elapsed The wall-clock time batch_run took, in seconds.
+ */
+void batch_report(FILE* out, const batch_job_t* jobs, size_t count,
+                  unsigned threads, double elapsed);
+
+/**
+ * Returns a short name for a job status, such as "halted" or "budget".
+ *
+ * @param status The status to name.
+ *
+ * @return A static string.
+ */
+const char* batch_status_name(batch_status_t status);
+
+/**
+ * Frees jobs returned by batch_read_jobs, including their buffers.
+ *
+ * @param jobs The jobs to free, may be NULL.
+ * @param count The number of jobs.
+ */
+void batch_free_jobs(batch_job_t* jobs, size_t count);
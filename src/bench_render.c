@@ -0,0 +1,73 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "render.h"
+#include "utils.h"
+#include "vm.h"
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define DECIMAL 10
+#define DEFAULT_FRAMES 2000
+#define USEC_PER_SEC 1e6
+#define FRAME_BUDGET_USEC (USEC_PER_SEC / 60)
+#define PATTERN_MULTIPLIER 2654435761U
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+// Measures how long each converter takes to draw one memory-map frame, the
+// work update_texture does 60 times a second, for every palette.
+int main(int argc, const char* argv[]) {
+  long frames = argc == 2 ? strtol(argv[1], NULL, DECIMAL) : DEFAULT_FRAMES;
+  if (argc > 2 || frames <= 0) {
+    // NOLINTNEXTLINE(cert-err33-c)
+    fprintf(stderr, "usage: bench_render [frames]\n");
+    return EXIT_FAILURE;
+  }
+
+  vm_t* vm = vm_create(NULL);
+  for (uint32_t addr = 0; addr <= MEMORY_MAX; ++addr) {
+    vm->memory[addr] = (uint16_t)((addr * PATTERN_MULTIPLIER) >> BIT_SHIFT_16);
+  }
+  static uint32_t pixels[MEMORY_MAP_DIM * MEMORY_MAP_DIM];
+  static uint32_t reference[MEMORY_MAP_DIM * MEMORY_MAP_DIM];
+
+  printf("%-9s %-7s %10s %9s %8s\n", "palette", "kernel", "us/frame",
+         "% budget", "speedup");
+  for (int id = 0; id < PALETTE_COUNT; ++id) {
+    palette_t palette;
+    palette_init(&palette, (palette_id_t)id);
+    render_words(RENDER_SCALAR, reference, vm->memory,
+                 MEMORY_MAP_DIM * MEMORY_MAP_DIM, &palette);
+
+    double scalar_usec = 0;
+    for (int kernel = 0; kernel < RENDER_KERNEL_COUNT; ++kernel) {
+      if (!render_kernel_supported((render_kernel_t)kernel)) {
+        continue;
+      }
+      double start = monotonic_seconds();
+      for (long frame = 0; frame < frames; ++frame) {
+        for (size_t y = 0; y < MEMORY_MAP_DIM; ++y) {
+          render_words((render_kernel_t)kernel, pixels + y * MEMORY_MAP_DIM,
+                       vm->memory + y * MEMORY_MAP_DIM, MEMORY_MAP_DIM,
+                       &palette);
+        }
+      }
+      double usec =
+          (monotonic_seconds() - start) * USEC_PER_SEC / (double)frames;
+      if (kernel == RENDER_SCALAR) {
+        scalar_usec = usec;
+      }
+      if (memcmp(pixels, reference, sizeof(pixels)) != 0) {
+        error_and_exit("Converters disagree");
+      }
+      printf("%-9s %-7s %10.2f %8.2f%% %7.2fx\n",
+             palette_name((palette_id_t)id),
+             render_kernel_name((render_kernel_t)kernel), usec,
+             usec / FRAME_BUDGET_USEC * 100, scalar_usec / usec);
+    }
+  }
+
+  vm_destroy(vm);
+  return 0;
+}
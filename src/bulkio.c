@@ -0,0 +1,125 @@
+#include "bulkio.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+#include <immintrin.h>
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define SSE2_WORDS 8U
+#define AVX2_WORDS 16U
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+/* Swaps 16 words per step with one byte shuffle, returns the words done. */
+__attribute__((target("avx2"))) static size_t swap16_avx2(uint16_t* dst,
+                                                          const uint8_t* src,
+                                                          size_t count) {
+  // NOLINTBEGIN(readability-magic-numbers)
+  const __m256i pairs =
+      _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14, 1,
+                       0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+  // NOLINTEND(readability-magic-numbers)
+  size_t done = 0;
+  for (; done + AVX2_WORDS <= count; done += AVX2_WORDS) {
+    __m256i words =
+        _mm256_loadu_si256((const __m256i*)(const void*)(src + 2 * done));
+    _mm256_storeu_si256((__m256i*)(void*)(dst + done),
+                        _mm256_shuffle_epi8(words, pairs));
+  }
+  return done;
+}
+
+/* Swaps 8 words per step with shifts, which SSE2 has on every x86-64. */
+static size_t swap16_sse2(uint16_t* dst, const uint8_t* src, size_t count) {
+  size_t done = 0;
+  for (; done + SSE2_WORDS <= count; done += SSE2_WORDS) {
+    __m128i words =
+        _mm_loadu_si128((const __m128i*)(const void*)(src + 2 * done));
+    words = _mm_or_si128(_mm_slli_epi16(words, BYTE_LEN),
+                         _mm_srli_epi16(words, BYTE_LEN));
+    _mm_storeu_si128((__m128i*)(void*)(dst + done), words);
+  }
+  return done;
+}
+
+#endif
+
+void swap16_buffer(uint16_t* dst, const uint8_t* src, size_t count) {
+  size_t done = 0;
+#if defined(__x86_64__) && defined(__GNUC__)
+  if (__builtin_cpu_supports("avx2")) {
+    done = swap16_avx2(dst, src, count);
+  }
+  done += swap16_sse2(dst + done, src + 2 * done, count - done);
+#endif
+  for (; done < count; ++done) {
+    uint16_t word = 0;
+    memcpy(&word, src + 2 * done, sizeof(word));
+    dst[done] = swap16(word);
+  }
+}
+
+int map_descriptor(int fd, mapped_file_t* file) {
+  struct stat info;
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+    return 0;
+  }
+
+  file->data = NULL;
+  file->size = (size_t)info.st_size;
+  if (file->size > 0) {
+    void* data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      return 0;
+    }
+    /* read once, front to back */
+    (void)madvise(data, file->size, MADV_SEQUENTIAL);
+    file->data = data;
+  }
+  return 1;
+}
+
+int map_file(const char* path, mapped_file_t* file) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return 0;
+  }
+  int mapped = map_descriptor(fd, file);
+  /* the mapping stays valid after the descriptor is closed */
+  close(fd);
+  return mapped;
+}
+
+int write_all(int fd, const void* data, size_t size) {
+  const uint8_t* bytes = data;
+  while (size > 0) {
+    ssize_t written = write(fd, bytes, size);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return 0;
+    }
+    bytes += written;
+    size -= (size_t)written;
+  }
+  return 1;
+}
+
+void unmap_file(mapped_file_t* file) {
+  if (file->data) {
+    munmap((void*)file->data, file->size);
+  }
+  file->data = NULL;
+  file->size = 0;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A read-only view of a whole file
+typedef struct {
+  const uint8_t* data; /* NULL for an empty file */
+  size_t size;
+} mapped_file_t;
+
+/**
+ * Maps a file into memory for reading.
+ *
+ * Images and PCM files are read front to back exactly once, so mapping them
+ * avoids both the copy through stdio's buffer and the per-call overhead of
+ * reading them a word at a time.
+ *
+ * @param path The file to map.
+ * @param file Set to the mapping on success.
+ *
+ * @return 1 on success, 0 if the file cannot be opened or mapped.
+ */
+int map_file(const char* path, mapped_file_t* file);
+
+/**
+ * Maps a file that is already open for reading.
+ *
+ * Like map_file, but leaves the descriptor open, so a file that was just
+ * written, or has no name at all, can be mapped too.
+ *
+ * @param fd The open file.
+ * @param file Set to the mapping on success.
+ *
+ * @return 1 on success, 0 if fd is not a regular file or cannot be mapped.
+ */
+int map_descriptor(int fd, mapped_file_t* file);
+
+/**
+ * Unmaps a file mapped with map_file.
+ *
+ * @param file The mapping to release, cleared afterwards.
+ */
+void unmap_file(mapped_file_t* file);
+
+/**
+ * Swaps the byte order of count 16-bit words, like swap16 on each of them.
+ *
+ * Uses AVX2 or SSE2 when the CPU has them and a scalar loop otherwise. The
+ * source needs no particular alignment, and may be the same buffer as the
+ * destination to swap in place.
+ *
+ * @param dst Where to store the swapped words.
+ * @param src The words to swap, as raw bytes.
+ * @param count The number of words.
+ */
+void swap16_buffer(uint16_t* dst, const uint8_t* src, size_t count);
+
+/**
+ * Writes a whole buffer to a descriptor, retrying short writes.
+ *
+ * @param fd The file to write to.
+ * @param data The bytes to write.
+ * @param size The number of bytes.
+ *
+ * @return 1 on success, 0 on an I/O error.
+ */
+int write_all(int fd, const void* data, size_t size);
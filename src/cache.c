@@ -0,0 +1,263 @@
+#include "cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bulkio.h"
+#include "utils.h"
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+#define KEY_DIGITS 16U /* hex digits of a key in an entry's name */
+#define ENTRY_SUFFIX ".obj"
+#define ENTRIES_MIN_CAP 16U
+#define STORE_CHUNK_WORDS 4096U
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+int cache_enabled = 1;
+const char* cache_dir_override;
+uint64_t cache_max_bytes = CACHE_DEFAULT_MAX_BYTES;
+static cache_stats_t stats;
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+/* The 64-bit finalizer of MurmurHash3, so every input bit reaches every
+   output bit. */
+static uint64_t mix64(uint64_t hash) {
+  // NOLINTBEGIN(readability-magic-numbers)
+  hash ^= hash >> 33U;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33U;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33U;
+  // NOLINTEND(readability-magic-numbers)
+  return hash;
+}
+
+uint64_t cache_key(const uint8_t* bytes, size_t size, const char* params) {
+  /* FNV-1a over the short parameter string seeds the hash of the input */
+  uint64_t hash = FNV_OFFSET;
+  for (const char* c = params; *c; ++c) {
+    hash = (hash ^ (uint8_t)*c) * FNV_PRIME;
+  }
+
+  /* the input, which may be megabytes, a word at a time */
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word = 0;
+    memcpy(&word, bytes + i, sizeof(word));
+    hash = (hash ^ mix64(word)) * FNV_PRIME;
+  }
+  for (; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * FNV_PRIME;
+  }
+  return mix64(hash ^ size);
+}
+
+static void entry_path(const char* dir, uint64_t key, char* path,
+                       size_t len) {
+  // NOLINTNEXTLINE(cert-err33-c)
+  snprintf(path, len, "%s/%016llx" ENTRY_SUFFIX, dir,
+           (unsigned long long)key);
+}
+
+/* Makes a directory and its parent, like mkdir -p for the last two. */
+static int make_dirs(const char* dir) {
+  char parent[CACHE_PATH_MAX];
+  // NOLINTNEXTLINE(cert-err33-c)
+  snprintf(parent, sizeof(parent), "%s", dir);
+  char* slash = strrchr(parent, '/');
+  if (slash && slash != parent) {
+    *slash = '\0';
+    (void)mkdir(parent, S_IRWXU);
+  }
+  return mkdir(dir, S_IRWXU) == 0 || errno == EEXIST;
+}
+
+int cache_dir(char* dir, size_t len) {
+  if (!cache_enabled) {
+    return 0;
+  }
+  // NOLINTBEGIN(concurrency-mt-unsafe)
+  const char* xdg = getenv("XDG_CACHE_HOME");
+  const char* home = getenv("HOME");
+  // NOLINTEND(concurrency-mt-unsafe)
+  int written = 0;
+  if (cache_dir_override) {
+    written = snprintf(dir, len, "%s", cache_dir_override);
+  } else if (xdg && *xdg) {
+    written = snprintf(dir, len, "%s/pvmpkin", xdg);
+  } else if (home && *home) {
+    written = snprintf(dir, len, "%s/.cache/pvmpkin", home);
+  } else {
+    return 0;
+  }
+  if (written < 0 || (size_t)written >= len) {
+    return 0;
+  }
+  return make_dirs(dir);
+}
+
+int cache_map(const char* dir, uint64_t key, mapped_file_t* image) {
+  char path[CACHE_PATH_MAX];
+  entry_path(dir, key, path, sizeof(path));
+  return map_file(path, image);
+}
+
+int cache_lookup(const char* dir, uint64_t key, mapped_file_t* image) {
+  char path[CACHE_PATH_MAX];
+  entry_path(dir, key, path, sizeof(path));
+  if (!map_file(path, image)) {
+    ++stats.misses;
+    return 0;
+  }
+  /* eviction goes by modification time, so a hit makes it recent */
+  (void)utimensat(AT_FDCWD, path, NULL, 0);
+  ++stats.hits;
+  return 1;
+}
+
+int cache_create(const char* dir, uint64_t key, cache_entry_t* entry) {
+  entry_path(dir, key, entry->path, sizeof(entry->path));
+  // NOLINTNEXTLINE(cert-err33-c)
+  snprintf(entry->temp, sizeof(entry->temp), "%s.%u.tmp", entry->path,
+           (unsigned)getpid());
+  entry->fd = open(entry->temp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                   S_IRUSR | S_IWUSR);
+  return entry->fd >= 0;
+}
+
+int cache_commit(const char* dir, cache_entry_t* entry) {
+  int stored = close(entry->fd) == 0;
+  entry->fd = -1;
+  stored = stored && rename(entry->temp, entry->path) == 0;
+  if (!stored) {
+    (void)unlink(entry->temp);
+    return 0;
+  }
+  cache_evict(dir, cache_max_bytes);
+  return 1;
+}
+
+void cache_discard(cache_entry_t* entry) {
+  (void)close(entry->fd);
+  entry->fd = -1;
+  (void)unlink(entry->temp);
+}
+
+int cache_store(const char* dir, uint64_t key, uint16_t origin,
+                const uint16_t* words, size_t count) {
+  cache_entry_t entry;
+  if (!cache_create(dir, key, &entry)) {
+    return 0;
+  }
+  /* the same layout as an .obj: a big-endian origin and words */
+  uint16_t chunk[STORE_CHUNK_WORDS];
+  chunk[0] = swap16(origin);
+  size_t pending = 1;
+  int written = 1;
+  for (size_t i = 0; written && i < count;) {
+    size_t step = STORE_CHUNK_WORDS - pending;
+    step = step > count - i ? count - i : step;
+    swap16_buffer(chunk + pending, (const uint8_t*)(words + i), step);
+    written = write_all(entry.fd, chunk, (pending + step) * sizeof(uint16_t));
+    i += step;
+    pending = 0;
+  }
+  if (written && pending) {
+    written = write_all(entry.fd, chunk, sizeof(uint16_t));
+  }
+  if (!written) {
+    cache_discard(&entry);
+    return 0;
+  }
+  return cache_commit(dir, &entry);
+}
+
+// An entry found while scanning the cache directory
+typedef struct {
+  char name[KEY_DIGITS + sizeof(ENTRY_SUFFIX)];
+  uint64_t size;
+  struct timespec used;
+} entry_t;
+
+static int is_entry_name(const char* name) {
+  if (strlen(name) != KEY_DIGITS + strlen(ENTRY_SUFFIX) ||
+      strcmp(name + KEY_DIGITS, ENTRY_SUFFIX) != 0) {
+    return 0;
+  }
+  return strspn(name, "0123456789abcdef") == KEY_DIGITS;
+}
+
+static int by_last_use(const void* a, const void* b) {
+  const struct timespec* x = &((const entry_t*)a)->used;
+  const struct timespec* y = &((const entry_t*)b)->used;
+  if (x->tv_sec != y->tv_sec) {
+    return x->tv_sec < y->tv_sec ? -1 : 1;
+  }
+  return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+size_t cache_evict(const char* dir, uint64_t max_bytes) {
+  DIR* listing = opendir(dir);
+  if (!listing) {
+    return 0;
+  }
+  entry_t* entries = NULL;
+  size_t count = 0;
+  size_t cap = 0;
+  uint64_t total = 0;
+  char path[CACHE_PATH_MAX];
+  const struct dirent* found = NULL;
+  // NOLINTNEXTLINE(concurrency-mt-unsafe)
+  while ((found = readdir(listing)) != NULL) {
+    struct stat info;
+    // NOLINTNEXTLINE(cert-err33-c)
+    snprintf(path, sizeof(path), "%s/%s", dir, found->d_name);
+    if (!is_entry_name(found->d_name) || stat(path, &info) != 0) {
+      continue;
+    }
+    if (count == cap) {
+      cap = cap ? cap * 2 : ENTRIES_MIN_CAP;
+      entry_t* grown = realloc(entries, cap * sizeof(entry_t));
+      if (!grown) {
+        error_and_exit("Failed to allocate cache listing");
+      }
+      entries = grown;
+    }
+    /* is_entry_name checked that the name and its NUL fit exactly */
+    memcpy(entries[count].name, found->d_name, sizeof(entries[count].name));
+    entries[count].size = (uint64_t)info.st_size;
+    entries[count].used = info.st_mtim;
+    total += entries[count].size;
+    ++count;
+  }
+  closedir(listing);
+
+  /* oldest first, until the rest fit */
+  if (count > 1) {
+    qsort(entries, count, sizeof(entry_t), by_last_use);
+  }
+  size_t removed = 0;
+  for (size_t i = 0; i < count && total > max_bytes; ++i) {
+    // NOLINTNEXTLINE(cert-err33-c)
+    snprintf(path, sizeof(path), "%s/%s", dir, entries[i].name);
+    if (unlink(path) == 0) {
+      total -= entries[i].size;
+      ++removed;
+    }
+  }
+  free(entries);
+  stats.evictions += removed;
+  return removed;
+}
+
+cache_stats_t cache_get_stats(void) { return stats; }
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bulkio.h"
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define CACHE_DEFAULT_MAX_BYTES (64ULL << 20U)
+#define CACHE_PATH_MAX 4096U
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+// What the cache did in this process
+typedef struct {
+  uint64_t hits;      /* conversions loaded from the cache */
+  uint64_t misses;    /* conversions that had to run */
+  uint64_t evictions; /* entries removed to stay under the size bound */
+} cache_stats_t;
+
+// An entry being written, which lookups only see once it is committed
+typedef struct {
+  int fd;                    /* the temporary file, open for writing */
+  char path[CACHE_PATH_MAX]; /* the entry once committed */
+  char temp[CACHE_PATH_MAX + sizeof(".4294967295.tmp")];
+} cache_entry_t;
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+extern int cache_enabled;              /* cleared by --no-cache */
+extern const char* cache_dir_override; /* set by --cache-dir */
+extern uint64_t cache_max_bytes;       /* total size of all entries */
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+/**
+ * Hashes an input file and the parameters of its conversion into a key.
+ *
+ * The key changes whenever either changes, so a cached image is only reused
+ * for the same bytes converted the same way, whatever the file is called.
+ *
+ * @param bytes The contents of the input file.
+ * @param size The size of the input in bytes.
+ * @param params Everything else the converted image depends on.
+ *
+ * @return The 64-bit key.
+ */
+uint64_t cache_key(const uint8_t* bytes, size_t size, const char* params);
+
+/**
+ * Finds and creates the cache directory.
+ *
+ * Uses --cache-dir if given, otherwise $XDG_CACHE_HOME/pvmpkin or
+ * $HOME/.cache/pvmpkin.
+ *
+ * @param dir Where to store the directory's path.
+ * @param len The size of dir.
+ *
+ * @return 1 if the cache can be used, 0 if it is disabled or unavailable.
+ */
+int cache_dir(char* dir, size_t len);
+
+/**
+ * Maps the image stored under a key and marks it as recently used.
+ *
+ * @param dir The cache directory.
+ * @param key The key of the conversion.
+ * @param image Set to the mapped image on a hit; unmap it with unmap_file.
+ *
+ * @return 1 on a hit, 0 on a miss. Either is counted.
+ */
+int cache_lookup(const char* dir, uint64_t key, mapped_file_t* image);
+
+/**
+ * Maps the image stored under a key without counting it as a lookup.
+ *
+ * @param dir The cache directory.
+ * @param key The key of the conversion.
+ * @param image Set to the mapped image if it exists; unmap it with
+ *              unmap_file.
+ *
+ * @return 1 if the entry exists, 0 otherwise.
+ */
+int cache_map(const char* dir, uint64_t key, mapped_file_t* image);
+
+/**
+ * Stores words as a loadable image under a key, then evicts the least
+ * recently used entries until the cache fits in cache_max_bytes.
+ *
+ * The image is written to a temporary file and renamed into place, so
+ * concurrent runs never see a partial entry.
+ *
+ * @param dir The cache directory.
+ * @param key The key of the conversion.
+ * @param origin The address the words load at.
+ * @param words The words in host order.
+ * @param count The number of words.
+ *
+ * @return 1 if the entry was stored, 0 on an I/O error.
+ */
+int cache_store(const char* dir, uint64_t key, uint16_t origin,
+                const uint16_t* words, size_t count);
+
+/**
+ * Starts writing an entry under a key into a temporary file.
+ *
+ * The caller writes the image, an .obj's big-endian origin and words, to
+ * entry->fd as it is produced, then ends with cache_commit or
+ * cache_discard. Lets a conversion too big to hold in memory go straight
+ * to disk.
+ *
+ * @param dir The cache directory.
+ * @param key The key of the conversion.
+ * @param entry Set to the entry being written.
+ *
+ * @return 1 if the temporary file was created, 0 otherwise.
+ */
+int cache_create(const char* dir, uint64_t key, cache_entry_t* entry);
+
+/**
+ * Renames a written entry into place, then evicts the least recently used
+ * entries until the cache fits in cache_max_bytes.
+ *
+ * Mappings of entry->fd stay valid even if the entry is evicted at once.
+ *
+ * @param dir The cache directory.
+ * @param entry The entry from cache_create, whose file is closed.
+ *
+ * @return 1 if the entry was stored, 0 on an I/O error.
+ */
+int cache_commit(const char* dir, cache_entry_t* entry);
+
+/**
+ * Closes and removes an entry that was not finished.
+ *
+ * @param entry The entry from cache_create.
+ */
+void cache_discard(cache_entry_t* entry);
+
+/**
+ * Removes the least recently used entries until the rest fit.
+ *
+ * @param dir The cache directory.
+ * @param max_bytes The most bytes the entries may take.
+ *
+ * @return The number of entries removed.
+ */
+size_t cache_evict(const char* dir, uint64_t max_bytes);
+
+/**
+ * Returns the hit, miss and eviction counts of this process.
+ *
+ * @return The counters.
+ */
+cache_stats_t cache_get_stats(void);
@@ -0,0 +1,29 @@
+#include "dma.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "stats.h"
+#include "utils.h"
+
+void dma_control(vm_t* vm, uint16_t value) {
+  vm->memory[MR_DMA_CONTROL] = 0;
+  if (value & DMA_START) {
+    uint16_t source = vm->memory[MR_DMA_SOURCE];
+    size_t length = vm->memory[MR_DMA_LENGTH];
+    if (length > (size_t)MEMORY_MAX + 1 - source) {
+      length = (size_t)MEMORY_MAX + 1 - source;
+    }
+    const uint16_t* samples = vm->memory + source;
+    STATS_ADD(vm, audio_samples, length);
+    if (vm->io.audio_buffer) {
+      vm->io.audio_buffer(vm->io.ctx, samples, length);
+    } else {
+      for (size_t i = 0; i < length; ++i) {
+        vm->io.audio_sample(vm->io.ctx, samples[i]);
+      }
+    }
+    vm->memory[MR_DMA_CONTROL] = DMA_DONE;
+  }
+  vm_mark_dirty(vm, MR_DMA_CONTROL);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "vm.h"
+
+enum {
+  DMA_START = 0x0001, /* stored to MR_DMA_CONTROL to start a transfer */
+  DMA_DONE = 0x8000,  /* read from MR_DMA_CONTROL once a transfer is over */
+};
+
+/**
+ * Handles a store to the audio DMA control register.
+ *
+ * With DMA_START set, the MR_DMA_LENGTH words from MR_DMA_SOURCE on are
+ * handed to the VM's audio_buffer callback in one call, or to audio_sample
+ * one at a time if it has none, and MR_DMA_CONTROL then reads as DMA_DONE.
+ * A buffer running past the end of memory stops there. The transfer is over
+ * by the time the store returns; like single samples, it may sleep while the
+ * device catches up. Any other value clears the register.
+ *
+ * @param vm The VM whose guest stored to MR_DMA_CONTROL.
+ * @param value The value stored.
+ */
+void dma_control(vm_t* vm, uint16_t value);
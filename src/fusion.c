@@ -0,0 +1,246 @@
+#include "fusion.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "interpreter.h"
+#include "memory.h"
+#include "predecode.h"
+#include "utils.h"
+#include "vm.h"
+
+// NOLINTNEXTLINE(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define PERCENT 100.0
+// NOLINTNEXTLINE(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define WORD_VALUES 0x10000U
+
+static const char* const handler_names[PD_COUNT] = {
+    [PD_DECODE] = "?",        [PD_ADD_REG] = "ADD",    [PD_ADD_IMM] = "ADD#",
+    [PD_AND_REG] = "AND",     [PD_AND_IMM] = "AND#",   [PD_NOT] = "NOT",
+    [PD_BR] = "BR",           [PD_BR_ALWAYS] = "BRnzp", [PD_NOP] = "NOP",
+    [PD_JMP] = "JMP",         [PD_JSR] = "JSR",        [PD_JSRR] = "JSRR",
+    [PD_LD] = "LD",           [PD_LDI] = "LDI",        [PD_LDR] = "LDR",
+    [PD_LEA] = "LEA",         [PD_ST] = "ST",          [PD_STI] = "STI",
+    [PD_STR] = "STR",         [PD_REF] = "TRAP",       [PD_ADD_BR] = "ADD+BR",
+    [PD_NEG] = "NEG",         [PD_NEG_ADD] = "SUB",    [PD_CMP_BR] = "CMP+BR",
+    [PD_LDR_STI] = "LDR+STI", [PD_DELAY] = "DELAY",
+};
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+int fast_forward_enabled = 1;
+static uint64_t pair_counts[PD_COUNT][PD_COUNT];
+static uint64_t triple_counts[PD_COUNT][PD_COUNT][PD_COUNT];
+static uint64_t profiled_instrs;
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+const char* handler_name(uint8_t handler) {
+  return handler < PD_COUNT ? handler_names[handler] : "?";
+}
+
+// Values of a register by the condition code they set
+static const struct {
+  uint16_t flag;
+  uint16_t low;
+  uint16_t high;
+} flag_ranges[] = {
+    {FL_POS, 0x0001, 0x7FFF},
+    {FL_ZRO, 0x0000, 0x0000},
+    {FL_NEG, 0x8000, 0xFFFF},
+};
+
+uint32_t delay_iterations(uint16_t value, uint16_t step, uint16_t mask) {
+  /* the value after the first iteration, then the distance from it to the
+   * nearest value whose condition code is not in the mask */
+  uint32_t first = (uint16_t)(value + step);
+  uint32_t distance = WORD_VALUES;
+
+  for (size_t i = 0; i < sizeof(flag_ranges) / sizeof(flag_ranges[0]); ++i) {
+    uint32_t low = flag_ranges[i].low;
+    uint32_t high = flag_ranges[i].high;
+    uint32_t to_range = 0;
+    if (mask & flag_ranges[i].flag) {
+      continue;
+    }
+    if (first < low) {
+      to_range = step == 1 ? low - first : first + WORD_VALUES - high;
+    } else if (first > high) {
+      to_range = step == 1 ? low + WORD_VALUES - first : first - high;
+    }
+    if (to_range < distance) {
+      distance = to_range;
+    }
+  }
+  return distance + 1;
+}
+
+static decoded_t decode_at(vm_t* vm, uint16_t address) {
+  return predecode_instr(address, mem_read(vm, address));
+}
+
+/* NOT Ra, Rb / ADD Ra, Ra, #1 [/ ADD Rc, Ra, Rd [/ BR]] */
+static void fuse_negation(vm_t* vm, uint16_t address, decoded_t* decoded,
+                          const decoded_t* second) {
+  if (second->handler != PD_ADD_IMM || second->dr != decoded->dr ||
+      second->sr1 != decoded->dr || second->imm != 1) {
+    return;
+  }
+  decoded->handler = PD_NEG;
+  decoded->length = 2;
+
+  decoded_t third = decode_at(vm, (uint16_t)(address + 2));
+  if (third.handler != PD_ADD_REG ||
+      (third.sr1 != decoded->dr && third.sr2 != decoded->dr)) {
+    return;
+  }
+  decoded->handler = PD_NEG_ADD;
+  decoded->rd2 = third.dr;
+  decoded->sr2 = third.sr1 == decoded->dr ? third.sr2 : third.sr1;
+  decoded->length = 3;
+
+  decoded_t fourth = decode_at(vm, (uint16_t)(address + 3));
+  if (fourth.handler != PD_BR) {
+    return;
+  }
+  decoded->handler = PD_CMP_BR;
+  decoded->imm2 = fourth.sr2;
+  decoded->imm = fourth.imm;
+  decoded->length = 4;
+}
+
+void fuse_instrs(vm_t* vm, uint16_t address, decoded_t* decoded) {
+  /* every word of the sequence must be inside memory[] */
+  if (address >= MEMORY_MAX - MAX_FUSED_LEN) {
+    return;
+  }
+  decoded_t second = decode_at(vm, (uint16_t)(address + 1));
+
+  switch (decoded->handler) {
+    case PD_ADD_IMM:
+      if (second.handler == PD_BR) {
+        decoded->handler = PD_ADD_BR;
+        decoded->imm2 = decoded->imm;
+        decoded->sr2 = second.sr2;
+        decoded->imm = second.imm;
+        decoded->length = 2;
+        if (fast_forward_enabled && decoded->imm == address &&
+            decoded->dr == decoded->sr1 &&
+            (decoded->imm2 == 1 || decoded->imm2 == (uint16_t)-1)) {
+          decoded->handler = PD_DELAY;
+        }
+      }
+      break;
+    case PD_NOT:
+      fuse_negation(vm, address, decoded, &second);
+      break;
+    case PD_LDR:
+      if (second.handler == PD_STI) {
+        decoded->handler = PD_LDR_STI;
+        decoded->imm2 = decoded->imm;
+        decoded->sr2 = second.dr;
+        decoded->imm = second.imm;
+        decoded->length = 2;
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+uint64_t run_fusion_profile(vm_t* vm, uint64_t budget, int* running) {
+  /* the trace carries over between slices */
+  static uint16_t last_pc;
+  static uint8_t last[2];
+  static unsigned adjacent;
+
+  uint64_t retired = 0;
+  while (*running && retired < budget) {
+    uint16_t pc = vm->reg[R_PC];
+    uint16_t instr = mem_read(vm, pc);
+    uint8_t handler = predecode_instr(pc, instr).handler;
+
+    if (profiled_instrs > 0 && pc == (uint16_t)(last_pc + 1)) {
+      ++pair_counts[last[1]][handler];
+      if (adjacent >= 1) {
+        ++triple_counts[last[0]][last[1]][handler];
+      }
+      ++adjacent;
+    } else {
+      adjacent = 0;
+    }
+    last[0] = last[1];
+    last[1] = handler;
+    last_pc = pc;
+    ++profiled_instrs;
+
+    vm->reg[R_PC]++;
+    execute_instr(vm, instr, running);
+    ++retired;
+  }
+  return retired;
+}
+
+typedef struct {
+  uint64_t count;
+  uint8_t handlers[3];
+} sequence_t;
+
+static int by_count_desc(const void* lhs, const void* rhs) {
+  uint64_t left = ((const sequence_t*)lhs)->count;
+  uint64_t right = ((const sequence_t*)rhs)->count;
+  return (left < right) - (left > right);
+}
+
+static void print_top(FILE* out, sequence_t* sequences, size_t count,
+                      size_t length, size_t top) {
+  qsort(sequences, count, sizeof(sequence_t), by_count_desc);
+  for (size_t i = 0; i < count && i < top; ++i) {
+    // NOLINTNEXTLINE(cert-err33-c)
+    fprintf(out, "  %6.2f%% %12llu  ",
+            PERCENT * (double)sequences[i].count / (double)profiled_instrs,
+            (unsigned long long)sequences[i].count);
+    for (size_t j = 0; j < length; ++j) {
+      // NOLINTNEXTLINE(cert-err33-c)
+      fprintf(out, "%s%s", j ? " -> " : "",
+              handler_name(sequences[i].handlers[j]));
+    }
+    // NOLINTNEXTLINE(cert-err33-c)
+    fprintf(out, "\n");
+  }
+}
+
+void fusion_profile_report(FILE* out, size_t top) {
+  static sequence_t sequences[PD_COUNT * PD_COUNT * PD_COUNT];
+  size_t count = 0;
+
+  // NOLINTNEXTLINE(cert-err33-c)
+  fprintf(out, "fusion profile: %llu instructions\npairs:\n",
+          (unsigned long long)profiled_instrs);
+  if (profiled_instrs == 0) {
+    return;
+  }
+  for (uint8_t a = 0; a < PD_COUNT; ++a) {
+    for (uint8_t b = 0; b < PD_COUNT; ++b) {
+      if (pair_counts[a][b]) {
+        sequences[count++] = (sequence_t){pair_counts[a][b], {a, b, 0}};
+      }
+    }
+  }
+  print_top(out, sequences, count, 2, top);
+
+  // NOLINTNEXTLINE(cert-err33-c)
+  fprintf(out, "triples:\n");
+  count = 0;
+  for (uint8_t a = 0; a < PD_COUNT; ++a) {
+    for (uint8_t b = 0; b < PD_COUNT; ++b) {
+      for (uint8_t c = 0; c < PD_COUNT; ++c) {
+        if (triple_counts[a][b][c]) {
+          sequences[count++] =
+              (sequence_t){triple_counts[a][b][c], {a, b, c}};
+        }
+      }
+    }
+  }
+  print_top(out, sequences, count, 3, top);
+}
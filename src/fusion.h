@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "predecode.h"
+#include "vm.h"
+
+// Whether fuse_instrs may build PD_DELAY records, on by default
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+extern int fast_forward_enabled;
+
+/**
+ * Upgrades a freshly decoded record to a superinstruction when the words
+ * following it form a known idiom.
+ *
+ * Recognized sequences, each executed by run_predecoded as one dispatch:
+ * - ADD Rd, Rs, #imm / BR (countdown loops)            -> PD_ADD_BR
+ * - NOT Ra, Rb / ADD Ra, Ra, #1 (negation)             -> PD_NEG
+ * - PD_NEG / ADD Rc, Ra, Rd (subtraction)              -> PD_NEG_ADD
+ * - PD_NEG_ADD / BR (compare and branch)               -> PD_CMP_BR
+ * - LDR Rd, Rb, #off / STI Rs, label (copy to device)  -> PD_LDR_STI
+ * - ADD Rd, Rd, #+-1 / BR back to the ADD (delay loop)  -> PD_DELAY
+ *
+ * Only the first record of a sequence is fused; the records of the
+ * following words stay plain, so jumps into the middle still work.
+ *
+ * @param vm The VM to read the following words from.
+ * @param address The address of the first instruction.
+ * @param decoded The record decoded from that address, updated in place.
+ */
+void fuse_instrs(vm_t* vm, uint16_t address, decoded_t* decoded);
+
+/**
+ * Counts the iterations of a delay loop before it falls through.
+ *
+ * The loop is ADD r, r, #step / BR mask back to the ADD, with step 1 or -1.
+ * It has no side effects besides r and the condition codes, so its exit
+ * state follows from the number of iterations alone: r + step * iterations,
+ * with the condition codes of that value. run_predecoded uses this to skip
+ * the loop while still retiring every instruction it would have executed,
+ * which keeps instruction-count based timing unchanged, and adds the skipped
+ * instructions to vm->fast_forward_cycles.
+ *
+ * @param value The value of r when the loop is entered.
+ * @param step The ADD immediate, 0x0001 or 0xFFFF.
+ * @param mask The BR nzp mask, neither 0 nor 7.
+ *
+ * @return The number of iterations, between 1 and 65536.
+ */
+uint32_t delay_iterations(uint16_t value, uint16_t step, uint16_t mask);
+
+/**
+ * Returns a short mnemonic for a decoded handler, such as "ADD#" or "BR".
+ *
+ * @param handler One of the PD_* handlers.
+ *
+ * @return A static string naming the handler.
+ */
+const char* handler_name(uint8_t handler);
+
+/**
+ * Runs the reference interpreter while counting instruction sequences.
+ *
+ * Equivalent to run_instructions, but also counts every pair and triple of
+ * instructions that executed back to back from adjacent addresses, keyed by
+ * their decoded handler. Those are the sequences fuse_instrs can turn into
+ * superinstructions, so the report shows which idioms to add next. The counts
+ * are process-wide, so only profile one VM at a time.
+ *
+ * @param vm The VM to run.
+ * @param budget The maximum number of instructions to execute.
+ * @param running An int pointer representing the status of the running loop.
+ *
+ * @return The number of instructions retired, at most budget.
+ */
+uint64_t run_fusion_profile(vm_t* vm, uint64_t budget, int* running);
+
+/**
+ * Prints the most frequent pairs and triples seen by run_fusion_profile.
+ *
+ * @param out The stream to print the report to.
+ * @param top The number of pairs and of triples to list.
+ */
+void fusion_profile_report(FILE* out, size_t top);
@@ -3,6 +3,7 @@
 #include <stdint.h>
 
 #include "utils.h"
+#include "vm.h"
 
 // NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
 #define REG 0x07U
@@ -48,9 +49,10 @@ uint16_t sign_extend(uint16_t num, uint8_t bit_count);
  * - 0001 DR SR1 0 00 SR2 (Register mode)
  * - 0001 DR SR1 1 imm5   (Immediate mode)
  *
+ * @param vm: The VM to execute in.
  * @param instr: Pointer to the instruction.
  */
-void add_instr(uint32_t instr);
+void add_instr(vm_t* vm, uint32_t instr);
 
 /**
  * Implements the LDI (Load Indirect) instruction.
@@ -59,9 +61,10 @@ void add_instr(uint32_t instr);
  * Format:
  * - 1010 DR PCoffset9
  *
+ * @param vm: The VM to execute in.
  * @param instr: Pointer to the instruction.
  */
-void ldi_instr(uint32_t instr);
+void ldi_instr(vm_t* vm, uint32_t instr);
 
 /**
  * Implements the AND instruction.
@@ -71,9 +74,10 @@ void ldi_instr(uint32_t instr);
  * - 0101 DR SR1 0 00 SR2
  * - 0101 DR SR1 1 imm5
  *
+ * @param vm: The VM to execute in.
  * @param instr: Pointer to the instruction.
  */
-void and_instr(uint32_t instr);
+void and_instr(vm_t* vm, uint32_t instr);
 
 /**
  * Implements the NOT instruction.
@@ -82,9 +86,10 @@ void and_instr(uint32_t instr);
  * Format:
  * - 1001 DR SR 111111
  *
+ * @param vm: The VM to execute in.
  * @param instr: Pointer to the instruction.
  */
-void not_instr(uint32_t instr);
+void not_instr(vm_t* vm, uint32_t instr);
 
 /**
  * Implements the BR (Branch) instruction.
@@ -93,9 +98,10 @@ void not_instr(uint32_t instr);
  * Format:
  * - 0000 n z p PCoffset9
  *
+ * @param vm: The VM to execute in.
  * @param instr: Pointer to the instruction.
  */
-void branch_instr(uint32_t instr);
+void branch_instr(vm_t* vm, uint32_t instr);
 
 /**
  * Implements the JMP or RET instruction.
@@ -104,9 +110,10 @@ void branch_instr(uint32_t instr);
  * Format:
  * - 1100 000 BaseR 000000
  *
+ * @param vm: The VM to execute in.
  * @param instr: Pointer to the instruction.
  */
-void jump_instr(uint32_t instr);
+void jump_instr(vm_t* vm, uint32_t instr);
 
 /**
  * Implements the JSR and JSRR instructions.
@@ -116,9 +123,10 @@ void jump_instr(uint32_t instr);
  * - 0100 1 PCoffset11    (JSR)
  * - 0100 0 00 BaseR ...  (JSRR)
  *
+ * @param vm: The VM to execute in.
  * @param instr: Pointer to the instruction.
  */
-void jump_register_instr(uint32_t instr);
+void jump_register_instr(vm_t* vm, uint32_t instr);
 
 /**
  * Implements the LD (Load) instruction.
@@ -127,9 +135,10 @@ void jump_register_instr(uint32_t instr);
  * Format:
  * - 0010 DR PCoffset9
  *
+ * @param vm: The VM to execute in.
  * @param instr: Pointer to the instruction.
  */
-void load_instr(uint32_t instr);
+void load_instr(vm_t* vm, uint32_t instr);
 
 /**
  * Implements the LDR (Load Register) instruction.
@@ -138,9 +147,10 @@ void load_instr(uint32_t instr);
  * Format:
  * - 0110 DR BaseR offset6
  *
+ * @param vm: The VM to execute in.
  * @param instr: Pointer to the instruction.
  */
-void load_reg_instr(uint32_t instr);
+void load_reg_instr(vm_t* vm, uint32_t instr);
 
 /**
  * Implements the LEA (Load Effective Address) instruction.
@@ -149,9 +159,10 @@ void load_reg_instr(uint32_t instr);
  * Format:
  * - 1110 DR PCoffset9
  *
+ * @param vm: The VM to execute in.
  * @param instr: Pointer to the instruction.
  */
-void load_eff_addr_instr(uint32_t instr);
+void load_eff_addr_instr(vm_t* vm, uint32_t instr);
 
 /**
  * Implements the ST (Store) instruction.
@@ -160,9 +171,10 @@ void load_eff_addr_instr(uint32_t instr);
  * Format:
  * - 0011 SR PCoffset9
  *
+ * @param vm: The VM to execute in.
  * @param instr: Pointer to the instruction.
  */
-void store_instr(uint32_t instr);
+void store_instr(vm_t* vm, uint32_t instr);
 
 /**
  * Implements the STI (Store Indirect) instruction.
@@ -171,9 +183,10 @@ void store_instr(uint32_t instr);
  * Format:
  * - 1011 SR PCoffset9
  *
+ * @param vm: The VM to execute in.
  * @param instr: Pointer to the instruction.
  */
-void store_indirect_instr(uint32_t instr);
+void store_indirect_instr(vm_t* vm, uint32_t instr);
 
 /**
  * Implements the STR (Store Register) instruction.
@@ -182,6 +195,7 @@ void store_indirect_instr(uint32_t instr);
  * Format:
  * - 0111 SR BaseR offset6
  *
+ * @param vm: The VM to execute in.
  * @param instr: Pointer to the instruction.
  */
-void store_reg_instr(uint32_t instr);
+void store_reg_instr(vm_t* vm, uint32_t instr);
@@ -0,0 +1,102 @@
+#include "interpreter.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "instructions.h"
+#include "memory.h"
+#include "stats.h"
+#include "trapping.h"
+#include "utils.h"
+#include "vm.h"
+
+void execute_instr(vm_t* vm, uint16_t instr, int* running) {
+  uint16_t opcode = (uint16_t)(instr >> OPCODE_SHIFT);
+
+  switch (opcode) {
+    case OP_ADD:
+      add_instr(vm, instr);
+      break;
+    case OP_AND:
+      and_instr(vm, instr);
+      break;
+    case OP_NOT:
+      not_instr(vm, instr);
+      break;
+    case OP_BR:
+      branch_instr(vm, instr);
+      break;
+    case OP_JMP:
+      jump_instr(vm, instr);
+      break;
+    case OP_JSR:
+      jump_register_instr(vm, instr);
+      break;
+    case OP_LD:
+      load_instr(vm, instr);
+      break;
+    case OP_LDI:
+      ldi_instr(vm, instr);
+      break;
+    case OP_LDR:
+      load_reg_instr(vm, instr);
+      break;
+    case OP_LEA:
+      load_eff_addr_instr(vm, instr);
+      break;
+    case OP_ST:
+      store_instr(vm, instr);
+      break;
+    case OP_STI:
+      store_indirect_instr(vm, instr);
+      break;
+    case OP_STR:
+      store_reg_instr(vm, instr);
+      break;
+    case OP_TRAP:
+      vm->reg[R_R7] = vm->reg[R_PC];
+      STATS_ADD(vm, traps[instr & FIRST_8BIT_MASK], 1);
+
+      switch (instr & FIRST_8BIT_MASK) {
+        case TRAP_GETC:
+          trap_getc(vm);
+          break;
+        case TRAP_OUT:
+          trap_out(vm);
+          break;
+        case TRAP_PUTS:
+          trap_puts(vm);
+          break;
+        case TRAP_IN:
+          trap_in(vm);
+          break;
+        case TRAP_PUTSP:
+          trap_putsp(vm);
+          break;
+        case TRAP_HALT:
+          trap_halt(vm, running);
+          break;
+        default:
+          printf("Unknown trapcode\n");
+          *running = 0;
+          break;
+      }
+      break;
+
+    default:
+      printf("Unknown opcode: 0x%X\n", opcode);
+      *running = 0;
+      break;
+  }
+}
+
+uint64_t run_instructions(vm_t* vm, uint64_t budget, int* running) {
+  uint64_t retired = 0;
+  while (*running && retired < budget) {
+    uint16_t instr = mem_read(vm, vm->reg[R_PC]++);
+    STATS_ADD(vm, opcodes[instr >> OPCODE_SHIFT], 1);
+    execute_instr(vm, instr, running);
+    ++retired;
+  }
+  return retired;
+}
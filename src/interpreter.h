@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "utils.h"
+#include "vm.h"
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define OPCODE_SHIFT 12U
+#define FIRST_8BIT_MASK 0xFFU
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+/**
+ * Executes a single, already fetched LC-3 instruction.
+ *
+ * The PC must already point at the instruction following instr. Traps are
+ * dispatched to the handlers in trapping.c, and HALT or an unknown opcode or
+ * trap vector clears the running flag.
+ *
+ * @param vm The VM to execute in.
+ * @param instr The 16-bit instruction word to execute.
+ * @param running An int pointer representing the status of the running loop.
+ */
+void execute_instr(vm_t* vm, uint16_t instr, int* running);
+
+/**
+ * Runs the fetch-decode-execute loop for a bounded number of instructions.
+ *
+ * The loop only checks the running flag between instructions, so callers that
+ * need to service SDL events, render frames or honor interrupts do so between
+ * calls. This keeps host bookkeeping out of the hot loop.
+ *
+ * @param vm The VM to run.
+ * @param budget The maximum number of instructions to execute.
+ * @param running An int pointer representing the status of the running loop.
+ *
+ * @return The number of instructions retired, at most budget.
+ */
+uint64_t run_instructions(vm_t* vm, uint64_t budget, int* running);
@@ -0,0 +1,709 @@
+#include "jit.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "instructions.h"
+#include "interpreter.h"
+#include "memory.h"
+#include "predecode.h"
+#include "stats.h"
+#include "utils.h"
+#include "vm.h"
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+uint16_t jit_code_pages[JIT_PAGES];
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define JIT_HOT_THRESHOLD 32U
+#define JIT_MAX_BLOCK_LEN 64U
+#define JIT_MAX_BLOCKS 4096U
+/* bounds on emitted code; the encoders below take at most 60 bytes for the
+   prologue, 97 for an exit and about 210 for one instruction, a BR with its
+   two exits or an STI to a device register with the exit after it */
+#define JIT_PROLOGUE_BYTES 64U
+#define JIT_MAX_INSTR_BYTES 256U
+#define JIT_MAX_EXIT_BYTES 128U
+#define JIT_MIN_BLOCK_BYTES \
+  (JIT_PROLOGUE_BYTES + JIT_MAX_INSTR_BYTES + JIT_MAX_EXIT_BYTES)
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+// Translated blocks are called as code(vm->reg, vm->memory) and return the
+// number of guest instructions they retired, with vm->reg fully written back.
+typedef uint32_t (*jit_code_fn)(uint16_t* regs, uint16_t* mem);
+
+typedef struct {
+  jit_code_fn code;
+  uint16_t entry;
+  uint16_t length; /* guest instructions, if no store exits early */
+  uint16_t first_page;
+  uint16_t last_page;
+  int live;
+} jit_block_t;
+
+// x86-64 register numbers
+enum {
+  RAX = 0,
+  RCX,
+  RDX,
+  RBX,
+  RSP,
+  RBP,
+  RSI,
+  RDI,
+  R8,
+  R9,
+  R10,
+  R11,
+  R12,
+  R13,
+  R14,
+  R15
+};
+
+// x86-64 condition codes
+enum {
+  CC_E = 0x4,
+  CC_NE = 0x5,
+  CC_AE = 0x3,
+  CC_S = 0x8,
+  CC_NS = 0x9,
+  CC_LE = 0xE,
+  CC_G = 0xF,
+  CC_ALWAYS = 0x10, /* pseudo code for BRnzp */
+};
+
+enum {
+  STATE = R10,    /* pointer to reg[] */
+  MEM_BASE = R11, /* pointer to memory[] */
+  NO_FLAGS = -1,  /* condition codes are still the ones in reg[R_COND] */
+  NUM_GPRS = R_PC,
+};
+
+// Guest R0-R7 live in these host registers for the whole block. R8/R9 and
+// the STATE/MEM_BASE registers are caller-saved and pushed around helpers.
+static const uint8_t host_reg[NUM_GPRS] = {RBX, RBP, R12, R13,
+                                           R14, R15, R8,  R9};
+
+// nzp mask -> condition code after `test r16, r16`
+static const uint8_t nzp_cc[COND_FLAG + 1] = {
+    [FL_NEG] = CC_S,
+    [FL_ZRO] = CC_E,
+    [FL_POS] = CC_G,
+    [FL_NEG | FL_ZRO] = CC_LE,
+    [FL_NEG | FL_POS] = CC_NE,
+    [FL_ZRO | FL_POS] = CC_NS,
+    [FL_NEG | FL_ZRO | FL_POS] = CC_ALWAYS,
+};
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+static uint8_t* code_buffer;
+static size_t code_used;
+static jit_block_t blocks[JIT_MAX_BLOCKS];
+static size_t num_blocks;
+static jit_block_t* block_at[MEMORY_MAX + 1];
+static uint8_t hits[MEMORY_MAX + 1];
+static uint32_t blocks_invalidated;
+static uint64_t translations;
+static vm_t* jit_vm; /* the VM the blocks were translated from */
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+/* --- memory helpers called from translated code --- */
+
+static uint32_t jit_load(uint32_t address) {
+  return mem_read(jit_vm, (uint16_t)address);
+}
+
+/* Returns nonzero if the store dropped translated code. */
+static uint32_t jit_store(uint32_t address, uint32_t value) {
+  blocks_invalidated = 0;
+  mem_write(jit_vm, (uint16_t)address, (uint16_t)value);
+  return blocks_invalidated;
+}
+
+/* --- x86-64 encoder --- */
+
+typedef struct {
+  uint8_t* buf;
+  size_t len;
+  size_t cap; /* bytes left in the code buffer at buf */
+} emitter_t;
+
+static void emit8(emitter_t* emit, uint32_t byte) {
+  emit->buf[emit->len++] = (uint8_t)byte;
+}
+
+static void emit16(emitter_t* emit, uint32_t value) {
+  emit8(emit, value & BYTE_MASK);
+  emit8(emit, (value >> BIT_SHIFT_8) & BYTE_MASK);
+}
+
+static void emit32(emitter_t* emit, uint32_t value) {
+  emit16(emit, value & ONES);
+  emit16(emit, value >> BIT_SHIFT_16);
+}
+
+static void emit64(emitter_t* emit, uint64_t value) {
+  emit32(emit, (uint32_t)value);
+  emit32(emit, (uint32_t)(value >> (2 * BIT_SHIFT_16)));
+}
+
+/* REX prefix, omitted when no extension bit is needed. */
+static void emit_rex(emitter_t* emit, int wide, uint32_t reg_field,
+                     uint32_t index, uint32_t base) {
+  uint32_t rex = 0x40U | (wide ? 0x8U : 0U) | ((reg_field >> 3U) << 2U) |
+                 ((index >> 3U) << 1U) | (base >> 3U);
+  if (rex != 0x40U) {
+    emit8(emit, rex);
+  }
+}
+
+static void emit_modrm(emitter_t* emit, uint32_t mod, uint32_t reg_field,
+                       uint32_t rm) {
+  emit8(emit, (mod << 6U) | ((reg_field & 7U) << 3U) | (rm & 7U));
+}
+
+static void emit_mov_rr(emitter_t* emit, uint32_t dst, uint32_t src) {
+  emit_rex(emit, 0, src, 0, dst);
+  emit8(emit, 0x89);
+  emit_modrm(emit, 3, src, dst);
+}
+
+static void emit_mov_ri(emitter_t* emit, uint32_t dst, uint32_t imm) {
+  emit_rex(emit, 0, 0, 0, dst);
+  emit8(emit, 0xB8U + (dst & 7U));
+  emit32(emit, imm);
+}
+
+/* 16-bit register-register ALU op (add 0x01, and 0x21, test 0x85). */
+static void emit_alu16_rr(emitter_t* emit, uint32_t opcode, uint32_t dst,
+                          uint32_t src) {
+  emit8(emit, 0x66);
+  emit_rex(emit, 0, src, 0, dst);
+  emit8(emit, opcode);
+  emit_modrm(emit, 3, src, dst);
+}
+
+/* 16-bit register-immediate ALU op (add /0, and /4). */
+static void emit_alu16_ri(emitter_t* emit, uint32_t ext, uint32_t dst,
+                          uint32_t imm) {
+  emit8(emit, 0x66);
+  emit_rex(emit, 0, 0, 0, dst);
+  emit8(emit, 0x81);
+  emit_modrm(emit, 3, ext, dst);
+  emit16(emit, imm);
+}
+
+static void emit_not16(emitter_t* emit, uint32_t dst) {
+  emit8(emit, 0x66);
+  emit_rex(emit, 0, 0, 0, dst);
+  emit8(emit, 0xF7);
+  emit_modrm(emit, 3, 2, dst);
+}
+
+static void emit_cmp_ri(emitter_t* emit, uint32_t dst, uint32_t imm) {
+  emit_rex(emit, 0, 0, 0, dst);
+  emit8(emit, 0x81);
+  emit_modrm(emit, 3, 7, dst);
+  emit32(emit, imm);
+}
+
+static void emit_cmov(emitter_t* emit, uint32_t cc, uint32_t dst,
+                      uint32_t src) {
+  emit_rex(emit, 0, dst, 0, src);
+  emit8(emit, 0x0F);
+  emit8(emit, 0x40U | cc);
+  emit_modrm(emit, 3, dst, src);
+}
+
+/* movzx dst, word [STATE + index * 2] */
+static void emit_load_state(emitter_t* emit, uint32_t dst, uint32_t index) {
+  emit_rex(emit, 0, dst, 0, STATE);
+  emit8(emit, 0x0F);
+  emit8(emit, 0xB7);
+  emit_modrm(emit, 1, dst, STATE);
+  emit8(emit, index * 2);
+}
+
+/* mov word [STATE + index * 2], src */
+static void emit_store_state(emitter_t* emit, uint32_t index, uint32_t src) {
+  emit8(emit, 0x66);
+  emit_rex(emit, 0, src, 0, STATE);
+  emit8(emit, 0x89);
+  emit_modrm(emit, 1, src, STATE);
+  emit8(emit, index * 2);
+}
+
+/* mov word [STATE + index * 2], imm */
+static void emit_store_state_imm(emitter_t* emit, uint32_t index,
+                                 uint32_t imm) {
+  emit8(emit, 0x66);
+  emit_rex(emit, 0, 0, 0, STATE);
+  emit8(emit, 0xC7);
+  emit_modrm(emit, 1, 0, STATE);
+  emit8(emit, index * 2);
+  emit16(emit, imm);
+}
+
+/* test word [STATE + index * 2], imm */
+static void emit_test_state_imm(emitter_t* emit, uint32_t index,
+                                uint32_t imm) {
+  emit8(emit, 0x66);
+  emit_rex(emit, 0, 0, 0, STATE);
+  emit8(emit, 0xF7);
+  emit_modrm(emit, 1, 0, STATE);
+  emit8(emit, index * 2);
+  emit16(emit, imm);
+}
+
+/* movzx dst, word [MEM_BASE + rax * 2] */
+static void emit_load_memory(emitter_t* emit, uint32_t dst) {
+  emit_rex(emit, 0, dst, RAX, MEM_BASE);
+  emit8(emit, 0x0F);
+  emit8(emit, 0xB7);
+  emit_modrm(emit, 0, dst, RSP); /* rm = 100: SIB follows */
+  emit8(emit, (1U << 6U) | ((RAX & 7U) << 3U) | (MEM_BASE & 7U));
+}
+
+static void emit_push(emitter_t* emit, uint32_t reg_num) {
+  emit_rex(emit, 0, 0, 0, reg_num);
+  emit8(emit, 0x50U + (reg_num & 7U));
+}
+
+static void emit_pop(emitter_t* emit, uint32_t reg_num) {
+  emit_rex(emit, 0, 0, 0, reg_num);
+  emit8(emit, 0x58U + (reg_num & 7U));
+}
+
+/* Emits a rel32 jump and returns the offset of its displacement. */
+static size_t emit_jump(emitter_t* emit, uint32_t cc) {
+  if (cc == CC_ALWAYS) {
+    emit8(emit, 0xE9);
+  } else {
+    emit8(emit, 0x0F);
+    emit8(emit, 0x80U | cc);
+  }
+  emit32(emit, 0);
+  return emit->len - sizeof(uint32_t);
+}
+
+/* Points a jump emitted by emit_jump at the current position. */
+static void patch_jump(emitter_t* emit, size_t at) {
+  uint32_t rel = (uint32_t)(emit->len - (at + sizeof(uint32_t)));
+  memcpy(emit->buf + at, &rel, sizeof(rel));
+}
+
+/* Calls a C helper with the stack aligned and caller-saved state kept. */
+static void emit_call(emitter_t* emit, uint64_t helper) {
+  emit_push(emit, R8);
+  emit_push(emit, R9);
+  emit_push(emit, STATE);
+  emit_push(emit, MEM_BASE);
+  emit8(emit, 0x48);
+  emit8(emit, 0xB8); /* mov rax, imm64 */
+  emit64(emit, helper);
+  emit8(emit, 0xFF);
+  emit8(emit, 0xD0); /* call rax */
+  emit_pop(emit, MEM_BASE);
+  emit_pop(emit, STATE);
+  emit_pop(emit, R9);
+  emit_pop(emit, R8);
+}
+
+static void emit_prologue(emitter_t* emit) {
+  static const uint8_t saved[] = {RBX, RBP, R12, R13, R14, R15};
+  for (size_t i = 0; i < sizeof(saved); ++i) {
+    emit_push(emit, saved[i]);
+  }
+  /* sub rsp, 8 realigns the stack to 16 bytes for helper calls */
+  emit8(emit, 0x48);
+  emit8(emit, 0x83);
+  emit8(emit, 0xEC);
+  emit8(emit, 0x08);
+  /* mov STATE, rdi; mov MEM_BASE, rsi */
+  emit8(emit, 0x49);
+  emit8(emit, 0x89);
+  emit_modrm(emit, 3, RDI, STATE);
+  emit8(emit, 0x49);
+  emit8(emit, 0x89);
+  emit_modrm(emit, 3, RSI, MEM_BASE);
+  for (uint32_t i = 0; i < NUM_GPRS; ++i) {
+    emit_load_state(emit, host_reg[i], i);
+  }
+}
+
+/* Stores the condition codes for the value of flag_reg, if any. */
+static void emit_flags(emitter_t* emit, int flag_reg) {
+  if (flag_reg == NO_FLAGS) {
+    return;
+  }
+  uint32_t value = host_reg[flag_reg];
+  emit_mov_ri(emit, RAX, FL_POS);
+  emit_mov_ri(emit, RCX, FL_ZRO);
+  emit_mov_ri(emit, RDX, FL_NEG);
+  emit_alu16_rr(emit, 0x85, value, value); /* test */
+  emit_cmov(emit, CC_E, RAX, RCX);
+  emit_cmov(emit, CC_S, RAX, RDX);
+  emit_store_state(emit, R_COND, RAX);
+}
+
+/*
+ * Leaves the block: computes the condition codes if an instruction in the
+ * block set them, writes back R0-R7, and returns the retired count. The new
+ * PC must already be stored.
+ */
+static void emit_exit(emitter_t* emit, int flag_reg, uint32_t retired) {
+  static const uint8_t saved[] = {R15, R14, R13, R12, RBP, RBX};
+
+  emit_flags(emit, flag_reg);
+  for (uint32_t i = 0; i < NUM_GPRS; ++i) {
+    emit_store_state(emit, i, host_reg[i]);
+  }
+  emit_mov_ri(emit, RAX, retired);
+  emit8(emit, 0x48);
+  emit8(emit, 0x83);
+  emit8(emit, 0xC4);
+  emit8(emit, 0x08); /* add rsp, 8 */
+  for (size_t i = 0; i < sizeof(saved); ++i) {
+    emit_pop(emit, saved[i]);
+  }
+  emit8(emit, 0xC3); /* ret */
+}
+
+static void emit_exit_to(emitter_t* emit, int flag_reg, uint32_t retired,
+                         uint16_t pc) {
+  emit_store_state_imm(emit, R_PC, pc);
+  emit_exit(emit, flag_reg, retired);
+}
+
+/* Loads memory[eax] into dst, calling mem_read for device registers. */
+static void emit_load_dynamic(emitter_t* emit, uint32_t dst) {
+  emit_cmp_ri(emit, RAX, MR_KBSR);
+  size_t to_device = emit_jump(emit, CC_AE);
+  emit_load_memory(emit, dst);
+  size_t to_done = emit_jump(emit, CC_ALWAYS);
+  patch_jump(emit, to_device);
+  emit_mov_rr(emit, RDI, RAX);
+  emit_call(emit, (uint64_t)(uintptr_t)jit_load);
+  emit_mov_rr(emit, dst, RAX);
+  patch_jump(emit, to_done);
+}
+
+/* Loads memory[address] for an address known at translation time. */
+static void emit_load_constant(emitter_t* emit, uint32_t dst,
+                               uint16_t address) {
+  if (address < MR_KBSR) {
+    emit_mov_ri(emit, RAX, address);
+    emit_load_memory(emit, dst);
+  } else {
+    emit_mov_ri(emit, RDI, address);
+    emit_call(emit, (uint64_t)(uintptr_t)jit_load);
+    emit_mov_rr(emit, dst, RAX);
+  }
+}
+
+/*
+ * Stores a guest register to memory[eax] through mem_write, so devices,
+ * predecode and JIT invalidation all see it. If the store dropped translated
+ * code the block exits right after it.
+ */
+static void emit_store(emitter_t* emit, uint32_t src, int flag_reg,
+                       uint32_t retired, uint16_t next_pc) {
+  emit_mov_rr(emit, RDI, RAX);
+  emit_mov_rr(emit, RSI, src);
+  emit_call(emit, (uint64_t)(uintptr_t)jit_store);
+  emit_alu16_rr(emit, 0x85, RAX, RAX); /* test */
+  size_t to_continue = emit_jump(emit, CC_E);
+  emit_exit_to(emit, flag_reg, retired, next_pc);
+  patch_jump(emit, to_continue);
+}
+
+/* Computes sr + imm (16-bit wrap-around) into eax. */
+static void emit_address(emitter_t* emit, uint32_t base_reg, uint16_t imm) {
+  emit_mov_rr(emit, RAX, host_reg[base_reg]);
+  emit_alu16_ri(emit, 0, RAX, imm);
+}
+
+/* dst = sr1 op operand, where operand is a register or an immediate. */
+static void emit_alu(emitter_t* emit, uint32_t opcode, uint32_t ext,
+                     const decoded_t* decoded, int immediate) {
+  uint32_t dst = host_reg[decoded->dr];
+  uint32_t src1 = host_reg[decoded->sr1];
+  uint32_t src2 = host_reg[decoded->sr2];
+
+  if (!immediate && decoded->dr == decoded->sr2 &&
+      decoded->dr != decoded->sr1) {
+    /* both ops commute, so dst = src2 op src1 avoids clobbering src2 */
+    emit_alu16_rr(emit, opcode, dst, src1);
+    return;
+  }
+  if (dst != src1) {
+    emit_mov_rr(emit, dst, src1);
+  }
+  if (immediate) {
+    emit_alu16_ri(emit, ext, dst, decoded->imm);
+  } else {
+    emit_alu16_rr(emit, opcode, dst, src2);
+  }
+}
+
+/* Emits a conditional BR as the last instruction of a block. */
+static void emit_branch(emitter_t* emit, const decoded_t* decoded,
+                        int flag_reg, uint32_t retired, uint16_t next_pc) {
+  size_t to_taken = 0;
+  if (flag_reg == NO_FLAGS) {
+    emit_test_state_imm(emit, R_COND, decoded->sr2);
+    to_taken = emit_jump(emit, CC_NE);
+  } else {
+    uint32_t value = host_reg[flag_reg];
+    emit_alu16_rr(emit, 0x85, value, value); /* test */
+    to_taken = emit_jump(emit, nzp_cc[decoded->sr2]);
+  }
+  emit_exit_to(emit, flag_reg, retired, next_pc);
+  patch_jump(emit, to_taken);
+  emit_exit_to(emit, flag_reg, retired, decoded->imm);
+}
+
+/*
+ * Translates the block starting at entry. Returns the number of guest
+ * instructions it covers, or 0 if the first instruction cannot be
+ * translated (traps and unused opcodes).
+ */
+static uint16_t translate_block(emitter_t* emit, uint16_t entry) {
+  int flag_reg = NO_FLAGS;
+  uint16_t address = entry;
+
+  emit_prologue(emit);
+  for (uint32_t count = 0; count < JIT_MAX_BLOCK_LEN; ++count) {
+    /* a block ends early rather than run past the end of the buffer, which
+       JIT_MIN_BLOCK_BYTES leaves room for at least one instruction */
+    if (address == MEMORY_MAX ||
+        emit->len + JIT_MAX_INSTR_BYTES + JIT_MAX_EXIT_BYTES > emit->cap) {
+      emit_exit_to(emit, flag_reg, count, address);
+      return (uint16_t)count;
+    }
+    decoded_t decoded =
+        predecode_instr(address, mem_read(jit_vm, address));
+    uint16_t next_pc = (uint16_t)(address + 1);
+    uint32_t retired = count + 1;
+    uint32_t dst = host_reg[decoded.dr];
+
+    switch (decoded.handler) {
+      case PD_ADD_REG:
+      case PD_ADD_IMM:
+        emit_alu(emit, 0x01, 0, &decoded, decoded.handler == PD_ADD_IMM);
+        flag_reg = decoded.dr;
+        break;
+      case PD_AND_REG:
+      case PD_AND_IMM:
+        emit_alu(emit, 0x21, 4, &decoded, decoded.handler == PD_AND_IMM);
+        flag_reg = decoded.dr;
+        break;
+      case PD_NOT:
+        if (decoded.dr != decoded.sr1) {
+          emit_mov_rr(emit, dst, host_reg[decoded.sr1]);
+        }
+        emit_not16(emit, dst);
+        flag_reg = decoded.dr;
+        break;
+      case PD_NOP:
+        break;
+      case PD_BR:
+        emit_branch(emit, &decoded, flag_reg, retired, next_pc);
+        return (uint16_t)retired;
+      case PD_BR_ALWAYS:
+        emit_exit_to(emit, flag_reg, retired, decoded.imm);
+        return (uint16_t)retired;
+      case PD_JMP:
+        emit_store_state(emit, R_PC, host_reg[decoded.sr1]);
+        emit_exit(emit, flag_reg, retired);
+        return (uint16_t)retired;
+      case PD_JSR:
+        /* the flags may come from R7, so they are stored before the link */
+        emit_flags(emit, flag_reg);
+        emit_mov_ri(emit, host_reg[R_R7], next_pc);
+        emit_exit_to(emit, NO_FLAGS, retired, decoded.imm);
+        return (uint16_t)retired;
+      case PD_JSRR:
+        /* R7 is written first, matching jump_register_instr for JSRR R7 */
+        emit_flags(emit, flag_reg);
+        emit_mov_ri(emit, host_reg[R_R7], next_pc);
+        emit_store_state(emit, R_PC, host_reg[decoded.sr1]);
+        emit_exit(emit, NO_FLAGS, retired);
+        return (uint16_t)retired;
+      case PD_LD:
+        emit_load_constant(emit, dst, decoded.imm);
+        flag_reg = decoded.dr;
+        break;
+      case PD_LDI:
+        emit_load_constant(emit, RAX, decoded.imm);
+        emit_load_dynamic(emit, dst);
+        flag_reg = decoded.dr;
+        break;
+      case PD_LDR:
+        emit_address(emit, decoded.sr1, decoded.imm);
+        emit_load_dynamic(emit, dst);
+        flag_reg = decoded.dr;
+        break;
+      case PD_LEA:
+        emit_mov_ri(emit, dst, decoded.imm);
+        flag_reg = decoded.dr;
+        break;
+      case PD_ST:
+        emit_mov_ri(emit, RAX, decoded.imm);
+        emit_store(emit, dst, flag_reg, retired, next_pc);
+        break;
+      case PD_STI:
+        emit_load_constant(emit, RAX, decoded.imm);
+        emit_store(emit, dst, flag_reg, retired, next_pc);
+        break;
+      case PD_STR:
+        emit_address(emit, decoded.sr1, decoded.imm);
+        emit_store(emit, dst, flag_reg, retired, next_pc);
+        break;
+      default:
+        /* traps and unused opcodes end the block in the interpreter */
+        emit_exit_to(emit, flag_reg, count, address);
+        return (uint16_t)count;
+    }
+    address = next_pc;
+  }
+  emit_exit_to(emit, flag_reg, JIT_MAX_BLOCK_LEN, address);
+  return JIT_MAX_BLOCK_LEN;
+}
+
+static void drop_block(jit_block_t* block) {
+  block->live = 0;
+  block_at[block->entry] = NULL;
+  hits[block->entry] = 0;
+  for (uint32_t page = block->first_page; page <= block->last_page; ++page) {
+    --jit_code_pages[page];
+  }
+}
+
+void jit_flush_page(uint16_t page) {
+  for (size_t i = 0; i < num_blocks; ++i) {
+    jit_block_t* block = &blocks[i];
+    if (block->live && block->first_page <= page && page <= block->last_page) {
+      drop_block(block);
+    }
+  }
+  blocks_invalidated = 1;
+}
+
+static void drop_all_blocks(void) {
+  for (size_t i = 0; i < num_blocks; ++i) {
+    if (blocks[i].live) {
+      drop_block(&blocks[i]);
+    }
+  }
+  num_blocks = 0;
+  code_used = 0;
+}
+
+void jit_reset(void) {
+  drop_all_blocks();
+  translations = 0;
+  memset(hits, 0, sizeof(hits));
+  jit_vm = NULL;
+}
+
+uint64_t jit_translations(void) { return translations; }
+
+size_t jit_code_bytes(void) { return code_used; }
+
+static int protect_code_buffer(int prot) {
+  return mprotect(code_buffer, JIT_BUFFER_SIZE, prot);
+}
+
+/* Translates the block at entry, or returns NULL if it cannot be. */
+static jit_block_t* jit_translate(uint16_t entry) {
+  if (!code_buffer) {
+    void* buffer = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED) {
+      error_and_exit("Failed to map JIT code buffer");
+    }
+    code_buffer = buffer;
+  }
+  if (num_blocks == JIT_MAX_BLOCKS ||
+      code_used + JIT_MIN_BLOCK_BYTES > JIT_BUFFER_SIZE) {
+    drop_all_blocks();
+  }
+
+  /* the buffer is never writable and executable at the same time */
+  if (protect_code_buffer(PROT_READ | PROT_WRITE) != 0) {
+    error_and_exit("Failed to unprotect JIT code buffer");
+  }
+  emitter_t emit = {code_buffer + code_used, 0, JIT_BUFFER_SIZE - code_used};
+  uint16_t length = translate_block(&emit, entry);
+  if (protect_code_buffer(PROT_READ | PROT_EXEC) != 0) {
+    error_and_exit("Failed to protect JIT code buffer");
+  }
+  if (length == 0) {
+    return NULL;
+  }
+
+  jit_block_t* block = &blocks[num_blocks++];
+  memcpy(&block->code, &emit.buf, sizeof(block->code));
+  block->entry = entry;
+  block->length = length;
+  block->first_page = (uint16_t)(entry >> JIT_PAGE_SHIFT);
+  block->last_page = (uint16_t)((entry + length - 1U) >> JIT_PAGE_SHIFT);
+  block->live = 1;
+  for (uint32_t page = block->first_page; page <= block->last_page; ++page) {
+    ++jit_code_pages[page];
+  }
+  block_at[entry] = block;
+  code_used += (emit.len + 15U) & ~(size_t)15U;
+  ++translations;
+  return block;
+}
+
+uint64_t run_jit(vm_t* vm, uint64_t budget, int* running) {
+  uint64_t retired = 0;
+
+  if (vm != jit_vm) {
+    jit_reset();
+    jit_vm = vm;
+    vm->uses_jit = 1;
+  }
+  while (*running && retired < budget) {
+    uint16_t pc = vm->reg[R_PC];
+    jit_block_t* block = block_at[pc];
+
+    if (!block && hits[pc] < JIT_HOT_THRESHOLD &&
+        ++hits[pc] == JIT_HOT_THRESHOLD) {
+      block = jit_translate(pc);
+    }
+    if (block && block->length <= budget - retired) {
+      uint64_t ran = block->code(vm->reg, vm->memory);
+      STATS_RUN(vm, pc, ran);
+      retired += ran;
+    } else {
+      retired += run_predecoded(vm, 1, running);
+    }
+  }
+  return retired;
+}
+
+#else
+
+void jit_flush_page(uint16_t page) { (void)page; }
+
+void jit_reset(void) {}
+
+uint64_t jit_translations(void) { return 0; }
+
+size_t jit_code_bytes(void) { return 0; }
+
+uint64_t run_jit(vm_t* vm, uint64_t budget, int* running) {
+  return run_predecoded(vm, budget, running);
+}
+
+#endif
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "memory.h"
+#include "utils.h"
+#include "vm.h"
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define JIT_PAGE_SHIFT 8U
+#define JIT_PAGES ((MEMORY_MAX >> JIT_PAGE_SHIFT) + 1U)
+#define JIT_BUFFER_SIZE (1U << 20U) /* bytes of translated code */
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+// Number of live translated blocks touching each 256-word code page
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+extern uint16_t jit_code_pages[JIT_PAGES];
+
+/**
+ * Drops every translated block that touches a code page.
+ *
+ * @param page The page index, an address shifted right by JIT_PAGE_SHIFT.
+ */
+void jit_flush_page(uint16_t page);
+
+/**
+ * Invalidates translated code after a store.
+ *
+ * Called by mem_write on every store. Stores by VMs that never ran under the
+ * JIT and to pages without translated code only cost a table lookup; stores
+ * into a code page drop the blocks on that page so they are retranslated
+ * from the new contents.
+ *
+ * @param vm The VM that was written to.
+ * @param address The memory address that was written.
+ */
+static inline void jit_invalidate(const vm_t* vm, uint16_t address) {
+  uint16_t page = (uint16_t)(address >> JIT_PAGE_SHIFT);
+  if (vm->uses_jit && jit_code_pages[page]) {
+    jit_flush_page(page);
+  }
+}
+
+/**
+ * Drops all translated code and resets the hot-spot counters.
+ *
+ * Also detaches the JIT from the VM it was translating for, so the next
+ * run_jit call may target any VM.
+ */
+void jit_reset(void);
+
+/**
+ * Returns the number of basic blocks translated since the last reset.
+ *
+ * @return The number of translations, including ones later invalidated.
+ */
+uint64_t jit_translations(void);
+
+/**
+ * Returns how much of the code buffer the live translations take.
+ *
+ * @return The bytes used, at most JIT_BUFFER_SIZE. Drops back to 0 when
+ *         the buffer fills and all blocks are dropped.
+ */
+size_t jit_code_bytes(void);
+
+/**
+ * Runs the fetch-decode-execute loop with the basic-block JIT.
+ *
+ * Equivalent to run_instructions. Block entry addresses are interpreted with
+ * run_predecoded until they become hot, then the straight-line run of
+ * instructions up to the next branch is translated to x86-64 with R0-R7
+ * pinned in host registers. Condition codes are only computed when a BR in
+ * the block consumes them and when the block exits. Traps end a block and
+ * run in the interpreter; loads from and stores to device registers call
+ * back into mem_read and mem_write.
+ *
+ * The translation cache is process-wide and holds code for one VM at a time:
+ * running a different VM drops it first, and only one thread may use the
+ * JIT. On hosts other than x86-64 Linux this falls back to run_predecoded.
+ *
+ * @param vm The VM to run.
+ * @param budget The maximum number of instructions to execute.
+ * @param running An int pointer representing the status of the running loop.
+ *
+ * @return The number of instructions retired, at most budget.
+ */
+uint64_t run_jit(vm_t* vm, uint64_t budget, int* running);
@@ -0,0 +1,69 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aot.h"
+#include "memory.h"
+#include "utils.h"
+
+// NOLINTNEXTLINE(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define HEX 16
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+static aot_image_t image;
+static uint8_t reachable[MEMORY_MAX + 1];
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+static noreturn void usage(void) {
+  // NOLINTNEXTLINE(cert-err33-c)
+  fprintf(stderr,
+          "usage: lc3aot [-e entry] -o output.c image.obj [image.obj ...]\n"
+          "  entry defaults to the origin of the first image (hex)\n");
+  // NOLINTNEXTLINE(concurrency-mt-unsafe)
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, const char* argv[]) {
+  const char* output_path = NULL;
+  const char* entry_arg = NULL;
+  int have_entry = 0;
+  uint16_t entry = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      output_path = argv[++i];
+    } else if (!strcmp(argv[i], "-e") && i + 1 < argc) {
+      entry_arg = argv[++i];
+    } else if (argv[i][0] == '-') {
+      usage();
+    } else {
+      uint16_t origin = aot_load_obj(&image, argv[i]);
+      if (!have_entry) {
+        entry = origin;
+        have_entry = 1;
+      }
+    }
+  }
+  if (!output_path || !have_entry) {
+    usage();
+  }
+  if (entry_arg) {
+    entry = (uint16_t)strtoul(entry_arg, NULL, HEX);
+  }
+
+  aot_mark_reachable(&image, entry, reachable);
+
+  FILE* out = fopen(output_path, "we");
+  if (!out) {
+    error_and_exit("Failed to open output file");
+  }
+  aot_emit_program(out, &image, reachable, entry);
+  if (ferror(out)) {
+    error_and_exit("Failed to write output file");
+  }
+  if (fclose(out) != 0) {
+    error_and_exit("Failed to close output file");
+  }
+  return 0;
+}
@@ -0,0 +1,115 @@
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "utils.h"
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define DECIMAL 10
+#define DEFAULT_BUDGET 100000000ULL
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+static noreturn void usage(void) {
+  // NOLINTNEXTLINE(cert-err33-c)
+  fprintf(stderr,
+          "usage: lc3batch [-j threads] [-n max-instructions] [-o outdir] "
+          "list\n"
+          "  list has one 'image.obj [input-script]' per line, - for stdin\n"
+          "  threads defaults to the number of online CPUs\n"
+          "  max-instructions is per job and defaults to %llu\n"
+          "  outdir receives each job's console output as <n>.out, where n\n"
+          "  counts the jobs from 0, skipping comments and blank lines\n",
+          DEFAULT_BUDGET);
+  // NOLINTNEXTLINE(concurrency-mt-unsafe)
+  exit(EXIT_FAILURE);
+}
+
+static unsigned long long parse_count(const char* arg) {
+  char* end = NULL;
+  unsigned long long value = strtoull(arg, &end, DECIMAL);
+  if (*arg == '\0' || *end != '\0' || value == 0) {
+    usage();
+  }
+  return value;
+}
+
+static void write_outputs(const char* dir, const batch_job_t* jobs,
+                          size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    char path[PATH_MAX];
+    // NOLINTNEXTLINE(cert-err33-c)
+    snprintf(path, sizeof(path), "%s/%zu.out", dir, i);
+    FILE* out = fopen(path, "we");
+    if (!out) {
+      error_and_exit("Failed to open job output file");
+    }
+    if (jobs[i].output_len &&
+        fwrite(jobs[i].output, 1, jobs[i].output_len, out) !=
+            jobs[i].output_len) {
+      error_and_exit("Failed to write job output file");
+    }
+    if (fclose(out) != 0) {
+      error_and_exit("Failed to close job output file");
+    }
+  }
+}
+
+int main(int argc, const char* argv[]) {
+  const char* list_path = NULL;
+  const char* output_dir = NULL;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  unsigned long long threads = cpus > 0 ? (unsigned long long)cpus : 1;
+  unsigned long long budget = DEFAULT_BUDGET;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+      threads = parse_count(argv[++i]);
+    } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+      budget = parse_count(argv[++i]);
+    } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      output_dir = argv[++i];
+    } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+      usage();
+    } else if (!list_path) {
+      list_path = argv[i];
+    } else {
+      usage();
+    }
+  }
+  if (!list_path || threads > UINT_MAX) {
+    usage();
+  }
+
+  FILE* list = strcmp(list_path, "-") ? fopen(list_path, "re") : stdin;
+  if (!list) {
+    error_and_exit("Failed to open job list");
+  }
+  size_t count = 0;
+  batch_job_t* jobs = batch_read_jobs(list, &count);
+  if (list != stdin && fclose(list) != 0) {
+    error_and_exit("Failed to close job list");
+  }
+
+  // NOLINTNEXTLINE(cert-err33-c)
+  signal(SIGINT, handle_interrupt);
+  double start = monotonic_seconds();
+  unsigned used = batch_run(jobs, count, (unsigned)threads, budget);
+  double elapsed = monotonic_seconds() - start;
+
+  if (output_dir) {
+    write_outputs(output_dir, jobs, count);
+  }
+  batch_report(stdout, jobs, count, used, elapsed);
+
+  int failed = 0;
+  for (size_t i = 0; i < count; ++i) {
+    failed |= jobs[i].status == BATCH_LOAD_FAILED;
+  }
+  batch_free_jobs(jobs, count);
+  return failed ? EXIT_FAILURE : 0;
+}
@@ -6,42 +6,356 @@
 #include <SDL2/SDL_stdinc.h>
 #include <SDL2/SDL_timer.h>
 #include <SDL2/SDL_video.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "audio.h"
-#include "instructions.h"
+#include "bank.h"
+#include "cache.h"
+#include "fusion.h"
+#include "interpreter.h"
+#include "jit.h"
 #include "memory.h"
-#include "trapping.h"
+#include "predecode.h"
+#include "profiler.h"
+#include "recorder.h"
+#include "render.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "threaded.h"
 #include "utils.h"
+#include "video.h"
+#include "voice.h"
+#include "vm.h"
 
 // NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
 #define PC_START 0x1000
 #define WINDOW_SIZE 1024
-#define MEMORY_MAP_DIM 256
-#define OPCODE_SHIFT (uint16_t)12
-#define FIRST_8BIT_MASK (uint16_t)0xFF
+#define DEFAULT_SLICE 4096U
+#define DECIMAL 10
+#define MEGA 1e6
+#define PROFILE_TOP 10
+#define PROFILE_INTERVAL 1000U
 // NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
 
-int main(int argc, const char* argv[]) {
-  Uint32 last_frame_time = 0;
-  const Uint32 frame_delay = 1000 / 60;  // 60 FPS
+// Dispatch engines selectable with --engine, all with the same contract
+typedef uint64_t (*engine_fn)(vm_t* vm, uint64_t budget, int* running);
+
+typedef struct {
+  const char* name;
+  engine_fn run;
+} engine_t;
+
+static const engine_t engines[] = {
+    {"switch", run_instructions},   /* reference switch interpreter */
+    {"threaded", run_threaded},     /* direct-threaded dispatch */
+    {"predecoded", run_predecoded}, /* threaded over the predecode cache */
+    {"jit", run_jit},               /* x86-64 basic-block JIT */
+};
+
+// Command line options
+typedef struct {
+  const engine_t* engine;
+  int headless;              /* never initialize SDL video or audio */
+  uint64_t slice;            /* instructions between event/frame servicing */
+  uint64_t max_instructions; /* stop after this many instructions, 0 = never */
+  int profile_fusion;        /* count instruction pairs/triples */
+  int profile_pc;            /* sample the PC and the guest call stack */
+  uint64_t profile_interval; /* instructions between PC samples */
+  uint32_t profile_hz;       /* sample on a CPU timer instead, 0 = never */
+  const char* symbols_path;  /* lc3as .sym file naming guest addresses */
+  const char* folded_path;   /* write folded call stacks to this file */
+  palette_id_t palette;      /* colors of the memory map */
+  int stream;                /* play the whole track through the bank window */
+  int dma;                   /* play with audio DMA instead of sample stores */
+  const char* render_path;   /* write the audio to this WAV file, no SDL */
+  uint64_t render_seconds;   /* audio to render, 0 = one pass of the track */
+  const char* video_path;    /* export the memory map to this file, no SDL */
+  uint64_t video_interval;   /* instructions between exported frames */
+  uint64_t video_frames;     /* frames to export, 0 = until the VM halts */
+  int stats;                 /* print the counters when the VM stops */
+  const char* stats_json;    /* also write them to this JSON file */
+  const char* image_path;
+} options_t;
+
+static noreturn void usage(void) {
+  // NOLINTNEXTLINE(cert-err33-c)
+  fprintf(stderr,
+          "usage: pVMpkin [--headless] [--engine NAME] [--slice N] "
+          "[--max-instructions N] [--profile-fusion] [--profile N] "
+          "[--profile-hz HZ] [--symbols FILE.sym] [--profile-folded FILE] "
+          "[--no-fast-forward] "
+          "[--palette NAME] [--no-cache] [--cache-dir DIR] [--stream] [--dma] "
+          "[--render FILE.wav] [--render-seconds N] "
+          "[--video FILE.y4m|.png|.rgba] [--video-interval N] "
+          "[--video-frames N] [--stats] [--stats-json FILE] "
+          "[audio-file | image.obj]\n"
+          "engines: switch, threaded, predecoded (default), jit\n"
+          "palettes: classic (default), gray, heat, phosphor\n");
+  // NOLINTNEXTLINE(concurrency-mt-unsafe)
+  exit(EXIT_FAILURE);
+}
 
-  if (argc < 2) {
-    /* show instructions on how to use */
-    error_and_exit("main [audio-file1] ...\n");
+static uint64_t parse_count(const char* text) {
+  char* end = NULL;
+  uint64_t count = strtoull(text, &end, DECIMAL);
+  if (end == text || *end != '\0') {
+    usage();
   }
+  return count;
+}
 
-  audio_init();
+static const engine_t* parse_engine(const char* name) {
+  for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); ++i) {
+    if (!strcmp(name, engines[i].name)) {
+      return &engines[i];
+    }
+  }
+  usage();
+}
 
-  if (!read_image("../player.obj")) {
-    error_and_exit("Failed to load audio player\n");
+static options_t parse_options(int argc, const char* argv[]) {
+  /* predecoded dispatch by default, the switch stays as the reference */
+  options_t opts = {&engines[2], 0, DEFAULT_SLICE, 0, 0, 0, PROFILE_INTERVAL,
+                    0, NULL, NULL, PALETTE_CLASSIC, 0, 0, NULL, 0, NULL,
+                    VIDEO_DEFAULT_INTERVAL, VIDEO_DEFAULT_FRAMES, 0, NULL,
+                    NULL};
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--headless")) {
+      opts.headless = 1;
+    } else if (!strcmp(argv[i], "--engine") && i + 1 < argc) {
+      opts.engine = parse_engine(argv[++i]);
+    } else if (!strcmp(argv[i], "--slice") && i + 1 < argc) {
+      opts.slice = parse_count(argv[++i]);
+    } else if (!strcmp(argv[i], "--max-instructions") && i + 1 < argc) {
+      opts.max_instructions = parse_count(argv[++i]);
+    } else if (!strcmp(argv[i], "--profile-fusion")) {
+      opts.profile_fusion = 1;
+    } else if (!strcmp(argv[i], "--profile") && i + 1 < argc) {
+      opts.profile_pc = 1;
+      opts.profile_interval = parse_count(argv[++i]);
+    } else if (!strcmp(argv[i], "--profile-hz") && i + 1 < argc) {
+      opts.profile_pc = 1;
+      opts.profile_hz = (uint32_t)parse_count(argv[++i]);
+    } else if (!strcmp(argv[i], "--symbols") && i + 1 < argc) {
+      opts.symbols_path = argv[++i];
+    } else if (!strcmp(argv[i], "--profile-folded") && i + 1 < argc) {
+      opts.profile_pc = 1;
+      opts.folded_path = argv[++i];
+    } else if (!strcmp(argv[i], "--no-fast-forward")) {
+      fast_forward_enabled = 0;
+    } else if (!strcmp(argv[i], "--no-cache")) {
+      cache_enabled = 0;
+    } else if (!strcmp(argv[i], "--cache-dir") && i + 1 < argc) {
+      cache_dir_override = argv[++i];
+    } else if (!strcmp(argv[i], "--stream")) {
+      opts.stream = 1;
+    } else if (!strcmp(argv[i], "--dma")) {
+      opts.dma = 1;
+    } else if (!strcmp(argv[i], "--render") && i + 1 < argc) {
+      /* rendering never touches SDL, so it runs like a headless run */
+      opts.render_path = argv[++i];
+      opts.headless = 1;
+    } else if (!strcmp(argv[i], "--render-seconds") && i + 1 < argc) {
+      opts.render_seconds = parse_count(argv[++i]);
+    } else if (!strcmp(argv[i], "--video") && i + 1 < argc) {
+      opts.video_path = argv[++i];
+      opts.headless = 1;
+    } else if (!strcmp(argv[i], "--video-interval") && i + 1 < argc) {
+      opts.video_interval = parse_count(argv[++i]);
+    } else if (!strcmp(argv[i], "--video-frames") && i + 1 < argc) {
+      opts.video_frames = parse_count(argv[++i]);
+    } else if (!strcmp(argv[i], "--stats")) {
+      opts.stats = 1;
+    } else if (!strcmp(argv[i], "--stats-json") && i + 1 < argc) {
+      opts.stats_json = argv[++i];
+    } else if (!strcmp(argv[i], "--palette") && i + 1 < argc) {
+      if (!palette_parse(argv[++i], &opts.palette)) {
+        usage();
+      }
+    } else if (argv[i][0] == '-' || opts.image_path) {
+      usage();
+    } else {
+      opts.image_path = argv[i];
+    }
   }
 
-  if (!read_image(argv[1])) {
-    error_and_exit("Failed to load audio\n");
+  if (!opts.image_path || opts.slice == 0 || opts.video_interval == 0 ||
+      opts.profile_interval == 0 || (opts.profile_pc && opts.profile_fusion)) {
+    usage();
+  }
+  return opts;
+}
+
+static const char* engine_name(const options_t* opts) {
+  if (opts->profile_fusion) {
+    return "fusion-profile";
+  }
+  return opts->profile_pc ? "pc-profile" : opts->engine->name;
+}
+
+static void report_throughput(const options_t* opts, const vm_t* vm,
+                              uint64_t retired, double elapsed) {
+  double mips = elapsed > 0 ? (double)retired / elapsed / MEGA : 0;
+  // NOLINTNEXTLINE(cert-err33-c)
+  fprintf(stderr, "\n%s/%s: %llu instructions in %.3f s (%.2f MIPS)\n",
+          opts->headless ? "headless" : "windowed",
+          engine_name(opts),
+          (unsigned long long)retired, elapsed, mips);
+  if (vm->fast_forward_cycles) {
+    // NOLINTNEXTLINE(cert-err33-c)
+    fprintf(stderr, "%llu of them fast-forwarded through delay loops\n",
+            (unsigned long long)vm->fast_forward_cycles);
+  }
+  cache_stats_t cache = cache_get_stats();
+  if (cache.hits || cache.misses) {
+    // NOLINTNEXTLINE(cert-err33-c)
+    fprintf(stderr, "audio cache: %llu hits, %llu misses, %llu evictions\n",
+            (unsigned long long)cache.hits, (unsigned long long)cache.misses,
+            (unsigned long long)cache.evictions);
+  }
+  if (vm->bank) {
+    // NOLINTNEXTLINE(cert-err33-c)
+    fprintf(stderr, "audio stream: %u banks, %llu switches\n",
+            (unsigned)vm->bank->count,
+            (unsigned long long)vm->bank->switches);
+  }
+  if (!opts->headless) {
+    audio_stats_t audio = audio_get_stats();
+    // NOLINTNEXTLINE(cert-err33-c)
+    fprintf(stderr,
+            "audio: %llu underruns, %llu overruns, %llu parks, %zu buffered\n",
+            (unsigned long long)audio.underruns,
+            (unsigned long long)audio.overruns,
+            (unsigned long long)audio.parks, audio.buffered);
+    for (uint16_t i = 0; i < VOICE_COUNT; ++i) {
+      voice_stats_t voice = audio_voice_stats(i);
+      if (!voice.triggers) {
+        continue;
+      }
+      double per_sample =
+          voice.samples ? (double)voice.nanoseconds / (double)voice.samples
+                        : 0;
+      // NOLINTNEXTLINE(cert-err33-c)
+      fprintf(stderr,
+              "voice %u: %llu triggers, %llu samples mixed in %.3f ms "
+              "(%.1f ns/sample)\n",
+              (unsigned)i, (unsigned long long)voice.triggers,
+              (unsigned long long)voice.samples,
+              (double)voice.nanoseconds / MEGA, per_sample);
+    }
   }
+}
+
+/* Runs at most slice instructions, clamped to the remaining budget. */
+static uint64_t run_slice(const options_t* opts, vm_t* vm, uint64_t retired,
+                          uint64_t slice) {
+  uint64_t budget = slice;
+  if (opts->max_instructions) {
+    uint64_t remaining = opts->max_instructions - retired;
+    if (remaining < budget) {
+      budget = remaining;
+    }
+    if (remaining == 0) {
+      vm->running = 0;
+    }
+  }
+  if (opts->profile_fusion) {
+    return run_fusion_profile(vm, budget, &vm->running);
+  }
+  if (opts->profile_pc) {
+    return run_pc_profile(vm, budget, &vm->running);
+  }
+  return opts->engine->run(vm, budget, &vm->running);
+}
+
+static uint64_t run_headless(const options_t* opts, vm_t* vm) {
+  uint64_t retired = 0;
+
+  while (vm->running && !interrupt_requested) {
+    retired += run_slice(opts, vm, retired, opts->slice);
+  }
+  return retired;
+}
+
+// Where an offline run sends the audio and the memory map, either may be NULL
+typedef struct {
+  const recorder_t* recorder;
+  video_t* video;
+  uint64_t frames; /* captured so far */
+} exports_t;
+
+static int exports_done(const options_t* opts, const exports_t* exports) {
+  return (!exports->recorder || recorder_done(exports->recorder)) &&
+         (!exports->video ||
+          (opts->video_frames && exports->frames >= opts->video_frames));
+}
+
+/* Runs without SDL until the VM halts or every export has what it wants,
+   capturing a frame after every video_interval instructions. */
+static uint64_t run_offline(const options_t* opts, vm_t* vm,
+                            exports_t* exports) {
+  uint64_t retired = 0;
+  uint64_t next_frame = opts->video_interval;
+
+  while (vm->running && !interrupt_requested &&
+         !exports_done(opts, exports)) {
+    uint64_t slice = opts->slice;
+    if (exports->video && next_frame - retired < slice) {
+      slice = next_frame - retired;
+    }
+    retired += run_slice(opts, vm, retired, slice);
+    if (exports->video && retired == next_frame) {
+      video_capture(exports->video, vm);
+      STATS_ADD(vm, frames, 1);
+      ++exports->frames;
+      next_frame += opts->video_interval;
+    }
+  }
+  return retired;
+}
+
+// Shared by the VM thread and the render thread of a windowed run
+typedef struct {
+  const options_t* opts;
+  vm_t* vm;
+  snapshot_t* snapshot;
+  atomic_int stop; /* set by the render thread when the window closes */
+  uint64_t retired;
+} vm_thread_t;
+
+/* Runs the VM, publishing its memory at frame boundaries between slices. */
+static void* run_vm_thread(void* arg) {
+  vm_thread_t* ctx = arg;
+  Uint32 last_frame_time = 0;
+  const Uint32 frame_delay = 1000 / 60;  // 60 FPS
+
+  while (ctx->vm->running && !interrupt_requested && !atomic_load(&ctx->stop)) {
+    /* the hot loop runs a whole slice without touching SDL */
+    ctx->retired +=
+        run_slice(ctx->opts, ctx->vm, ctx->retired, ctx->opts->slice);
+
+    Uint32 current_time = SDL_GetTicks();
+    /* a skipped publish keeps its dirty pages and is retried next slice */
+    if (current_time - last_frame_time >= frame_delay &&
+        snapshot_publish(ctx->snapshot, ctx->vm)) {
+      STATS_ADD(ctx->vm, frames, 1);
+      last_frame_time = current_time;
+    }
+  }
+  snapshot_publish(ctx->snapshot, ctx->vm);
+  snapshot_close(ctx->snapshot);
+  return NULL;
+}
+
+static uint64_t run_windowed(const options_t* opts, vm_t* vm) {
+  const Uint32 frame_delay = 1000 / 60;  // 60 FPS
 
   if (SDL_Init(SDL_INIT_VIDEO) != 0) {
     error_and_exit("Failed to inialize SDL\n");
@@ -58,121 +372,178 @@ int main(int argc, const char* argv[]) {
                         SDL_PIXELFORMAT_RGBA8888,     // 32-bit texture
                         SDL_TEXTUREACCESS_STREAMING,  // update every frame
                         MEMORY_MAP_DIM, MEMORY_MAP_DIM);
+  palette_t palette;
+  palette_init(&palette, opts->palette);
+  /* the last uploaded frame, so clean rows never need converting again */
+  uint32_t* pixels = calloc(MEMORY_MAP_DIM * MEMORY_MAP_DIM, sizeof(uint32_t));
+  /* the memory the render thread draws from, updated from snapshots */
+  mem_view_t* view = calloc(1, sizeof(mem_view_t));
+  if (!pixels || !view) {
+    error_and_exit("Failed to allocate memory map\n");
+  }
+  int exposed = 1; /* the window needs presenting even if memory is clean */
 
-  disable_input_buffering();
-
-  /* since one condition flag should be set at all times, set the Z flag*/
-  reg[R_COND] = FL_ZRO;
-
-  /* set the PC to starting position (0x3000 is default)*/
-  reg[R_PC] = PC_START;
-
-  int running = 1;
-
-  while (running) {
-    uint32_t instr = mem_read(reg[R_PC]++);
-    uint16_t opcode = (uint16_t)instr >> OPCODE_SHIFT;
+  /* SDL wants video on the thread that initialized it, so this thread
+     renders and the VM moves to its own thread */
+  vm_thread_t ctx = {opts, vm, snapshot_create(), 0, 0};
+  pthread_t vm_thread;
+  if (pthread_create(&vm_thread, NULL, run_vm_thread, &ctx) != 0) {
+    error_and_exit("Failed to start VM thread\n");
+  }
 
-    /* TODO: Implement Memory Map */
+  while (!snapshot_closed(ctx.snapshot)) {
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
       if (event.type == SDL_QUIT) {
-        SDL_DestroyRenderer(renderer);
-        SDL_DestroyWindow(window);
-        SDL_Quit();
-        restore_input_buffering();
-        audio_close();
-        printf("Exited Gracefully\n");
-        // NOLINTNEXTLINE(concurrency-mt-unsafe)
-        exit(0);
+        atomic_store(&ctx.stop, 1);
+      } else if (event.type == SDL_WINDOWEVENT) {
+        exposed = 1;
       }
     }
-    Uint32 current_time = SDL_GetTicks();
 
-    if (current_time - last_frame_time >= frame_delay) {  // 60 FPS
-      /* update the frame */
-      update_texture(texture);
+    /* waits at most a frame, so events are still serviced while idle */
+    snapshot_take(ctx.snapshot, view, frame_delay);
+    /* update the frame, skipping it entirely if nothing changed */
+    if (update_texture(view->memory, view->dirty_pages, texture, pixels,
+                       &palette) ||
+        exposed) {
       SDL_RenderClear(renderer);
 
       SDL_Rect dest_rect = {0, 0, WINDOW_SIZE, WINDOW_SIZE};
       SDL_RenderCopy(renderer, texture, NULL, &dest_rect);
       SDL_RenderPresent(renderer);
-      last_frame_time = current_time;
+      exposed = 0;
     }
+  }
+  pthread_join(vm_thread, NULL);
+
+  snapshot_destroy(ctx.snapshot);
+  free(view);
+  free(pixels);
+  SDL_DestroyTexture(texture);
+  SDL_DestroyRenderer(renderer);
+  SDL_DestroyWindow(window);
+  return ctx.retired;
+}
+
+int main(int argc, const char* argv[]) {
+  options_t opts = parse_options(argc, argv);
 
-    switch (opcode) {
-      case OP_ADD:
-        add_instr(instr);
-        break;
-      case OP_AND:
-        and_instr(instr);
-        break;
-      case OP_NOT:
-        not_instr(instr);
-        break;
-      case OP_BR:
-        branch_instr(instr);
-        break;
-      case OP_JMP:
-        jump_instr(instr);
-        break;
-      case OP_JSR:
-        jump_register_instr(instr);
-        break;
-      case OP_LD:
-        load_instr(instr);
-        break;
-      case OP_LDI:
-        ldi_instr(instr);
-        break;
-      case OP_LDR:
-        load_reg_instr(instr);
-        break;
-      case OP_LEA:
-        load_eff_addr_instr(instr);
-        break;
-      case OP_ST:
-        store_instr(instr);
-        break;
-      case OP_STI:
-        store_indirect_instr(instr);
-        break;
-      case OP_STR:
-        store_reg_instr(instr);
-        break;
-      case OP_TRAP:
-        reg[R_R7] = reg[R_PC];
-
-        switch (instr & FIRST_8BIT_MASK) {
-          case TRAP_GETC:
-            trap_getc();
-            break;
-          case TRAP_OUT:
-            trap_out();
-            break;
-          case TRAP_PUTS:
-            trap_puts();
-            break;
-          case TRAP_IN:
-            trap_in();
-            break;
-          case TRAP_PUTSP:
-            trap_putsp();
-            break;
-          case TRAP_HALT:
-            trap_halt(&running);
-            break;
-          default:
-            printf("Unknown trapcode\n");
-            running = 0;
-            break;
-        }
-        break;
-
-      default:
-        printf("Unknown opcode: 0x%X\n", opcode);
-        running = 0;
-        break;
+  if (!opts.headless) {
+    audio_init();
+  }
+
+  recorder_t* recorder = NULL;
+  vm_io_t render_io;
+  if (opts.render_path) {
+    recorder = recorder_open(opts.render_path, AUDIO_FREQUENCY, 0);
+    if (!recorder) {
+      error_and_exit("Failed to create the WAV file\n");
     }
+    render_io = recorder_io(recorder);
+  }
+
+  vm_t* vm = vm_create(recorder ? &render_io : NULL);
+  /* the DMA player plays five-second clips and streams alike */
+  const char* player = opts.dma      ? "../player_dma.obj"
+                       : opts.stream ? "../player_stream.obj"
+                                     : "../player.obj";
+  if (!vm_load_image(vm, player)) {
+    error_and_exit("Failed to load audio player\n");
+  }
+
+  if (opts.stream ? !read_audio_stream(vm, opts.image_path)
+                  : !vm_load_image(vm, opts.image_path)) {
+    error_and_exit("Failed to load audio\n");
+  }
+
+  if (recorder) {
+    /* the players loop forever, so by default stop after one pass */
+    recorder->limit = opts.render_seconds
+                          ? opts.render_seconds * AUDIO_FREQUENCY
+                          : recorder_pass_samples(vm);
+  }
+
+  // NOLINTNEXTLINE(cert-err33-c)
+  signal(SIGINT, handle_interrupt);
+  disable_input_buffering();
+
+  /* set the PC to starting position (0x3000 is default)*/
+  vm->reg[R_PC] = PC_START;
+
+  exports_t exports = {recorder, NULL, 0};
+  if (opts.video_path) {
+    exports.video = video_open(opts.video_path, opts.palette);
+    if (!exports.video) {
+      error_and_exit("Failed to create the video file\n");
+    }
+  }
+
+  if (opts.symbols_path && profiler_load_symbols(opts.symbols_path) < 0) {
+    error_and_exit("Failed to read the symbol file\n");
+  }
+  if (opts.profile_pc) {
+    profiler_start(opts.profile_interval, opts.profile_hz);
+  }
+
+  double start = monotonic_seconds();
+  uint64_t retired = recorder || exports.video
+                         ? run_offline(&opts, vm, &exports)
+                     : opts.headless ? run_headless(&opts, vm)
+                                     : run_windowed(&opts, vm);
+  double elapsed = monotonic_seconds() - start;
+  profiler_stop();
+  report_throughput(&opts, vm, retired, elapsed);
+  if (recorder) {
+    size_t samples = recorder->written + recorder->buffered;
+    double seconds = (double)samples / AUDIO_FREQUENCY;
+    // NOLINTNEXTLINE(cert-err33-c)
+    fprintf(stderr, "render: %zu samples (%.2f s of audio), %.1fx real time\n",
+            samples, seconds, elapsed > 0 ? seconds / elapsed : 0);
+    if (!recorder_close(recorder)) {
+      error_and_exit("Failed to write the WAV file\n");
+    }
+  }
+  if (exports.video) {
+    video_stats_t video;
+    int written = video_close(exports.video, &video);
+    // NOLINTNEXTLINE(cert-err33-c)
+    fprintf(stderr, "video: %llu frames written, %llu dropped\n",
+            (unsigned long long)video.written,
+            (unsigned long long)video.dropped);
+    if (!written) {
+      error_and_exit("Failed to write the video\n");
+    }
+  }
+  if (opts.profile_fusion) {
+    fusion_profile_report(stderr, PROFILE_TOP);
+  }
+  if (opts.profile_pc) {
+    profiler_report(stderr, PROFILE_TOP);
+  }
+  if (opts.folded_path) {
+    FILE* folded = fopen(opts.folded_path, "we");
+    if (!folded || !profiler_write_folded(folded) || fclose(folded) != 0) {
+      error_and_exit("Failed to write the folded stacks\n");
+    }
+  }
+  /* reached on HALT and on SIGINT alike, which only stops the run loops */
+  stats_run_t run = {engine_name(&opts), retired, elapsed};
+  if (opts.stats) {
+    stats_report(stderr, vm, &run);
+  }
+  if (opts.stats_json) {
+    FILE* json = fopen(opts.stats_json, "we");
+    if (!json || !stats_write_json(json, vm, &run) || fclose(json) != 0) {
+      error_and_exit("Failed to write the stats file\n");
+    }
+  }
+
+  restore_input_buffering();
+  vm_destroy(vm);
+  if (!opts.headless) {
+    audio_close();
+    printf("Exited Gracefully\n");
   }
+  return 0;
 }
@@ -1,19 +1,55 @@
 #include "memory.h"
 
+#include <stddef.h>
 #include <stdint.h>
 
-#include "audio.h"
+#include "bank.h"
+#include "dma.h"
+#include "jit.h"
+#include "predecode.h"
+#include "stats.h"
 #include "utils.h"
+#include "voice.h"
 
-// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
-uint16_t memory[MEMORY_MAX];
-
-void mem_write(uint16_t address, uint16_t value) {
+void mem_write(vm_t* vm, uint16_t address, uint16_t value) {
+  STATS_ADD(vm, mem_writes, 1);
+  STATS_ADD(vm, mmio_writes, address >= MR_KBSR);
   if (address == MR_AUDIO_DATA) {
-    audio_output(value);
-  } else {
-    memory[address] = value;
+    STATS_ADD(vm, audio_samples, 1);
+    vm->io.audio_sample(vm->io.ctx, value);
+  } else if (address == MR_DMA_CONTROL) {
+    dma_control(vm, value);
+  } else if (address >= MR_VOICE_BASE && address < MR_VOICE_END) {
+    voice_store(vm, address, value);
+  } else if (address == MR_BANK_SELECT && vm->bank) {
+    bank_select(vm, value);
+  } else if (address != MR_BANK_COUNT || !vm->bank) {
+    /* MR_BANK_COUNT is read-only while a stream is attached */
+    vm->memory[address] = value;
+    vm_mark_dirty(vm, address);
+    predecode_invalidate(vm, address);
+    jit_invalidate(vm, address);
   }
 }
 
-uint16_t mem_read(uint16_t address) { return memory[address]; }
+uint16_t mem_read(vm_t* vm, uint16_t address) {
+  STATS_ADD(vm, mem_reads, 1);
+  STATS_ADD(vm, mmio_reads, address >= MR_KBSR);
+  return vm->memory[address];
+}
+
+void mem_loaded(vm_t* vm, uint16_t origin, size_t count) {
+  if (count == 0) {
+    return;
+  }
+  vm_mark_dirty_range(vm, origin, count);
+  predecode_invalidate_range(vm, origin, count);
+  /* page by page rather than with jit_reset, since a device store may load
+     words in the middle of a translated block */
+  size_t last = (size_t)origin + count - 1;
+  last = last > MEMORY_MAX ? MEMORY_MAX : last;
+  for (size_t page = origin >> JIT_PAGE_SHIFT; page <= last >> JIT_PAGE_SHIFT;
+       ++page) {
+    jit_invalidate(vm, (uint16_t)(page << JIT_PAGE_SHIFT));
+  }
+}
@@ -1,25 +1,28 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
-#include "audio.h"
-
-// NOLINTNEXTLINE(cppcoreguidelines-macro-to-enum,modernize-macro-to-enum)
-#define MEMORY_MAX 0xFFFFU
-
-// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
-extern uint16_t memory[MEMORY_MAX];
+#include "vm.h"
 
 /**
  * Writes a uint16_t value to the specified memory address.
  *
  * This function simulates writing to memory by directly updating the
- * value at the given address in the virtual memory array.
+ * value at the given address in the VM's memory, marks its page dirty for
+ * the renderer, and marks any predecoded instruction or translated block
+ * covering that address stale. Stores to MR_AUDIO_DATA go to the VM's
+ * audio_sample callback instead, stores to MR_DMA_CONTROL start an audio
+ * transfer with dma_control, stores to voice registers go through
+ * voice_store, and while a stream is attached, stores to
+ * MR_BANK_SELECT switch banks with bank_select and stores to MR_BANK_COUNT
+ * are ignored.
  *
+ * @param vm The VM to write to.
  * @param address The memory address to write to.
  * @param value The uint16_t value to store at the memory location.
  */
-void mem_write(uint16_t address, uint16_t value);
+void mem_write(vm_t* vm, uint16_t address, uint16_t value);
 
 /**
  * Reads a uint16_t value from the specified memory address.
@@ -29,7 +32,20 @@ void mem_write(uint16_t address, uint16_t value);
  * high bit of MR_KBSR and stores the character in the keyboard data
  * register (MR_KBDR). Otherwise, it clears the MR_KBSR.
  *
+ * @param vm The VM to read from.
  * @param address The memory address to read from.
  * @return The uint16_t value stored at the specified memory address.
  */
-uint16_t mem_read(uint16_t address);
+uint16_t mem_read(vm_t* vm, uint16_t address);
+
+/**
+ * Marks words stored straight into memory as changed.
+ *
+ * Loaders and devices that fill memory without mem_write call this so the
+ * renderer redraws the words and no engine runs stale decoded code.
+ *
+ * @param vm The VM whose memory changed.
+ * @param origin The first address that was stored.
+ * @param count The number of words stored.
+ */
+void mem_loaded(vm_t* vm, uint16_t origin, size_t count);
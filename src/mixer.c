@@ -0,0 +1,265 @@
+#include "mixer.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+#include "voice.h"
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define FRAC_BITS 16U
+#define FRAC_MASK 0xFFFFU
+#define RATE_TO_STEP 8U /* 8.8 rate register to a 16.16 step */
+#define VOLUME_BITS 8U
+#define NSEC_PER_SEC_D 1e9
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+#include <immintrin.h>
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define SSE2_WORDS 8U
+#define AVX2_WORDS 16U
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+/* Scales 16 samples per step through 32-bit products, returns the samples
+   done. Unpacking and packing both work within 128-bit lanes, so the order
+   comes out unchanged. */
+__attribute__((target("avx2"))) static size_t accumulate_avx2(
+    int16_t* acc, const int16_t* src, size_t count, int16_t volume) {
+  const __m256i scale = _mm256_set1_epi16(volume);
+  size_t done = 0;
+  for (; done + AVX2_WORDS <= count; done += AVX2_WORDS) {
+    __m256i samples =
+        _mm256_loadu_si256((const __m256i*)(const void*)(src + done));
+    __m256i low = _mm256_mullo_epi16(samples, scale);
+    __m256i high = _mm256_mulhi_epi16(samples, scale);
+    __m256i first = _mm256_srai_epi32(_mm256_unpacklo_epi16(low, high),
+                                      VOLUME_BITS);
+    __m256i second = _mm256_srai_epi32(_mm256_unpackhi_epi16(low, high),
+                                       VOLUME_BITS);
+    __m256i scaled = _mm256_packs_epi32(first, second);
+    __m256i* out = (__m256i*)(void*)(acc + done);
+    _mm256_storeu_si256(out,
+                        _mm256_adds_epi16(_mm256_loadu_si256(out), scaled));
+  }
+  return done;
+}
+
+/* The same with 8 samples per step, which SSE2 has on every x86-64. */
+static size_t accumulate_sse2(int16_t* acc, const int16_t* src, size_t count,
+                              int16_t volume) {
+  const __m128i scale = _mm_set1_epi16(volume);
+  size_t done = 0;
+  for (; done + SSE2_WORDS <= count; done += SSE2_WORDS) {
+    __m128i samples =
+        _mm_loadu_si128((const __m128i*)(const void*)(src + done));
+    __m128i low = _mm_mullo_epi16(samples, scale);
+    __m128i high = _mm_mulhi_epi16(samples, scale);
+    __m128i first =
+        _mm_srai_epi32(_mm_unpacklo_epi16(low, high), VOLUME_BITS);
+    __m128i second =
+        _mm_srai_epi32(_mm_unpackhi_epi16(low, high), VOLUME_BITS);
+    __m128i scaled = _mm_packs_epi32(first, second);
+    __m128i* out = (__m128i*)(void*)(acc + done);
+    _mm_storeu_si128(out, _mm_adds_epi16(_mm_loadu_si128(out), scaled));
+  }
+  return done;
+}
+
+#endif
+
+static int16_t saturate16(int32_t value) {
+  return (int16_t)(value < INT16_MIN   ? INT16_MIN
+                   : value > INT16_MAX ? INT16_MAX
+                                       : value);
+}
+
+void mixer_accumulate(int16_t* acc, const int16_t* src, size_t count,
+                      int16_t volume) {
+  size_t done = 0;
+#if defined(__x86_64__) && defined(__GNUC__)
+  if (__builtin_cpu_supports("avx2")) {
+    done = accumulate_avx2(acc, src, count, volume);
+  }
+  done += accumulate_sse2(acc + done, src + done, count - done, volume);
+#endif
+  for (; done < count; ++done) {
+    /* the SIMD paths saturate the scaled sample before adding it */
+    int16_t scaled = saturate16((src[done] * volume) >> VOLUME_BITS);
+    acc[done] = saturate16(acc[done] + scaled);
+  }
+}
+
+static void program_free(voice_program_t* program) {
+  if (program) {
+    free(program->samples);
+    free(program);
+  }
+}
+
+mixer_t* mixer_create(void) {
+  mixer_t* mixer = calloc(1, sizeof(mixer_t));
+  if (!mixer) {
+    error_and_exit("Failed to allocate mixer");
+  }
+  for (size_t i = 0; i < VOICE_COUNT; ++i) {
+    atomic_init(&mixer->voices[i].pending, NULL);
+    atomic_init(&mixer->voices[i].retired, NULL);
+    atomic_init(&mixer->voices[i].triggers, 0);
+    atomic_init(&mixer->voices[i].samples, 0);
+    atomic_init(&mixer->voices[i].nanoseconds, 0);
+  }
+  return mixer;
+}
+
+void mixer_destroy(mixer_t* mixer) {
+  if (!mixer) {
+    return;
+  }
+  for (size_t i = 0; i < VOICE_COUNT; ++i) {
+    voice_t* voice = &mixer->voices[i];
+    program_free(atomic_load(&voice->pending));
+    program_free(atomic_load(&voice->retired));
+    program_free(voice->playing);
+  }
+  free(mixer);
+}
+
+void mixer_voice(mixer_t* mixer, const voice_params_t* params) {
+  voice_t* voice = &mixer->voices[params->voice];
+  program_free(atomic_exchange(&voice->retired, NULL));
+
+  /* a program without samples stops the voice */
+  voice_program_t* program = calloc(1, sizeof(voice_program_t));
+  if (!program) {
+    error_and_exit("Failed to allocate voice");
+  }
+  if ((params->control & VOICE_PLAY) && params->length > 0) {
+    program->samples = malloc(params->length * sizeof(int16_t));
+    if (!program->samples) {
+      error_and_exit("Failed to allocate voice");
+    }
+    memcpy(program->samples, params->samples,
+           params->length * sizeof(int16_t));
+    program->length = params->length;
+    program->step = (uint32_t)params->rate << RATE_TO_STEP;
+    program->volume = (int16_t)(params->volume > INT16_MAX ? INT16_MAX
+                                                           : params->volume);
+    program->loop = (params->control & VOICE_LOOP) != 0;
+  }
+
+  /* a program the audio thread never took is still ours to free */
+  program_free(atomic_exchange(&voice->pending, program));
+  uint64_t triggers = atomic_load_explicit(&voice->triggers,
+                                           memory_order_relaxed);
+  atomic_store_explicit(&voice->triggers, triggers + 1, memory_order_relaxed);
+}
+
+/* Resamples up to count samples of a voice into out by linear
+   interpolation, returns how many before a one-shot buffer ran out. */
+static size_t resample(voice_t* voice, int16_t* out, size_t count) {
+  const voice_program_t* program = voice->playing;
+  uint64_t end = (uint64_t)program->length << FRAC_BITS;
+  size_t made = 0;
+  for (; made < count; ++made) {
+    if (voice->position >= end) {
+      if (!program->loop) {
+        break;
+      }
+      voice->position %= end;
+    }
+    size_t index = (size_t)(voice->position >> FRAC_BITS);
+    int32_t frac = (int32_t)(voice->position & FRAC_MASK);
+    int32_t here = program->samples[index];
+    int32_t next = here;
+    if (index + 1 < program->length) {
+      next = program->samples[index + 1];
+    } else if (program->loop) {
+      next = program->samples[0];
+    }
+    out[made] = (int16_t)(here + (((next - here) * frac) >> FRAC_BITS));
+    voice->position += program->step;
+  }
+  return made;
+}
+
+/* Mixes one voice onto out, returns how many samples it covered. */
+static size_t mix_voice(mixer_t* mixer, voice_t* voice, int16_t* out,
+                        size_t count) {
+  const voice_program_t* program = voice->playing;
+  uint64_t end = (uint64_t)program->length << FRAC_BITS;
+  size_t done = 0;
+  while (done < count) {
+    size_t run = 0;
+    if (program->step == 1U << FRAC_BITS &&
+        (voice->position & FRAC_MASK) == 0 &&
+        (voice->position < end || program->loop)) {
+      /* at the output rate the buffer is added in place */
+      voice->position %= end;
+      size_t index = (size_t)(voice->position >> FRAC_BITS);
+      run = program->length - index;
+      run = run < count - done ? run : count - done;
+      mixer_accumulate(out + done, program->samples + index, run,
+                       program->volume);
+      voice->position += (uint64_t)run << FRAC_BITS;
+    } else {
+      size_t want = count - done < MIXER_CHUNK ? count - done : MIXER_CHUNK;
+      run = resample(voice, mixer->scratch, want);
+      mixer_accumulate(out + done, mixer->scratch, run, program->volume);
+    }
+    if (run == 0) {
+      break;
+    }
+    done += run;
+  }
+  return done;
+}
+
+void mixer_mix(mixer_t* mixer, uint16_t* out, size_t count) {
+  for (size_t i = 0; i < VOICE_COUNT; ++i) {
+    voice_t* voice = &mixer->voices[i];
+    /* take a new program only once the VM thread freed the last old one */
+    if (!atomic_load(&voice->retired)) {
+      voice_program_t* next = atomic_exchange(&voice->pending, NULL);
+      if (next) {
+        atomic_store(&voice->retired, voice->playing);
+        voice->playing = next;
+        voice->position = 0;
+      }
+    }
+    const voice_program_t* program = voice->playing;
+    if (!program || program->length == 0 || program->step == 0 ||
+        (!program->loop &&
+         voice->position >= (uint64_t)program->length << FRAC_BITS)) {
+      continue;
+    }
+
+    double start = monotonic_seconds();
+    size_t mixed = mix_voice(mixer, voice, (int16_t*)out, count);
+    uint64_t elapsed =
+        (uint64_t)((monotonic_seconds() - start) * NSEC_PER_SEC_D);
+    uint64_t samples =
+        atomic_load_explicit(&voice->samples, memory_order_relaxed);
+    atomic_store_explicit(&voice->samples, samples + mixed,
+                          memory_order_relaxed);
+    uint64_t nanoseconds =
+        atomic_load_explicit(&voice->nanoseconds, memory_order_relaxed);
+    atomic_store_explicit(&voice->nanoseconds, nanoseconds + elapsed,
+                          memory_order_relaxed);
+  }
+}
+
+voice_stats_t mixer_voice_stats(mixer_t* mixer, uint16_t voice) {
+  voice_t* source = &mixer->voices[voice];
+  voice_stats_t stats = {
+      atomic_load_explicit(&source->triggers, memory_order_relaxed),
+      atomic_load_explicit(&source->samples, memory_order_relaxed),
+      atomic_load_explicit(&source->nanoseconds, memory_order_relaxed),
+  };
+  return stats;
+}
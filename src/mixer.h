@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "voice.h"
+
+// NOLINTNEXTLINE(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MIXER_CHUNK 512U /* samples resampled per pass of the kernel */
+
+// A buffer a voice plays, owned by whichever thread holds it
+typedef struct {
+  int16_t* samples;
+  size_t length;
+  uint32_t step;  /* 16.16 buffer samples per output sample */
+  int16_t volume; /* 8.8 fixed point */
+  int loop;
+} voice_program_t;
+
+// One voice. The VM thread publishes a new program in pending, and the audio
+// thread swaps it in at the start of its next callback and hands the old one
+// back in retired for the VM thread to free, so neither side ever waits or
+// frees memory the other may be reading.
+typedef struct {
+  _Atomic(voice_program_t*) pending;
+  _Atomic(voice_program_t*) retired;
+  voice_program_t* playing; /* audio thread only */
+  uint64_t position;        /* 16.16 into the buffer, audio thread only */
+  _Atomic uint64_t triggers;
+  _Atomic uint64_t samples;
+  _Atomic uint64_t nanoseconds;
+} voice_t;
+
+// Mixes the voices onto the sample stream inside the audio callback
+typedef struct {
+  voice_t voices[VOICE_COUNT];
+  int16_t scratch[MIXER_CHUNK]; /* a resampled run of one voice */
+} mixer_t;
+
+// What a voice has cost so far
+typedef struct {
+  uint64_t triggers;    /* stores to its control register */
+  uint64_t samples;     /* output samples it was mixed into */
+  uint64_t nanoseconds; /* audio thread time spent mixing it */
+} voice_stats_t;
+
+/**
+ * Creates a mixer with every voice silent.
+ *
+ * @return The new mixer, exits the program if it cannot be allocated.
+ */
+mixer_t* mixer_create(void);
+
+/**
+ * Frees a mixer and the buffers of its voices, once mixer_mix cannot run.
+ *
+ * @param mixer The mixer to free, may be NULL.
+ */
+void mixer_destroy(mixer_t* mixer);
+
+/**
+ * Starts or stops a voice, from the VM thread.
+ *
+ * The buffer is copied, so the guest may overwrite it right away. The audio
+ * thread picks the change up at its next mixer_mix call.
+ *
+ * @param mixer The mixer.
+ * @param params The voice and its buffer and settings.
+ */
+void mixer_voice(mixer_t* mixer, const voice_params_t* params);
+
+/**
+ * Adds every playing voice to a run of samples, from the audio thread.
+ *
+ * Samples are signed 16-bit words. Each voice is resampled by linear
+ * interpolation at its rate, scaled by its volume and added with
+ * saturation. Voices playing at rate 0x100 are added straight from their
+ * buffers.
+ *
+ * @param mixer The mixer.
+ * @param out The samples to mix onto.
+ * @param count The number of samples.
+ */
+void mixer_mix(mixer_t* mixer, uint16_t* out, size_t count);
+
+/**
+ * Adds src scaled by an 8.8 volume to acc, saturating to 16 bits.
+ *
+ * Uses AVX2 or SSE2 when the CPU has them and a scalar loop otherwise; all
+ * three give the same result.
+ *
+ * @param acc The samples to add to.
+ * @param src The samples to add.
+ * @param count The number of samples.
+ * @param volume The scale, 0x100 for unity.
+ */
+void mixer_accumulate(int16_t* acc, const int16_t* src, size_t count,
+                      int16_t volume);
+
+/**
+ * Returns the cost of a voice so far, from any thread.
+ *
+ * @param mixer The mixer.
+ * @param voice The voice, below VOICE_COUNT.
+ *
+ * @return The voice's counters.
+ */
+voice_stats_t mixer_voice_stats(mixer_t* mixer, uint16_t voice);
@@ -0,0 +1,344 @@
+#include "predecode.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "fusion.h"
+#include "instructions.h"
+#include "interpreter.h"
+#include "memory.h"
+#include "stats.h"
+#include "utils.h"
+#include "vm.h"
+
+void predecode_invalidate_range(vm_t* vm, uint16_t origin, size_t count) {
+  /* fused records starting just before origin cover it as well */
+  size_t first = origin < MAX_FUSED_LEN ? 0 : origin - (MAX_FUSED_LEN - 1);
+  for (size_t i = first; i < (size_t)origin + count && i <= MEMORY_MAX; ++i) {
+    vm->decode_cache[i].handler = PD_DECODE;
+  }
+}
+
+decoded_t predecode_instr(uint16_t address, uint16_t instr) {
+  uint16_t next_pc = (uint16_t)(address + 1);
+  uint16_t pc_target =
+      (uint16_t)(next_pc + sign_extend(instr & PC_OFFSET, PC_OFFSET_BIT_LEN));
+  uint16_t imm_flag = (instr >> IMM_FLAG_SHIFT) & FLAG;
+
+  decoded_t decoded = {
+      .handler = PD_REF,
+      .dr = (uint8_t)((instr >> DEST_REG_SHIFT) & REG),
+      .sr1 = (uint8_t)((instr >> VALUE_REG_SHIFT) & REG),
+      .sr2 = (uint8_t)(instr & REG),
+      .imm = 0,
+      .instr = instr,
+      .length = 1,
+      .rd2 = 0,
+      .imm2 = 0,
+  };
+
+  switch (instr >> OPCODE_SHIFT) {
+    case OP_ADD:
+      decoded.handler = imm_flag ? PD_ADD_IMM : PD_ADD_REG;
+      decoded.imm = sign_extend(instr & IMM_NUM, IMM_NUM_BIT_LEN);
+      break;
+    case OP_AND:
+      decoded.handler = imm_flag ? PD_AND_IMM : PD_AND_REG;
+      decoded.imm = sign_extend(instr & IMM_NUM, IMM_NUM_BIT_LEN);
+      break;
+    case OP_NOT:
+      decoded.handler = PD_NOT;
+      break;
+    case OP_BR:
+      decoded.sr2 = (uint8_t)((instr >> COND_FLAG_SHIFT) & COND_FLAG);
+      if (decoded.sr2 == 0) {
+        decoded.handler = PD_NOP;
+      } else if (decoded.sr2 == COND_FLAG) {
+        decoded.handler = PD_BR_ALWAYS;
+      } else {
+        decoded.handler = PD_BR;
+      }
+      decoded.imm = pc_target;
+      break;
+    case OP_JMP:
+      decoded.handler = PD_JMP;
+      break;
+    case OP_JSR:
+      if ((instr >> LONG_FLAG_SHIFT) & FLAG) {
+        decoded.handler = PD_JSR;
+        decoded.imm = (uint16_t)(next_pc + sign_extend(instr & LONG_PC_OFFSET,
+                                                       LONG_PC_OFFSET_BIT_LEN));
+      } else {
+        decoded.handler = PD_JSRR;
+      }
+      break;
+    case OP_LD:
+      decoded.handler = PD_LD;
+      decoded.imm = pc_target;
+      break;
+    case OP_LDI:
+      decoded.handler = PD_LDI;
+      decoded.imm = pc_target;
+      break;
+    case OP_LDR:
+      decoded.handler = PD_LDR;
+      decoded.imm = sign_extend(instr & OFFSET, OFFSET_BIT_LEN);
+      break;
+    case OP_LEA:
+      decoded.handler = PD_LEA;
+      decoded.imm = pc_target;
+      break;
+    case OP_ST:
+      decoded.handler = PD_ST;
+      decoded.imm = pc_target;
+      break;
+    case OP_STI:
+      decoded.handler = PD_STI;
+      decoded.imm = pc_target;
+      break;
+    case OP_STR:
+      decoded.handler = PD_STR;
+      decoded.imm = sign_extend(instr & OFFSET, OFFSET_BIT_LEN);
+      break;
+    default:
+      break;
+  }
+  return decoded;
+}
+
+#if defined(__GNUC__)
+
+enum { NUM_GPRS = R_PC };
+
+// NOLINTBEGIN(cppcoreguidelines-macro-usage)
+/* Look up the record for the next PC and jump straight to its handler. */
+#define DISPATCH()                                             \
+  do {                                                         \
+    if (remaining == 0) {                                      \
+      goto done;                                               \
+    }                                                          \
+    --remaining;                                               \
+    STATS_ADD(vm, opcodes[vm->memory[pc] >> OPCODE_SHIFT], 1); \
+    decoded = &vm->decode_cache[pc++];                         \
+    goto* dispatch_table[decoded->handler];                    \
+  } while (0)
+
+/* Write the locals back so reference handlers see the current state. */
+#define SPILL()                               \
+  do {                                        \
+    for (unsigned i = 0; i < NUM_GPRS; ++i) { \
+      vm->reg[i] = gpr[i];                    \
+    }                                         \
+    vm->reg[R_PC] = pc;                       \
+    vm->reg[R_COND] = cond;                   \
+  } while (0)
+
+/* Retire the rest of a fused record, or run its first instruction alone
+ * when the budget ends inside it. */
+#define FUSED()                                   \
+  do {                                            \
+    if (remaining < decoded->length - 1U) {       \
+      goto unfused;                               \
+    }                                             \
+    remaining -= decoded->length - 1U;            \
+    STATS_RUN(vm, pc, decoded->length - 1U);      \
+  } while (0)
+
+#define RELOAD()                              \
+  do {                                        \
+    for (unsigned i = 0; i < NUM_GPRS; ++i) { \
+      gpr[i] = vm->reg[i];                    \
+    }                                         \
+    pc = vm->reg[R_PC];                       \
+    cond = vm->reg[R_COND];                   \
+  } while (0)
+// NOLINTEND(cppcoreguidelines-macro-usage)
+
+// Labels as values are a GNU extension; the fallback below keeps the switch.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+uint64_t run_predecoded(vm_t* vm, uint64_t budget, int* running) {
+  static const void* const dispatch_table[PD_COUNT] = {
+      [PD_DECODE] = &&pd_decode,       [PD_ADD_REG] = &&pd_add_reg,
+      [PD_ADD_IMM] = &&pd_add_imm,     [PD_AND_REG] = &&pd_and_reg,
+      [PD_AND_IMM] = &&pd_and_imm,     [PD_NOT] = &&pd_not,
+      [PD_BR] = &&pd_br,               [PD_BR_ALWAYS] = &&pd_br_always,
+      [PD_NOP] = &&pd_nop,             [PD_JMP] = &&pd_jmp,
+      [PD_JSR] = &&pd_jsr,             [PD_JSRR] = &&pd_jsrr,
+      [PD_LD] = &&pd_ld,               [PD_LDI] = &&pd_ldi,
+      [PD_LDR] = &&pd_ldr,             [PD_LEA] = &&pd_lea,
+      [PD_ST] = &&pd_st,               [PD_STI] = &&pd_sti,
+      [PD_STR] = &&pd_str,             [PD_REF] = &&pd_ref,
+      [PD_ADD_BR] = &&pd_add_br,       [PD_NEG] = &&pd_neg,
+      [PD_NEG_ADD] = &&pd_neg_add,     [PD_CMP_BR] = &&pd_cmp_br,
+      [PD_LDR_STI] = &&pd_ldr_sti,     [PD_DELAY] = &&pd_delay,
+  };
+
+  uint16_t gpr[NUM_GPRS];
+  uint16_t pc = 0;
+  uint16_t cond = 0;
+  decoded_t* decoded = NULL;
+  decoded_t single;
+  uint64_t remaining = budget;
+
+  if (!*running) {
+    return 0;
+  }
+  RELOAD();
+  DISPATCH();
+
+pd_decode: {
+  uint16_t address = (uint16_t)(pc - 1);
+  *decoded = predecode_instr(address, mem_read(vm, address));
+  fuse_instrs(vm, address, decoded);
+  goto* dispatch_table[decoded->handler];
+}
+pd_add_reg:
+  gpr[decoded->dr] = (uint16_t)(gpr[decoded->sr1] + gpr[decoded->sr2]);
+  cond = flags_for(gpr[decoded->dr]);
+  DISPATCH();
+pd_add_imm:
+  gpr[decoded->dr] = (uint16_t)(gpr[decoded->sr1] + decoded->imm);
+  cond = flags_for(gpr[decoded->dr]);
+  DISPATCH();
+pd_and_reg:
+  gpr[decoded->dr] = gpr[decoded->sr1] & gpr[decoded->sr2];
+  cond = flags_for(gpr[decoded->dr]);
+  DISPATCH();
+pd_and_imm:
+  gpr[decoded->dr] = gpr[decoded->sr1] & decoded->imm;
+  cond = flags_for(gpr[decoded->dr]);
+  DISPATCH();
+pd_not:
+  gpr[decoded->dr] = (uint16_t)~gpr[decoded->sr1];
+  cond = flags_for(gpr[decoded->dr]);
+  DISPATCH();
+pd_br:
+  if (decoded->sr2 & cond) {
+    pc = decoded->imm;
+  }
+  DISPATCH();
+pd_br_always:
+  pc = decoded->imm;
+  DISPATCH();
+pd_nop:
+  DISPATCH();
+pd_jmp:
+  pc = gpr[decoded->sr1];
+  DISPATCH();
+pd_jsr:
+  gpr[R_R7] = pc;
+  pc = decoded->imm;
+  DISPATCH();
+pd_jsrr:
+  /* R7 is written first, matching jump_register_instr for JSRR R7 */
+  gpr[R_R7] = pc;
+  pc = gpr[decoded->sr1];
+  DISPATCH();
+pd_ld:
+  gpr[decoded->dr] = mem_read(vm, decoded->imm);
+  cond = flags_for(gpr[decoded->dr]);
+  DISPATCH();
+pd_ldi:
+  gpr[decoded->dr] = mem_read(vm, mem_read(vm, decoded->imm));
+  cond = flags_for(gpr[decoded->dr]);
+  DISPATCH();
+pd_ldr:
+  gpr[decoded->dr] = mem_read(vm, (uint16_t)(gpr[decoded->sr1] + decoded->imm));
+  cond = flags_for(gpr[decoded->dr]);
+  DISPATCH();
+pd_lea:
+  gpr[decoded->dr] = decoded->imm;
+  cond = flags_for(gpr[decoded->dr]);
+  DISPATCH();
+pd_st:
+  mem_write(vm, decoded->imm, gpr[decoded->dr]);
+  DISPATCH();
+pd_sti:
+  mem_write(vm, mem_read(vm, decoded->imm), gpr[decoded->dr]);
+  DISPATCH();
+pd_str:
+  mem_write(vm, (uint16_t)(gpr[decoded->sr1] + decoded->imm), gpr[decoded->dr]);
+  DISPATCH();
+pd_ref:
+  /* TRAP and the unused opcodes go through the reference interpreter */
+  SPILL();
+  execute_instr(vm, decoded->instr, running);
+  RELOAD();
+  if (!*running) {
+    goto done;
+  }
+  DISPATCH();
+
+pd_add_br:
+  FUSED();
+  gpr[decoded->dr] = (uint16_t)(gpr[decoded->sr1] + decoded->imm2);
+  cond = flags_for(gpr[decoded->dr]);
+  pc = (decoded->sr2 & cond) ? decoded->imm : (uint16_t)(pc + 1);
+  DISPATCH();
+pd_neg:
+  FUSED();
+  gpr[decoded->dr] = (uint16_t)-gpr[decoded->sr1];
+  cond = flags_for(gpr[decoded->dr]);
+  pc = (uint16_t)(pc + 1);
+  DISPATCH();
+pd_neg_add:
+  FUSED();
+  gpr[decoded->dr] = (uint16_t)-gpr[decoded->sr1];
+  gpr[decoded->rd2] = (uint16_t)(gpr[decoded->dr] + gpr[decoded->sr2]);
+  cond = flags_for(gpr[decoded->rd2]);
+  pc = (uint16_t)(pc + 2);
+  DISPATCH();
+pd_cmp_br:
+  FUSED();
+  gpr[decoded->dr] = (uint16_t)-gpr[decoded->sr1];
+  gpr[decoded->rd2] = (uint16_t)(gpr[decoded->dr] + gpr[decoded->sr2]);
+  cond = flags_for(gpr[decoded->rd2]);
+  pc = (decoded->imm2 & cond) ? decoded->imm : (uint16_t)(pc + 3);
+  DISPATCH();
+pd_ldr_sti:
+  FUSED();
+  gpr[decoded->dr] =
+      mem_read(vm, (uint16_t)(gpr[decoded->sr1] + decoded->imm2));
+  cond = flags_for(gpr[decoded->dr]);
+  pc = (uint16_t)(pc + 1);
+  mem_write(vm, mem_read(vm, decoded->imm), gpr[decoded->sr2]);
+  DISPATCH();
+pd_delay: {
+  /* the first iteration is charged like PD_ADD_BR, the rest are skipped */
+  FUSED();
+  uint32_t iterations =
+      delay_iterations(gpr[decoded->dr], decoded->imm2, decoded->sr2);
+  uint64_t affordable = 1 + remaining / 2;
+  uint32_t taken =
+      iterations <= affordable ? iterations : (uint32_t)affordable;
+  remaining -= 2ULL * (taken - 1);
+  vm->fast_forward_cycles += 2ULL * (taken - 1);
+  STATS_ADD(vm, opcodes[OP_ADD], taken - 1);
+  STATS_ADD(vm, opcodes[OP_BR], taken - 1);
+  gpr[decoded->dr] = (uint16_t)(gpr[decoded->dr] + decoded->imm2 * taken);
+  cond = flags_for(gpr[decoded->dr]);
+  pc = taken == iterations ? (uint16_t)(pc + 1) : decoded->imm;
+  DISPATCH();
+}
+unfused:
+  single = predecode_instr((uint16_t)(pc - 1), decoded->instr);
+  decoded = &single;
+  goto* dispatch_table[decoded->handler];
+
+done:
+  SPILL();
+  return budget - remaining;
+}
+
+#pragma GCC diagnostic pop
+
+#else
+
+uint64_t run_predecoded(vm_t* vm, uint64_t budget, int* running) {
+  return run_instructions(vm, budget, running);
+}
+
+#endif
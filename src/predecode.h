@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "memory.h"
+#include "utils.h"
+#include "vm.h"
+
+// Handlers a decoded record can dispatch to
+enum {
+  PD_DECODE = 0, /* stale or never executed, decode from memory[] first */
+  PD_ADD_REG,
+  PD_ADD_IMM,
+  PD_AND_REG,
+  PD_AND_IMM,
+  PD_NOT,
+  PD_BR,        /* conditional branch, sr2 holds the nzp mask */
+  PD_BR_ALWAYS, /* BRnzp */
+  PD_NOP,       /* BR with an empty nzp mask */
+  PD_JMP,
+  PD_JSR,
+  PD_JSRR,
+  PD_LD,
+  PD_LDI,
+  PD_LDR,
+  PD_LEA,
+  PD_ST,
+  PD_STI,
+  PD_STR,
+  PD_REF, /* TRAP and unused opcodes, run by the reference interpreter */
+  /* superinstructions built by fuse_instrs, see fusion.h */
+  PD_ADD_BR,  /* ADD dr, sr1, #imm2 / BR sr2 -> imm */
+  PD_NEG,     /* NOT dr, sr1 / ADD dr, dr, #1 */
+  PD_NEG_ADD, /* PD_NEG / ADD rd2, dr, sr2 */
+  PD_CMP_BR,  /* PD_NEG_ADD / BR imm2 -> imm */
+  PD_LDR_STI, /* LDR dr, sr1, #imm2 / STI sr2, imm */
+  PD_DELAY,   /* PD_ADD_BR with dr == sr1 branching back to itself */
+  PD_COUNT
+};
+
+// NOLINTNEXTLINE(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MAX_FUSED_LEN 4U
+
+// A predecoded instruction: 12 bytes, with every field already extracted
+typedef struct decoded {
+  uint8_t handler; /* one of PD_* */
+  uint8_t dr;      /* destination register, or source register for stores */
+  uint8_t sr1;     /* first source or base register */
+  uint8_t sr2;     /* second source register, or the BR nzp mask */
+  uint16_t imm;    /* sign-extended immediate, offset or PC-relative target */
+  uint16_t instr;  /* raw instruction word */
+  uint8_t length;  /* instructions covered, more than 1 for fused records */
+  uint8_t rd2;     /* second destination register of a fused record */
+  uint16_t imm2;   /* second immediate or nzp mask of a fused record */
+} decoded_t;
+
+/**
+ * Marks the decoded record for an address stale.
+ *
+ * Called by mem_write on every store, so it is a handful of byte stores. The
+ * records just before the address are dropped too, since a fused record
+ * covers up to MAX_FUSED_LEN words. The next time the address is executed it
+ * is decoded again from memory, which keeps self-modifying code correct.
+ *
+ * @param vm The VM whose vm->decode_cache to update.
+ * @param address The memory address that was written.
+ */
+static inline void predecode_invalidate(vm_t* vm, uint16_t address) {
+  for (uint16_t i = 0; i < MAX_FUSED_LEN; ++i) {
+    vm->decode_cache[(uint16_t)(address - i)].handler = PD_DECODE;
+  }
+}
+
+/**
+ * Marks the decoded records for a range of addresses stale.
+ *
+ * Used after bulk writes that bypass mem_write, such as image loads.
+ *
+ * @param vm The VM whose vm->decode_cache to update.
+ * @param origin The first address written.
+ * @param count The number of words written.
+ */
+void predecode_invalidate_range(vm_t* vm, uint16_t origin, size_t count);
+
+/**
+ * Decodes a single instruction word into a compact record.
+ *
+ * Register fields are extracted and offsets are sign-extended once, so the
+ * predecoded engine never repeats that work for an address in a loop.
+ * PC-relative instructions store their absolute target, computed from the
+ * address the word was fetched from.
+ *
+ * @param address The address of the instruction.
+ * @param instr The 16-bit instruction word.
+ *
+ * @return The decoded record.
+ */
+decoded_t predecode_instr(uint16_t address, uint16_t instr);
+
+/**
+ * Runs the fetch-decode-execute loop from the predecoded instruction cache.
+ *
+ * Equivalent to run_instructions. Each address is decoded on its first
+ * execution and whenever mem_write has invalidated it since, fusing common
+ * sequences into superinstructions with fuse_instrs; otherwise the cached
+ * record is dispatched directly (threaded, like run_threaded). Records live
+ * in vm->decode_cache.
+ *
+ * @param vm The VM to run.
+ * @param budget The maximum number of instructions to execute.
+ * @param running An int pointer representing the status of the running loop.
+ *
+ * @return The number of instructions retired, at most budget.
+ */
+uint64_t run_predecoded(vm_t* vm, uint64_t budget, int* running);
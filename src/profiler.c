@@ -0,0 +1,428 @@
+#include "profiler.h"
+
+#include <ctype.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "instructions.h"
+#include "interpreter.h"
+#include "memory.h"
+#include "stats.h"
+#include "utils.h"
+#include "vm.h"
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define PERCENT 100.0
+#define USEC_PER_SEC 1000000U
+#define LINE_MAX_LEN 256U
+#define ADDRESS_NAME_MAX 8U
+#define FNV_OFFSET 2166136261U
+#define FNV_PRIME 16777619U
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+typedef struct {
+  uint16_t address;
+  char name[PROFILER_NAME_MAX];
+} symbol_t;
+
+// A sampled call stack: the entry, the call targets, then the leaf
+typedef struct {
+  uint64_t count;
+  uint32_t hash;
+  uint16_t length;
+  uint16_t frames[PROFILER_MAX_DEPTH + 2];
+} sample_stack_t;
+
+// One call the guest has not returned from yet
+typedef struct {
+  uint16_t target;
+  uint16_t ret;
+} call_t;
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+static symbol_t* symbols;
+static size_t symbol_count;
+
+static uint64_t pc_samples[MEMORY_MAX + 1];
+static uint64_t total_samples;
+static uint64_t lost_samples; /* stacks that did not fit in the table */
+static sample_stack_t stacks[PROFILER_STACKS];
+static size_t stack_count;
+
+static uint64_t sample_interval;
+static uint64_t countdown;
+static uint32_t timer_hz;
+static volatile sig_atomic_t timer_expired;
+
+static int entered;
+static uint16_t entry;
+static call_t calls[PROFILER_MAX_DEPTH];
+static size_t depth;
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+static int is_symbol_name(const char* name) {
+  if (!isalpha((unsigned char)name[0]) && name[0] != '_') {
+    return 0;
+  }
+  for (const char* c = name; *c; ++c) {
+    if (!isalnum((unsigned char)*c) && *c != '_') {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* Parses "3003", "x3003" or "X3003"; headings and the like are rejected. */
+static int parse_address(const char* text, uint16_t* address) {
+  if (*text == 'x' || *text == 'X') {
+    ++text;
+  }
+  size_t len = strlen(text);
+  if (len == 0 || len > 4 || strspn(text, "0123456789abcdefABCDEF") != len) {
+    return 0;
+  }
+  *address = (uint16_t)strtoul(text, NULL, 16);
+  return 1;
+}
+
+static int by_address(const void* lhs, const void* rhs) {
+  const symbol_t* left = lhs;
+  const symbol_t* right = rhs;
+  /* ties keep file order, so the first name for an address wins */
+  if (left->address != right->address) {
+    return left->address < right->address ? -1 : 1;
+  }
+  return left < right ? -1 : left > right;
+}
+
+int profiler_load_symbols(const char* path) {
+  FILE* file = fopen(path, "re");
+  if (!file) {
+    return -1;
+  }
+  free(symbols);
+  symbols = NULL;
+  symbol_count = 0;
+
+  size_t capacity = 0;
+  char line[LINE_MAX_LEN];
+  while (fgets(line, sizeof(line), file)) {
+    const char* text = line + strspn(line, " \t");
+    if (!strncmp(text, "//", 2)) {
+      text += 2;
+    }
+    char name[PROFILER_NAME_MAX];
+    char address_text[ADDRESS_NAME_MAX];
+    uint16_t address = 0;
+    // NOLINTNEXTLINE(cert-err34-c)
+    if (sscanf(text, "%63s %7s", name, address_text) != 2 ||
+        !is_symbol_name(name) || !parse_address(address_text, &address)) {
+      continue;
+    }
+    if (symbol_count == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      symbols = realloc(symbols, capacity * sizeof(symbol_t));
+      if (!symbols) {
+        error_and_exit("Failed to allocate symbols\n");
+      }
+    }
+    symbols[symbol_count].address = address;
+    memcpy(symbols[symbol_count].name, name, sizeof(name));
+    ++symbol_count;
+  }
+  // NOLINTNEXTLINE(cert-err33-c)
+  fclose(file);
+
+  if (symbol_count) {
+    qsort(symbols, symbol_count, sizeof(symbol_t), by_address);
+    size_t kept = 1;
+    for (size_t i = 1; i < symbol_count; ++i) {
+      if (symbols[i].address != symbols[kept - 1].address) {
+        symbols[kept++] = symbols[i];
+      }
+    }
+    symbol_count = kept;
+  }
+  return (int)symbol_count;
+}
+
+/* Finds the closest symbol at or below address, or NULL. */
+static const symbol_t* symbol_at(uint16_t address) {
+  size_t low = 0;
+  size_t high = symbol_count;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (symbols[mid].address <= address) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low ? &symbols[low - 1] : NULL;
+}
+
+const char* profiler_describe(uint16_t address, char* buf, size_t len) {
+  const symbol_t* symbol = symbol_at(address);
+  // NOLINTBEGIN(cert-err33-c)
+  if (!symbol) {
+    snprintf(buf, len, "x%04X", (unsigned)address);
+  } else if (symbol->address == address) {
+    snprintf(buf, len, "%s", symbol->name);
+  } else {
+    snprintf(buf, len, "%s+%u", symbol->name,
+             (unsigned)(address - symbol->address));
+  }
+  // NOLINTEND(cert-err33-c)
+  return buf;
+}
+
+static void handle_profile_timer(int signal) {
+  (void)signal;
+  timer_expired = 1;
+}
+
+static void arm_timer(uint32_t hz) {
+  struct itimerval timer = {{0, 0}, {0, 0}};
+  if (hz) {
+    suseconds_t period = (suseconds_t)(USEC_PER_SEC / hz);
+    timer.it_interval.tv_usec = period ? period : 1;
+    timer.it_value = timer.it_interval;
+  }
+  setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+void profiler_start(uint64_t interval, uint32_t hz) {
+  memset(pc_samples, 0, sizeof(pc_samples));
+  memset(stacks, 0, sizeof(stacks));
+  total_samples = 0;
+  lost_samples = 0;
+  stack_count = 0;
+  sample_interval = interval ? interval : 1;
+  countdown = sample_interval;
+  timer_hz = hz;
+  timer_expired = 0;
+  entered = 0;
+  depth = 0;
+
+  if (hz) {
+    /* SA_RESTART keeps the timer from failing the host's own I/O */
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_profile_timer;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, NULL);
+    arm_timer(hz);
+  }
+}
+
+void profiler_stop(void) {
+  if (timer_hz) {
+    arm_timer(0);
+    // NOLINTNEXTLINE(cert-err33-c)
+    signal(SIGPROF, SIG_DFL);
+    timer_hz = 0;
+  }
+}
+
+/* Counts a sample of the current stack with pc as its leaf. */
+static void sample_stack(uint16_t pc) {
+  sample_stack_t sample = {1, FNV_OFFSET, 0, {0}};
+  sample.frames[sample.length++] = entry;
+  for (size_t i = 0; i < depth; ++i) {
+    sample.frames[sample.length++] = calls[i].target;
+  }
+  /* with symbols the leaf is the label, so each label folds into one line */
+  const symbol_t* symbol = symbol_at(pc);
+  sample.frames[sample.length++] = symbol ? symbol->address : pc;
+  for (uint16_t i = 0; i < sample.length; ++i) {
+    sample.hash = (sample.hash ^ sample.frames[i]) * FNV_PRIME;
+  }
+
+  for (size_t probe = 0; probe < PROFILER_STACKS; ++probe) {
+    sample_stack_t* slot =
+        &stacks[(sample.hash + probe) & (PROFILER_STACKS - 1)];
+    if (slot->count == 0) {
+      *slot = sample;
+      ++stack_count;
+      return;
+    }
+    if (slot->hash == sample.hash && slot->length == sample.length &&
+        !memcmp(slot->frames, sample.frames,
+                sample.length * sizeof(uint16_t))) {
+      ++slot->count;
+      return;
+    }
+  }
+  ++lost_samples;
+}
+
+/* Follows calls and returns after instr at pc has executed. */
+static void track_calls(uint16_t pc, uint16_t instr, uint16_t next_pc) {
+  uint16_t opcode = instr >> OPCODE_SHIFT;
+  if (opcode == OP_JSR) {
+    /* calls past the deepest frame are charged to it */
+    if (depth < PROFILER_MAX_DEPTH) {
+      calls[depth++] = (call_t){next_pc, (uint16_t)(pc + 1)};
+    }
+  } else if (opcode == OP_JMP &&
+             ((instr >> VALUE_REG_SHIFT) & REG) == R_R7) {
+    /* unwind to the call returned to; a RET used as a plain jump is not
+       a return and leaves the stack alone */
+    for (size_t i = depth; i > 0; --i) {
+      if (calls[i - 1].ret == next_pc) {
+        depth = i - 1;
+        break;
+      }
+    }
+  }
+}
+
+uint64_t run_pc_profile(vm_t* vm, uint64_t budget, int* running) {
+  uint64_t retired = 0;
+  while (*running && retired < budget) {
+    uint16_t pc = vm->reg[R_PC];
+    if (!entered) {
+      entry = pc;
+      entered = 1;
+    }
+    int sample = 0;
+    if (timer_hz) {
+      sample = timer_expired;
+      timer_expired = 0;
+    } else if (--countdown == 0) {
+      countdown = sample_interval;
+      sample = 1;
+    }
+    if (sample) {
+      ++pc_samples[pc];
+      ++total_samples;
+      sample_stack(pc);
+    }
+
+    uint16_t instr = mem_read(vm, pc);
+    STATS_ADD(vm, opcodes[instr >> OPCODE_SHIFT], 1);
+    vm->reg[R_PC]++;
+    execute_instr(vm, instr, running);
+    track_calls(pc, instr, vm->reg[R_PC]);
+    ++retired;
+  }
+  return retired;
+}
+
+uint64_t profiler_samples_at(uint16_t address) { return pc_samples[address]; }
+
+typedef struct {
+  uint64_t count;
+  uint16_t address;
+} hot_spot_t;
+
+static int by_count_desc(const void* lhs, const void* rhs) {
+  const hot_spot_t* left = lhs;
+  const hot_spot_t* right = rhs;
+  if (left->count != right->count) {
+    return left->count < right->count ? 1 : -1;
+  }
+  return (left->address > right->address) - (left->address < right->address);
+}
+
+static void print_hot_spots(FILE* out, hot_spot_t* spots, size_t count,
+                            size_t top, int with_address) {
+  qsort(spots, count, sizeof(hot_spot_t), by_count_desc);
+  char name[PROFILER_NAME_MAX + ADDRESS_NAME_MAX];
+  for (size_t i = 0; i < count && i < top; ++i) {
+    // NOLINTBEGIN(cert-err33-c)
+    fprintf(out, "  %6.2f%% %12llu  ",
+            PERCENT * (double)spots[i].count / (double)total_samples,
+            (unsigned long long)spots[i].count);
+    if (with_address) {
+      fprintf(out, "x%04X  ", (unsigned)spots[i].address);
+    }
+    fprintf(out, "%s\n",
+            profiler_describe(spots[i].address, name, sizeof(name)));
+    // NOLINTEND(cert-err33-c)
+  }
+}
+
+void profiler_report(FILE* out, size_t top) {
+  static hot_spot_t spots[MEMORY_MAX + 1];
+  size_t count = 0;
+
+  // NOLINTBEGIN(cert-err33-c)
+  if (timer_hz) {
+    fprintf(out, "pc profile: %llu samples at %u Hz of CPU time\n",
+            (unsigned long long)total_samples, (unsigned)timer_hz);
+  } else {
+    fprintf(out, "pc profile: %llu samples, one every %llu instructions\n",
+            (unsigned long long)total_samples,
+            (unsigned long long)sample_interval);
+  }
+  fprintf(out, "  %zu distinct call stacks", stack_count);
+  if (lost_samples) {
+    fprintf(out, ", %llu more samples had no room for theirs",
+            (unsigned long long)lost_samples);
+  }
+  fprintf(out, "\n");
+  if (total_samples == 0) {
+    return;
+  }
+  fprintf(out, "hot spots:\n");
+  // NOLINTEND(cert-err33-c)
+  for (uint32_t address = 0; address <= MEMORY_MAX; ++address) {
+    if (pc_samples[address]) {
+      spots[count++] = (hot_spot_t){pc_samples[address], (uint16_t)address};
+    }
+  }
+  print_hot_spots(out, spots, count, top, 1);
+  if (symbol_count == 0) {
+    return;
+  }
+
+  /* the same samples summed per symbol, with what lies below the first
+     symbol under its own address */
+  count = 0;
+  for (uint32_t address = 0; address <= MEMORY_MAX; ++address) {
+    if (!pc_samples[address]) {
+      continue;
+    }
+    const symbol_t* symbol = symbol_at((uint16_t)address);
+    uint16_t key = symbol ? symbol->address : (uint16_t)address;
+    if (count && spots[count - 1].address == key) {
+      spots[count - 1].count += pc_samples[address];
+    } else {
+      spots[count++] = (hot_spot_t){pc_samples[address], key};
+    }
+  }
+  // NOLINTNEXTLINE(cert-err33-c)
+  fprintf(out, "by symbol:\n");
+  print_hot_spots(out, spots, count, top, 0);
+}
+
+int profiler_write_folded(FILE* out) {
+  int failed = 0;
+  char name[PROFILER_NAME_MAX + ADDRESS_NAME_MAX];
+  char previous[PROFILER_NAME_MAX + ADDRESS_NAME_MAX];
+  for (size_t i = 0; i < PROFILER_STACKS; ++i) {
+    const sample_stack_t* stack = &stacks[i];
+    if (stack->count == 0) {
+      continue;
+    }
+    previous[0] = '\0';
+    for (uint16_t j = 0; j < stack->length; ++j) {
+      profiler_describe(stack->frames[j], name, sizeof(name));
+      /* a sample in a function's first block would repeat its name */
+      if (j == stack->length - 1 && j > 0 && !strcmp(name, previous)) {
+        continue;
+      }
+      failed |= fprintf(out, "%s%s", j ? ";" : "", name) < 0;
+      memcpy(previous, name, sizeof(name));
+    }
+    failed |= fprintf(out, " %llu\n", (unsigned long long)stack->count) < 0;
+  }
+  return !failed;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "vm.h"
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define PROFILER_MAX_DEPTH 32U  /* calls kept per sample, deeper ones fold */
+#define PROFILER_STACKS 4096U   /* distinct stacks, a power of two */
+#define PROFILER_NAME_MAX 64U   /* longest symbol name kept */
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+/**
+ * Reads the symbols of a guest program from a .sym file.
+ *
+ * Understands the tables lc3as writes ("//\tLOOP  3003") as well as plain
+ * "NAME x3003" lines; anything else, such as the table's headings, is
+ * skipped. Replaces the symbols loaded before.
+ *
+ * @param path The symbol file.
+ *
+ * @return The number of symbols read, or -1 if the file cannot be opened.
+ */
+int profiler_load_symbols(const char* path);
+
+/**
+ * Names an address after the closest symbol at or below it.
+ *
+ * @param address The guest address.
+ * @param buf Where to write the name, such as "LOOP" or "LOOP+3", or "x3003"
+ *            when no symbol lies below the address.
+ * @param len The size of buf.
+ *
+ * @return buf.
+ */
+const char* profiler_describe(uint16_t address, char* buf, size_t len);
+
+/**
+ * Clears the samples and arms the sampler for run_pc_profile.
+ *
+ * @param interval Sample every interval retired instructions, if hz is 0.
+ * @param hz If not 0, sample instead whenever a SIGPROF timer firing hz
+ *           times per second of process CPU time has expired.
+ */
+void profiler_start(uint64_t interval, uint32_t hz);
+
+/**
+ * Disarms the SIGPROF timer started by profiler_start, if any.
+ */
+void profiler_stop(void);
+
+/**
+ * Runs the reference interpreter while sampling the PC.
+ *
+ * Equivalent to run_instructions, but also follows JSR/JSRR and RET
+ * (JMP R7) to keep a shadow call stack, and at every sample adds the PC to
+ * a histogram and the call stack to a table of stacks. The samples are
+ * process-wide, so only profile one VM at a time.
+ *
+ * @param vm The VM to run.
+ * @param budget The maximum number of instructions to execute.
+ * @param running An int pointer representing the status of the running loop.
+ *
+ * @return The number of instructions retired, at most budget.
+ */
+uint64_t run_pc_profile(vm_t* vm, uint64_t budget, int* running);
+
+/**
+ * Returns how many samples landed on an address.
+ *
+ * @param address The guest address.
+ *
+ * @return The sample count.
+ */
+uint64_t profiler_samples_at(uint16_t address);
+
+/**
+ * Prints the hottest addresses and, with symbols loaded, the hottest
+ * symbols, busiest first.
+ *
+ * @param out The stream to print the report to.
+ * @param top The number of addresses and of symbols to list.
+ */
+void profiler_report(FILE* out, size_t top);
+
+/**
+ * Writes the sampled call stacks as folded stacks, one
+ * "entry;callee;label count" line per distinct stack, as flamegraph.pl and
+ * speedscope read them.
+ *
+ * The root is where profiling started, each call is named after its target
+ * and the leaf is the symbol containing the sampled PC, or the PC itself
+ * without symbols.
+ *
+ * @param out Where to write.
+ *
+ * @return 1 on success, 0 on an I/O error.
+ */
+int profiler_write_folded(FILE* out);
@@ -0,0 +1,157 @@
+#include "recorder.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio.h"
+#include "bank.h"
+#include "mixer.h"
+#include "utils.h"
+#include "vm.h"
+#include "voice.h"
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define FMT_CHUNK_BYTES 16U
+#define SAMPLE_BYTES 2U
+#define SAMPLE_BITS 16U
+#define RIFF_SIZE_OFFSET 4U
+#define DATA_SIZE_OFFSET 40U
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+static void put_le16(uint8_t* out, uint16_t value) {
+  out[0] = (uint8_t)(value & 0xFFU);
+  out[1] = (uint8_t)(value >> 8U);
+}
+
+static void put_le32(uint8_t* out, uint32_t value) {
+  put_le16(out, (uint16_t)(value & 0xFFFFU));
+  put_le16(out + 2, (uint16_t)(value >> 16U));
+}
+
+/* Fills in a header for data_bytes of mono 16-bit PCM. */
+static void make_header(uint8_t* header, uint32_t rate, uint32_t data_bytes) {
+  // NOLINTBEGIN(readability-magic-numbers)
+  memcpy(header, "RIFF", 4);
+  put_le32(header + RIFF_SIZE_OFFSET, RECORDER_HEADER_BYTES - 8 + data_bytes);
+  memcpy(header + 8, "WAVEfmt ", 8);
+  put_le32(header + 16, FMT_CHUNK_BYTES);
+  put_le16(header + 20, 1); /* integer PCM */
+  put_le16(header + 22, 1); /* mono */
+  put_le32(header + 24, rate);
+  put_le32(header + 28, rate * SAMPLE_BYTES);
+  put_le16(header + 32, SAMPLE_BYTES);
+  put_le16(header + 34, SAMPLE_BITS);
+  memcpy(header + 36, "data", 4);
+  put_le32(header + DATA_SIZE_OFFSET, data_bytes);
+  // NOLINTEND(readability-magic-numbers)
+}
+
+recorder_t* recorder_open(const char* path, uint32_t rate, size_t limit) {
+  FILE* file = fopen(path, "wbe");
+  if (!file) {
+    return NULL;
+  }
+  recorder_t* recorder = calloc(1, sizeof(recorder_t));
+  if (!recorder) {
+    error_and_exit("Failed to allocate recorder");
+  }
+  recorder->file = file;
+  recorder->rate = rate;
+  recorder->limit = limit;
+  recorder->mixer = mixer_create();
+
+  uint8_t header[RECORDER_HEADER_BYTES];
+  make_header(header, rate, 0);
+  recorder->failed = fwrite(header, 1, sizeof(header), file) != sizeof(header);
+  return recorder;
+}
+
+/* Mixes the voices onto the buffered samples and writes them. */
+static void flush_buffer(recorder_t* recorder) {
+  if (recorder->buffered == 0) {
+    return;
+  }
+  mixer_mix(recorder->mixer, recorder->buffer, recorder->buffered);
+  /* the host is little-endian like WAV, as swap16 already assumes */
+  if (fwrite(recorder->buffer, sizeof(uint16_t), recorder->buffered,
+             recorder->file) != recorder->buffered) {
+    recorder->failed = 1;
+  }
+  recorder->written += recorder->buffered;
+  recorder->buffered = 0;
+}
+
+void recorder_write(recorder_t* recorder, const uint16_t* samples,
+                    size_t count) {
+  if (recorder->limit) {
+    size_t kept = recorder->written + recorder->buffered;
+    size_t room = recorder->limit > kept ? recorder->limit - kept : 0;
+    count = count < room ? count : room;
+  }
+  while (count > 0) {
+    size_t run = RECORDER_CHUNK - recorder->buffered;
+    run = run < count ? run : count;
+    memcpy(recorder->buffer + recorder->buffered, samples,
+           run * sizeof(uint16_t));
+    recorder->buffered += run;
+    samples += run;
+    count -= run;
+    if (recorder->buffered == RECORDER_CHUNK) {
+      flush_buffer(recorder);
+    }
+  }
+}
+
+int recorder_done(const recorder_t* recorder) {
+  return recorder->limit &&
+         recorder->written + recorder->buffered >= recorder->limit;
+}
+
+size_t recorder_pass_samples(const vm_t* vm) {
+  return vm->bank ? vm->bank->samples : (size_t)AUDIO_CLIP_SAMPLES;
+}
+
+static void recorder_sample(void* ctx, uint16_t sample) {
+  recorder_write(ctx, &sample, 1);
+}
+
+static void recorder_buffer(void* ctx, const uint16_t* samples,
+                            size_t count) {
+  recorder_write(ctx, samples, count);
+}
+
+static void recorder_voice(void* ctx, const voice_params_t* params) {
+  recorder_t* recorder = ctx;
+  /* the samples so far are mixed without it, so it starts at the next one */
+  flush_buffer(recorder);
+  mixer_voice(recorder->mixer, params);
+}
+
+vm_io_t recorder_io(recorder_t* recorder) {
+  vm_io_t io = vm_terminal_io;
+  io.audio_sample = recorder_sample;
+  io.audio_buffer = recorder_buffer;
+  io.voice = recorder_voice;
+  io.ctx = recorder;
+  return io;
+}
+
+int recorder_close(recorder_t* recorder) {
+  if (!recorder) {
+    return 1;
+  }
+  flush_buffer(recorder);
+  uint8_t header[RECORDER_HEADER_BYTES];
+  make_header(header, recorder->rate,
+              (uint32_t)(recorder->written * SAMPLE_BYTES));
+  int written =
+      !recorder->failed && fseek(recorder->file, 0, SEEK_SET) == 0 &&
+      fwrite(header, 1, sizeof(header), recorder->file) == sizeof(header);
+  written = fclose(recorder->file) == 0 && written;
+  mixer_destroy(recorder->mixer);
+  free(recorder);
+  return written;
+}
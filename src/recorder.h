@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "mixer.h"
+#include "vm.h"
+
+enum {
+  RECORDER_CHUNK = 4096,      /* samples mixed and written at a time */
+  RECORDER_HEADER_BYTES = 44, /* a canonical RIFF/WAVE header */
+};
+
+// Audio a VM makes, written to a WAV file instead of a sound device. There
+// is no device to wait for, so the VM runs as fast as it can, and the file
+// depends only on the guest program, never on timing.
+typedef struct {
+  FILE* file;
+  uint32_t rate;   /* frames per second in the header */
+  size_t limit;    /* samples to keep, 0 keeps all of them */
+  size_t written;  /* samples in the file so far */
+  size_t buffered; /* samples in buffer, not yet mixed or written */
+  int failed;      /* set by the first write error */
+  mixer_t* mixer;  /* the voices, mixed in as the buffer is written */
+  uint16_t buffer[RECORDER_CHUNK];
+} recorder_t;
+
+/**
+ * Creates a WAV file of mono 16-bit PCM samples to record into.
+ *
+ * The header is written with empty sizes and completed by recorder_close.
+ *
+ * @param path Where to create the file.
+ * @param rate The sample rate of the recording.
+ * @param limit The most samples to keep, 0 for no limit. Later samples are
+ *              dropped and recorder_done turns true.
+ *
+ * @return The recorder, or NULL if the file cannot be created.
+ */
+recorder_t* recorder_open(const char* path, uint32_t rate, size_t limit);
+
+/**
+ * Returns host services that record a VM's audio.
+ *
+ * MR_AUDIO_DATA stores and DMA transfers are appended to the recording and
+ * voices are mixed onto it from the sample they were triggered at. The
+ * console is the terminal, as in vm_terminal_io.
+ *
+ * @param recorder The recorder to send the audio to.
+ *
+ * @return The services, to pass to vm_create.
+ */
+vm_io_t recorder_io(recorder_t* recorder);
+
+/**
+ * Appends samples to a recording, up to its limit.
+ *
+ * @param recorder The recorder.
+ * @param samples The samples, as the bits of signed words.
+ * @param count The number of samples.
+ */
+void recorder_write(recorder_t* recorder, const uint16_t* samples,
+                    size_t count);
+
+/**
+ * Returns whether a recording has reached its limit.
+ *
+ * @param recorder The recorder.
+ *
+ * @return 1 once limit samples were recorded, 0 otherwise.
+ */
+int recorder_done(const recorder_t* recorder);
+
+/**
+ * Returns how many samples one pass of the loaded audio plays, the default
+ * length of a render since the players loop forever.
+ *
+ * @param vm The VM with a clip or a stream loaded.
+ *
+ * @return The stream's samples, or AUDIO_CLIP_SAMPLES for a clip.
+ */
+size_t recorder_pass_samples(const vm_t* vm);
+
+/**
+ * Writes the buffered samples, completes the header and closes the file.
+ *
+ * @param recorder The recorder to free, may be NULL.
+ *
+ * @return 1 if the whole file was written, 0 on an I/O error.
+ */
+int recorder_close(recorder_t* recorder);
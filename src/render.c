@@ -0,0 +1,230 @@
+#include "render.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "utils.h"
+#include "vm.h"
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define SIMD_WORDS 8U
+#define HEAT_STEP 3U
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+_Static_assert(VM_PAGES == MEMORY_MAP_DIM, "one page per memory-map row");
+_Static_assert(MEMORY_MAP_DIM << VM_PAGE_SHIFT == MEMORY_MAX + 1,
+               "one page fills a memory-map row");
+
+static const char* const palette_names[PALETTE_COUNT] = {
+    "classic",
+    "gray",
+    "heat",
+    "phosphor",
+};
+
+static const char* const kernel_names[RENDER_KERNEL_COUNT] = {
+    "scalar",
+    "sse2",
+    "avx2",
+};
+
+/* Packs a color as SDL_PIXELFORMAT_RGBA8888, fully opaque. */
+static uint32_t rgba(uint32_t red, uint32_t green, uint32_t blue) {
+  return (red << BIT_SHIFT_24) | (green << BIT_SHIFT_16) |
+         (blue << BIT_SHIFT_8) | BYTE_MASK;
+}
+
+/* Clamps a channel that ramps up after an offset, for the heat palette. */
+static uint32_t ramp(uint32_t value, uint32_t offset) {
+  if (value <= offset) {
+    return 0;
+  }
+  return value - offset > BYTE_MASK ? BYTE_MASK : value - offset;
+}
+
+void palette_init(palette_t* palette, palette_id_t id) {
+  for (uint32_t i = 0; i < PALETTE_SIZE; ++i) {
+    uint32_t color = 0;
+    switch (id) {
+      case PALETTE_GRAY:
+        color = rgba(i, i, i);
+        break;
+      case PALETTE_HEAT:
+        color = rgba(ramp(HEAT_STEP * i, 0), ramp(HEAT_STEP * i, BYTE_MASK),
+                     ramp(HEAT_STEP * i, 2 * BYTE_MASK));
+        break;
+      case PALETTE_PHOSPHOR:
+        color = rgba(i / BYTE_LEN, i, i / BYTE_LEN);
+        break;
+      case PALETTE_CLASSIC:
+      default:
+        /* what update_texture has always drawn, alpha included */
+        color = (BYTE_MASK << BIT_SHIFT_24) | (i << BIT_SHIFT_16) |
+                (i << BIT_SHIFT_8) | i;
+        break;
+    }
+    palette->colors[i] = color;
+  }
+}
+
+int palette_parse(const char* name, palette_id_t* id) {
+  for (int i = 0; i < PALETTE_COUNT; ++i) {
+    if (!strcmp(name, palette_names[i])) {
+      *id = (palette_id_t)i;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+const char* palette_name(palette_id_t id) {
+  return id < PALETTE_COUNT ? palette_names[id] : "unknown";
+}
+
+const char* render_kernel_name(render_kernel_t kernel) {
+  return kernel < RENDER_KERNEL_COUNT ? kernel_names[kernel] : "unknown";
+}
+
+static size_t render_scalar(uint32_t* pixels, const uint16_t* words,
+                            size_t count, const palette_t* palette) {
+  for (size_t i = 0; i < count; ++i) {
+    pixels[i] = palette->colors[words[i] >> BIT_SHIFT_8];
+  }
+  return count;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+#include <immintrin.h>
+
+/* SSE2 has no gather, so it shifts 8 words at once and looks each up. */
+static size_t render_sse2(uint32_t* pixels, const uint16_t* words,
+                          size_t count, const palette_t* palette) {
+  const uint32_t* colors = palette->colors;
+  size_t done = 0;
+  for (; done + SIMD_WORDS <= count; done += SIMD_WORDS) {
+    __m128i index = _mm_srli_epi16(
+        _mm_loadu_si128((const __m128i*)(const void*)(words + done)),
+        BIT_SHIFT_8);
+    // NOLINTBEGIN(readability-magic-numbers)
+    __m128i low = _mm_setr_epi32((int)colors[_mm_extract_epi16(index, 0)],
+                                 (int)colors[_mm_extract_epi16(index, 1)],
+                                 (int)colors[_mm_extract_epi16(index, 2)],
+                                 (int)colors[_mm_extract_epi16(index, 3)]);
+    __m128i high = _mm_setr_epi32((int)colors[_mm_extract_epi16(index, 4)],
+                                  (int)colors[_mm_extract_epi16(index, 5)],
+                                  (int)colors[_mm_extract_epi16(index, 6)],
+                                  (int)colors[_mm_extract_epi16(index, 7)]);
+    // NOLINTEND(readability-magic-numbers)
+    _mm_storeu_si128((__m128i*)(void*)(pixels + done), low);
+    _mm_storeu_si128((__m128i*)(void*)(pixels + done + SIMD_WORDS / 2), high);
+  }
+  return done;
+}
+
+/* Widens 8 words to 32 bits and gathers their colors in one instruction. */
+__attribute__((target("avx2"))) static size_t render_avx2(
+    uint32_t* pixels, const uint16_t* words, size_t count,
+    const palette_t* palette) {
+  const int* colors = (const int*)(const void*)palette->colors;
+  size_t done = 0;
+  for (; done + SIMD_WORDS <= count; done += SIMD_WORDS) {
+    __m256i index = _mm256_srli_epi32(
+        _mm256_cvtepu16_epi32(
+            _mm_loadu_si128((const __m128i*)(const void*)(words + done))),
+        BIT_SHIFT_8);
+    _mm256_storeu_si256((__m256i*)(void*)(pixels + done),
+                        _mm256_i32gather_epi32(colors, index, sizeof(int)));
+  }
+  return done;
+}
+
+#endif
+
+int render_kernel_supported(render_kernel_t kernel) {
+  switch (kernel) {
+    case RENDER_SCALAR:
+      return 1;
+#if defined(__x86_64__) && defined(__GNUC__)
+    case RENDER_SSE2:
+      return 1;
+    case RENDER_AVX2:
+      return __builtin_cpu_supports("avx2") != 0;
+#endif
+    default:
+      return 0;
+  }
+}
+
+render_kernel_t render_best_kernel(void) {
+  if (render_kernel_supported(RENDER_AVX2)) {
+    return RENDER_AVX2;
+  }
+  if (render_kernel_supported(RENDER_SSE2)) {
+    return RENDER_SSE2;
+  }
+  return RENDER_SCALAR;
+}
+
+void render_words(render_kernel_t kernel, uint32_t* pixels,
+                  const uint16_t* words, size_t count,
+                  const palette_t* palette) {
+  size_t done = 0;
+#if defined(__x86_64__) && defined(__GNUC__)
+  if (kernel == RENDER_AVX2) {
+    done = render_avx2(pixels, words, count, palette);
+  } else if (kernel == RENDER_SSE2) {
+    done = render_sse2(pixels, words, count, palette);
+  }
+#else
+  (void)kernel;
+#endif
+  render_scalar(pixels + done, words + done, count - done, palette);
+}
+
+void render_memory_map(const vm_t* vm, void* pixels, int pitch,
+                       const palette_t* palette) {
+  render_kernel_t kernel = render_best_kernel();
+  uint8_t* row = pixels;
+  for (size_t y = 0; y < MEMORY_MAP_DIM; ++y) {
+    render_words(kernel, (uint32_t*)(void*)row,
+                 vm->memory + y * MEMORY_MAP_DIM, MEMORY_MAP_DIM, palette);
+    row += pitch;
+  }
+}
+
+size_t render_dirty_rows(const uint16_t* memory, uint64_t* dirty_pages,
+                         uint32_t* pixels, const palette_t* palette,
+                         render_span_t* spans) {
+  render_kernel_t kernel = render_best_kernel();
+  size_t num_spans = 0;
+  int in_span = 0;
+
+  for (uint32_t row = 0; row < MEMORY_MAP_DIM; ++row) {
+    uint64_t bits = dirty_pages[row / VM_PAGE_BITS];
+    if (!bits && row % VM_PAGE_BITS == 0) {
+      /* a whole word of clean pages, the common case */
+      row += VM_PAGE_BITS - 1;
+      in_span = 0;
+      continue;
+    }
+    if (!(bits & (1ULL << (row % VM_PAGE_BITS)))) {
+      in_span = 0;
+      continue;
+    }
+
+    render_words(kernel, pixels + (size_t)row * MEMORY_MAP_DIM,
+                 memory + ((size_t)row << VM_PAGE_SHIFT), MEMORY_MAP_DIM,
+                 palette);
+    if (in_span) {
+      ++spans[num_spans - 1].rows;
+    } else {
+      spans[num_spans++] = (render_span_t){(uint16_t)row, 1};
+      in_span = 1;
+    }
+  }
+
+  memset(dirty_pages, 0, VM_PAGES / VM_PAGE_BITS * sizeof(uint64_t));
+  return num_spans;
+}
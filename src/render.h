@@ -0,0 +1,140 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vm.h"
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MEMORY_MAP_DIM 256 /* the map is a square with one pixel per word */
+#define PALETTE_SIZE 256   /* one color per value of a word's high byte */
+#define RENDER_MAX_SPANS (MEMORY_MAP_DIM / 2) /* dirty rows alternate at most */
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+// Palettes selectable with --palette, indexed by the high byte of a word
+typedef enum {
+  PALETTE_CLASSIC = 0, /* the original red-to-white ramp */
+  PALETTE_GRAY,        /* black to white */
+  PALETTE_HEAT,        /* black through red and yellow to white */
+  PALETTE_PHOSPHOR,    /* black to green, like an old terminal */
+  PALETTE_COUNT
+} palette_id_t;
+
+// A run of consecutive memory-map rows that changed
+typedef struct {
+  uint16_t first_row;
+  uint16_t rows;
+} render_span_t;
+
+// SDL_PIXELFORMAT_RGBA8888 colors for every intensity
+typedef struct {
+  uint32_t colors[PALETTE_SIZE];
+} palette_t;
+
+// Word-to-pixel converters; render_best_kernel picks one for this CPU
+typedef enum {
+  RENDER_SCALAR = 0,
+  RENDER_SSE2, /* 8 words per step, lookups through pextrw */
+  RENDER_AVX2, /* 8 words per step with a gather from the palette */
+  RENDER_KERNEL_COUNT
+} render_kernel_t;
+
+/**
+ * Fills a palette.
+ *
+ * @param palette The palette to fill.
+ * @param id Which palette to build.
+ */
+void palette_init(palette_t* palette, palette_id_t id);
+
+/**
+ * Looks up a palette by the name shown in --help, such as "heat".
+ *
+ * @param name The name to look up.
+ * @param id Set to the palette on success.
+ *
+ * @return 1 if the name is known, 0 otherwise.
+ */
+int palette_parse(const char* name, palette_id_t* id);
+
+/**
+ * Returns the name of a palette.
+ *
+ * @param id The palette to name.
+ *
+ * @return A static string.
+ */
+const char* palette_name(palette_id_t id);
+
+/**
+ * Returns the fastest converter this CPU supports.
+ *
+ * @return RENDER_AVX2, RENDER_SSE2 or RENDER_SCALAR.
+ */
+render_kernel_t render_best_kernel(void);
+
+/**
+ * Checks whether this CPU can run a converter.
+ *
+ * @param kernel The converter to check.
+ *
+ * @return 1 if it is supported, 0 otherwise.
+ */
+int render_kernel_supported(render_kernel_t kernel);
+
+/**
+ * Returns the name of a converter, such as "avx2".
+ *
+ * @param kernel The converter to name.
+ *
+ * @return A static string.
+ */
+const char* render_kernel_name(render_kernel_t kernel);
+
+/**
+ * Converts words to pixels by looking their high byte up in a palette.
+ *
+ * Every kernel produces the same pixels; the SIMD ones only differ in speed.
+ *
+ * @param kernel The converter to use, which must be supported.
+ * @param pixels Where to store count pixels.
+ * @param words The words to convert.
+ * @param count The number of words.
+ * @param palette The colors to use.
+ */
+void render_words(render_kernel_t kernel, uint32_t* pixels,
+                  const uint16_t* words, size_t count,
+                  const palette_t* palette);
+
+/**
+ * Draws a VM's whole memory as a MEMORY_MAP_DIM square image.
+ *
+ * @param vm The VM whose memory to draw.
+ * @param pixels The top-left pixel of the image.
+ * @param pitch The number of bytes between the starts of two rows.
+ * @param palette The colors to use.
+ */
+void render_memory_map(const vm_t* vm, void* pixels, int pitch,
+                       const palette_t* palette);
+
+/**
+ * Redraws only the rows of the memory map whose pages were written.
+ *
+ * Each row is one VM page, and mem_write and the image loaders mark pages in
+ * vm->dirty_pages. The dirty rows are converted into pixels, consecutive ones
+ * are merged into spans so each can be uploaded with one call, and the dirty
+ * bits are cleared. Rows that did not change keep their previous pixels.
+ *
+ * @param memory The memory to draw, a VM's or a snapshot of it.
+ * @param dirty_pages The bitmap of pages changed since the last call, cleared
+ *                    afterwards.
+ * @param pixels A MEMORY_MAP_DIM square image with rows MEMORY_MAP_DIM pixels
+ *               apart, kept from frame to frame.
+ * @param palette The colors to use.
+ * @param spans Set to the redrawn spans, at most RENDER_MAX_SPANS of them.
+ *
+ * @return The number of spans, 0 if nothing changed since the last call.
+ */
+size_t render_dirty_rows(const uint16_t* memory, uint64_t* dirty_pages,
+                         uint32_t* pixels, const palette_t* palette,
+                         render_span_t* spans);
@@ -0,0 +1,132 @@
+#include "ring.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+ring_t* ring_create(size_t capacity) {
+  if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+    error_and_exit("Ring capacity must be a power of two");
+  }
+  /* aligned_alloc honors the cache-line alignment of the indices */
+  size_t size = (sizeof(ring_t) + RING_CACHE_LINE - 1) / RING_CACHE_LINE *
+                RING_CACHE_LINE;
+  ring_t* ring = aligned_alloc(RING_CACHE_LINE, size);
+  uint16_t* samples = calloc(capacity, sizeof(uint16_t));
+  if (!ring || !samples) {
+    error_and_exit("Failed to allocate ring");
+  }
+  memset(ring, 0, sizeof(*ring));
+  ring->samples = samples;
+  ring->mask = capacity - 1;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->overruns, 0);
+  atomic_init(&ring->parks, 0);
+  atomic_init(&ring->underruns, 0);
+  atomic_init(&ring->parked, 0);
+  pthread_mutex_init(&ring->lock, NULL);
+  pthread_cond_init(&ring->drained, NULL);
+  return ring;
+}
+
+void ring_destroy(ring_t* ring) {
+  if (!ring) {
+    return;
+  }
+  pthread_cond_destroy(&ring->drained);
+  pthread_mutex_destroy(&ring->lock);
+  free(ring->samples);
+  free(ring);
+}
+
+size_t ring_push_buffer(ring_t* ring, const uint16_t* samples, size_t count) {
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  size_t room = ring->mask + 1 - (head - tail);
+  size_t written = room < count ? room : count;
+
+  /* at most two contiguous runs, before and after the wrap */
+  size_t start = head & ring->mask;
+  size_t first = ring->mask + 1 - start;
+  if (first > written) {
+    first = written;
+  }
+  memcpy(ring->samples + start, samples, first * sizeof(uint16_t));
+  memcpy(ring->samples, samples + first, (written - first) * sizeof(uint16_t));
+  atomic_store_explicit(&ring->head, head + written, memory_order_release);
+
+  if (written < count) {
+    uint64_t overruns =
+        atomic_load_explicit(&ring->overruns, memory_order_relaxed);
+    atomic_store_explicit(&ring->overruns, overruns + (count - written),
+                          memory_order_relaxed);
+  }
+  return written;
+}
+
+size_t ring_pop_or_repeat(ring_t* ring, uint16_t* out, size_t count) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  size_t available = head - tail;
+  size_t read = available < count ? available : count;
+
+  /* at most two contiguous runs, before and after the wrap */
+  size_t start = tail & ring->mask;
+  size_t first = ring->mask + 1 - start;
+  if (first > read) {
+    first = read;
+  }
+  memcpy(out, ring->samples + start, first * sizeof(uint16_t));
+  memcpy(out + first, ring->samples, (read - first) * sizeof(uint16_t));
+  atomic_store_explicit(&ring->tail, tail + read, memory_order_release);
+  /* a store then a load of another variable, which only a full fence keeps
+     in order. It pairs with the fence in ring_wait_below: either the
+     producer sees the new tail before sleeping or this sees it parked. */
+  if (read > 0) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&ring->parked)) {
+      pthread_mutex_lock(&ring->lock);
+      pthread_cond_signal(&ring->drained);
+      pthread_mutex_unlock(&ring->lock);
+    }
+  }
+
+  if (read > 0) {
+    ring->last = out[read - 1];
+  }
+  for (size_t i = read; i < count; ++i) {
+    out[i] = ring->last;
+  }
+  uint64_t underruns =
+      atomic_load_explicit(&ring->underruns, memory_order_relaxed);
+  atomic_store_explicit(&ring->underruns, underruns + (count - read),
+                        memory_order_relaxed);
+  return read;
+}
+
+int ring_wait_below(ring_t* ring, size_t level, uint32_t timeout_ms) {
+  struct timespec deadline = deadline_after_ms(timeout_ms);
+  uint64_t parks = atomic_load_explicit(&ring->parks, memory_order_relaxed);
+  atomic_store_explicit(&ring->parks, parks + 1, memory_order_relaxed);
+
+  pthread_mutex_lock(&ring->lock);
+  atomic_store(&ring->parked, 1);
+  /* pairs with the fence in ring_pop_or_repeat, so the tail is not read
+     before parked is visible */
+  atomic_thread_fence(memory_order_seq_cst);
+  int timed_out = 0;
+  while (ring_size(ring) > level && !timed_out) {
+    timed_out = pthread_cond_timedwait(&ring->drained, &ring->lock,
+                                       &deadline) == ETIMEDOUT;
+  }
+  atomic_store(&ring->parked, 0);
+  pthread_mutex_unlock(&ring->lock);
+  return ring_size(ring) <= level;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// NOLINTNEXTLINE(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define RING_CACHE_LINE 64
+
+// A lock-free ring of samples with one producer thread and one consumer
+// thread. Each index and counter is only ever stored by its own side, so
+// pushing is a store and an index bump with no lock and no read-modify-write,
+// and any thread can read the counters. The lock is only taken when the
+// producer sleeps on a full ring and the consumer has to wake it.
+typedef struct {
+  uint16_t* samples;
+  size_t mask; /* capacity - 1, the capacity is a power of two */
+  pthread_mutex_t lock;
+  pthread_cond_t drained;
+  atomic_int parked; /* the producer is asleep in ring_wait_below */
+  /* producer side, on its own cache line: the next slot to write, the
+     samples dropped because the ring was full and the times it slept */
+  _Alignas(RING_CACHE_LINE) atomic_size_t head;
+  _Atomic uint64_t overruns;
+  _Atomic uint64_t parks;
+  /* consumer side: the next slot to read, the samples wanted but missing
+     from the ring, and the last sample read, repeated on underrun */
+  _Alignas(RING_CACHE_LINE) atomic_size_t tail;
+  _Atomic uint64_t underruns;
+  uint16_t last;
+} ring_t;
+
+/**
+ * Creates an empty ring.
+ *
+ * @param capacity The number of samples it holds, a power of two.
+ *
+ * @return The new ring, exits the program if it cannot be allocated.
+ */
+ring_t* ring_create(size_t capacity);
+
+/**
+ * Frees a ring.
+ *
+ * @param ring The ring to free, may be NULL.
+ */
+void ring_destroy(ring_t* ring);
+
+/**
+ * Returns the number of samples waiting to be read.
+ *
+ * Exact when called from either side, a snapshot from anywhere else.
+ *
+ * @param ring The ring to check.
+ *
+ * @return The number of samples in the ring.
+ */
+static inline size_t ring_size(ring_t* ring) {
+  return atomic_load_explicit(&ring->head, memory_order_acquire) -
+         atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+/**
+ * Appends a sample, from the producer thread.
+ *
+ * @param ring The ring to write to.
+ * @param sample The sample to append.
+ *
+ * @return 1 if it was stored, 0 if the ring was full and it was dropped.
+ */
+static inline int ring_push(ring_t* ring, uint16_t sample) {
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  if (head - tail > ring->mask) {
+    uint64_t overruns =
+        atomic_load_explicit(&ring->overruns, memory_order_relaxed);
+    atomic_store_explicit(&ring->overruns, overruns + 1, memory_order_relaxed);
+    return 0;
+  }
+  ring->samples[head & ring->mask] = sample;
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  return 1;
+}
+
+/**
+ * Appends as many of count samples as fit, from the producer thread, with
+ * at most two copies instead of one index update per sample.
+ *
+ * @param ring The ring to write to.
+ * @param samples The samples to append.
+ * @param count The number of samples.
+ *
+ * @return The number of samples stored; the rest are dropped as overruns.
+ */
+size_t ring_push_buffer(ring_t* ring, const uint16_t* samples, size_t count);
+
+/**
+ * Reads up to count samples, from the consumer thread, and repeats the last
+ * sample read for any the ring does not have, so a late producer holds the
+ * output level steady instead of clicking.
+ *
+ * @param ring The ring to read from.
+ * @param out Where to store exactly count samples.
+ * @param count The number of samples wanted.
+ *
+ * @return The number of samples actually read; the rest are underruns.
+ */
+size_t ring_pop_or_repeat(ring_t* ring, uint16_t* out, size_t count);
+
+/**
+ * Puts the producer to sleep until the consumer drains the ring to at most
+ * level samples, so the producer runs at the consumer's pace instead of
+ * spinning or overrunning.
+ *
+ * @param ring The ring to wait on.
+ * @param level The number of samples to wait for the ring to drain to.
+ * @param timeout_ms The longest to sleep, in case the consumer stopped.
+ *
+ * @return 1 if the ring drained to level, 0 on timeout.
+ */
+int ring_wait_below(ring_t* ring, size_t level, uint32_t timeout_ms);
@@ -0,0 +1,99 @@
+#include "snapshot.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+#include "vm.h"
+
+// NOLINTNEXTLINE(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define PAGE_WORDS (1U << VM_PAGE_SHIFT)
+
+/* Copies the pages set in dirty and adds them to the destination's bits. */
+static void copy_dirty_pages(mem_view_t* dst, const uint16_t* memory,
+                             const uint64_t* dirty) {
+  for (uint32_t word = 0; word < VM_PAGES / VM_PAGE_BITS; ++word) {
+    uint64_t bits = dirty[word];
+    dst->dirty_pages[word] |= bits;
+    while (bits) {
+      uint32_t page = word * VM_PAGE_BITS + (uint32_t)__builtin_ctzll(bits);
+      memcpy(dst->memory + page * PAGE_WORDS, memory + page * PAGE_WORDS,
+             PAGE_WORDS * sizeof(uint16_t));
+      bits &= bits - 1;
+    }
+  }
+}
+
+snapshot_t* snapshot_create(void) {
+  snapshot_t* snapshot = calloc(1, sizeof(snapshot_t));
+  if (!snapshot) {
+    error_and_exit("Failed to allocate snapshot");
+  }
+  pthread_mutex_init(&snapshot->lock, NULL);
+  pthread_cond_init(&snapshot->ready, NULL);
+  memset(snapshot->shared.dirty_pages, 0xFF,
+         sizeof(snapshot->shared.dirty_pages));
+  return snapshot;
+}
+
+int snapshot_publish(snapshot_t* snapshot, vm_t* vm) {
+  if (pthread_mutex_trylock(&snapshot->lock) != 0) {
+    ++snapshot->skipped; /* only the VM thread touches this counter */
+    return 0;
+  }
+  copy_dirty_pages(&snapshot->shared, vm->memory, vm->dirty_pages);
+  snapshot->fresh = 1;
+  ++snapshot->published;
+  pthread_cond_signal(&snapshot->ready);
+  pthread_mutex_unlock(&snapshot->lock);
+
+  memset(vm->dirty_pages, 0, sizeof(vm->dirty_pages));
+  return 1;
+}
+
+int snapshot_take(snapshot_t* snapshot, mem_view_t* view,
+                  uint32_t timeout_ms) {
+  struct timespec deadline = deadline_after_ms(timeout_ms);
+  pthread_mutex_lock(&snapshot->lock);
+  int waited = 0;
+  while (!snapshot->fresh && !snapshot->closed && timeout_ms && !waited) {
+    waited = pthread_cond_timedwait(&snapshot->ready, &snapshot->lock,
+                                    &deadline) == ETIMEDOUT;
+  }
+  int fresh = snapshot->fresh;
+  if (fresh) {
+    copy_dirty_pages(view, snapshot->shared.memory,
+                     snapshot->shared.dirty_pages);
+    memset(snapshot->shared.dirty_pages, 0,
+           sizeof(snapshot->shared.dirty_pages));
+    snapshot->fresh = 0;
+  }
+  pthread_mutex_unlock(&snapshot->lock);
+  return fresh;
+}
+
+void snapshot_close(snapshot_t* snapshot) {
+  pthread_mutex_lock(&snapshot->lock);
+  snapshot->closed = 1;
+  pthread_cond_broadcast(&snapshot->ready);
+  pthread_mutex_unlock(&snapshot->lock);
+}
+
+int snapshot_closed(snapshot_t* snapshot) {
+  pthread_mutex_lock(&snapshot->lock);
+  int closed = snapshot->closed;
+  pthread_mutex_unlock(&snapshot->lock);
+  return closed;
+}
+
+void snapshot_destroy(snapshot_t* snapshot) {
+  if (!snapshot) {
+    return;
+  }
+  pthread_cond_destroy(&snapshot->ready);
+  pthread_mutex_destroy(&snapshot->lock);
+  free(snapshot);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "vm.h"
+
+// A copy of VM memory with the pages changed since its owner last drew it
+typedef struct {
+  uint16_t memory[MEMORY_MAX + 1];
+  uint64_t dirty_pages[VM_PAGES / VM_PAGE_BITS];
+} mem_view_t;
+
+// Hands consistent copies of a VM's memory from the VM thread to a renderer.
+//
+// The VM thread publishes into the shared view at frame boundaries and the
+// renderer takes from it into its own view, so the buffers are the VM's
+// memory, the shared view and the renderer's view. Both sides copy only
+// dirty pages while holding the lock, and the VM thread never waits for it.
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  mem_view_t shared;
+  int fresh;  /* published since the renderer last took a view */
+  int closed; /* the VM thread is done */
+  uint64_t published;
+  uint64_t skipped; /* publishes dropped because the renderer held the lock */
+} snapshot_t;
+
+/**
+ * Creates a snapshot channel with every page dirty.
+ *
+ * @return The new channel, exits the program if it cannot be allocated.
+ */
+snapshot_t* snapshot_create(void);
+
+/**
+ * Publishes the pages a VM wrote since its last publish.
+ *
+ * Called by the VM thread between slices, so the copy is always of a
+ * consistent machine state. If the renderer is copying at that moment the
+ * publish is skipped and the VM keeps its dirty bits for the next one.
+ *
+ * @param snapshot The channel to publish to.
+ * @param vm The VM to copy from. Its dirty pages are cleared on success.
+ *
+ * @return 1 if the snapshot was published, 0 if it was skipped.
+ */
+int snapshot_publish(snapshot_t* snapshot, vm_t* vm);
+
+/**
+ * Waits for a new snapshot and copies it into a renderer's view.
+ *
+ * Only the pages published since the last take are copied, and their dirty
+ * bits are added to the view's.
+ *
+ * @param snapshot The channel to take from.
+ * @param view The renderer's view, updated in place.
+ * @param timeout_ms How long to wait for a publish, 0 to only poll.
+ *
+ * @return 1 if the view changed, 0 on timeout or once the channel is closed
+ *         and drained.
+ */
+int snapshot_take(snapshot_t* snapshot, mem_view_t* view,
+                  uint32_t timeout_ms);
+
+/**
+ * Marks the VM thread as done and wakes any waiting renderer.
+ *
+ * @param snapshot The channel to close.
+ */
+void snapshot_close(snapshot_t* snapshot);
+
+/**
+ * Checks whether the VM thread closed the channel.
+ *
+ * @param snapshot The channel to check.
+ *
+ * @return 1 once snapshot_close has been called, 0 before.
+ */
+int snapshot_closed(snapshot_t* snapshot);
+
+/**
+ * Frees a channel once both threads are done with it.
+ *
+ * @param snapshot The channel to free, may be NULL.
+ */
+void snapshot_destroy(snapshot_t* snapshot);
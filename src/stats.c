@@ -0,0 +1,145 @@
+#include "stats.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "interpreter.h"
+#include "utils.h"
+#include "vm.h"
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MEGA 1e6
+#define PERCENT 100.0
+#define TRAP_NAME_MAX 8U
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+static const char* const opcode_names[VM_OPCODES] = {
+    "BR",  "ADD", "LD",  "ST",  "JSR", "AND", "LDR", "STR",
+    "RTI", "NOT", "LDI", "STI", "JMP", "RES", "LEA", "TRAP",
+};
+
+static const char* const trap_names[] = {
+    "GETC", "OUT", "PUTS", "IN", "PUTSP", "HALT",
+};
+
+void stats_count_run(vm_t* vm, uint16_t address, uint64_t count) {
+  for (uint64_t i = 0; i < count; ++i) {
+    uint16_t instr = vm->memory[(uint16_t)(address + i)];
+    ++vm->stats.opcodes[instr >> OPCODE_SHIFT];
+  }
+}
+
+const char* stats_opcode_name(uint16_t opcode) {
+  return opcode_names[opcode % VM_OPCODES];
+}
+
+/* Names a trap vector, by its mnemonic if it has one. */
+static const char* trap_name(uint32_t vector, char* buf, size_t len) {
+  if (vector >= TRAP_GETC && vector <= TRAP_HALT) {
+    return trap_names[vector - TRAP_GETC];
+  }
+  // NOLINTNEXTLINE(cert-err33-c)
+  snprintf(buf, len, "x%02X", (unsigned)vector);
+  return buf;
+}
+
+static double mips(const stats_run_t* run) {
+  return run->seconds > 0 ? (double)run->retired / run->seconds / MEGA : 0;
+}
+
+void stats_report(FILE* out, const vm_t* vm, const stats_run_t* run) {
+  // NOLINTBEGIN(cert-err33-c)
+  fprintf(out, "\nstats (%s): %llu instructions in %.3f s, %.2f MIPS\n",
+          run->engine, (unsigned long long)run->retired, run->seconds,
+          mips(run));
+  if (vm->fast_forward_cycles) {
+    fprintf(out, "  %llu fast-forwarded through delay loops\n",
+            (unsigned long long)vm->fast_forward_cycles);
+  }
+  if (!STATS_ENABLED) {
+    fprintf(out, "  counters compiled out; rebuild with -DPVMPKIN_STATS=ON\n");
+    return;
+  }
+
+  /* busiest first; sixteen entries are sorted in place */
+  uint16_t order[VM_OPCODES];
+  uint64_t total = 0;
+  for (uint16_t i = 0; i < VM_OPCODES; ++i) {
+    order[i] = i;
+    total += vm->stats.opcodes[i];
+  }
+  for (uint16_t i = 1; i < VM_OPCODES; ++i) {
+    for (uint16_t j = i; j > 0 && vm->stats.opcodes[order[j]] >
+                                      vm->stats.opcodes[order[j - 1]];
+         --j) {
+      uint16_t swap = order[j];
+      order[j] = order[j - 1];
+      order[j - 1] = swap;
+    }
+  }
+  for (uint16_t i = 0; i < VM_OPCODES && vm->stats.opcodes[order[i]]; ++i) {
+    uint64_t count = vm->stats.opcodes[order[i]];
+    fprintf(out, "  %-5s %14llu  %5.1f%%\n", opcode_names[order[i]],
+            (unsigned long long)count,
+            PERCENT * (double)count / (double)total);
+  }
+
+  char buf[TRAP_NAME_MAX];
+  for (uint32_t vector = 0; vector < VM_TRAP_VECTORS; ++vector) {
+    if (vm->stats.traps[vector]) {
+      fprintf(out, "  trap %-5s %9llu\n", trap_name(vector, buf, sizeof(buf)),
+              (unsigned long long)vm->stats.traps[vector]);
+    }
+  }
+  fprintf(out,
+          "  memory: %llu reads (%llu MMIO), %llu writes (%llu MMIO)\n"
+          "  %llu frames, %llu audio samples\n",
+          (unsigned long long)vm->stats.mem_reads,
+          (unsigned long long)vm->stats.mmio_reads,
+          (unsigned long long)vm->stats.mem_writes,
+          (unsigned long long)vm->stats.mmio_writes,
+          (unsigned long long)vm->stats.frames,
+          (unsigned long long)vm->stats.audio_samples);
+  // NOLINTEND(cert-err33-c)
+}
+
+int stats_write_json(FILE* out, const vm_t* vm, const stats_run_t* run) {
+  int failed = fprintf(out,
+                       "{\"engine\": \"%s\", \"instructions\": %llu, "
+                       "\"seconds\": %.6f, \"mips\": %.3f, "
+                       "\"fast_forwarded\": %llu, \"counters\": %s",
+                       run->engine, (unsigned long long)run->retired,
+                       run->seconds, mips(run),
+                       (unsigned long long)vm->fast_forward_cycles,
+                       STATS_ENABLED ? "true" : "false") < 0;
+  if (STATS_ENABLED) {
+    failed |= fputs(", \"opcodes\": {", out) < 0;
+    for (uint16_t i = 0; i < VM_OPCODES; ++i) {
+      failed |= fprintf(out, "%s\"%s\": %llu", i ? ", " : "", opcode_names[i],
+                        (unsigned long long)vm->stats.opcodes[i]) < 0;
+    }
+    failed |= fputs("}, \"traps\": {", out) < 0;
+    const char* separator = "";
+    char buf[TRAP_NAME_MAX];
+    for (uint32_t vector = 0; vector < VM_TRAP_VECTORS; ++vector) {
+      if (vm->stats.traps[vector]) {
+        failed |= fprintf(out, "%s\"%s\": %llu", separator,
+                          trap_name(vector, buf, sizeof(buf)),
+                          (unsigned long long)vm->stats.traps[vector]) < 0;
+        separator = ", ";
+      }
+    }
+    failed |= fprintf(out,
+                      "}, \"mem_reads\": %llu, \"mem_writes\": %llu, "
+                      "\"mmio_reads\": %llu, \"mmio_writes\": %llu, "
+                      "\"frames\": %llu, \"audio_samples\": %llu",
+                      (unsigned long long)vm->stats.mem_reads,
+                      (unsigned long long)vm->stats.mem_writes,
+                      (unsigned long long)vm->stats.mmio_reads,
+                      (unsigned long long)vm->stats.mmio_writes,
+                      (unsigned long long)vm->stats.frames,
+                      (unsigned long long)vm->stats.audio_samples) < 0;
+  }
+  failed |= fputs("}\n", out) < 0;
+  return !failed;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "vm.h"
+
+// Counting costs a few instructions on every fetch and memory access, so the
+// counters in vm->stats are only updated when the build defines
+// PVMPKIN_STATS (cmake -DPVMPKIN_STATS=ON). Otherwise STATS_ADD compiles to
+// nothing and the report only has what is measured anyway.
+// NOLINTBEGIN(cppcoreguidelines-macro-usage)
+#ifdef PVMPKIN_STATS
+#define STATS_ENABLED 1
+#define STATS_ADD(vm, counter, count) ((vm)->stats.counter += (count))
+#define STATS_RUN(vm, address, count) stats_count_run(vm, address, count)
+#else
+#define STATS_ENABLED 0
+#define STATS_ADD(vm, counter, count) ((void)0)
+#define STATS_RUN(vm, address, count) ((void)0)
+#endif
+// NOLINTEND(cppcoreguidelines-macro-usage)
+
+// Everything a report covers besides vm->stats
+typedef struct {
+  const char* engine;
+  uint64_t retired; /* instructions, including fast-forwarded ones */
+  double seconds;   /* wall-clock time spent running */
+} stats_run_t;
+
+/**
+ * Counts the opcodes of instructions retired in a straight line.
+ *
+ * Engines that retire several instructions at once, such as fused records
+ * and translated blocks, call this with where the run started, so every
+ * engine reports the same opcode counts for the same program.
+ *
+ * @param vm The VM that retired the instructions.
+ * @param address The address of the first instruction.
+ * @param count The number of consecutive instructions.
+ */
+void stats_count_run(vm_t* vm, uint16_t address, uint64_t count);
+
+/**
+ * Returns the assembler name of an opcode, such as "ADD".
+ *
+ * @param opcode The opcode, below VM_OPCODES.
+ *
+ * @return A static string.
+ */
+const char* stats_opcode_name(uint16_t opcode);
+
+/**
+ * Prints the counters of a VM as a table, busiest opcodes first.
+ *
+ * @param out Where to print.
+ * @param vm The VM whose counters to print.
+ * @param run The engine, instructions and time of the run.
+ */
+void stats_report(FILE* out, const vm_t* vm, const stats_run_t* run);
+
+/**
+ * Writes the counters of a VM as one JSON object.
+ *
+ * Opcodes are keyed by name and traps by name or hex vector; counters that
+ * the build compiled out are left out and "counters" is false.
+ *
+ * @param out Where to write.
+ * @param vm The VM whose counters to write.
+ * @param run The engine, instructions and time of the run.
+ *
+ * @return 1 on success, 0 on an I/O error.
+ */
+int stats_write_json(FILE* out, const vm_t* vm, const stats_run_t* run);
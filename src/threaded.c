@@ -0,0 +1,167 @@
+#include "threaded.h"
+
+#include <stdint.h>
+
+#include "instructions.h"
+#include "interpreter.h"
+#include "memory.h"
+#include "stats.h"
+#include "utils.h"
+#include "vm.h"
+
+#if defined(__GNUC__)
+
+// NOLINTBEGIN(cppcoreguidelines-macro-usage)
+/* Branch-free sign extension of the low `bits` bits of num. */
+#define SEXT(num, bits) \
+  ((uint16_t)(((num) ^ (1U << ((bits) - 1U))) - (1U << ((bits) - 1U))))
+
+#define DR(instr) (((instr) >> DEST_REG_SHIFT) & REG)
+#define SR1(instr) (((instr) >> VALUE_REG_SHIFT) & REG)
+#define SR2(instr) ((instr) & REG)
+#define IMM5(instr) SEXT((instr) & IMM_NUM, IMM_NUM_BIT_LEN)
+#define OFF6(instr) SEXT((instr) & OFFSET, OFFSET_BIT_LEN)
+#define OFF9(instr) SEXT((instr) & PC_OFFSET, PC_OFFSET_BIT_LEN)
+#define OFF11(instr) SEXT((instr) & LONG_PC_OFFSET, LONG_PC_OFFSET_BIT_LEN)
+
+/* Fetch the next instruction and jump straight to its handler. */
+#define DISPATCH()                                    \
+  do {                                                \
+    if (remaining == 0) {                             \
+      goto done;                                      \
+    }                                                 \
+    --remaining;                                      \
+    instr = mem_read(vm, pc++);                       \
+    STATS_ADD(vm, opcodes[instr >> OPCODE_SHIFT], 1); \
+    goto* dispatch_table[instr >> OPCODE_SHIFT];      \
+  } while (0)
+
+/* Write the locals back so reference handlers see the current state. */
+#define SPILL()                               \
+  do {                                        \
+    for (unsigned i = 0; i < NUM_GPRS; ++i) { \
+      vm->reg[i] = gpr[i];                    \
+    }                                         \
+    vm->reg[R_PC] = pc;                       \
+    vm->reg[R_COND] = cond;                   \
+  } while (0)
+
+#define RELOAD()                              \
+  do {                                        \
+    for (unsigned i = 0; i < NUM_GPRS; ++i) { \
+      gpr[i] = vm->reg[i];                    \
+    }                                         \
+    pc = vm->reg[R_PC];                       \
+    cond = vm->reg[R_COND];                   \
+  } while (0)
+// NOLINTEND(cppcoreguidelines-macro-usage)
+
+enum { NUM_GPRS = R_PC };
+
+// Labels as values are a GNU extension; the fallback below keeps the switch.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+uint64_t run_threaded(vm_t* vm, uint64_t budget, int* running) {
+  static const void* const dispatch_table[] = {
+      &&op_br,  &&op_add, &&op_ld,  &&op_st,  &&op_jsr,  &&op_and,
+      &&op_ldr, &&op_str, &&op_ref, &&op_not, &&op_ldi,  &&op_sti,
+      &&op_jmp, &&op_ref, &&op_lea, &&op_ref,
+  };
+
+  uint16_t gpr[NUM_GPRS];
+  uint16_t pc = 0;
+  uint16_t cond = 0;
+  uint16_t instr = 0;
+  uint64_t remaining = budget;
+
+  if (!*running) {
+    return 0;
+  }
+  RELOAD();
+  DISPATCH();
+
+op_add: {
+  uint16_t operand = (instr >> IMM_FLAG_SHIFT) & FLAG ? IMM5(instr)
+                                                      : gpr[SR2(instr)];
+  gpr[DR(instr)] = (uint16_t)(gpr[SR1(instr)] + operand);
+  cond = flags_for(gpr[DR(instr)]);
+  DISPATCH();
+}
+op_and: {
+  uint16_t operand = (instr >> IMM_FLAG_SHIFT) & FLAG ? IMM5(instr)
+                                                      : gpr[SR2(instr)];
+  gpr[DR(instr)] = gpr[SR1(instr)] & operand;
+  cond = flags_for(gpr[DR(instr)]);
+  DISPATCH();
+}
+op_not:
+  gpr[DR(instr)] = (uint16_t)~gpr[SR1(instr)];
+  cond = flags_for(gpr[DR(instr)]);
+  DISPATCH();
+op_br:
+  if ((instr >> COND_FLAG_SHIFT) & cond) {
+    pc = (uint16_t)(pc + OFF9(instr));
+  }
+  DISPATCH();
+op_jmp:
+  pc = gpr[SR1(instr)];
+  DISPATCH();
+op_jsr:
+  /* R7 is written first, matching jump_register_instr for JSRR R7 */
+  gpr[R_R7] = pc;
+  if ((instr >> LONG_FLAG_SHIFT) & FLAG) {
+    pc = (uint16_t)(pc + OFF11(instr));
+  } else {
+    pc = gpr[SR1(instr)];
+  }
+  DISPATCH();
+op_ld:
+  gpr[DR(instr)] = mem_read(vm, (uint16_t)(pc + OFF9(instr)));
+  cond = flags_for(gpr[DR(instr)]);
+  DISPATCH();
+op_ldi:
+  gpr[DR(instr)] = mem_read(vm, mem_read(vm, (uint16_t)(pc + OFF9(instr))));
+  cond = flags_for(gpr[DR(instr)]);
+  DISPATCH();
+op_ldr:
+  gpr[DR(instr)] = mem_read(vm, (uint16_t)(gpr[SR1(instr)] + OFF6(instr)));
+  cond = flags_for(gpr[DR(instr)]);
+  DISPATCH();
+op_lea:
+  gpr[DR(instr)] = (uint16_t)(pc + OFF9(instr));
+  cond = flags_for(gpr[DR(instr)]);
+  DISPATCH();
+op_st:
+  mem_write(vm, (uint16_t)(pc + OFF9(instr)), gpr[DR(instr)]);
+  DISPATCH();
+op_sti:
+  mem_write(vm, mem_read(vm, (uint16_t)(pc + OFF9(instr))), gpr[DR(instr)]);
+  DISPATCH();
+op_str:
+  mem_write(vm, (uint16_t)(gpr[SR1(instr)] + OFF6(instr)), gpr[DR(instr)]);
+  DISPATCH();
+op_ref:
+  /* TRAP and the unused opcodes go through the reference interpreter */
+  SPILL();
+  execute_instr(vm, instr, running);
+  RELOAD();
+  if (!*running) {
+    goto done;
+  }
+  DISPATCH();
+
+done:
+  SPILL();
+  return budget - remaining;
+}
+
+#pragma GCC diagnostic pop
+
+#else
+
+uint64_t run_threaded(vm_t* vm, uint64_t budget, int* running) {
+  return run_instructions(vm, budget, running);
+}
+
+#endif
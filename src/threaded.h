@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "utils.h"
+#include "vm.h"
+
+/**
+ * Runs the fetch-decode-execute loop using direct-threaded dispatch.
+ *
+ * Equivalent to run_instructions, but every handler ends with its own
+ * indirect jump through a table of label addresses (GCC/Clang labels as
+ * values) instead of returning to a single switch. The PC, the condition
+ * codes and R0-R7 are kept in locals for the whole call and only written back
+ * to the VM around traps and on return.
+ *
+ * On compilers without labels as values this falls back to run_instructions.
+ *
+ * @param vm The VM to run.
+ * @param budget The maximum number of instructions to execute.
+ * @param running An int pointer representing the status of the running loop.
+ *
+ * @return The number of instructions retired, at most budget.
+ */
+uint64_t run_threaded(vm_t* vm, uint64_t budget, int* running);
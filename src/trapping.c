@@ -5,67 +5,80 @@
 
 #include "memory.h"
 #include "utils.h"
+#include "vm.h"
 
-void trap_getc(void) {
-  int input = getc(stdin);
+/* Writes a C string through the VM's console, returns EOF on failure. */
+static int put_string(vm_t* vm, const char* str) {
+  for (; *str; ++str) {
+    if (vm->io.put_char(vm->io.ctx, *str) == EOF) {
+      return EOF;
+    }
+  }
+  return 0;
+}
+
+void trap_getc(vm_t* vm) {
+  int input = vm->io.get_char(vm->io.ctx);
   if (input == EOF) {
     error_and_exit("Failed to get character in GETC.");
   }
 
   else {
-    reg[R_R0] = (uint16_t)input;
-    update_flags(R_R0);
+    vm->reg[R_R0] = (uint16_t)input;
+    update_flags(vm, R_R0);
   }
 }
-void trap_out(void) {
-  if (putc((char)reg[R_R0], stdout) == EOF) {
+void trap_out(vm_t* vm) {
+  if (vm->io.put_char(vm->io.ctx, (char)vm->reg[R_R0]) == EOF) {
     error_and_exit("Failed to print in OUT");
   }
-  if (fflush(stdout) == EOF) {
+  if (vm->io.flush(vm->io.ctx) == EOF) {
     error_and_exit("Failed to flush in OUT.");
   }
 }
-void trap_puts(void) {
-  uint16_t* chr = memory + reg[R_R0];  // get char pointer
+void trap_puts(vm_t* vm) {
+  uint16_t* chr = vm->memory + vm->reg[R_R0];  // get char pointer
   while (*chr) {
-    if (putc((char)*chr, stdout) == EOF) {
+    if (vm->io.put_char(vm->io.ctx, (char)*chr) == EOF) {
       error_and_exit("Failed to put in PUTS.");
     }
     ++chr;
   }
-  if (fflush(stdout) == EOF) {
+  if (vm->io.flush(vm->io.ctx) == EOF) {
     error_and_exit("Failed to flush in PUTS.");
   }
 }
 
-void trap_in(void) {
-  printf("Enter a character: ");
-  int chr = getc(stdin);
+void trap_in(vm_t* vm) {
+  if (put_string(vm, "Enter a character: ") == EOF) {
+    error_and_exit("Failed to print prompt in IN.");
+  }
+  int chr = vm->io.get_char(vm->io.ctx);
   if (chr == EOF) {
     error_and_exit("Failed to get input character in IN");
   }
-  if (putc((char)chr, stdout) == EOF) {
+  if (vm->io.put_char(vm->io.ctx, (char)chr) == EOF) {
     error_and_exit("Failed to print input character in IN.");
   }
-  if (fflush(stdout) == EOF) {
+  if (vm->io.flush(vm->io.ctx) == EOF) {
     error_and_exit("Failed to flush stdout in IN.");
   }
-  reg[R_R0] = (uint16_t)chr;  // store as unsigned 16-bit value into R0
-  update_flags(R_R0);
+  vm->reg[R_R0] = (uint16_t)chr;  // store as unsigned 16-bit value into R0
+  update_flags(vm, R_R0);
 }
 
-void trap_putsp(void) {
-  uint16_t* chr = memory + reg[R_R0];  // get address in memory
+void trap_putsp(vm_t* vm) {
+  uint16_t* chr = vm->memory + vm->reg[R_R0];  // get address in memory
 
   while (*chr) {
     uint8_t chr1 = (uint8_t)((*chr) & BIT_MASK_8);  // mask lower 8 bits
-    if (putc(chr1, stdout) == EOF) {
+    if (vm->io.put_char(vm->io.ctx, chr1) == EOF) {
       error_and_exit("Failed to print 1st char in PUTSP.");
     }
 
     uint8_t chr2 = (uint8_t)((*chr) >> BIT_SHIFT_8);  // shift to upper 8 bits
     if (chr2 != 0) {  // only print if second character exists
-      if (putc(chr2, stdout) == EOF) {
+      if (vm->io.put_char(vm->io.ctx, chr2) == EOF) {
         error_and_exit("Failed to print 2nd char in PUTSP.");
       }
     }
@@ -73,13 +86,15 @@ void trap_putsp(void) {
     ++chr;
   }
 
-  if (fflush(stdout) == EOF) {
+  if (vm->io.flush(vm->io.ctx) == EOF) {
     error_and_exit("Failed to flush stdout in PUTSP.");
   }
 }
-void trap_halt(int* running) {
-  printf("HALT");
-  if (fflush(stdout) == EOF) {
+void trap_halt(vm_t* vm, int* running) {
+  if (put_string(vm, "HALT") == EOF) {
+    error_and_exit("Failed to print in HALT.");
+  }
+  if (vm->io.flush(vm->io.ctx) == EOF) {
     error_and_exit("Failed to flush stdout in HALT.");
   };
   *running = 0;
@@ -3,6 +3,7 @@
 
 #include "memory.h"
 #include "utils.h"
+#include "vm.h"
 
 // NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
 #define BIT_MASK_8 0xFFU
@@ -12,28 +13,39 @@
 /**
  * Trapping function for getting a char from keyboard, not echoed onto the
  * terminal.
+ *
+ * @param vm The VM executing the trap.
  */
-void trap_getc(void);
+void trap_getc(vm_t* vm);
 /**
  * Trapping function for outputting a char onto the terminal.
+ *
+ * @param vm The VM executing the trap.
  */
-void trap_out(void);
+void trap_out(vm_t* vm);
 /**
  * Trapping function for outputting a char onto the terminal.
+ *
+ * @param vm The VM executing the trap.
  */
-void trap_puts(void);
+void trap_puts(vm_t* vm);
 /**
  * Trapping function for getting an input char from stdin, echoed onto the
  * terminal.
+ *
+ * @param vm The VM executing the trap.
  */
-void trap_in(void);
+void trap_in(vm_t* vm);
 /**
  * Trapping function for outputting a byte string.
+ *
+ * @param vm The VM executing the trap.
  */
-void trap_putsp(void);
+void trap_putsp(vm_t* vm);
 /**
  * Trapping function for halting the program.
  *
+ * @param vm The VM executing the trap.
  * @param running An int pointer representing the status of the running loop.
  */
-void trap_halt(int* running);
+void trap_halt(vm_t* vm, int* running);
@@ -5,20 +5,32 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/select.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "audio.h"
+#include "bank.h"
+#include "bulkio.h"
+#include "cache.h"
 #include "memory.h"
+#include "render.h"
+#include "wav.h"
 
 struct timeval;
 
-// Register Storage
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MSEC_PER_SEC 1000U
+#define NSEC_PER_MSEC 1000000L
+#define NSEC_PER_SEC_L 1000000000L
+#define STREAM_CHUNK_BYTES 8192U
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
 
 // NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
-uint16_t reg[R_COUNT];
 struct termios original_tio;
+volatile sig_atomic_t interrupt_requested;
 // NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
 
 void error_and_exit(const char* error_msg) {
@@ -49,21 +61,44 @@ uint16_t check_key(void) {
   return select(1, &readfds, NULL, NULL, &timeout) != 0;
 }
 
-void update_flags(uint16_t R_Rx) {
-  if (reg[R_Rx] == 0) {
-    reg[R_COND] = FL_ZRO;
-  } else if (reg[R_Rx] >> (2 * BYTE_LEN - 1)) {
-    reg[R_COND] = FL_NEG;
-  } else {
-    reg[R_COND] = FL_POS;
+void handle_interrupt(int signal) {
+  (void)signal;
+  interrupt_requested = 1;
+}
+
+double monotonic_seconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + (double)now.tv_nsec / NSEC_PER_SEC;
+}
+
+struct timespec deadline_after_ms(uint32_t timeout_ms) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += (time_t)(timeout_ms / MSEC_PER_SEC);
+  deadline.tv_nsec += (long)(timeout_ms % MSEC_PER_SEC) * NSEC_PER_MSEC;
+  if (deadline.tv_nsec >= NSEC_PER_SEC_L) {
+    ++deadline.tv_sec;
+    deadline.tv_nsec -= NSEC_PER_SEC_L;
   }
+  return deadline;
+}
+
+void update_flags(vm_t* vm, uint16_t R_Rx) {
+  vm->reg[R_COND] = flags_for(vm->reg[R_Rx]);
 }
 
 uint16_t swap16(uint16_t bit) {
   return (uint16_t)(bit << BYTE_LEN) | (uint16_t)(bit >> BYTE_LEN);
 }
 
-void read_image_file(FILE* file) {
+int has_suffix(const char* str, const char* suffix) {
+  size_t len = strlen(str);
+  size_t suffix_len = strlen(suffix);
+  return len >= suffix_len && !strcmp(str + len - suffix_len, suffix);
+}
+
+void read_image_file(vm_t* vm, FILE* file) {
   /* the origin tells us where in memory to place the image */
   uint16_t origin = 0;
   if (!fread(&origin, sizeof(origin), 1, file)) {
@@ -73,64 +108,251 @@ void read_image_file(FILE* file) {
 
   /* we know the maximum file size so we only need one fread */
   uint16_t max_read = MEMORY_MAX - origin;
-  uint16_t* pointer = memory + origin;
+  uint16_t* pointer = vm->memory + origin;
   size_t read = fread(pointer, sizeof(uint16_t), max_read, file);
+  mem_loaded(vm, origin, read);
+
+  /* swap to little endian */
+  swap16_buffer(pointer, (const uint8_t*)pointer, read);
+}
+
+int read_image_bytes(vm_t* vm, const uint8_t* bytes, size_t size) {
+  if (size < sizeof(uint16_t)) {
+    return 0;
+  }
+  uint16_t origin = 0;
+  swap16_buffer(&origin, bytes, 1);
+
+  /* same limit as read_image_file, and any odd trailing byte is ignored */
+  size_t count = (size - sizeof(uint16_t)) / sizeof(uint16_t);
+  if (count > (size_t)(MEMORY_MAX - origin)) {
+    count = MEMORY_MAX - origin;
+  }
+  swap16_buffer(vm->memory + origin, bytes + sizeof(uint16_t), count);
+  mem_loaded(vm, origin, count);
+  return 1;
+}
 
-  // /* swap to little endian */
-  while (read-- > 0) {
-    *pointer = swap16(*pointer);
-    ++pointer;
+size_t read_words_stream(vm_t* vm, FILE* stream, uint16_t origin) {
+  size_t capacity = (size_t)(MEMORY_MAX - origin);
+  size_t count = 0;
+  uint8_t chunk[STREAM_CHUNK_BYTES];
+  size_t got = 0;
+  /* swap each chunk while it is still in cache; once memory is full the
+     rest is drained so the writer is not killed by a closed pipe */
+  while ((got = fread(chunk, 1, sizeof(chunk), stream)) > 0) {
+    size_t words = got / sizeof(uint16_t);
+    if (words > capacity - count) {
+      words = capacity - count;
+    }
+    swap16_buffer(vm->memory + origin + count, chunk, words);
+    count += words;
   }
+
+  mem_loaded(vm, origin, count);
+  return count;
 }
 
-int read_image(const char* image_path) {
-  const char* output_obj = "audio.obj";
-  char* suffix_wav = ".wav";
-  char* suffix_mp3 = ".mp3";
+/* Converts an audio file to samples at AUDIO_ADDRESS, returns how many. */
+static size_t convert_audio(vm_t* vm, const char* audio_path,
+                            const mapped_file_t* input, int is_wav) {
+  /* decode WAV files in-process, without starting ffmpeg */
+  if (is_wav) {
+    size_t samples =
+        wav_decode(input->data, input->size, vm->memory + AUDIO_ADDRESS,
+                   (size_t)AUDIO_CLIP_SECONDS * AUDIO_FREQUENCY,
+                   AUDIO_FREQUENCY);
+    if (samples > 0) {
+      mem_loaded(vm, AUDIO_ADDRESS, samples);
+      return samples;
+    }
+  }
+  /* other formats, and WAV encodings the decoder does not handle */
+  FILE* pipe = open_audio_pipe(audio_path, AUDIO_FFMPEG_ARGS);
+  if (!pipe) {
+    return 0;
+  }
+  size_t samples = read_words_stream(vm, pipe, AUDIO_ADDRESS);
+  return close_audio_pipe(pipe) ? samples : 0;
+}
 
-  if (!strcmp(image_path + strlen(image_path) - strlen(suffix_wav),
-              suffix_wav) ||
-      !strcmp(image_path + strlen(image_path) - strlen(suffix_mp3),
-              suffix_mp3)) {
-    const char* output_pcm = "audio.pcm";
-    if (process_audio(image_path, output_pcm) == 0) {
-      pcm_to_obj(output_pcm, output_obj);
-    } else {
+/* A five-second clip runs on past AUDIO_ADDRESS into the device registers.
+   The DMA player tells a clip from a stream by MR_BANK_COUNT, so a sample
+   must not be left there. */
+static int clip_loaded(vm_t* vm, int loaded) {
+  if (loaded) {
+    vm->memory[MR_BANK_COUNT] = vm->bank ? vm->bank->count : 0;
+  }
+  return loaded;
+}
+
+int read_image(vm_t* vm, const char* image_path) {
+  int is_wav = has_suffix(image_path, ".wav");
+
+  if (is_wav || has_suffix(image_path, ".mp3")) {
+    mapped_file_t input;
+    if (!map_file(image_path, &input)) {
       return 0;
     }
-  } else {
-    output_obj = image_path;
+    /* a converted image is reused as long as the input and the conversion
+       are the same */
+    char dir[CACHE_PATH_MAX];
+    int cached = cache_dir(dir, sizeof(dir));
+    uint64_t key = cache_key(input.data, input.size,
+                             is_wav ? AUDIO_WAV_CLIP_ARGS : AUDIO_FFMPEG_ARGS);
+    mapped_file_t image;
+    if (cached && cache_lookup(dir, key, &image)) {
+      unmap_file(&input);
+      int loaded = read_image_bytes(vm, image.data, image.size);
+      unmap_file(&image);
+      return clip_loaded(vm, loaded);
+    }
+
+    size_t samples = convert_audio(vm, image_path, &input, is_wav);
+    unmap_file(&input);
+    if (cached && samples > 0) {
+      cache_store(dir, key, AUDIO_ADDRESS, vm->memory + AUDIO_ADDRESS,
+                  samples);
+    }
+    return clip_loaded(vm, samples > 0);
   }
 
-  FILE* file = fopen(output_obj, "rbe");
-  if (!file) {
+  mapped_file_t image;
+  if (!map_file(image_path, &image)) {
     return 0;
-  };
-  read_image_file(file);
-
-  if (fclose(file) != 0) {
-    error_and_exit("Failed to close image file");
   }
+  if (!read_image_bytes(vm, image.data, image.size)) {
+    error_and_exit("Unable to read origin from image");
+  }
+  unmap_file(&image);
   return 1;
 }
 
-void update_texture(SDL_Texture* texture) {
-  void* pixels = NULL;
-  int pitch = 0;
-  SDL_LockTexture(texture, NULL, &pixels, &pitch);
+/* Decodes a WAV file into the image in a file, through a shared mapping of
+   the whole track, so the samples never take heap memory. Returns the
+   number of samples, 0 on failure. */
+static size_t decode_wav_into(const mapped_file_t* input, int fd) {
+  size_t length = wav_length(input->data, input->size, AUDIO_FREQUENCY);
+  size_t size = (length + 1) * sizeof(uint16_t);
+  if (length == 0 || ftruncate(fd, (off_t)size) != 0) {
+    return 0;
+  }
+  uint16_t* image =
+      mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (image == MAP_FAILED) {
+    return 0;
+  }
+  size_t count = wav_decode(input->data, input->size, image + 1, length,
+                            AUDIO_FREQUENCY);
+  image[0] = swap16(BANK_WINDOW_ADDRESS);
+  swap16_buffer(image + 1, (const uint8_t*)(image + 1), count);
+  munmap(image, size);
+  if (ftruncate(fd, (off_t)((count + 1) * sizeof(uint16_t))) != 0) {
+    return 0;
+  }
+  return count;
+}
 
-  uint32_t* pixel_ptr = (uint32_t*)pixels;
+/* Copies ffmpeg's big-endian samples into the image in a file a chunk at a
+   time. Returns the number of samples, 0 on failure. */
+static size_t pipe_into(FILE* pipe, int fd) {
+  uint16_t origin = swap16(BANK_WINDOW_ADDRESS);
+  if (ftruncate(fd, 0) != 0 || lseek(fd, 0, SEEK_SET) != 0 ||
+      !write_all(fd, &origin, sizeof(origin))) {
+    return 0;
+  }
+  uint8_t chunk[STREAM_CHUNK_BYTES];
+  size_t bytes = 0;
+  size_t got = 0;
+  while ((got = fread(chunk, 1, sizeof(chunk), pipe)) > 0) {
+    if (!write_all(fd, chunk, got)) {
+      return 0;
+    }
+    bytes += got;
+  }
+  /* a trailing odd byte is not a sample */
+  size_t count = bytes / sizeof(uint16_t);
+  if (ftruncate(fd, (off_t)((count + 1) * sizeof(uint16_t))) != 0) {
+    return 0;
+  }
+  return count;
+}
 
-  for (uint16_t addr = 0; addr < MEMORY_MAX; ++addr) {
-    uint16_t val = memory[addr];
-    uint16_t intensity = (uint16_t)(val >> BIT_SHIFT_8) & BYTE_MASK;
-    uint32_t color = (BYTE_MASK << BIT_SHIFT_24) |            // A
-                     (uint32_t)(intensity << BIT_SHIFT_16) |  // R
-                     (uint32_t)(intensity << BIT_SHIFT_8) |   // G
-                     (intensity);                             // B
+/* Converts a whole audio file into an image of samples in a file, after a
+   big-endian origin. Returns the number of samples, 0 on failure. */
+static size_t convert_stream(const char* audio_path,
+                             const mapped_file_t* input, int is_wav, int fd) {
+  if (is_wav) {
+    size_t count = decode_wav_into(input, fd);
+    if (count > 0) {
+      return count;
+    }
+  }
+  FILE* pipe = open_audio_pipe(audio_path, AUDIO_STREAM_ARGS);
+  if (!pipe) {
+    return 0;
+  }
+  size_t count = pipe_into(pipe, fd);
+  return close_audio_pipe(pipe) ? count : 0;
+}
+
+int read_audio_stream(vm_t* vm, const char* audio_path) {
+  int is_wav = has_suffix(audio_path, ".wav");
+  mapped_file_t input;
+  if (!map_file(audio_path, &input)) {
+    return 0;
+  }
+  bank_detach(vm);
+
+  char dir[CACHE_PATH_MAX];
+  int cached = cache_dir(dir, sizeof(dir));
+  uint64_t key = cache_key(input.data, input.size,
+                           is_wav ? AUDIO_WAV_STREAM_ARGS : AUDIO_STREAM_ARGS);
+  mapped_file_t image;
+  if (cached && cache_lookup(dir, key, &image)) {
+    unmap_file(&input);
+    bank_attach(vm, image, NULL);
+    return 1;
+  }
 
-    pixel_ptr[addr] = color;
+  /* the samples go straight to the cache entry, or without the cache to an
+     unlinked file, and are streamed from its mapping, so only the banks
+     played are paged in */
+  cache_entry_t entry;
+  int storing = cached && cache_create(dir, key, &entry);
+  FILE* scratch = storing ? NULL : tmpfile();
+  int fd = storing ? entry.fd : scratch ? fileno(scratch) : -1;
+  size_t count = fd >= 0 ? convert_stream(audio_path, &input, is_wav, fd) : 0;
+  unmap_file(&input);
+  int mapped = count > 0 && map_descriptor(fd, &image);
+  if (storing && mapped) {
+    (void)cache_commit(dir, &entry);
+  } else if (storing) {
+    cache_discard(&entry);
+  }
+  if (scratch) {
+    (void)fclose(scratch);
+  }
+  if (!mapped) {
+    return 0;
   }
+  bank_attach(vm, image, NULL);
+  return 1;
+}
 
-  SDL_UnlockTexture(texture);
+size_t update_texture(const uint16_t* memory, uint64_t* dirty_pages,
+                      SDL_Texture* texture, uint32_t* pixels,
+                      const palette_t* palette) {
+  render_span_t spans[RENDER_MAX_SPANS];
+  size_t num_spans =
+      render_dirty_rows(memory, dirty_pages, pixels, palette, spans);
+  const int pitch = MEMORY_MAP_DIM * (int)sizeof(uint32_t);
+
+  for (size_t i = 0; i < num_spans; ++i) {
+    SDL_Rect rect = {0, spans[i].first_row, MEMORY_MAP_DIM, spans[i].rows};
+    SDL_UpdateTexture(texture, &rect,
+                      pixels + (size_t)spans[i].first_row * MEMORY_MAP_DIM,
+                      pitch);
+  }
+  return num_spans;
 }
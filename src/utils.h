@@ -9,10 +9,13 @@
 #include <sys/termios.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "audio.h"
 #include "memory.h"
+#include "render.h"
+#include "vm.h"
 
 // NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
 #define BYTE_LEN 8U
@@ -20,26 +23,12 @@
 #define BIT_SHIFT_8 8U
 #define BIT_SHIFT_16 16U
 #define BIT_SHIFT_24 24U
+#define NSEC_PER_SEC 1e9
 // NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
 
-// Registers Enum
-enum {
-  R_R0 = 0,
-  R_R1,
-  R_R2,
-  R_R3,
-  R_R4,
-  R_R5,
-  R_R6,
-  R_R7,
-  R_PC, /* Program Counter */
-  R_COND,
-  R_COUNT
-};
-
-// Register Storage
+// Set by handle_interrupt, polled by the main loop between instruction slices
 // NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
-extern uint16_t reg[R_COUNT];
+extern volatile sig_atomic_t interrupt_requested;
 
 // Opcodes for Instructions
 enum {
@@ -79,9 +68,16 @@ enum {
 // Allows to poll the keyboard state and avoid blocking the execution of the
 // program,
 enum {
-  MR_KBSR = 0xFE00,       /* Keyboard Status */
-  MR_KBDR = 0xFE02,       /* Keyboard data */
-  MR_AUDIO_DATA = 0xFE04, /* Audio data */
+  MR_KBSR = 0xFE00,        /* Keyboard Status */
+  MR_KBDR = 0xFE02,        /* Keyboard data */
+  MR_AUDIO_DATA = 0xFE04,  /* Audio data */
+  MR_BANK_SELECT = 0xFE06, /* Stream bank shown in the window */
+  MR_BANK_COUNT = 0xFE08,  /* Banks in the stream, read-only */
+  MR_DMA_SOURCE = 0xFE0A,  /* First word of an audio DMA buffer */
+  MR_DMA_LENGTH = 0xFE0C,  /* Words in an audio DMA buffer */
+  MR_DMA_CONTROL = 0xFE0E, /* DMA_START to play it, then reads DMA_DONE */
+  MR_VOICE_BASE = 0xFE10,  /* Registers of the mixer's voices */
+  MR_VOICE_END = 0xFE50,   /* One past the last voice register */
 };
 
 /**
@@ -117,16 +113,52 @@ uint16_t check_key(void);
 /**
  * Handles interrupt signals to perform cleanup or other actions.
  *
+ * Only sets interrupt_requested, so the main loop can stop at the next slice
+ * boundary, restore the terminal and print its report.
+ *
  * @param signal The signal number that triggered the interrupt.
  */
 void handle_interrupt(int signal);
 
+/**
+ * Reads the monotonic clock.
+ *
+ * Used for throughput reports, and available without initializing SDL.
+ *
+ * @return The current monotonic time in seconds.
+ */
+double monotonic_seconds(void);
+
+/**
+ * Computes an absolute CLOCK_REALTIME deadline for pthread_cond_timedwait.
+ *
+ * @param timeout_ms How far from now the deadline is, in milliseconds.
+ *
+ * @return The deadline.
+ */
+struct timespec deadline_after_ms(uint32_t timeout_ms);
+
+/**
+ * Computes the condition flag for a value.
+ *
+ * @param value The value written to a register.
+ *
+ * @return FL_ZRO, FL_NEG or FL_POS.
+ */
+static inline uint16_t flags_for(uint16_t value) {
+  if (value == 0) {
+    return FL_ZRO;
+  }
+  return (value >> (2 * BYTE_LEN - 1)) ? FL_NEG : FL_POS;
+}
+
 /**
  * Updates the flag according to the value stored in the provided register
  *
+ * @param vm The VM whose registers to use.
  * @param R_Rx a uint16_t representing the register to update flags for
  */
-void update_flags(uint16_t R_Rx);
+void update_flags(vm_t* vm, uint16_t R_Rx);
 
 /**
  * Swap the byte order of a uint16_t. Converts a little-endian value to
@@ -138,33 +170,110 @@ void update_flags(uint16_t R_Rx);
  */
 uint16_t swap16(uint16_t bit);
 
+/**
+ * Tells whether a string, such as a file name, ends with a suffix.
+ *
+ * @param str The string to check.
+ * @param suffix The ending to look for, e.g. ".wav".
+ *
+ * @return 1 if str ends with suffix, 0 otherwise, including when str is
+ *         shorter than suffix.
+ */
+int has_suffix(const char* str, const char* suffix);
+
 /**
  * Read an image file into memory from a file pointer.
  *
  * Copies contents right into an address of memory.
  *
+ * @param vm The VM to load the image into.
  * @param file a FILE pointer representing the image.
  */
-void read_image_file(FILE* file);
+void read_image_file(vm_t* vm, FILE* file);
+
+/**
+ * Reads an image that is already in memory, such as a mapped file.
+ *
+ * Uses the same format and limits as read_image_file, and converts the whole
+ * image with one vectorized byte swap.
+ *
+ * @param vm The VM to load the image into.
+ * @param bytes The image: a big-endian origin followed by big-endian words.
+ * @param size The size of the image in bytes.
+ *
+ * @return 1 on success, 0 if the image is too short to hold an origin.
+ */
+int read_image_bytes(vm_t* vm, const uint8_t* bytes, size_t size);
+
+/**
+ * Streams big-endian words into memory as they arrive.
+ *
+ * Each chunk is byte-swapped into place as soon as it is read, so there is
+ * no intermediate file and no second pass. Words past the end of memory are
+ * read and dropped so the writer can finish, and an odd trailing byte is
+ * ignored.
+ *
+ * @param vm The VM to load the words into.
+ * @param stream The words, e.g. a decoder's pipe.
+ * @param origin The address of the first word.
+ *
+ * @return The number of words stored.
+ */
+size_t read_words_stream(vm_t* vm, FILE* stream, uint16_t origin);
 
 /**
- * Reads an image file or processes an audio file into an image-like object.
+ * Reads an image file or processes an audio file into memory.
  *
- * Handles image files and audio files (e.g., `.wav`, `.mp3`). For audio files,
- * processes them into a temporary PCM file, converts it into an object file,
- * and then reads it. For image files, directly reads the file.
+ * Handles image files and audio files (e.g., `.wav`, `.mp3`). Audio files are
+ * loaded from the conversion cache when the same file was converted before.
+ * Otherwise WAV files are decoded in-process, and anything else is decoded
+ * by ffmpeg and streamed through a pipe straight to AUDIO_ADDRESS; the
+ * result is then cached. Image files are mapped and read directly.
  *
+ * @param vm The VM to load the image into.
  * @param image_path Path to the image or audio file. Supported audio formats:
  *                   `.wav`, `.mp3`.
  *
  * @return 1 on success, 0 on failure (e.g., file not found, processing error).
  */
-int read_image(const char* image_path);
+int read_image(vm_t* vm, const char* image_path);
+
+/**
+ * Converts a whole audio file and attaches it to a VM as a stream of banks.
+ *
+ * Unlike read_image, nothing is cut: the track is converted once, at the
+ * same rate and with the same filters, into a conversion cache entry that
+ * is mapped and shown to the guest one bank at a time through
+ * MR_BANK_SELECT. Without the cache the track goes to an unlinked temporary
+ * file that is mapped the same way.
+ *
+ * @param vm The VM to attach the stream to, replacing any it had.
+ * @param audio_path Path to the audio file, in any format read_image takes.
+ *
+ * @return 1 on success, 0 on failure.
+ */
+int read_audio_stream(vm_t* vm, const char* audio_path);
 
 /**
  * Updates the given SDL_Texture with the values of the addresses stored in the
  * memory.
  *
- * @param texture A pointer to the SDL_Texture to be updated.
+ * Only rows whose pages were written since the last call are converted and
+ * uploaded, one SDL_UpdateTexture call per span of consecutive dirty rows.
+ * Each word's high byte selects a color from the palette, converted with the
+ * fastest SIMD kernel the CPU supports.
+ *
+ * @param memory The memory to draw, a VM's or a snapshot of it.
+ * @param dirty_pages The pages changed since the last call, cleared
+ *                    afterwards.
+ * @param texture A pointer to the MEMORY_MAP_DIM square SDL_Texture to be
+ *                updated.
+ * @param pixels The MEMORY_MAP_DIM square image the texture was last updated
+ *               from, kept by the caller between frames.
+ * @param palette The colors to draw with.
+ *
+ * @return The number of spans uploaded, 0 if the texture is unchanged.
  */
-void update_texture(SDL_Texture* texture);
+size_t update_texture(const uint16_t* memory, uint64_t* dirty_pages,
+                      SDL_Texture* texture, uint32_t* pixels,
+                      const palette_t* palette);
@@ -0,0 +1,319 @@
+#include "video.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "render.h"
+#include "utils.h"
+#include "vm.h"
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define FRAME_PIXELS (MEMORY_MAP_DIM * MEMORY_MAP_DIM)
+#define RGB_BYTES 3U
+#define RGBA_BYTES 4U
+#define PNG_ROW_BYTES (1U + RGB_BYTES * MEMORY_MAP_DIM) /* filter byte first */
+#define PNG_RAW_BYTES (PNG_ROW_BYTES * MEMORY_MAP_DIM)
+#define STORED_MAX 0xFFFFU /* bytes in an uncompressed deflate block */
+#define STORED_HEADER 5U   /* the block type byte, LEN and NLEN */
+#define ADLER_MOD 65521U
+#define CRC_POLY 0xEDB88320U
+#define PNG_SUFFIX ".png"
+#define FRAME_NAME_MAX 24U /* "_", the frame number and PNG_SUFFIX */
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+video_format_t video_format_for(const char* path) {
+  if (has_suffix(path, ".y4m")) {
+    return VIDEO_Y4M;
+  }
+  return has_suffix(path, PNG_SUFFIX) ? VIDEO_PNG : VIDEO_RAW;
+}
+
+static uint32_t channel(uint32_t pixel, uint32_t shift) {
+  return (pixel >> shift) & BYTE_MASK;
+}
+
+// --- PNG ---
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+static uint32_t crc_table[PALETTE_SIZE];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+static void crc_init(void) {
+  for (uint32_t i = 0; i < PALETTE_SIZE; ++i) {
+    uint32_t crc = i;
+    for (uint32_t bit = 0; bit < BIT_SHIFT_8; ++bit) {
+      crc = (crc & 1U) ? CRC_POLY ^ (crc >> 1U) : crc >> 1U;
+    }
+    crc_table[i] = crc;
+  }
+}
+
+static uint32_t crc_update(uint32_t crc, const uint8_t* bytes, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    crc = crc_table[(crc ^ bytes[i]) & BYTE_MASK] ^ (crc >> BIT_SHIFT_8);
+  }
+  return crc;
+}
+
+static void put_be32(uint8_t* out, uint32_t value) {
+  out[0] = (uint8_t)(value >> BIT_SHIFT_24);
+  out[1] = (uint8_t)channel(value, BIT_SHIFT_16);
+  out[2] = (uint8_t)channel(value, BIT_SHIFT_8);
+  out[3] = (uint8_t)(value & BYTE_MASK);
+}
+
+/* Writes a chunk: its length, type and data, then the CRC of the last two. */
+static int write_chunk(FILE* file, const char* type, const uint8_t* data,
+                       uint32_t size) {
+  uint8_t length[4];
+  uint8_t crc[4];
+  put_be32(length, size);
+  uint32_t sum = crc_update(UINT32_MAX, (const uint8_t*)type, 4);
+  put_be32(crc, crc_update(sum, data, size) ^ UINT32_MAX);
+  return fwrite(length, 1, 4, file) == 4 && fwrite(type, 1, 4, file) == 4 &&
+         fwrite(data, 1, size, file) == size && fwrite(crc, 1, 4, file) == 4;
+}
+
+int video_write_png(FILE* file, const uint32_t* pixels) {
+  // NOLINTBEGIN(readability-magic-numbers)
+  static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A,
+                                       '\n'};
+  uint8_t header[13] = {0};
+  put_be32(header, MEMORY_MAP_DIM);
+  put_be32(header + 4, MEMORY_MAP_DIM);
+  header[8] = 8; /* bits per channel */
+  header[9] = 2; /* RGB */
+  // NOLINTEND(readability-magic-numbers)
+  (void)pthread_once(&crc_once, crc_init);
+
+  /* a zlib stream of stored deflate blocks holding the filtered rows */
+  const size_t blocks = (PNG_RAW_BYTES + STORED_MAX - 1) / STORED_MAX;
+  const size_t size = 2 + PNG_RAW_BYTES + blocks * STORED_HEADER + 4;
+  uint8_t* data = malloc(size);
+  uint8_t* row = malloc(PNG_ROW_BYTES);
+  if (!data || !row) {
+    error_and_exit("Failed to allocate PNG frame");
+  }
+  data[0] = 0x78; /* deflate with a 32 KiB window */
+  data[1] = 0x01; /* no preset dictionary, header check bits */
+  uint8_t* out = data + 2;
+  size_t block_left = 0;
+  size_t raw_left = PNG_RAW_BYTES;
+  uint32_t adler_low = 1;
+  uint32_t adler_high = 0;
+  for (uint32_t y = 0; y < MEMORY_MAP_DIM; ++y) {
+    row[0] = 0; /* no filter */
+    for (uint32_t x = 0; x < MEMORY_MAP_DIM; ++x) {
+      uint32_t pixel = pixels[y * MEMORY_MAP_DIM + x];
+      row[1 + RGB_BYTES * x] = (uint8_t)channel(pixel, BIT_SHIFT_24);
+      row[2 + RGB_BYTES * x] = (uint8_t)channel(pixel, BIT_SHIFT_16);
+      row[3 + RGB_BYTES * x] = (uint8_t)channel(pixel, BIT_SHIFT_8);
+    }
+    for (size_t i = 0; i < PNG_ROW_BYTES; ++i) {
+      if (block_left == 0) {
+        block_left = raw_left < STORED_MAX ? raw_left : STORED_MAX;
+        *out++ = raw_left == block_left; /* BFINAL on the last block */
+        *out++ = (uint8_t)(block_left & BYTE_MASK);
+        *out++ = (uint8_t)(block_left >> BIT_SHIFT_8);
+        *out++ = (uint8_t)(~block_left & BYTE_MASK);
+        *out++ = (uint8_t)((~block_left >> BIT_SHIFT_8) & BYTE_MASK);
+      }
+      *out++ = row[i];
+      --block_left;
+      --raw_left;
+      adler_low = (adler_low + row[i]) % ADLER_MOD;
+      adler_high = (adler_high + adler_low) % ADLER_MOD;
+    }
+  }
+  put_be32(out, (adler_high << BIT_SHIFT_16) | adler_low);
+
+  int written = fwrite(signature, 1, sizeof(signature), file) ==
+                    sizeof(signature) &&
+                write_chunk(file, "IHDR", header, sizeof(header)) &&
+                write_chunk(file, "IDAT", data, (uint32_t)size) &&
+                write_chunk(file, "IEND", NULL, 0);
+  free(row);
+  free(data);
+  return written;
+}
+
+// --- Y4M and raw ---
+
+static int write_y4m_frame(FILE* file, const uint32_t* pixels,
+                           uint8_t* planes) {
+  // NOLINTBEGIN(readability-magic-numbers)
+  /* BT.601 with studio swing, as players expect by default */
+  for (size_t i = 0; i < FRAME_PIXELS; ++i) {
+    int32_t red = (int32_t)channel(pixels[i], BIT_SHIFT_24);
+    int32_t green = (int32_t)channel(pixels[i], BIT_SHIFT_16);
+    int32_t blue = (int32_t)channel(pixels[i], BIT_SHIFT_8);
+    planes[i] = (uint8_t)(((66 * red + 129 * green + 25 * blue + 128) >> 8) +
+                          16);
+    planes[FRAME_PIXELS + i] =
+        (uint8_t)(((-38 * red - 74 * green + 112 * blue + 128) >> 8) + 128);
+    planes[2 * FRAME_PIXELS + i] =
+        (uint8_t)(((112 * red - 94 * green - 18 * blue + 128) >> 8) + 128);
+  }
+  // NOLINTEND(readability-magic-numbers)
+  return fputs("FRAME\n", file) >= 0 &&
+         fwrite(planes, 1, RGB_BYTES * FRAME_PIXELS, file) ==
+             RGB_BYTES * FRAME_PIXELS;
+}
+
+static int write_raw_frame(FILE* file, const uint32_t* pixels,
+                           uint8_t* bytes) {
+  for (size_t i = 0; i < FRAME_PIXELS; ++i) {
+    put_be32(bytes + RGBA_BYTES * i, pixels[i]); /* R, G, B, A */
+  }
+  return fwrite(bytes, 1, RGBA_BYTES * FRAME_PIXELS, file) ==
+         RGBA_BYTES * FRAME_PIXELS;
+}
+
+static int write_png_frame(const video_t* video, const uint32_t* pixels) {
+  char path[VIDEO_PATH_MAX + FRAME_NAME_MAX];
+  size_t stem = strlen(video->path) - strlen(PNG_SUFFIX);
+  // NOLINTNEXTLINE(cert-err33-c)
+  snprintf(path, sizeof(path), "%.*s_%06llu" PNG_SUFFIX, (int)stem,
+           video->path, (unsigned long long)video->stats.written);
+  FILE* file = fopen(path, "wbe");
+  if (!file) {
+    return 0;
+  }
+  int written = video_write_png(file, pixels);
+  return fclose(file) == 0 && written;
+}
+
+// --- the writer thread ---
+
+static void* video_writer(void* arg) {
+  video_t* video = arg;
+  uint32_t* pixels = malloc(FRAME_PIXELS * sizeof(uint32_t));
+  uint8_t* bytes = malloc(RGBA_BYTES * FRAME_PIXELS);
+  if (!pixels || !bytes) {
+    error_and_exit("Failed to allocate video frame");
+  }
+  render_kernel_t kernel = render_best_kernel();
+
+  for (;;) {
+    pthread_mutex_lock(&video->lock);
+    while (video->count == 0 && !video->closed) {
+      pthread_cond_wait(&video->ready, &video->lock);
+    }
+    int done = video->count == 0;
+    pthread_mutex_unlock(&video->lock);
+    if (done) {
+      break;
+    }
+
+    /* the VM thread does not touch a filled slot until it is released */
+    render_words(kernel, pixels, video->slots[video->tail], FRAME_PIXELS,
+                 &video->palette);
+    if (!video->failed) {
+      int written = 0;
+      switch (video->format) {
+        case VIDEO_Y4M:
+          written = write_y4m_frame(video->file, pixels, bytes);
+          break;
+        case VIDEO_PNG:
+          written = write_png_frame(video, pixels);
+          break;
+        default:
+          written = write_raw_frame(video->file, pixels, bytes);
+          break;
+      }
+      video->failed = !written;
+      video->stats.written += (uint64_t)written;
+    }
+    video->tail = (video->tail + 1) % VIDEO_QUEUE_FRAMES;
+
+    pthread_mutex_lock(&video->lock);
+    --video->count;
+    pthread_mutex_unlock(&video->lock);
+  }
+  free(bytes);
+  free(pixels);
+  return NULL;
+}
+
+video_t* video_open(const char* path, palette_id_t palette) {
+  video_format_t format = video_format_for(path);
+  if (strlen(path) >= VIDEO_PATH_MAX) {
+    return NULL;
+  }
+  FILE* file = NULL;
+  if (format != VIDEO_PNG) {
+    file = fopen(path, "wbe");
+    if (!file) {
+      return NULL;
+    }
+  }
+  video_t* video = calloc(1, sizeof(video_t));
+  if (!video) {
+    error_and_exit("Failed to allocate video export");
+  }
+  pthread_mutex_init(&video->lock, NULL);
+  pthread_cond_init(&video->ready, NULL);
+  video->format = format;
+  palette_init(&video->palette, palette);
+  video->file = file;
+  // NOLINTNEXTLINE(cert-err33-c)
+  snprintf(video->path, sizeof(video->path), "%s", path);
+  if (format == VIDEO_Y4M) {
+    // NOLINTNEXTLINE(cert-err33-c)
+    video->failed = fprintf(file, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n",
+                            MEMORY_MAP_DIM, MEMORY_MAP_DIM, VIDEO_FPS) < 0;
+  }
+
+  if (pthread_create(&video->writer, NULL, video_writer, video) != 0) {
+    error_and_exit("Failed to start video writer\n");
+  }
+  return video;
+}
+
+int video_capture(video_t* video, const vm_t* vm) {
+  ++video->stats.captured;
+  pthread_mutex_lock(&video->lock);
+  int full = video->count == VIDEO_QUEUE_FRAMES;
+  pthread_mutex_unlock(&video->lock);
+  if (full) {
+    ++video->stats.dropped;
+    return 0;
+  }
+
+  /* the slot is free until count says otherwise, so copy without the lock */
+  memcpy(video->slots[video->head], vm->memory, sizeof(vm->memory));
+  video->head = (video->head + 1) % VIDEO_QUEUE_FRAMES;
+  pthread_mutex_lock(&video->lock);
+  ++video->count;
+  pthread_cond_signal(&video->ready);
+  pthread_mutex_unlock(&video->lock);
+  return 1;
+}
+
+int video_close(video_t* video, video_stats_t* stats) {
+  if (!video) {
+    return 1;
+  }
+  pthread_mutex_lock(&video->lock);
+  video->closed = 1;
+  pthread_cond_signal(&video->ready);
+  pthread_mutex_unlock(&video->lock);
+  pthread_join(video->writer, NULL);
+
+  int written = !video->failed;
+  if (video->file) {
+    written = fclose(video->file) == 0 && written;
+  }
+  if (stats) {
+    *stats = video->stats;
+  }
+  pthread_cond_destroy(&video->ready);
+  pthread_mutex_destroy(&video->lock);
+  free(video);
+  return written;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "render.h"
+#include "vm.h"
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define VIDEO_QUEUE_FRAMES 512U        /* 64 MiB, touched only as needed */
+#define VIDEO_FPS 60U                  /* the rate in Y4M headers */
+#define VIDEO_DEFAULT_INTERVAL 200000U /* instructions between frames */
+#define VIDEO_DEFAULT_FRAMES 300U      /* five seconds at VIDEO_FPS */
+#define VIDEO_PATH_MAX 4096U
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+// What --video writes, chosen by the file name
+typedef enum {
+  VIDEO_RAW = 0, /* RGBA bytes, frame after frame, like ffmpeg's rawvideo */
+  VIDEO_Y4M,     /* a YUV4MPEG2 stream with full 4:4:4 chroma */
+  VIDEO_PNG,     /* one numbered PNG file per frame */
+} video_format_t;
+
+// How an export went
+typedef struct {
+  uint64_t captured; /* frames copied from the VM */
+  uint64_t dropped;  /* frames skipped because the queue was full */
+  uint64_t written;  /* frames encoded and stored */
+} video_stats_t;
+
+// Frames of the memory map on their way from the VM thread to a writer
+// thread. The VM thread copies memory into a free slot and moves on, and the
+// writer converts and encodes the slots in order. The lock only guards the
+// slot count, so the VM never waits for a frame to be encoded; when every
+// slot is taken the frame is dropped instead. The queue is deep enough to
+// hold a whole default export, and its pages are only committed once a
+// frame is copied into them.
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  pthread_t writer;
+  video_format_t format;
+  palette_t palette;
+  FILE* file;   /* NULL for a PNG sequence */
+  char path[VIDEO_PATH_MAX];
+  size_t head;  /* next slot to fill, VM thread only */
+  size_t tail;  /* next slot to encode, writer thread only */
+  size_t count; /* filled slots, under the lock */
+  int closed;   /* no more frames will come, under the lock */
+  int failed;   /* set by the writer on an I/O error */
+  video_stats_t stats;
+  uint16_t slots[VIDEO_QUEUE_FRAMES][MEMORY_MAX + 1];
+} video_t;
+
+/**
+ * Chooses the format for a file name: .y4m, .png or anything else for raw.
+ *
+ * @param path The file name given to --video.
+ *
+ * @return The format.
+ */
+video_format_t video_format_for(const char* path);
+
+/**
+ * Opens a video export and starts its writer thread.
+ *
+ * A PNG sequence is written next to path, as path without .png followed by
+ * _000000.png, _000001.png and so on.
+ *
+ * @param path Where to write the video.
+ * @param palette The colors of the memory map.
+ *
+ * @return The export, or NULL if the file cannot be created.
+ */
+video_t* video_open(const char* path, palette_id_t palette);
+
+/**
+ * Hands the current memory of a VM to the writer as the next frame.
+ *
+ * Called by the VM thread between slices. Copies memory into a free slot
+ * and returns without waiting for it to be encoded.
+ *
+ * @param video The export.
+ * @param vm The VM to capture.
+ *
+ * @return 1 if the frame was queued, 0 if the queue was full and it was
+ *         dropped.
+ */
+int video_capture(video_t* video, const vm_t* vm);
+
+/**
+ * Waits for the queued frames to be written, then closes the export.
+ *
+ * @param video The export to free, may be NULL.
+ * @param stats Set to the export's counts if not NULL.
+ *
+ * @return 1 if every frame was written, 0 on an I/O error.
+ */
+int video_close(video_t* video, video_stats_t* stats);
+
+/**
+ * Encodes one frame as a PNG image.
+ *
+ * The image is 8-bit RGB and stored without compression, so it needs no
+ * library.
+ *
+ * @param file Where to write the image.
+ * @param pixels MEMORY_MAP_DIM square RGBA8888 pixels, as render_words makes.
+ *
+ * @return 1 on success, 0 on an I/O error.
+ */
+int video_write_png(FILE* file, const uint32_t* pixels);
@@ -0,0 +1,91 @@
+#include "vm.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "audio.h"
+#include "bank.h"
+#include "jit.h"
+#include "predecode.h"
+#include "utils.h"
+#include "voice.h"
+
+static int terminal_get_char(void* ctx) {
+  (void)ctx;
+  return getc(stdin);
+}
+
+static int terminal_put_char(void* ctx, int chr) {
+  (void)ctx;
+  return putc(chr, stdout);
+}
+
+static int terminal_flush(void* ctx) {
+  (void)ctx;
+  return fflush(stdout);
+}
+
+static void terminal_audio_sample(void* ctx, uint16_t sample) {
+  (void)ctx;
+  audio_output(sample);
+}
+
+static void terminal_audio_buffer(void* ctx, const uint16_t* samples,
+                                  size_t count) {
+  (void)ctx;
+  audio_output_buffer(samples, count);
+}
+
+static void terminal_voice(void* ctx, const voice_params_t* params) {
+  (void)ctx;
+  audio_voice(params);
+}
+
+const vm_io_t vm_terminal_io = {
+    .get_char = terminal_get_char,
+    .put_char = terminal_put_char,
+    .flush = terminal_flush,
+    .audio_sample = terminal_audio_sample,
+    .ctx = NULL,
+    .audio_buffer = terminal_audio_buffer,
+    .voice = terminal_voice,
+};
+
+vm_t* vm_create(const vm_io_t* io) {
+  vm_t* vm = calloc(1, sizeof(vm_t));
+  if (!vm) {
+    error_and_exit("Failed to allocate VM");
+  }
+  /* calloc leaves every record as PD_DECODE */
+  vm->decode_cache = calloc(MEMORY_MAX + 1, sizeof(decoded_t));
+  if (!vm->decode_cache) {
+    error_and_exit("Failed to allocate predecode cache");
+  }
+
+  vm->io = io ? *io : vm_terminal_io;
+  vm->reg[R_COND] = FL_ZRO;
+  vm->reg[R_PC] = VM_PC_START;
+  vm->running = 1;
+  vm_mark_dirty_range(vm, 0, MEMORY_MAX + 1);
+  return vm;
+}
+
+int vm_load_image(vm_t* vm, const char* path) { return read_image(vm, path); }
+
+uint64_t vm_run_for(vm_t* vm, uint64_t cycles) {
+  return run_predecoded(vm, cycles, &vm->running);
+}
+
+void vm_destroy(vm_t* vm) {
+  if (!vm) {
+    return;
+  }
+  if (vm->uses_jit) {
+    jit_reset();
+  }
+  bank_detach(vm);
+  free(vm->decode_cache);
+  free(vm);
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MEMORY_MAX 0xFFFFU
+#define VM_PC_START 0x3000U
+#define VM_PAGE_SHIFT 8U /* a page is 256 words, one row of the memory map */
+#define VM_PAGES ((MEMORY_MAX + 1) >> VM_PAGE_SHIFT)
+#define VM_PAGE_BITS 64U /* pages per word of the dirty bitmap */
+#define VM_OPCODES 16U
+#define VM_TRAP_VECTORS 256U
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+// Registers Enum
+enum {
+  R_R0 = 0,
+  R_R1,
+  R_R2,
+  R_R3,
+  R_R4,
+  R_R5,
+  R_R6,
+  R_R7,
+  R_PC, /* Program Counter */
+  R_COND,
+  R_COUNT
+};
+
+struct decoded;
+struct bank;
+struct voice_params;
+
+// Host services used by traps and devices. Every callback gets ctx.
+typedef struct {
+  int (*get_char)(void* ctx);          /* next input character, or EOF */
+  int (*put_char)(void* ctx, int chr); /* returns EOF on failure */
+  int (*flush)(void* ctx);             /* returns EOF on failure */
+  void (*audio_sample)(void* ctx, uint16_t sample); /* MR_AUDIO_DATA store */
+  void* ctx;
+  /* a whole audio DMA transfer; NULL sends it through audio_sample */
+  void (*audio_buffer)(void* ctx, const uint16_t* samples, size_t count);
+  /* a store to a voice control register; NULL ignores the voices */
+  void (*voice)(void* ctx, const struct voice_params* params);
+} vm_io_t;
+
+// What a VM did, counted only in builds with PVMPKIN_STATS (see stats.h)
+typedef struct {
+  uint64_t opcodes[VM_OPCODES];    /* instructions retired per opcode */
+  uint64_t traps[VM_TRAP_VECTORS]; /* TRAPs per vector */
+  uint64_t mem_reads;              /* calls to mem_read */
+  uint64_t mem_writes;             /* calls to mem_write */
+  uint64_t mmio_reads;             /* of them, at MR_KBSR and above */
+  uint64_t mmio_writes;
+  uint64_t frames;                 /* memory maps presented or exported */
+  uint64_t audio_samples;          /* handed to the audio callbacks */
+} vm_stats_t;
+
+// The complete state of one LC-3 machine
+typedef struct vm {
+  uint16_t reg[R_COUNT];
+  uint16_t memory[MEMORY_MAX + 1];
+  struct decoded* decode_cache; /* one predecoded record per address */
+  vm_io_t io;
+  struct bank* bank;            /* the attached audio stream, or NULL */
+  int running;                  /* cleared by HALT and unknown opcodes */
+  int uses_jit;                 /* set once run_jit has run this VM */
+  uint64_t fast_forward_cycles; /* instructions skipped by PD_DELAY */
+  uint64_t dirty_pages[VM_PAGES / VM_PAGE_BITS]; /* written since last draw */
+  vm_stats_t stats;
+} vm_t;
+
+/**
+ * Marks the page holding an address as changed since the last frame.
+ *
+ * @param vm The VM whose memory changed.
+ * @param address The address that was written.
+ */
+static inline void vm_mark_dirty(vm_t* vm, uint16_t address) {
+  uint32_t page = (uint32_t)address >> VM_PAGE_SHIFT;
+  vm->dirty_pages[page / VM_PAGE_BITS] |= 1ULL << (page % VM_PAGE_BITS);
+}
+
+/**
+ * Marks every page overlapping a range of addresses as changed.
+ *
+ * @param vm The VM whose memory changed.
+ * @param origin The first address that was written.
+ * @param count The number of words written, clamped to the end of memory.
+ */
+static inline void vm_mark_dirty_range(vm_t* vm, uint16_t origin,
+                                       size_t count) {
+  if (count == 0) {
+    return;
+  }
+  size_t last = (size_t)origin + count - 1;
+  if (last > MEMORY_MAX) {
+    last = MEMORY_MAX;
+  }
+  for (size_t page = origin >> VM_PAGE_SHIFT; page <= last >> VM_PAGE_SHIFT;
+       ++page) {
+    vm->dirty_pages[page / VM_PAGE_BITS] |= 1ULL << (page % VM_PAGE_BITS);
+  }
+}
+
+// stdin/stdout for the console and the SDL audio queue for samples
+extern const vm_io_t vm_terminal_io;
+
+/**
+ * Creates a VM with zeroed memory and registers.
+ *
+ * The PC starts at VM_PC_START with the Z flag set, the VM is running, and
+ * every page is dirty so the first frame draws all of memory.
+ * VMs share no state with each other, so any number can exist at once and
+ * different threads can run different VMs.
+ *
+ * @param io The host services to use, copied into the VM. NULL selects
+ *           vm_terminal_io.
+ *
+ * @return The new VM, exits the program if it cannot be allocated.
+ */
+vm_t* vm_create(const vm_io_t* io);
+
+/**
+ * Loads an .obj image, or an audio file converted to one, into a VM.
+ *
+ * @param vm The VM to load into.
+ * @param path Path to the image or audio file, as accepted by read_image.
+ *
+ * @return 1 on success, 0 on failure.
+ */
+int vm_load_image(vm_t* vm, const char* path);
+
+/**
+ * Runs a VM for at most a number of instructions.
+ *
+ * Uses the predecoded engine. Returns early once the VM halts, after which
+ * vm->running stays 0 and further calls return 0.
+ *
+ * @param vm The VM to run.
+ * @param cycles The maximum number of instructions to retire.
+ *
+ * @return The number of instructions retired.
+ */
+uint64_t vm_run_for(vm_t* vm, uint64_t cycles);
+
+/**
+ * Frees a VM created with vm_create and the stream attached to it, if any.
+ *
+ * @param vm The VM to free, may be NULL.
+ */
+void vm_destroy(vm_t* vm);
@@ -0,0 +1,31 @@
+#include "voice.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "utils.h"
+
+void voice_store(vm_t* vm, uint16_t address, uint16_t value) {
+  vm->memory[address] = value;
+  vm_mark_dirty(vm, address);
+  uint16_t offset = (uint16_t)(address - MR_VOICE_BASE);
+  if (offset % VOICE_STRIDE != VOICE_CONTROL || !vm->io.voice) {
+    return;
+  }
+
+  const uint16_t* regs = vm->memory + (address - VOICE_CONTROL);
+  uint16_t source = regs[VOICE_ADDRESS];
+  size_t length = regs[VOICE_LENGTH];
+  if (length > (size_t)MEMORY_MAX + 1 - source) {
+    length = (size_t)MEMORY_MAX + 1 - source;
+  }
+  voice_params_t params = {
+      .voice = (uint16_t)(offset / VOICE_STRIDE),
+      .samples = vm->memory + source,
+      .length = length,
+      .volume = regs[VOICE_VOLUME],
+      .rate = regs[VOICE_RATE],
+      .control = value,
+  };
+  vm->io.voice(vm->io.ctx, &params);
+}
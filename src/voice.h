@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vm.h"
+
+// Registers of voice n start at MR_VOICE_BASE + n * VOICE_STRIDE
+enum {
+  VOICE_COUNT = 4,
+  VOICE_STRIDE = 0x10,
+  VOICE_ADDRESS = 0x0, /* first sample of the voice's buffer */
+  VOICE_LENGTH = 0x2,  /* samples in the buffer */
+  VOICE_VOLUME = 0x4,  /* 8.8 fixed point, 0x100 plays at full level */
+  VOICE_RATE = 0x6,    /* 8.8 buffer samples per output sample */
+  VOICE_CONTROL = 0x8, /* VOICE_PLAY and VOICE_LOOP, 0 stops the voice */
+  VOICE_PLAY = 0x0001,
+  VOICE_LOOP = 0x0002,
+};
+
+// What a store to a voice's control register asks the host to play
+typedef struct voice_params {
+  uint16_t voice;
+  const uint16_t* samples; /* in guest memory, copied by the callee */
+  size_t length;
+  uint16_t volume;
+  uint16_t rate;
+  uint16_t control;
+} voice_params_t;
+
+/**
+ * Handles a store to a voice register.
+ *
+ * Every register keeps the value stored. A store to a VOICE_CONTROL register
+ * also passes the voice's buffer and settings to the VM's voice callback,
+ * which starts the voice over from its first sample, or stops it when
+ * VOICE_PLAY is clear. A buffer running past the end of memory stops there.
+ *
+ * @param vm The VM whose guest stored to the register.
+ * @param address The register, from MR_VOICE_BASE up to MR_VOICE_END.
+ * @param value The value stored.
+ */
+void voice_store(vm_t* vm, uint16_t address, uint16_t value);
@@ -0,0 +1,302 @@
+#include "wav.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define RIFF_HEADER 12U
+#define CHUNK_HEADER 8U
+#define FMT_MIN_SIZE 16U
+#define FMT_EXTENSIBLE_SIZE 40U
+#define FMT_SUBFORMAT 24U  /* offset of the subformat GUID in the chunk */
+#define FILTER_LANES 8U    /* taps are padded to the widest dot product */
+#define BLACKMAN_WIDTH 5.5 /* transition width times filter length */
+#define S16_SCALE 32768.0F
+#define S16_MIN (-32768.0F)
+#define S16_MAX 32767.0F
+#define PI 3.14159265358979323846
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+// NOLINTBEGIN(readability-magic-numbers)
+
+static uint16_t le16(const uint8_t* bytes) {
+  return (uint16_t)(bytes[0] | bytes[1] << 8U);
+}
+
+static uint32_t le32(const uint8_t* bytes) {
+  return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8U |
+         (uint32_t)bytes[2] << 16U | (uint32_t)bytes[3] << 24U;
+}
+
+/* Reads one sample as a float in [-1, 1). */
+static float sample_at(const wav_info_t* info, const uint8_t* bytes) {
+  switch (info->bits) {
+    case 8:
+      return ((float)bytes[0] - 128.0F) / 128.0F;
+    case 16:
+      return (float)(int16_t)le16(bytes) / 32768.0F;
+    case 24: {
+      /* into the top of a word so the shift back extends the sign */
+      uint32_t bits = (uint32_t)bytes[0] << 8U | (uint32_t)bytes[1] << 16U |
+                      (uint32_t)bytes[2] << 24U;
+      return (float)((int32_t)bits >> 8) / 8388608.0F;
+    }
+    default: {
+      uint32_t bits = le32(bytes);
+      if (info->format == WAV_FORMAT_FLOAT) {
+        float value = 0;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+      }
+      return (float)(int32_t)bits / 2147483648.0F;
+    }
+  }
+}
+
+// NOLINTEND(readability-magic-numbers)
+
+int wav_parse(const uint8_t* bytes, size_t size, wav_info_t* info) {
+  if (size < RIFF_HEADER || memcmp(bytes, "RIFF", 4) != 0 ||
+      memcmp(bytes + 8, "WAVE", 4) != 0) {
+    return 0;
+  }
+  int have_fmt = 0;
+  int have_data = 0;
+  uint16_t block_align = 0;
+  memset(info, 0, sizeof(*info));
+
+  size_t offset = RIFF_HEADER;
+  while (offset + CHUNK_HEADER <= size && !have_data) {
+    const uint8_t* chunk = bytes + offset + CHUNK_HEADER;
+    size_t left = size - offset - CHUNK_HEADER;
+    size_t length = le32(bytes + offset + 4);
+    if (length > left) {
+      length = left; /* streamed files leave the size unset */
+    }
+    if (memcmp(bytes + offset, "fmt ", 4) == 0 && length >= FMT_MIN_SIZE) {
+      info->format = le16(chunk);
+      info->channels = le16(chunk + 2);
+      info->rate = le32(chunk + 4);
+      block_align = le16(chunk + 12);
+      info->bits = le16(chunk + 14);
+      if (info->format == WAV_FORMAT_EXTENSIBLE &&
+          length >= FMT_EXTENSIBLE_SIZE) {
+        info->format = le16(chunk + FMT_SUBFORMAT);
+      }
+      have_fmt = 1;
+    } else if (memcmp(bytes + offset, "data", 4) == 0 && have_fmt) {
+      info->data = chunk;
+      info->frames = block_align ? length / block_align : 0;
+      have_data = 1;
+    }
+    offset += CHUNK_HEADER + length + (length & 1U);
+  }
+
+  int integer = info->format == WAV_FORMAT_PCM &&
+                (info->bits == 8 || info->bits == 16 || info->bits == 24 ||
+                 info->bits == 32);
+  int floating = info->format == WAV_FORMAT_FLOAT && info->bits == 32;
+  return have_data && (integer || floating) && info->channels > 0 &&
+         info->rate > 0 &&
+         block_align == info->channels * (info->bits / BYTE_LEN);
+}
+
+/* --- the polyphase resampler --- */
+
+// Converts by up/down with the phases of one lowpass prototype
+typedef struct {
+  uint32_t up; /* output rate / input rate = up / down, in lowest terms */
+  uint32_t down;
+  size_t taps;    /* per phase, a multiple of FILTER_LANES */
+  uint64_t delay; /* of the prototype, in upsampled samples */
+  float* coeffs;  /* up phases of taps, each reversed for a forward dot */
+} polyphase_t;
+
+typedef float (*dot_fn)(const float* coeffs, const float* samples,
+                        size_t taps);
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+  while (b) {
+    uint32_t rest = a % b;
+    a = b;
+    b = rest;
+  }
+  return a;
+}
+
+/* Designs a Blackman-windowed sinc and splits it into phases. */
+static int polyphase_init(polyphase_t* filter, uint32_t in_rate,
+                          uint32_t out_rate) {
+  uint32_t common = gcd(in_rate, out_rate);
+  filter->up = out_rate / common;
+  filter->down = in_rate / common;
+  if (filter->up > WAV_MAX_PHASES) {
+    return 0;
+  }
+
+  double nyquist = (in_rate < out_rate ? in_rate : out_rate) / 2.0;
+  double cutoff = nyquist - WAV_TRANSITION_HZ / 2;
+  if (cutoff > WAV_CUTOFF_HZ) {
+    cutoff = WAV_CUTOFF_HZ;
+  }
+  size_t per_phase =
+      (size_t)ceil(BLACKMAN_WIDTH * in_rate / WAV_TRANSITION_HZ);
+  /* an odd length puts the center on a tap, so the delay is whole */
+  size_t length = (per_phase * filter->up - 1) | 1U;
+  filter->taps = (per_phase + FILTER_LANES - 1) / FILTER_LANES * FILTER_LANES;
+  filter->delay = (length - 1) / 2;
+  filter->coeffs = calloc(filter->up * filter->taps, sizeof(float));
+  double* prototype = malloc(length * sizeof(double));
+  if (!filter->coeffs || !prototype) {
+    error_and_exit("Failed to allocate resampler");
+  }
+
+  /* cutoff in cycles per upsampled sample */
+  double fc = cutoff / ((double)in_rate * filter->up);
+  double center = (double)(length - 1) / 2;
+  double sum = 0;
+  for (size_t i = 0; i < length; ++i) {
+    double x = (double)i - center;
+    double sinc = x == 0 ? 1 : sin(2 * PI * fc * x) / (2 * PI * fc * x);
+    double phase = 2 * PI * (double)i / (double)(length - 1);
+    // NOLINTNEXTLINE(readability-magic-numbers)
+    double window = 0.42 - 0.5 * cos(phase) + 0.08 * cos(2 * phase);
+    prototype[i] = sinc * window;
+    sum += prototype[i];
+  }
+
+  /* each phase sees every up-th tap, so unity gain means a sum of up */
+  double scale = WAV_GAIN * filter->up / sum;
+  for (uint32_t p = 0; p < filter->up; ++p) {
+    float* phase = filter->coeffs + p * filter->taps;
+    for (size_t j = 0; j < filter->taps; ++j) {
+      size_t i = p + (filter->taps - 1 - j) * filter->up;
+      phase[j] = i < length ? (float)(prototype[i] * scale) : 0;
+    }
+  }
+  free(prototype);
+  return 1;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+#include <immintrin.h>
+
+/* Four products per step; SSE is on every x86-64. */
+static float dot_sse(const float* coeffs, const float* samples, size_t taps) {
+  __m128 sum = _mm_setzero_ps();
+  for (size_t i = 0; i < taps; i += 4) {
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(coeffs + i),
+                                     _mm_loadu_ps(samples + i)));
+  }
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum);
+}
+
+/* Eight fused multiply-adds per step. */
+__attribute__((target("avx2,fma"))) static float dot_avx2(
+    const float* coeffs, const float* samples, size_t taps) {
+  __m256 sum = _mm256_setzero_ps();
+  for (size_t i = 0; i < taps; i += FILTER_LANES) {
+    sum = _mm256_fmadd_ps(_mm256_loadu_ps(coeffs + i),
+                          _mm256_loadu_ps(samples + i), sum);
+  }
+  __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum),
+                           _mm256_extractf128_ps(sum, 1));
+  half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+  half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+  return _mm_cvtss_f32(half);
+}
+
+#else
+
+static float dot_scalar(const float* coeffs, const float* samples,
+                        size_t taps) {
+  float sum = 0;
+  for (size_t i = 0; i < taps; ++i) {
+    sum += coeffs[i] * samples[i];
+  }
+  return sum;
+}
+
+#endif
+
+static dot_fn best_dot(void) {
+#if defined(__x86_64__) && defined(__GNUC__)
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return dot_avx2;
+  }
+  return dot_sse;
+#else
+  return dot_scalar;
+#endif
+}
+
+size_t wav_length(const uint8_t* bytes, size_t size, uint32_t rate) {
+  wav_info_t info;
+  if (!wav_parse(bytes, size, &info)) {
+    return 0;
+  }
+  return (size_t)((uint64_t)info.frames * rate / info.rate);
+}
+
+size_t wav_decode(const uint8_t* bytes, size_t size, uint16_t* out,
+                  size_t capacity, uint32_t rate) {
+  wav_info_t info;
+  polyphase_t filter;
+  if (!wav_parse(bytes, size, &info) ||
+      !polyphase_init(&filter, info.rate, rate)) {
+    return 0;
+  }
+  size_t count = (size_t)((uint64_t)info.frames * filter.up / filter.down);
+  if (count > capacity) {
+    count = capacity;
+  }
+  /* only convert the input the stored samples reach */
+  size_t frames = info.frames;
+  size_t reach =
+      count > 0 ? ((count - 1) * filter.down + filter.delay) / filter.up + 1
+                : 0;
+  if (frames > reach) {
+    frames = reach;
+  }
+
+  /* the mono signal with a filter's worth of silence on both sides */
+  float* padded = calloc(frames + 2 * filter.taps, sizeof(float));
+  if (!padded) {
+    error_and_exit("Failed to allocate resampler input");
+  }
+  float* mono = padded + filter.taps;
+  size_t sample_bytes = info.bits / BYTE_LEN;
+  const uint8_t* frame = info.data;
+  for (size_t f = 0; f < frames; ++f) {
+    float sum = 0;
+    for (uint16_t c = 0; c < info.channels; ++c) {
+      sum += sample_at(&info, frame);
+      frame += sample_bytes;
+    }
+    mono[f] = sum / (float)info.channels;
+  }
+
+  dot_fn dot = best_dot();
+  for (size_t n = 0; n < count; ++n) {
+    uint64_t t = (uint64_t)n * filter.down + filter.delay;
+    size_t base = (size_t)(t / filter.up);
+    const float* coeffs = filter.coeffs + (t % filter.up) * filter.taps;
+    /* the window ends at base, reaching into the padding at either end */
+    float y = dot(coeffs, mono + base + 1 - filter.taps, filter.taps);
+    float scaled = rintf(y * S16_SCALE);
+    scaled = scaled < S16_MIN ? S16_MIN : scaled > S16_MAX ? S16_MAX : scaled;
+    out[n] = (uint16_t)(int16_t)scaled;
+  }
+
+  free(padded);
+  free(filter.coeffs);
+  return count;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// NOLINTBEGIN(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define WAV_FORMAT_PCM 1U
+#define WAV_FORMAT_FLOAT 3U
+#define WAV_FORMAT_EXTENSIBLE 0xFFFEU
+#define WAV_MAX_PHASES 1024U /* rarer rate ratios are left to ffmpeg */
+#define WAV_CUTOFF_HZ 5000.0 /* like the lowpass=f=5000 filter */
+#define WAV_TRANSITION_HZ 1000.0
+#define WAV_GAIN 0.70794578 /* -3 dB, like the volume filter */
+/* bump whenever the filter's window or the rounding of samples changes */
+#define WAV_DECODER_VERSION 1
+// NOLINTEND(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+// Everything wav_decode's samples depend on besides the input and the rate,
+// for the cache key of a decoded file. The constants are spelled out as
+// written above, so changing one invalidates the cached images.
+// NOLINTBEGIN(cppcoreguidelines-macro-usage)
+#define WAV_STRINGIFY(x) #x
+#define WAV_STRING(x) WAV_STRINGIFY(x)
+#define WAV_DECODER_PARAMS                                             \
+  "wav_decode v" WAV_STRING(WAV_DECODER_VERSION) " blackman-sinc"      \
+  " cutoff=" WAV_STRING(WAV_CUTOFF_HZ)                                 \
+  " transition=" WAV_STRING(WAV_TRANSITION_HZ)                         \
+  " gain=" WAV_STRING(WAV_GAIN) " phases=" WAV_STRING(WAV_MAX_PHASES)  \
+  " rint-s16"
+// NOLINTEND(cppcoreguidelines-macro-usage)
+
+// Where the samples of a WAV file are and how to read them
+typedef struct {
+  uint16_t format; /* WAV_FORMAT_PCM or WAV_FORMAT_FLOAT */
+  uint16_t channels;
+  uint32_t rate;       /* frames per second */
+  uint16_t bits;       /* per sample: 8, 16, 24 or 32 */
+  const uint8_t* data; /* interleaved little-endian frames */
+  size_t frames;
+} wav_info_t;
+
+/**
+ * Finds the format and the sample data of a RIFF WAVE file.
+ *
+ * Accepts integer PCM of 8, 16, 24 or 32 bits and 32-bit float, including
+ * WAVE_FORMAT_EXTENSIBLE headers, with any number of channels. A data chunk
+ * that claims more bytes than the file has is cut to the file.
+ *
+ * @param bytes The file.
+ * @param size The size of the file in bytes.
+ * @param info Set to the sample format and data on success.
+ *
+ * @return 1 if the file is a WAV file this decoder supports, 0 otherwise.
+ */
+int wav_parse(const uint8_t* bytes, size_t size, wav_info_t* info);
+
+/**
+ * Returns how many samples wav_decode makes of a whole WAV file.
+ *
+ * @param bytes The file.
+ * @param size The size of the file in bytes.
+ * @param rate The output sample rate.
+ *
+ * @return The number of samples, 0 if the file is not a supported WAV file.
+ */
+size_t wav_length(const uint8_t* bytes, size_t size, uint32_t rate);
+
+/**
+ * Decodes a WAV file to mono 16-bit samples the way the ffmpeg chain does.
+ *
+ * The channels are averaged, resampled to rate with a polyphase
+ * windowed-sinc filter whose passband ends at WAV_CUTOFF_HZ, attenuated by
+ * 3 dB and rounded to signed 16 bits. Only as much input as the first
+ * capacity samples need is converted. The filter runs with AVX2 and FMA or
+ * SSE when the CPU has them.
+ *
+ * @param bytes The file.
+ * @param size The size of the file in bytes.
+ * @param out Where to store the samples, as the bits of signed words.
+ * @param capacity The most samples to store.
+ * @param rate The output sample rate.
+ *
+ * @return The number of samples stored, 0 if the file is not a supported WAV
+ *         file or its rate needs more than WAV_MAX_PHASES filter phases.
+ */
+size_t wav_decode(const uint8_t* bytes, size_t size, uint16_t* out,
+                  size_t capacity, uint32_t rate);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+// Guest programs shared by the engine tests, loaded at VM_PC_START (x3000).
+
+// NOLINTBEGIN
+
+// Sums 10 + 9 + ... + 1 into R0, stores it after the program and halts.
+// Retires 34 instructions and leaves 55 in R0 and at x3007.
+static const uint16_t sum_program[] = {
+    0x5020,  // AND R0, R0, #0
+    0x122A,  // ADD R1, R0, #10
+    0x1001,  // ADD R0, R0, R1
+    0x127F,  // ADD R1, R1, #-1
+    0x03FD,  // BRp #-3
+    0x3001,  // ST R0, #1
+    0xF025,  // HALT
+};
+
+// NOLINTEND
@@ -0,0 +1,81 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/aot.h"
+#include "../src/memory.h"
+#include "../src/utils.h"
+
+// NOLINTBEGIN
+
+static aot_image_t image;
+static uint8_t reachable[MEMORY_MAX + 1];
+
+static void place(uint16_t origin, const uint16_t* words, size_t count) {
+  memset(&image, 0, sizeof(image));
+  for (size_t i = 0; i < count; ++i) {
+    image.words[origin + i] = words[i];
+    image.loaded[origin + i] = 1;
+  }
+}
+
+// --- aot_mark_reachable ---
+
+Test(aot_mark_reachable, follows_branches_and_skips_data) {
+  const uint16_t program[] = {
+      0x2203,  // x3000 LD R1, #3
+      0x127F,  // x3001 ADD R1, R1, #-1
+      0x03FE,  // x3002 BRp #-2
+      0xF025,  // x3003 HALT
+      0x000A,  // x3004 data
+  };
+  place(0x3000, program, 5);
+  aot_mark_reachable(&image, 0x3000, reachable);
+
+  for (uint16_t address = 0x3000; address <= 0x3003; ++address) {
+    cr_assert(eq(u8, reachable[address], 1), "x%04X", address);
+  }
+  cr_assert(eq(u8, reachable[0x3004], 0), "data after HALT is not code");
+}
+
+Test(aot_mark_reachable, subroutine_return_address_is_reachable) {
+  const uint16_t program[] = {
+      0x4802,  // x3000 JSR #2
+      0xF025,  // x3001 HALT
+      0x0000,  // x3002 data
+      0xC1C0,  // x3003 RET
+  };
+  place(0x3000, program, 4);
+  aot_mark_reachable(&image, 0x3000, reachable);
+
+  cr_assert(eq(u8, reachable[0x3001], 1));
+  cr_assert(eq(u8, reachable[0x3002], 0));
+  cr_assert(eq(u8, reachable[0x3003], 1));
+}
+
+// --- aot_emit_program ---
+
+Test(aot_emit_program, emits_label_per_reachable_instruction) {
+  const uint16_t program[] = {0x2203, 0x127F, 0x03FE, 0xF025, 0x000A};
+  place(0x3000, program, 5);
+  aot_mark_reachable(&image, 0x3000, reachable);
+
+  char* source = NULL;
+  size_t size = 0;
+  FILE* out = open_memstream(&source, &size);
+  aot_emit_program(out, &image, reachable, 0x3000);
+  fclose(out);
+
+  cr_assert(strstr(source, "L_3000:") != NULL);
+  cr_assert(strstr(source, "L_3003:") != NULL);
+  cr_assert(strstr(source, "L_3004:") == NULL);
+  cr_assert(strstr(source, "goto L_3001;") != NULL, "loop is a direct goto");
+  cr_assert(strstr(source, "execute_instr(vm, 0xF025, running);") != NULL);
+  cr_assert(strstr(source, "run_program);") != NULL);
+  free(source);
+}
+
+// NOLINTEND
@@ -0,0 +1,205 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/audio.h"
+#include "../src/bank.h"
+#include "../src/bulkio.h"
+#include "../src/cache.h"
+#include "../src/memory.h"
+#include "../src/utils.h"
+#include "../src/vm.h"
+
+// NOLINTBEGIN
+
+// Two and a half banks of samples numbered from 1, so silence stands out
+#define STREAM_SAMPLES (2 * BANK_WINDOW_SIZE + BANK_WINDOW_SIZE / 2)
+
+// Attaches a heap image of STREAM_SAMPLES numbered samples to a VM.
+static void attach_numbered(vm_t* vm) {
+  uint16_t* image = malloc((STREAM_SAMPLES + 1) * sizeof(uint16_t));
+  image[0] = swap16(BANK_WINDOW_ADDRESS);
+  for (size_t i = 0; i < STREAM_SAMPLES; ++i) {
+    image[i + 1] = swap16((uint16_t)(i + 1));
+  }
+  mapped_file_t file = {(const uint8_t*)image,
+                        (STREAM_SAMPLES + 1) * sizeof(uint16_t)};
+  bank_attach(vm, file, image);
+}
+
+// Collects the samples the guest plays, up to a limit.
+typedef struct {
+  uint16_t* samples;
+  size_t count;
+  size_t limit;
+} capture_t;
+
+static void capture_sample(void* ctx, uint16_t sample) {
+  capture_t* capture = ctx;
+  if (capture->count < capture->limit) {
+    capture->samples[capture->count++] = sample;
+  }
+}
+
+static int no_char(void* ctx) {
+  (void)ctx;
+  return EOF;
+}
+
+static int put_char(void* ctx, int chr) {
+  (void)ctx;
+  return chr;
+}
+
+static int flush(void* ctx) {
+  (void)ctx;
+  return 0;
+}
+
+// --- bank_attach ---
+
+Test(bank_attach, shows_the_first_bank_and_the_count) {
+  vm_t* vm = vm_create(NULL);
+  attach_numbered(vm);
+  cr_assert(eq(u16, mem_read(vm, MR_BANK_COUNT), 3));
+  cr_assert(eq(u16, mem_read(vm, MR_BANK_SELECT), 0));
+  cr_assert(eq(u16, vm->memory[BANK_WINDOW_ADDRESS], 1));
+  cr_assert(eq(u16, vm->memory[BANK_WINDOW_ADDRESS + BANK_WINDOW_SIZE - 1],
+               BANK_WINDOW_SIZE));
+  cr_assert(eq(u64, vm->bank->switches, 0));
+  vm_destroy(vm);
+}
+
+// --- bank_select ---
+
+Test(bank_select, guest_store_remaps_the_window) {
+  vm_t* vm = vm_create(NULL);
+  attach_numbered(vm);
+  mem_write(vm, MR_BANK_SELECT, 1);
+  cr_assert(eq(u16, mem_read(vm, MR_BANK_SELECT), 1));
+  cr_assert(eq(u16, vm->memory[BANK_WINDOW_ADDRESS], BANK_WINDOW_SIZE + 1));
+  cr_assert(eq(u64, vm->bank->switches, 1));
+  vm_destroy(vm);
+}
+
+Test(bank_select, pads_the_last_bank_with_silence) {
+  vm_t* vm = vm_create(NULL);
+  attach_numbered(vm);
+  mem_write(vm, MR_BANK_SELECT, 2);
+  const uint16_t* window = vm->memory + BANK_WINDOW_ADDRESS;
+  cr_assert(eq(u16, window[BANK_WINDOW_SIZE / 2 - 1], STREAM_SAMPLES));
+  cr_assert(eq(u16, window[BANK_WINDOW_SIZE / 2], 0));
+  cr_assert(eq(u16, window[BANK_WINDOW_SIZE - 1], 0));
+
+  mem_write(vm, MR_BANK_SELECT, 7);
+  cr_assert(eq(u16, window[0], 0), "past the end is silent");
+  vm_destroy(vm);
+}
+
+Test(bank_select, marks_the_window_changed) {
+  vm_t* vm = vm_create(NULL);
+  attach_numbered(vm);
+  memset(vm->dirty_pages, 0, sizeof(vm->dirty_pages));
+  mem_write(vm, MR_BANK_SELECT, 1);
+  uint32_t first = BANK_WINDOW_ADDRESS >> VM_PAGE_SHIFT;
+  uint32_t last = (BANK_WINDOW_ADDRESS + BANK_WINDOW_SIZE - 1) >> VM_PAGE_SHIFT;
+  for (uint32_t page = first; page <= last; ++page) {
+    cr_assert(vm->dirty_pages[page / VM_PAGE_BITS] &
+              (1ULL << (page % VM_PAGE_BITS)));
+  }
+  vm_destroy(vm);
+}
+
+Test(bank_select, count_is_read_only_while_attached) {
+  vm_t* vm = vm_create(NULL);
+  attach_numbered(vm);
+  mem_write(vm, MR_BANK_COUNT, 99);
+  cr_assert(eq(u16, mem_read(vm, MR_BANK_COUNT), 3));
+
+  // without a stream the registers are plain memory
+  bank_detach(vm);
+  mem_write(vm, MR_BANK_SELECT, 5);
+  cr_assert(eq(u16, mem_read(vm, MR_BANK_SELECT), 5));
+  cr_assert(eq(u16, vm->memory[BANK_WINDOW_ADDRESS], 1));
+  vm_destroy(vm);
+}
+
+// --- the streaming player ---
+
+Test(bank_select, player_plays_every_bank_in_order_and_loops) {
+  const size_t padded = 3 * BANK_WINDOW_SIZE;
+  capture_t capture = {calloc(padded + 100, sizeof(uint16_t)), 0,
+                       padded + 100};
+  vm_io_t io = {no_char, put_char, flush, capture_sample, &capture, NULL,
+                NULL};
+  vm_t* vm = vm_create(&io);
+  cr_assert(eq(int, vm_load_image(vm, PLAYER_STREAM_OBJ), 1));
+  attach_numbered(vm);
+  vm->reg[R_PC] = 0x1000;
+
+  while (capture.count < capture.limit) {
+    vm_run_for(vm, 10000);
+  }
+  size_t wrong = 0;
+  for (size_t i = 0; i < STREAM_SAMPLES; ++i) {
+    wrong += capture.samples[i] != i + 1;
+  }
+  cr_assert(eq(sz, wrong, 0));
+  cr_assert(eq(u16, capture.samples[STREAM_SAMPLES], 0), "padding");
+  cr_assert(eq(u16, capture.samples[padded], 1), "back to the first bank");
+  cr_assert(eq(u16, capture.samples[padded + 99], 100));
+  free(capture.samples);
+  vm_destroy(vm);
+}
+
+// --- read_audio_stream ---
+
+static void put16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+  put16(p, (uint16_t)v);
+  put16(p + 2, (uint16_t)(v >> 16));
+}
+
+Test(read_audio_stream, converts_the_whole_track) {
+  // ten seconds of silence at the output rate, twice what fits in memory
+  const uint32_t frames = 10 * AUDIO_FREQUENCY;
+  size_t size = 44 + (size_t)frames * 2;
+  uint8_t* wav = calloc(1, size);
+  memcpy(wav, "RIFF", 4);
+  put32(wav + 4, (uint32_t)(size - 8));
+  memcpy(wav + 8, "WAVEfmt ", 8);
+  put32(wav + 16, 16);
+  put16(wav + 20, 1);
+  put16(wav + 22, 1);
+  put32(wav + 24, AUDIO_FREQUENCY);
+  put32(wav + 28, AUDIO_FREQUENCY * 2);
+  put16(wav + 32, 2);
+  put16(wav + 34, 16);
+  memcpy(wav + 36, "data", 4);
+  put32(wav + 40, frames * 2);
+  char path[] = "/tmp/test_bank_XXXXXX.wav";
+  int fd = mkstemps(path, 4);
+  cr_assert(fd >= 0);
+  cr_assert(eq(sz, (size_t)write(fd, wav, size), size));
+  close(fd);
+
+  cache_enabled = 0;
+  vm_t* vm = vm_create(NULL);
+  cr_assert(eq(int, read_audio_stream(vm, path), 1));
+  cr_assert(eq(sz, vm->bank->samples, frames));
+  cr_assert(eq(u16, mem_read(vm, MR_BANK_COUNT),
+               (frames + BANK_WINDOW_SIZE - 1) / BANK_WINDOW_SIZE));
+  vm_destroy(vm);
+  unlink(path);
+  free(wav);
+}
+
+// NOLINTEND
@@ -0,0 +1,174 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/batch.h"
+
+// NOLINTBEGIN
+
+// Writes bytes to a new temporary file and returns its malloc'd path.
+static char* write_temp(const uint8_t* bytes, size_t len) {
+  char* path = strdup("/tmp/test_batch_XXXXXX");
+  int fd = mkstemp(path);
+  cr_assert(fd >= 0);
+  cr_assert(eq(sz, (size_t)write(fd, bytes, len), len));
+  close(fd);
+  return path;
+}
+
+// x3000 LEA R0, #2 / PUTS / HALT / "hi"
+static const uint8_t hello_obj[] = {0x30, 0x00, 0xE0, 0x02, 0xF0, 0x22,
+                                    0xF0, 0x25, 0x00, 0x68, 0x00, 0x69,
+                                    0x00, 0x00};
+
+// x3000 GETC / OUT / BRnzp #-3, echoes its input forever
+static const uint8_t echo_obj[] = {0x30, 0x00, 0xF0, 0x20,
+                                   0xF0, 0x21, 0x0F, 0xFD};
+
+// x3000 BRnzp #-1, never halts
+static const uint8_t spin_obj[] = {0x30, 0x00, 0x0F, 0xFF};
+
+static batch_job_t* make_jobs(size_t count) {
+  batch_job_t* jobs = calloc(count, sizeof(batch_job_t));
+  cr_assert(jobs != NULL);
+  return jobs;
+}
+
+static void remove_jobs(batch_job_t* jobs, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    unlink(jobs[i].image_path);
+    if (jobs[i].input_path) {
+      unlink(jobs[i].input_path);
+    }
+  }
+  batch_free_jobs(jobs, count);
+}
+
+// --- batch_read_jobs ---
+
+Test(batch_read_jobs, parses_images_and_inputs) {
+  char list[] =
+      "# comment\n"
+      "a.obj\n"
+      "\n"
+      "  b.obj   b.txt  \n"
+      "c.obj\tc.txt\n";
+  FILE* stream = fmemopen(list, strlen(list), "r");
+  size_t count = 0;
+  batch_job_t* jobs = batch_read_jobs(stream, &count);
+  fclose(stream);
+
+  cr_assert(eq(sz, count, 3));
+  cr_assert(eq(str, jobs[0].image_path, "a.obj"));
+  cr_assert(jobs[0].input_path == NULL);
+  cr_assert(eq(str, jobs[1].image_path, "b.obj"));
+  cr_assert(eq(str, jobs[1].input_path, "b.txt"));
+  cr_assert(eq(str, jobs[2].image_path, "c.obj"));
+  cr_assert(eq(str, jobs[2].input_path, "c.txt"));
+  cr_assert(eq(int, jobs[2].status, BATCH_PENDING));
+  batch_free_jobs(jobs, count);
+}
+
+// --- batch_run ---
+
+Test(batch_run, captures_output_until_halt) {
+  batch_job_t* jobs = make_jobs(1);
+  jobs[0].image_path = write_temp(hello_obj, sizeof(hello_obj));
+
+  cr_assert(eq(u32, batch_run(jobs, 1, 4, 1000), 1));
+
+  cr_assert(eq(int, jobs[0].status, BATCH_HALTED));
+  cr_assert(eq(u64, jobs[0].retired, 3));
+  cr_assert(eq(sz, jobs[0].output_len, 6));
+  cr_assert(eq(int, memcmp(jobs[0].output, "hiHALT", 6), 0));
+  remove_jobs(jobs, 1);
+}
+
+Test(batch_run, enforces_budget) {
+  batch_job_t* jobs = make_jobs(1);
+  jobs[0].image_path = write_temp(spin_obj, sizeof(spin_obj));
+
+  batch_run(jobs, 1, 1, 12345);
+
+  cr_assert(eq(int, jobs[0].status, BATCH_BUDGET));
+  cr_assert(eq(u64, jobs[0].retired, 12345));
+  cr_assert(eq(sz, jobs[0].output_len, 0));
+  remove_jobs(jobs, 1);
+}
+
+Test(batch_run, feeds_input_script) {
+  const uint8_t script[] = "abc";
+  batch_job_t* jobs = make_jobs(1);
+  jobs[0].image_path = write_temp(echo_obj, sizeof(echo_obj));
+  jobs[0].input_path = write_temp(script, 3);
+
+  batch_run(jobs, 1, 1, 1000);
+
+  cr_assert(eq(int, jobs[0].status, BATCH_INPUT));
+  cr_assert(eq(sz, jobs[0].output_len, 3));
+  cr_assert(eq(int, memcmp(jobs[0].output, "abc", 3), 0));
+  remove_jobs(jobs, 1);
+}
+
+Test(batch_run, reports_missing_files) {
+  batch_job_t* jobs = make_jobs(2);
+  jobs[0].image_path = strdup("/nonexistent/image.obj");
+  jobs[1].image_path = write_temp(hello_obj, 1);  // truncated origin
+
+  batch_run(jobs, 2, 2, 1000);
+
+  cr_assert(eq(int, jobs[0].status, BATCH_LOAD_FAILED));
+  cr_assert(eq(int, jobs[1].status, BATCH_LOAD_FAILED));
+  cr_assert(eq(u64, jobs[0].retired, 0));
+  remove_jobs(jobs, 2);
+}
+
+Test(batch_run, runs_every_job_once_across_threads) {
+  const size_t count = 48;
+  batch_job_t* jobs = make_jobs(count);
+  for (size_t i = 0; i < count; ++i) {
+    // a few long jobs bunched together, which other workers must steal
+    if (i < 4) {
+      jobs[i].image_path = write_temp(spin_obj, sizeof(spin_obj));
+    } else {
+      jobs[i].image_path = write_temp(hello_obj, sizeof(hello_obj));
+    }
+  }
+
+  cr_assert(eq(u32, batch_run(jobs, count, 4, 2000000), 4));
+
+  for (size_t i = 0; i < count; ++i) {
+    if (i < 4) {
+      cr_assert(eq(int, jobs[i].status, BATCH_BUDGET));
+      cr_assert(eq(u64, jobs[i].retired, 2000000));
+    } else {
+      cr_assert(eq(int, jobs[i].status, BATCH_HALTED));
+      cr_assert(eq(sz, jobs[i].output_len, 6));
+    }
+  }
+  remove_jobs(jobs, count);
+}
+
+// --- batch_report ---
+
+Test(batch_report, summarizes_statuses) {
+  batch_job_t* jobs = make_jobs(2);
+  jobs[0].image_path = write_temp(hello_obj, sizeof(hello_obj));
+  jobs[1].image_path = write_temp(spin_obj, sizeof(spin_obj));
+  batch_run(jobs, 2, 2, 100);
+
+  char report[1024] = {0};
+  FILE* out = fmemopen(report, sizeof(report) - 1, "w");
+  batch_report(out, jobs, 2, 2, 1.0);
+  fclose(out);
+
+  cr_assert(strstr(report, "2 jobs: 1 halted, 1 budget") != NULL);
+  cr_assert(strstr(report, "103 instructions") != NULL);
+  remove_jobs(jobs, 2);
+}
+
+// NOLINTEND
@@ -0,0 +1,172 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/audio.h"
+#include "../src/bulkio.h"
+#include "../src/utils.h"
+#include "../src/vm.h"
+
+// NOLINTBEGIN
+
+// Writes bytes to a new temporary file and returns its malloc'd path.
+static char* write_temp(const uint8_t* bytes, size_t len) {
+  char* path = strdup("/tmp/test_bulkio_XXXXXX");
+  int fd = mkstemp(path);
+  cr_assert(fd >= 0);
+  cr_assert(eq(sz, (size_t)write(fd, bytes, len), len));
+  close(fd);
+  return path;
+}
+
+// --- swap16_buffer ---
+
+Test(swap16_buffer, matches_swap16_at_every_length_and_offset) {
+  uint8_t bytes[2 * 80 + 1];
+  for (size_t i = 0; i < sizeof(bytes); ++i) {
+    bytes[i] = (uint8_t)(i * 37 + 11);
+  }
+  // odd offsets exercise unaligned loads, lengths cover every SIMD tail
+  for (size_t offset = 0; offset < 2; ++offset) {
+    for (size_t count = 0; count <= 80; ++count) {
+      uint16_t swapped[80 + 1];
+      swapped[count] = 0xBEEF;
+      swap16_buffer(swapped, bytes + offset, count);
+      for (size_t i = 0; i < count; ++i) {
+        uint16_t word = 0;
+        memcpy(&word, bytes + offset + 2 * i, sizeof(word));
+        cr_assert(eq(u16, swapped[i], swap16(word)));
+      }
+      cr_assert(eq(u16, swapped[count], 0xBEEF), "wrote past the end");
+    }
+  }
+}
+
+Test(swap16_buffer, swaps_in_place) {
+  uint16_t words[37];
+  for (uint16_t i = 0; i < 37; ++i) {
+    words[i] = (uint16_t)(0x0102 * i);
+  }
+  swap16_buffer(words, (const uint8_t*)words, 37);
+  for (uint16_t i = 0; i < 37; ++i) {
+    cr_assert(eq(u16, words[i], swap16((uint16_t)(0x0102 * i))));
+  }
+}
+
+// --- map_file ---
+
+Test(map_file, maps_contents) {
+  const uint8_t bytes[] = {1, 2, 3, 4, 5};
+  char* path = write_temp(bytes, sizeof(bytes));
+  mapped_file_t file;
+  cr_assert(eq(int, map_file(path, &file), 1));
+  cr_assert(eq(sz, file.size, sizeof(bytes)));
+  cr_assert(eq(int, memcmp(file.data, bytes, sizeof(bytes)), 0));
+  unmap_file(&file);
+  cr_assert(file.data == NULL);
+  unlink(path);
+  free(path);
+}
+
+Test(map_file, maps_empty_and_rejects_missing_files) {
+  char* path = write_temp(NULL, 0);
+  mapped_file_t file;
+  cr_assert(eq(int, map_file(path, &file), 1));
+  cr_assert(eq(sz, file.size, 0));
+  unmap_file(&file);
+  unlink(path);
+  free(path);
+
+  cr_assert(eq(int, map_file("/nonexistent/file", &file), 0));
+  cr_assert(eq(int, map_file("/tmp", &file), 0));
+}
+
+// --- read_image_bytes ---
+
+Test(read_image_bytes, loads_at_origin) {
+  vm_t* vm = vm_create(NULL);
+  const uint8_t image[] = {0x30, 0x00, 0x12, 0x34, 0xF0, 0x25, 0xAB};
+  cr_assert(eq(int, read_image_bytes(vm, image, sizeof(image)), 1));
+  cr_assert(eq(u16, vm->memory[0x3000], 0x1234));
+  cr_assert(eq(u16, vm->memory[0x3001], 0xF025));
+  cr_assert(eq(u16, vm->memory[0x3002], 0), "odd trailing byte ignored");
+  cr_assert(eq(int, read_image_bytes(vm, image, 1), 0));
+  vm_destroy(vm);
+}
+
+Test(read_image_bytes, stops_at_end_of_memory) {
+  vm_t* vm = vm_create(NULL);
+  const uint8_t image[] = {0xFF, 0xFD, 0x11, 0x11, 0x22, 0x22, 0x33, 0x33};
+  cr_assert(eq(int, read_image_bytes(vm, image, sizeof(image)), 1));
+  cr_assert(eq(u16, vm->memory[0xFFFD], 0x1111));
+  cr_assert(eq(u16, vm->memory[0xFFFE], 0x2222));
+  cr_assert(eq(u16, vm->memory[0xFFFF], 0));
+  vm_destroy(vm);
+}
+
+// --- has_suffix ---
+
+Test(has_suffix, matches_whole_endings_only) {
+  cr_assert(eq(int, has_suffix("song.wav", ".wav"), 1));
+  cr_assert(eq(int, has_suffix(".wav", ".wav"), 1));
+  cr_assert(eq(int, has_suffix("song.wav.obj", ".wav"), 0));
+  cr_assert(eq(int, has_suffix("wav", ".wav"), 0));
+  cr_assert(eq(int, has_suffix("", ".mp3"), 0));
+}
+
+// --- read_words_stream ---
+
+// Returns a stream that reads back len bytes, like a decoder's pipe.
+static FILE* stream_of(const uint8_t* bytes, size_t len) {
+  FILE* stream = tmpfile();
+  cr_assert(stream != NULL);
+  cr_assert(eq(sz, fwrite(bytes, 1, len, stream), len));
+  rewind(stream);
+  return stream;
+}
+
+Test(read_words_stream, swaps_samples_into_place) {
+  vm_t* vm = vm_create(NULL);
+  memset(vm->dirty_pages, 0, sizeof(vm->dirty_pages));
+  const uint8_t pcm[] = {0x01, 0x02, 0x03, 0x04, 0xFF};
+  FILE* stream = stream_of(pcm, sizeof(pcm));
+
+  cr_assert(eq(sz, read_words_stream(vm, stream, AUDIO_ADDRESS), 2));
+  cr_assert(eq(u16, vm->memory[AUDIO_ADDRESS], 0x0102));
+  cr_assert(eq(u16, vm->memory[AUDIO_ADDRESS + 1], 0x0304));
+  cr_assert(eq(u16, vm->memory[AUDIO_ADDRESS + 2], 0), "odd byte ignored");
+  cr_assert(eq(u64, vm->dirty_pages[0], 1ULL << (AUDIO_ADDRESS >> 8)));
+
+  fclose(stream);
+  vm_destroy(vm);
+}
+
+Test(read_words_stream, spans_chunks_and_drains_past_end_of_memory) {
+  vm_t* vm = vm_create(NULL);
+  /* more words than fit between the origin and the end of memory */
+  size_t words = 10000;
+  uint8_t* pcm = malloc(words * 2);
+  for (size_t i = 0; i < words; ++i) {
+    pcm[2 * i] = (uint8_t)(i >> 8);
+    pcm[2 * i + 1] = (uint8_t)i;
+  }
+  FILE* stream = stream_of(pcm, words * 2);
+
+  uint16_t origin = 0xE000;
+  cr_assert(eq(sz, read_words_stream(vm, stream, origin), 0x1FFF));
+  for (size_t i = 0; i < 0x1FFF; ++i) {
+    cr_assert(eq(u16, vm->memory[origin + i], (uint16_t)i));
+  }
+  cr_assert(eq(u16, vm->memory[0xFFFF], 0));
+  cr_assert(feof(stream), "the rest was drained");
+
+  fclose(stream);
+  free(pcm);
+  vm_destroy(vm);
+}
+
+// NOLINTEND
@@ -0,0 +1,212 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../src/bulkio.h"
+#include "../src/cache.h"
+
+// NOLINTBEGIN
+
+static char dir[64];
+
+static void setup(void) {
+  strcpy(dir, "/tmp/test_cache_XXXXXX");
+  cr_assert(mkdtemp(dir) != NULL);
+  cache_enabled = 1;
+  cache_dir_override = dir;
+  cache_max_bytes = CACHE_DEFAULT_MAX_BYTES;
+}
+
+static void teardown(void) {
+  char command[128];
+  snprintf(command, sizeof(command), "rm -rf %s", dir);
+  system(command);
+  cache_dir_override = NULL;
+}
+
+// Sets an entry's last use to a fixed time, for eviction order.
+static void set_used(uint64_t key, time_t when) {
+  char path[128];
+  snprintf(path, sizeof(path), "%s/%016llx.obj", dir,
+           (unsigned long long)key);
+  struct timespec times[2] = {{when, 0}, {when, 0}};
+  cr_assert(eq(int, utimensat(AT_FDCWD, path, times, 0), 0));
+}
+
+static int exists(uint64_t key) {
+  char path[128];
+  snprintf(path, sizeof(path), "%s/%016llx.obj", dir,
+           (unsigned long long)key);
+  return access(path, F_OK) == 0;
+}
+
+// --- cache_key ---
+
+Test(cache_key, depends_on_contents_and_params) {
+  const uint8_t song[] = "not really an mp3, but eleven words long....";
+  uint8_t edited[sizeof(song)];
+  memcpy(edited, song, sizeof(song));
+  edited[37] ^= 1;
+
+  uint64_t key = cache_key(song, sizeof(song), "-ar 12000");
+  cr_assert(eq(u64, cache_key(song, sizeof(song), "-ar 12000"), key));
+  cr_assert(ne(u64, cache_key(edited, sizeof(song), "-ar 12000"), key));
+  cr_assert(ne(u64, cache_key(song, sizeof(song), "-ar 8000"), key));
+  cr_assert(ne(u64, cache_key(song, sizeof(song) - 1, "-ar 12000"), key));
+}
+
+// --- cache_dir ---
+
+Test(cache_dir, honors_override_and_no_cache, .init = setup,
+     .fini = teardown) {
+  char found[CACHE_PATH_MAX];
+  cr_assert(eq(int, cache_dir(found, sizeof(found)), 1));
+  cr_assert(eq(str, found, dir));
+
+  cache_enabled = 0;
+  cr_assert(eq(int, cache_dir(found, sizeof(found)), 0));
+}
+
+Test(cache_dir, creates_missing_directory, .init = setup, .fini = teardown) {
+  char nested[128];
+  snprintf(nested, sizeof(nested), "%s/pvmpkin", dir);
+  cache_dir_override = nested;
+  char found[CACHE_PATH_MAX];
+  cr_assert(eq(int, cache_dir(found, sizeof(found)), 1));
+  struct stat info;
+  cr_assert(eq(int, stat(nested, &info), 0));
+  cr_assert(S_ISDIR(info.st_mode));
+}
+
+// --- cache_store / cache_lookup ---
+
+Test(cache_lookup, misses_then_hits_stored_image, .init = setup,
+     .fini = teardown) {
+  cache_stats_t before = cache_get_stats();
+  mapped_file_t image;
+  cr_assert(eq(int, cache_lookup(dir, 42, &image), 0));
+
+  const uint16_t words[] = {0x1234, 0xABCD};
+  cr_assert(eq(int, cache_store(dir, 42, 0x1500, words, 2), 1));
+  cr_assert(eq(int, cache_lookup(dir, 42, &image), 1));
+  const uint8_t expected[] = {0x15, 0x00, 0x12, 0x34, 0xAB, 0xCD};
+  cr_assert(eq(sz, image.size, sizeof(expected)));
+  cr_assert(eq(int, memcmp(image.data, expected, sizeof(expected)), 0));
+  unmap_file(&image);
+
+  cache_stats_t after = cache_get_stats();
+  cr_assert(eq(u64, after.misses - before.misses, 1));
+  cr_assert(eq(u64, after.hits - before.hits, 1));
+}
+
+Test(cache_store, writes_images_larger_than_a_chunk, .init = setup,
+     .fini = teardown) {
+  enum { COUNT = 10000 };
+  uint16_t* words = malloc(COUNT * sizeof(uint16_t));
+  for (size_t i = 0; i < COUNT; ++i) {
+    words[i] = (uint16_t)(i * 257);
+  }
+
+  cr_assert(eq(int, cache_store(dir, 7, 0x1500, words, COUNT), 1));
+  mapped_file_t image;
+  cr_assert(eq(int, cache_map(dir, 7, &image), 1));
+  cr_assert(eq(sz, image.size, (COUNT + 1) * sizeof(uint16_t)));
+  cr_assert(eq(u8, image.data[0], 0x15));
+  for (size_t i = 0; i < COUNT; ++i) {
+    uint16_t word = (uint16_t)(image.data[2 + 2 * i] << 8) |
+                    image.data[3 + 2 * i];
+    cr_assert(eq(u16, word, words[i]), "word %zu", i);
+  }
+  unmap_file(&image);
+  free(words);
+}
+
+// --- cache_create / cache_commit ---
+
+Test(cache_commit, publishes_a_written_entry, .init = setup,
+     .fini = teardown) {
+  cache_entry_t entry;
+  cr_assert(eq(int, cache_create(dir, 9, &entry), 1));
+  const uint8_t bytes[] = {0x15, 0x00, 0x12, 0x34};
+  cr_assert(eq(int, write_all(entry.fd, bytes, sizeof(bytes)), 1));
+  cr_assert(eq(int, exists(9), 0));
+
+  mapped_file_t image;
+  cr_assert(eq(int, map_descriptor(entry.fd, &image), 1));
+  cr_assert(eq(int, cache_commit(dir, &entry), 1));
+  cr_assert(eq(int, exists(9), 1));
+  cr_assert(eq(int, memcmp(image.data, bytes, sizeof(bytes)), 0));
+  unmap_file(&image);
+}
+
+Test(cache_discard, leaves_nothing_behind, .init = setup, .fini = teardown) {
+  cache_entry_t entry;
+  cr_assert(eq(int, cache_create(dir, 9, &entry), 1));
+  cr_assert(eq(int, write_all(entry.fd, "x", 1), 1));
+
+  cache_discard(&entry);
+
+  cr_assert(eq(int, exists(9), 0));
+  cr_assert(eq(int, access(entry.temp, F_OK), -1));
+}
+
+// --- cache_evict ---
+
+Test(cache_evict, removes_least_recently_used_first, .init = setup,
+     .fini = teardown) {
+  uint16_t words[99] = {0}; /* 200 bytes per entry with the origin */
+  for (uint64_t key = 1; key <= 4; ++key) {
+    cr_assert(eq(int, cache_store(dir, key, 0, words, 99), 1));
+  }
+  set_used(1, 1000);
+  set_used(2, 4000);
+  set_used(3, 2000);
+  set_used(4, 3000);
+
+  cache_stats_t before = cache_get_stats();
+  cr_assert(eq(sz, cache_evict(dir, 450), 2));
+  cr_assert(eq(int, exists(1), 0));
+  cr_assert(eq(int, exists(3), 0));
+  cr_assert(eq(int, exists(2), 1));
+  cr_assert(eq(int, exists(4), 1));
+  cr_assert(eq(u64, cache_get_stats().evictions - before.evictions, 2));
+
+  // a hit makes an entry the most recent
+  mapped_file_t image;
+  cr_assert(eq(int, cache_lookup(dir, 4, &image), 1));
+  unmap_file(&image);
+  cr_assert(eq(sz, cache_evict(dir, 200), 1));
+  cr_assert(eq(int, exists(2), 0));
+  cr_assert(eq(int, exists(4), 1));
+}
+
+Test(cache_store, stays_under_the_size_bound, .init = setup,
+     .fini = teardown) {
+  cache_max_bytes = 500;
+  uint16_t words[99] = {0};
+  for (uint64_t key = 1; key <= 5; ++key) {
+    cr_assert(eq(int, cache_store(dir, key, 0, words, 99), 1));
+    set_used(key, (time_t)(1000 * key));
+  }
+  cr_assert(eq(int, exists(5), 1), "the newest entry survives");
+  cr_assert(eq(int, exists(4), 1));
+  cr_assert(eq(int, exists(3), 0));
+}
+
+Test(cache_evict, ignores_other_files, .init = setup, .fini = teardown) {
+  char path[128];
+  snprintf(path, sizeof(path), "%s/notes.obj", dir);
+  FILE* other = fopen(path, "w");
+  fputs("keep me, I am not an entry", other);
+  fclose(other);
+  cr_assert(eq(sz, cache_evict(dir, 0), 0));
+  cr_assert(eq(int, access(path, F_OK), 0));
+}
+
+// NOLINTEND
@@ -0,0 +1,168 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/bank.h"
+#include "../src/dma.h"
+#include "../src/memory.h"
+#include "../src/utils.h"
+#include "../src/vm.h"
+
+// NOLINTBEGIN
+
+// Records the samples the guest plays and how they arrived, up to a limit.
+typedef struct {
+  uint16_t* samples;
+  size_t count;
+  size_t limit;
+  size_t buffers; /* audio_buffer calls */
+  size_t singles; /* audio_sample calls */
+} capture_t;
+
+static void capture_sample(void* ctx, uint16_t sample) {
+  capture_t* capture = ctx;
+  ++capture->singles;
+  if (capture->count < capture->limit) {
+    capture->samples[capture->count++] = sample;
+  }
+}
+
+static void capture_buffer(void* ctx, const uint16_t* samples, size_t count) {
+  capture_t* capture = ctx;
+  ++capture->buffers;
+  size_t room = capture->limit - capture->count;
+  count = count < room ? count : room;
+  memcpy(capture->samples + capture->count, samples, count * sizeof(uint16_t));
+  capture->count += count;
+}
+
+static int no_char(void* ctx) {
+  (void)ctx;
+  return EOF;
+}
+
+static int put_char(void* ctx, int chr) {
+  (void)ctx;
+  return chr;
+}
+
+static int flush(void* ctx) {
+  (void)ctx;
+  return 0;
+}
+
+static vm_t* capture_vm(capture_t* capture, size_t limit, int buffered) {
+  memset(capture, 0, sizeof(*capture));
+  capture->samples = calloc(limit, sizeof(uint16_t));
+  capture->limit = limit;
+  vm_io_t io = {no_char, put_char, flush, capture_sample, capture,
+                buffered ? capture_buffer : NULL, NULL};
+  return vm_create(&io);
+}
+
+// --- dma_control ---
+
+Test(dma_control, hands_the_buffer_over_in_one_call) {
+  capture_t capture;
+  vm_t* vm = capture_vm(&capture, 16, 1);
+  for (uint16_t i = 0; i < 5; ++i) {
+    vm->memory[0x4000 + i] = (uint16_t)(100 + i);
+  }
+  mem_write(vm, MR_DMA_SOURCE, 0x4000);
+  mem_write(vm, MR_DMA_LENGTH, 5);
+  cr_assert(eq(u16, mem_read(vm, MR_DMA_CONTROL), 0));
+  mem_write(vm, MR_DMA_CONTROL, DMA_START);
+
+  cr_assert(eq(u16, mem_read(vm, MR_DMA_CONTROL), DMA_DONE));
+  cr_assert(eq(sz, capture.buffers, 1));
+  cr_assert(eq(sz, capture.singles, 0));
+  cr_assert(eq(sz, capture.count, 5));
+  cr_assert(eq(u16, capture.samples[0], 100));
+  cr_assert(eq(u16, capture.samples[4], 104));
+
+  mem_write(vm, MR_DMA_CONTROL, 0);
+  cr_assert(eq(u16, mem_read(vm, MR_DMA_CONTROL), 0), "acknowledged");
+  free(capture.samples);
+  vm_destroy(vm);
+}
+
+Test(dma_control, falls_back_to_single_samples) {
+  capture_t capture;
+  vm_t* vm = capture_vm(&capture, 16, 0);
+  vm->memory[0x4000] = 7;
+  vm->memory[0x4001] = 8;
+  mem_write(vm, MR_DMA_SOURCE, 0x4000);
+  mem_write(vm, MR_DMA_LENGTH, 2);
+  mem_write(vm, MR_DMA_CONTROL, DMA_START);
+  cr_assert(eq(sz, capture.singles, 2));
+  cr_assert(eq(u16, capture.samples[1], 8));
+  cr_assert(eq(u16, mem_read(vm, MR_DMA_CONTROL), DMA_DONE));
+  free(capture.samples);
+  vm_destroy(vm);
+}
+
+Test(dma_control, stops_at_the_end_of_memory) {
+  capture_t capture;
+  vm_t* vm = capture_vm(&capture, 64, 1);
+  mem_write(vm, MR_DMA_SOURCE, 0xFFF0);
+  mem_write(vm, MR_DMA_LENGTH, 0x100);
+  mem_write(vm, MR_DMA_CONTROL, DMA_START);
+  cr_assert(eq(sz, capture.count, 0x10));
+  free(capture.samples);
+  vm_destroy(vm);
+}
+
+// --- the DMA player ---
+
+Test(dma_control, player_loops_the_clip_a_buffer_at_a_time) {
+  const size_t clip = 0xEC40 - 0x1500;
+  capture_t capture;
+  vm_t* vm = capture_vm(&capture, 2 * clip, 1);
+  cr_assert(eq(int, vm_load_image(vm, PLAYER_DMA_OBJ), 1));
+  for (size_t i = 0; i < clip; ++i) {
+    vm->memory[0x1500 + i] = (uint16_t)(i + 1);
+  }
+  vm->reg[R_PC] = 0x1000;
+
+  // eight instructions of setup, then five per buffer
+  cr_assert(eq(u64, vm_run_for(vm, 8 + 2 * 5), 8 + 2 * 5));
+  cr_assert(eq(sz, capture.buffers, 2));
+  cr_assert(eq(u16, capture.samples[clip - 1], clip));
+  cr_assert(eq(u16, capture.samples[clip], 1));
+  free(capture.samples);
+  vm_destroy(vm);
+}
+
+Test(dma_control, player_walks_the_banks_of_a_stream) {
+  capture_t capture;
+  vm_t* vm = capture_vm(&capture, 4 * BANK_WINDOW_SIZE, 1);
+  cr_assert(eq(int, vm_load_image(vm, PLAYER_DMA_OBJ), 1));
+  const size_t samples = 2 * BANK_WINDOW_SIZE + 10;
+  uint16_t* image = malloc((samples + 1) * sizeof(uint16_t));
+  image[0] = swap16(BANK_WINDOW_ADDRESS);
+  for (size_t i = 0; i < samples; ++i) {
+    image[i + 1] = swap16((uint16_t)(i + 1));
+  }
+  mapped_file_t file = {(const uint8_t*)image,
+                        (samples + 1) * sizeof(uint16_t)};
+  bank_attach(vm, file, image);
+  vm->reg[R_PC] = 0x1000;
+
+  while (capture.count < capture.limit) {
+    vm_run_for(vm, 100);
+  }
+  size_t wrong = 0;
+  for (size_t i = 0; i < samples; ++i) {
+    wrong += capture.samples[i] != i + 1;
+  }
+  cr_assert(eq(sz, wrong, 0));
+  cr_assert(eq(u16, capture.samples[samples], 0), "padding");
+  cr_assert(eq(u16, capture.samples[3 * BANK_WINDOW_SIZE], 1), "looped");
+  free(capture.samples);
+  vm_destroy(vm);
+}
+
+// NOLINTEND
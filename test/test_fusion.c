@@ -0,0 +1,283 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../src/fusion.h"
+#include "../src/interpreter.h"
+#include "../src/memory.h"
+#include "../src/predecode.h"
+#include "../src/utils.h"
+#include "../src/vm.h"
+
+// NOLINTBEGIN
+
+static vm_t* vm;
+
+static void setup(void) { vm = vm_create(NULL); }
+
+static void teardown(void) { vm_destroy(vm); }
+
+static void reset_vm(void) {
+  memset(vm->memory, 0, sizeof(vm->memory));
+  memset(vm->reg, 0, sizeof(vm->reg));
+  predecode_invalidate_range(vm, 0, MEMORY_MAX + 1);
+  vm->reg[R_PC] = 0x3000;
+  vm->reg[R_COND] = FL_ZRO;
+}
+
+static decoded_t fused_at(uint16_t address) {
+  decoded_t decoded = predecode_instr(address, vm->memory[address]);
+  fuse_instrs(vm, address, &decoded);
+  return decoded;
+}
+
+// Compares R3 against R4 and counts the loop down in R1:
+//   x3000 NOT R2, R3
+//   x3001 ADD R2, R2, #1
+//   x3002 ADD R5, R2, R4    (R5 = R4 - R3)
+//   x3003 BRz #2
+//   x3004 ADD R1, R1, #-1
+//   x3005 BRp #-6
+//   x3006 HALT
+static const uint16_t compare_loop[] = {0x94FF, 0x14A1, 0x1A84, 0x0402,
+                                        0x127F, 0x03FA, 0xF025};
+
+// --- fuse_instrs ---
+
+Test(fuse_instrs, compare_and_branch, .init = setup, .fini = teardown) {
+  reset_vm();
+  memcpy(vm->memory + 0x3000, compare_loop, sizeof(compare_loop));
+
+  decoded_t decoded = fused_at(0x3000);
+  cr_assert(eq(u8, decoded.handler, PD_CMP_BR));
+  cr_assert(eq(u8, decoded.length, 4));
+  cr_assert(eq(u8, decoded.dr, R_R2));
+  cr_assert(eq(u8, decoded.sr1, R_R3));
+  cr_assert(eq(u8, decoded.rd2, R_R5));
+  cr_assert(eq(u8, decoded.sr2, R_R4));
+  cr_assert(eq(u16, decoded.imm2, FL_ZRO));
+  cr_assert(eq(u16, decoded.imm, 0x3006));
+  cr_assert(eq(u16, decoded.instr, 0x94FF));
+}
+
+Test(fuse_instrs, countdown_branch, .init = setup, .fini = teardown) {
+  reset_vm();
+  memcpy(vm->memory + 0x3000, compare_loop, sizeof(compare_loop));
+
+  decoded_t decoded = fused_at(0x3004);
+  cr_assert(eq(u8, decoded.handler, PD_ADD_BR));
+  cr_assert(eq(u8, decoded.length, 2));
+  cr_assert(eq(u16, decoded.imm2, 0xFFFF));
+  cr_assert(eq(u8, decoded.sr2, FL_POS));
+  cr_assert(eq(u16, decoded.imm, 0x3000));
+}
+
+Test(fuse_instrs, negation_without_add, .init = setup, .fini = teardown) {
+  reset_vm();
+  vm->memory[0x3000] = 0x94FF;  // NOT R2, R3
+  vm->memory[0x3001] = 0x14A1;  // ADD R2, R2, #1
+  vm->memory[0x3002] = 0xF025;  // HALT
+
+  decoded_t decoded = fused_at(0x3000);
+  cr_assert(eq(u8, decoded.handler, PD_NEG));
+  cr_assert(eq(u8, decoded.length, 2));
+}
+
+Test(fuse_instrs, copy_to_device, .init = setup, .fini = teardown) {
+  reset_vm();
+  vm->memory[0x3000] = 0x6C41;  // LDR R6, R1, #1
+  vm->memory[0x3001] = 0xBC05;  // STI R6, #5
+
+  decoded_t decoded = fused_at(0x3000);
+  cr_assert(eq(u8, decoded.handler, PD_LDR_STI));
+  cr_assert(eq(u8, decoded.dr, R_R6));
+  cr_assert(eq(u8, decoded.sr1, R_R1));
+  cr_assert(eq(u16, decoded.imm2, 1));
+  cr_assert(eq(u8, decoded.sr2, R_R6));
+  cr_assert(eq(u16, decoded.imm, 0x3007));
+}
+
+Test(fuse_instrs, unrelated_instructions_stay_plain, .init = setup,
+     .fini = teardown) {
+  reset_vm();
+  vm->memory[0x3000] = 0x94FF;  // NOT R2, R3
+  vm->memory[0x3001] = 0x1462;  // ADD R2, R1, #2, not an increment of R2
+
+  decoded_t decoded = fused_at(0x3000);
+  cr_assert(eq(u8, decoded.handler, PD_NOT));
+  cr_assert(eq(u8, decoded.length, 1));
+}
+
+// --- run_predecoded with fused records ---
+
+static void run_compare_loop(uint64_t (*engine)(vm_t*, uint64_t, int*),
+                             uint64_t budget, uint64_t* retired) {
+  reset_vm();
+  memcpy(vm->memory + 0x3000, compare_loop, sizeof(compare_loop));
+  vm->reg[R_R1] = 5;
+  vm->reg[R_R3] = 2;
+  vm->reg[R_R4] = 9;
+
+  int running = 1;
+  *retired = engine(vm, budget, &running);
+}
+
+Test(run_predecoded, fused_loop_matches_interpreter, .init = setup,
+     .fini = teardown) {
+  uint64_t expected_retired = 0;
+  run_compare_loop(run_instructions, 1000, &expected_retired);
+  uint16_t expected[R_COUNT];
+  memcpy(expected, vm->reg, sizeof(expected));
+
+  uint64_t retired = 0;
+  run_compare_loop(run_predecoded, 1000, &retired);
+
+  cr_assert(eq(u64, retired, expected_retired));
+  cr_assert(eq(u16, vm->reg[R_R1], 0));
+  cr_assert(eq(u16, vm->reg[R_R5], 7));
+  for (int i = 0; i < R_COUNT; ++i) {
+    cr_assert(eq(u16, vm->reg[i], expected[i]));
+  }
+}
+
+Test(run_predecoded, budget_ends_inside_fused_record, .init = setup,
+     .fini = teardown) {
+  for (uint64_t budget = 1; budget <= 8; ++budget) {
+    uint64_t expected_retired = 0;
+    run_compare_loop(run_instructions, budget, &expected_retired);
+    uint16_t expected[R_COUNT];
+    memcpy(expected, vm->reg, sizeof(expected));
+
+    uint64_t retired = 0;
+    run_compare_loop(run_predecoded, budget, &retired);
+
+    cr_assert(eq(u64, retired, budget));
+    for (int i = 0; i < R_COUNT; ++i) {
+      cr_assert(eq(u16, vm->reg[i], expected[i]));
+    }
+  }
+}
+
+Test(run_predecoded, store_inside_fused_record_drops_it, .init = setup,
+     .fini = teardown) {
+  reset_vm();
+  memcpy(vm->memory + 0x3000, compare_loop, sizeof(compare_loop));
+  vm->reg[R_R1] = 1;
+  int running = 1;
+  run_predecoded(vm, 4, &running);
+  cr_assert(eq(u8, vm->decode_cache[0x3000].handler, PD_CMP_BR));
+
+  mem_write(vm, 0x3003, 0x0E02);  // BRnzp #2, the compare now always jumps
+  cr_assert(eq(u8, vm->decode_cache[0x3000].handler, PD_DECODE));
+  vm->reg[R_PC] = 0x3000;
+  vm->decode_cache[0x3000] = fused_at(0x3000);
+  cr_assert(eq(u8, vm->decode_cache[0x3000].handler, PD_NEG_ADD));
+}
+
+// --- delay loops ---
+
+// x3000 ADD R5, R5, #-1 / x3001 BRzp #-2 / x3002 HALT, from player.asm
+static const uint16_t delay_loop[] = {0x1B7F, 0x07FE, 0xF025};
+
+static void run_delay_loop(uint64_t (*engine)(vm_t*, uint64_t, int*),
+                           uint16_t start, uint64_t budget,
+                           uint64_t* retired) {
+  reset_vm();
+  memcpy(vm->memory + 0x3000, delay_loop, sizeof(delay_loop));
+  vm->reg[R_R5] = start;
+
+  int running = 1;
+  *retired = engine(vm, budget, &running);
+}
+
+Test(fuse_instrs, delay_loop, .init = setup, .fini = teardown) {
+  reset_vm();
+  memcpy(vm->memory + 0x3000, delay_loop, sizeof(delay_loop));
+
+  decoded_t decoded = fused_at(0x3000);
+  cr_assert(eq(u8, decoded.handler, PD_DELAY));
+  cr_assert(eq(u16, decoded.imm, 0x3000));
+}
+
+Test(fuse_instrs, delay_loop_disabled, .init = setup, .fini = teardown) {
+  reset_vm();
+  memcpy(vm->memory + 0x3000, delay_loop, sizeof(delay_loop));
+
+  fast_forward_enabled = 0;
+  decoded_t decoded = fused_at(0x3000);
+  fast_forward_enabled = 1;
+  cr_assert(eq(u8, decoded.handler, PD_ADD_BR));
+}
+
+Test(delay_iterations, matches_stepping, .init = setup, .fini = teardown) {
+  const uint16_t starts[] = {0, 1, 10, 0x7FFF, 0x8000, 0xFFFF};
+  const uint16_t steps[] = {1, 0xFFFF};
+  for (size_t s = 0; s < sizeof(starts) / sizeof(starts[0]); ++s) {
+    for (size_t d = 0; d < 2; ++d) {
+      for (uint16_t mask = 1; mask < 7; ++mask) {
+        uint16_t value = starts[s];
+        uint32_t iterations = 0;
+        do {
+          value = (uint16_t)(value + steps[d]);
+          ++iterations;
+        } while (flags_for(value) & mask);
+        cr_assert(eq(u32, delay_iterations(starts[s], steps[d], mask),
+                     iterations));
+      }
+    }
+  }
+}
+
+Test(run_predecoded, delay_loop_matches_interpreter, .init = setup,
+     .fini = teardown) {
+  const uint16_t starts[] = {0, 10, 0x7FFF, 0xFFFF};
+  const uint64_t budgets[] = {1, 2, 3, 21, 22, 23, 1000, 70000};
+  for (size_t s = 0; s < sizeof(starts) / sizeof(starts[0]); ++s) {
+    for (size_t b = 0; b < sizeof(budgets) / sizeof(budgets[0]); ++b) {
+      uint64_t expected_retired = 0;
+      run_delay_loop(run_instructions, starts[s], budgets[b],
+                     &expected_retired);
+      uint16_t expected[R_COUNT];
+      memcpy(expected, vm->reg, sizeof(expected));
+
+      uint64_t retired = 0;
+      run_delay_loop(run_predecoded, starts[s], budgets[b], &retired);
+
+      cr_assert(eq(u64, retired, expected_retired));
+      for (int i = 0; i < R_COUNT; ++i) {
+        cr_assert(eq(u16, vm->reg[i], expected[i]));
+      }
+    }
+  }
+}
+
+Test(run_predecoded, delay_loop_advances_virtual_cycles, .init = setup,
+     .fini = teardown) {
+  vm->fast_forward_cycles = 0;
+  uint64_t retired = 0;
+  run_delay_loop(run_predecoded, 0x7FFF, 1000000, &retired);
+
+  // 32768 iterations of two instructions, then HALT
+  cr_assert(eq(u64, retired, 65537));
+  cr_assert(eq(u16, vm->reg[R_R5], 0xFFFF));
+  cr_assert(eq(u64, vm->fast_forward_cycles, 65534));
+}
+
+// --- run_fusion_profile ---
+
+Test(run_fusion_profile, counts_adjacent_pairs, .init = setup,
+     .fini = teardown) {
+  uint64_t retired = 0;
+  run_compare_loop(run_fusion_profile, 1000, &retired);
+  cr_assert(eq(u16, vm->reg[R_R1], 0));
+
+  char report[4096] = {0};
+  FILE* out = fmemopen(report, sizeof(report) - 1, "w");
+  fusion_profile_report(out, 3);
+  fclose(out);
+  cr_assert(strstr(report, "NOT -> ADD#") != NULL);
+  cr_assert(strstr(report, "NOT -> ADD# -> ADD") != NULL);
+}
+
+// NOLINTEND
@@ -0,0 +1,87 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../src/interpreter.h"
+#include "../src/memory.h"
+#include "../src/threaded.h"
+#include "../src/utils.h"
+#include "../src/vm.h"
+#include "programs.h"
+
+// NOLINTBEGIN
+
+static vm_t* vm;
+
+static void setup(void) { vm = vm_create(NULL); }
+
+static void teardown(void) { vm_destroy(vm); }
+
+static void load_program(void) {
+  memset(vm->memory, 0, sizeof(vm->memory));
+  memset(vm->reg, 0, sizeof(vm->reg));
+  memcpy(vm->memory + 0x3000, sum_program, sizeof(sum_program));
+  vm->reg[R_PC] = 0x3000;
+  vm->reg[R_COND] = FL_ZRO;
+}
+
+// --- Switch interpreter ---
+
+Test(run_instructions, runs_program_to_halt, .init = setup, .fini = teardown) {
+  load_program();
+  int running = 1;
+  uint64_t retired = run_instructions(vm, 1000, &running);
+
+  cr_assert(eq(int, running, 0));
+  cr_assert(eq(u64, retired, 34));
+  cr_assert(eq(u16, vm->memory[0x3007], 55));
+}
+
+Test(run_instructions, stops_at_budget, .init = setup, .fini = teardown) {
+  load_program();
+  int running = 1;
+  uint64_t retired = run_instructions(vm, 3, &running);
+
+  cr_assert(eq(int, running, 1));
+  cr_assert(eq(u64, retired, 3));
+  cr_assert(eq(u16, vm->reg[R_PC], 0x3003));
+}
+
+// --- Threaded interpreter ---
+
+Test(run_threaded, matches_switch_interpreter, .init = setup,
+     .fini = teardown) {
+  load_program();
+  int running = 1;
+  run_instructions(vm, 1000, &running);
+  uint16_t expected[R_COUNT];
+  memcpy(expected, vm->reg, sizeof(vm->reg));
+
+  load_program();
+  running = 1;
+  uint64_t retired = run_threaded(vm, 1000, &running);
+
+  cr_assert(eq(int, running, 0));
+  cr_assert(eq(u64, retired, 34));
+  cr_assert(eq(u16, vm->memory[0x3007], 55));
+  for (int i = 0; i < R_COUNT; ++i) {
+    cr_assert(eq(u16, vm->reg[i], expected[i]), "register %d differs", i);
+  }
+}
+
+Test(run_threaded, writes_back_state_at_budget, .init = setup,
+     .fini = teardown) {
+  load_program();
+  int running = 1;
+  uint64_t retired = run_threaded(vm, 4, &running);
+
+  cr_assert(eq(int, running, 1));
+  cr_assert(eq(u64, retired, 4));
+  cr_assert(eq(u16, vm->reg[R_PC], 0x3004));
+  cr_assert(eq(u16, vm->reg[R_R0], 10));
+  cr_assert(eq(u16, vm->reg[R_R1], 9));
+  cr_assert(eq(u16, vm->reg[R_COND], FL_POS));
+}
+
+// NOLINTEND
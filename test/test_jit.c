@@ -0,0 +1,239 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../src/interpreter.h"
+#include "../src/jit.h"
+#include "../src/memory.h"
+#include "../src/predecode.h"
+#include "../src/utils.h"
+#include "../src/vm.h"
+
+// NOLINTBEGIN
+
+static vm_t* vm;
+
+static void setup(void) { vm = vm_create(NULL); }
+
+static void teardown(void) { vm_destroy(vm); }
+
+// Counts R1 down from 1000, summing R1 into R0 and storing the running sum
+// through R2 on every iteration, then halts. Long enough to get hot.
+static const uint16_t countdown_program[] = {
+    0x5020,  // x3000 AND R0, R0, #0
+    0x2209,  // x3001 LD R1, #9        (R1 = 1000)
+    0xE408,  // x3002 LEA R2, #8       (R2 = x300B)
+    0x1001,  // x3003 ADD R0, R0, R1
+    0x7080,  // x3004 STR R0, R2, #0
+    0x967F,  // x3005 NOT R3, R1
+    0x127F,  // x3006 ADD R1, R1, #-1
+    0x03FB,  // x3007 BRp #-5
+    0x0C01,  // x3008 BRnz #1
+    0x0000,  // x3009 (skipped)
+    0xF025,  // x300A HALT
+    0x03E8,  // x300B / data: 1000, overwritten with the sum
+};
+
+static void load_program(const uint16_t* program, size_t size) {
+  memset(vm->memory, 0, sizeof(vm->memory));
+  memset(vm->reg, 0, sizeof(vm->reg));
+  memcpy(vm->memory + 0x3000, program, size);
+  predecode_invalidate_range(vm, 0, MEMORY_MAX + 1);
+  jit_reset();
+  vm->reg[R_PC] = 0x3000;
+  vm->reg[R_COND] = FL_ZRO;
+}
+
+Test(run_jit, matches_switch_interpreter, .init = setup, .fini = teardown) {
+  load_program(countdown_program, sizeof(countdown_program));
+  int running = 1;
+  uint64_t expected_retired = run_instructions(vm, 100000, &running);
+  uint16_t expected[R_COUNT];
+  memcpy(expected, vm->reg, sizeof(vm->reg));
+  uint16_t expected_sum = vm->memory[0x300B];
+
+  load_program(countdown_program, sizeof(countdown_program));
+  running = 1;
+  uint64_t retired = run_jit(vm, 100000, &running);
+
+  cr_assert(eq(int, running, 0));
+  cr_assert(gt(u64, jit_translations(), 0), "loop should be translated");
+  cr_assert(eq(u64, retired, expected_retired));
+  cr_assert(eq(u16, vm->memory[0x300B], expected_sum));
+  for (int i = 0; i < R_COUNT; ++i) {
+    cr_assert(eq(u16, vm->reg[i], expected[i]), "register %d differs", i);
+  }
+}
+
+Test(run_jit, respects_budget, .init = setup, .fini = teardown) {
+  load_program(countdown_program, sizeof(countdown_program));
+  int running = 1;
+  for (int i = 0; i < 200; ++i) {
+    uint64_t retired = run_jit(vm, 3, &running);
+    cr_assert(le(u64, retired, 3));
+  }
+  uint16_t jit_r1 = vm->reg[R_R1];
+
+  load_program(countdown_program, sizeof(countdown_program));
+  running = 1;
+  run_instructions(vm, 600, &running);
+  cr_assert(eq(u16, jit_r1, vm->reg[R_R1]));
+}
+
+Test(run_jit, store_into_code_page_invalidates_block, .init = setup,
+     .fini = teardown) {
+  // Runs ADD R0, R0, #1 in a hot loop, then patches it to ADD R0, R0, #2
+  // from inside the same translated block.
+  const uint16_t program[] = {
+      0x1021,  // x3000 ADD R0, R0, #1
+      0x127F,  // x3001 ADD R1, R1, #-1
+      0x03FD,  // x3002 BRp #-3
+      0x2402,  // x3003 LD R2, #2        (R2 = ADD R0, R0, #2)
+      0x35FB,  // x3004 ST R2, #-5       (patch x3000)
+      0xF025,  // x3005 HALT
+      0x1022,  // x3006 ADD R0, R0, #2
+  };
+  load_program(program, sizeof(program));
+  vm->reg[R_R1] = 100;
+  int running = 1;
+  run_jit(vm, 100000, &running);
+  cr_assert(gt(u64, jit_translations(), 0), "loop should be translated");
+  cr_assert(eq(u16, vm->reg[R_R0], 100));
+  cr_assert(eq(u16, vm->memory[0x3000], 0x1022));
+
+  // Run the patched loop again: it must not reuse the stale translation.
+  vm->reg[R_PC] = 0x3000;
+  vm->reg[R_R0] = 0;
+  vm->reg[R_R1] = 100;
+  running = 1;
+  run_jit(vm, 100000, &running);
+  cr_assert(eq(u16, vm->reg[R_R0], 200));
+}
+
+Test(run_jit, device_stores_go_through_mem_write, .init = setup,
+     .fini = teardown) {
+  // Writes R0 to MR_AUDIO_DATA in a hot loop; memory[] must not change.
+  const uint16_t program[] = {
+      0xB203,  // x3000 STI R0, #3      (MR_AUDIO_DATA)
+      0x127F,  // x3001 ADD R1, R1, #-1
+      0x03FD,  // x3002 BRp #-3
+      0xF025,  // x3003 HALT
+      MR_AUDIO_DATA,
+  };
+  load_program(program, sizeof(program));
+  vm->reg[R_R0] = 0xABCD;
+  vm->reg[R_R1] = 100;
+  int running = 1;
+  run_jit(vm, 100000, &running);
+  cr_assert(eq(u16, vm->memory[MR_AUDIO_DATA], 0));
+  cr_assert(gt(u64, jit_translations(), 0));
+}
+
+Test(run_jit, calls_keep_flags_set_from_r7, .init = setup, .fini = teardown) {
+  // Clears R7, which sets Z, then calls the next instruction; the BRz after
+  // the call must still see Z even though the call overwrote R7. R0 counts
+  // the iterations where it did not.
+  const uint16_t jsr_program[] = {
+      0x5FE0,  // x3000 AND R7, R7, #0
+      0x4800,  // x3001 JSR #0
+      0x0401,  // x3002 BRz #1
+      0x1021,  // x3003 ADD R0, R0, #1
+      0x127F,  // x3004 ADD R1, R1, #-1
+      0x03FA,  // x3005 BRp #-6
+      0xF025,  // x3006 HALT
+  };
+  uint16_t jsrr_program[sizeof(jsr_program) / sizeof(jsr_program[0])];
+  memcpy(jsrr_program, jsr_program, sizeof(jsr_program));
+  jsrr_program[1] = 0x4080;  // x3001 JSRR R2
+  const uint16_t* programs[] = {jsr_program, jsrr_program};
+
+  for (int i = 0; i < 2; ++i) {
+    load_program(programs[i], sizeof(jsr_program));
+    vm->reg[R_R1] = 100;
+    vm->reg[R_R2] = 0x3002;
+    int running = 1;
+    run_jit(vm, 100000, &running);
+    cr_assert(gt(u64, jit_translations(), 0), "loop should be translated");
+    cr_assert(eq(int, running, 0));
+    cr_assert(eq(u16, vm->reg[R_R0], 0), "program %d", i);
+  }
+}
+
+// Lays out full 64-instruction blocks from x3000, each an ADD that sets the
+// flags and 63 STR R0, R6, #0, so every store carries an exit that writes
+// the flags back. R1 counts the passes over the blocks, then it halts.
+static void load_store_blocks(size_t blocks) {
+  memset(vm->memory, 0, sizeof(vm->memory));
+  memset(vm->reg, 0, sizeof(vm->reg));
+  uint16_t address = 0x3000;
+  for (size_t b = 0; b < blocks; ++b) {
+    vm->memory[address++] = 0x1021;  // ADD R0, R0, #1
+    for (int i = 1; i < 64; ++i) {
+      vm->memory[address++] = 0x7180;  // STR R0, R6, #0
+    }
+  }
+  vm->memory[address++] = 0x127F;  // ADD R1, R1, #-1
+  vm->memory[address++] = 0x0C01;  // BRnz #1
+  vm->memory[address++] = 0xC140;  // JMP R5
+  vm->memory[address++] = 0xF025;  // HALT
+  predecode_invalidate_range(vm, 0, MEMORY_MAX + 1);
+  jit_reset();
+  vm->reg[R_PC] = 0x3000;
+  vm->reg[R_COND] = FL_ZRO;
+  vm->reg[R_R1] = 40;  // hot after 32 passes
+  vm->reg[R_R5] = 0x3000;
+  vm->reg[R_R6] = 0x8000;
+}
+
+// Runs the store blocks under the JIT, checks the result against the switch
+// interpreter and returns the most code the buffer held at once.
+static size_t run_store_blocks(size_t blocks) {
+  load_store_blocks(blocks);
+  int running = 1;
+  uint64_t expected_retired = run_instructions(vm, 10000000, &running);
+  uint16_t expected[R_COUNT];
+  memcpy(expected, vm->reg, sizeof(vm->reg));
+  uint16_t expected_stored = vm->memory[0x8000];
+
+  load_store_blocks(blocks);
+  running = 1;
+  uint64_t retired = 0;
+  size_t peak = 0;
+  while (running) {
+    retired += run_jit(vm, 1000, &running);
+    size_t used = jit_code_bytes();
+    cr_assert(le(sz, used, JIT_BUFFER_SIZE));
+    peak = used > peak ? used : peak;
+  }
+
+  cr_assert(eq(u64, retired, expected_retired));
+  cr_assert(eq(u16, vm->memory[0x8000], expected_stored));
+  for (int i = 0; i < R_COUNT; ++i) {
+    cr_assert(eq(u16, vm->reg[i], expected[i]), "register %d differs", i);
+  }
+  return peak;
+}
+
+Test(run_jit, fits_store_heavy_blocks_into_an_almost_full_buffer,
+     .init = setup, .fini = teardown) {
+  // about 9 KiB per block, so the last ones are translated with less room
+  // left than a whole block takes
+  size_t peak = run_store_blocks(150);
+
+  cr_assert(gt(sz, peak, JIT_BUFFER_SIZE - 1024), "peak %zu", peak);
+}
+
+Test(run_jit, drops_all_blocks_when_the_buffer_fills, .init = setup,
+     .fini = teardown) {
+  run_store_blocks(150);
+
+  // the buffer filled partway through the pass that made the blocks hot,
+  // so the first blocks were dropped and not yet translated again
+  cr_assert(lt(sz, jit_code_bytes(), JIT_BUFFER_SIZE / 2));
+  cr_assert(eq(u16, jit_code_pages[0x3000 >> JIT_PAGE_SHIFT], 0));
+  cr_assert(gt(u16, jit_code_pages[(0x3000 + 149 * 64) >> JIT_PAGE_SHIFT],
+               0));
+}
+
+// NOLINTEND
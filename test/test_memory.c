@@ -6,47 +6,55 @@
 
 #include "../src/memory.h"
 #include "../src/utils.h"
+#include "../src/vm.h"
 
 // NOLINTBEGIN
 
+static vm_t* vm;
+
+static void setup(void) { vm = vm_create(NULL); }
+
+static void teardown(void) { vm_destroy(vm); }
+
 // --- Basic mem_write to normal memory ---
 
-Test(mem_write, writes_to_memory) {
-  memset(memory, 0, sizeof(memory));
+Test(mem_write, writes_to_memory, .init = setup, .fini = teardown) {
+  memset(vm->memory, 0, sizeof(vm->memory));
   uint16_t address = 0x1000;
   uint16_t value = 0x1234;
 
-  mem_write(address, value);
+  mem_write(vm, address, value);
 
-  cr_assert(eq(u16, memory[address], value),
+  cr_assert(eq(u16, vm->memory[address], value),
             "Memory write failed at normal address");
 }
 
 // --- Basic mem_read from normal memory ---
 
-Test(mem_read, normal_memory_read) {
-  memset(memory, 0, sizeof(memory));
+Test(mem_read, normal_memory_read, .init = setup, .fini = teardown) {
+  memset(vm->memory, 0, sizeof(vm->memory));
   uint16_t address = 0x1000;
   uint16_t value = 0x5678;
 
-  mem_write(address, value);
-  uint16_t result = mem_read(address);
+  mem_write(vm, address, value);
+  uint16_t result = mem_read(vm, address);
 
   cr_assert(eq(u16, result, value), "Memory read returned wrong value");
 }
 
 // --- Special case: write to MR_AUDIO_DATA ---
 
-Test(mem_write, writes_to_audio_memory_triggers_audio_output) {
+Test(mem_write, writes_to_audio_memory_triggers_audio_output, .init = setup,
+     .fini = teardown) {
   // Setup: MR_AUDIO_DATA is a special address for audio
-  memset(memory, 0, sizeof(memory));
+  memset(vm->memory, 0, sizeof(vm->memory));
 
-  reg[R_R0] = AUDIO_ADDRESS;
+  vm->reg[R_R0] = AUDIO_ADDRESS;
 
   uint16_t value = 0xABCD;
-  mem_write(MR_AUDIO_DATA, value);
+  mem_write(vm, MR_AUDIO_DATA, value);
 
-  cr_assert(eq(u16, memory[MR_AUDIO_DATA], 0),
+  cr_assert(eq(u16, vm->memory[MR_AUDIO_DATA], 0),
             "Memory at MR_AUDIO_DATA should not be directly modified");
 }
 
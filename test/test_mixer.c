@@ -0,0 +1,168 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/memory.h"
+#include "../src/mixer.h"
+#include "../src/utils.h"
+#include "../src/vm.h"
+#include "../src/voice.h"
+
+// NOLINTBEGIN
+
+static mixer_t* mixer;
+
+static void setup(void) { mixer = mixer_create(); }
+
+static void teardown(void) { mixer_destroy(mixer); }
+
+static void play(uint16_t voice, const uint16_t* samples, size_t length,
+                 uint16_t volume, uint16_t rate, uint16_t control) {
+  voice_params_t params = {voice, samples, length, volume, rate, control};
+  mixer_voice(mixer, &params);
+}
+
+// --- mixer_accumulate ---
+
+Test(mixer_accumulate, matches_the_scalar_definition) {
+  // odd lengths cover the SIMD bodies and the scalar tail
+  const size_t sizes[] = {1, 7, 8, 15, 16, 17, 33, 1000};
+  const int16_t volumes[] = {0x100, 0x80, 0x7FFF, -0x100, 3};
+  srand(1);
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    for (size_t v = 0; v < sizeof(volumes) / sizeof(volumes[0]); ++v) {
+      size_t n = sizes[s];
+      int16_t* acc = malloc(n * sizeof(int16_t));
+      int16_t* src = malloc(n * sizeof(int16_t));
+      int16_t* expected = malloc(n * sizeof(int16_t));
+      for (size_t i = 0; i < n; ++i) {
+        acc[i] = (int16_t)(rand() & 0xFFFF);
+        src[i] = (int16_t)(rand() & 0xFFFF);
+        int32_t scaled = (src[i] * volumes[v]) >> 8;
+        scaled = scaled < -32768 ? -32768 : scaled > 32767 ? 32767 : scaled;
+        int32_t sum = acc[i] + scaled;
+        expected[i] = (int16_t)(sum < -32768 ? -32768
+                                : sum > 32767 ? 32767
+                                              : sum);
+      }
+      mixer_accumulate(acc, src, n, volumes[v]);
+      cr_assert(eq(int, memcmp(acc, expected, n * sizeof(int16_t)), 0),
+                "n=%zu volume=%d", n, volumes[v]);
+      free(expected);
+      free(src);
+      free(acc);
+    }
+  }
+}
+
+// --- mixer_mix ---
+
+Test(mixer_mix, adds_a_voice_at_unity, .init = setup, .fini = teardown) {
+  const uint16_t samples[] = {100, 200, (uint16_t)-300, 400};
+  play(0, samples, 4, 0x100, 0x100, VOICE_PLAY);
+  uint16_t out[6] = {1, 1, 1, 1, 1, 1};
+  mixer_mix(mixer, out, 6);
+  cr_assert(eq(i16, (int16_t)out[0], 101));
+  cr_assert(eq(i16, (int16_t)out[2], -299));
+  cr_assert(eq(i16, (int16_t)out[3], 401));
+  cr_assert(eq(u16, out[4], 1), "a one-shot voice ends");
+
+  mixer_mix(mixer, out, 6);
+  cr_assert(eq(u16, out[0], 101), "and stays silent");
+  voice_stats_t stats = mixer_voice_stats(mixer, 0);
+  cr_assert(eq(u64, stats.triggers, 1));
+  cr_assert(eq(u64, stats.samples, 4));
+}
+
+Test(mixer_mix, scales_loops_and_saturates, .init = setup,
+     .fini = teardown) {
+  const uint16_t samples[] = {1000, 30000};
+  play(1, samples, 2, 0x80, 0x100, VOICE_PLAY | VOICE_LOOP);
+  uint16_t out[5] = {0, 0, 0, 30000, 0};
+  mixer_mix(mixer, out, 5);
+  cr_assert(eq(i16, (int16_t)out[0], 500));
+  cr_assert(eq(i16, (int16_t)out[1], 15000));
+  cr_assert(eq(i16, (int16_t)out[2], 500), "looped");
+  cr_assert(eq(i16, (int16_t)out[3], 32767), "saturated");
+  cr_assert(eq(u64, mixer_voice_stats(mixer, 1).samples, 5));
+}
+
+Test(mixer_mix, interpolates_at_other_rates, .init = setup,
+     .fini = teardown) {
+  const uint16_t samples[] = {0, 1000, 2000};
+  play(2, samples, 3, 0x100, 0x80, VOICE_PLAY); /* half speed */
+  uint16_t out[8] = {0};
+  mixer_mix(mixer, out, 8);
+  const int16_t expected[] = {0, 500, 1000, 1500, 2000, 2000, 0, 0};
+  for (int i = 0; i < 8; ++i) {
+    cr_assert(eq(i16, (int16_t)out[i], expected[i]), "sample %d", i);
+  }
+}
+
+Test(mixer_mix, sums_voices_and_stops_them, .init = setup,
+     .fini = teardown) {
+  const uint16_t low[] = {10};
+  const uint16_t high[] = {1000};
+  play(0, low, 1, 0x100, 0x100, VOICE_PLAY | VOICE_LOOP);
+  play(3, high, 1, 0x200, 0x100, VOICE_PLAY | VOICE_LOOP);
+  uint16_t out[4] = {0};
+  mixer_mix(mixer, out, 4);
+  cr_assert(eq(i16, (int16_t)out[3], 2010));
+
+  play(3, high, 1, 0x100, 0x100, 0);
+  memset(out, 0, sizeof(out));
+  mixer_mix(mixer, out, 4);
+  cr_assert(eq(i16, (int16_t)out[3], 10));
+}
+
+Test(mixer_voice, copies_the_buffer, .init = setup, .fini = teardown) {
+  uint16_t samples[] = {7, 7};
+  play(0, samples, 2, 0x100, 0x100, VOICE_PLAY);
+  samples[0] = 9;
+  uint16_t out[2] = {0};
+  mixer_mix(mixer, out, 2);
+  cr_assert(eq(u16, out[0], 7));
+}
+
+// --- voice_store ---
+
+static voice_params_t seen;
+static size_t calls;
+
+static void record_voice(void* ctx, const voice_params_t* params) {
+  (void)ctx;
+  seen = *params;
+  ++calls;
+}
+
+static void ignore_sample(void* ctx, uint16_t sample) {
+  (void)ctx;
+  (void)sample;
+}
+
+Test(voice_store, control_store_passes_the_registers) {
+  vm_io_t io = {NULL, NULL, NULL, ignore_sample, NULL, NULL, record_voice};
+  vm_t* vm = vm_create(&io);
+  uint16_t regs = MR_VOICE_BASE + 2 * VOICE_STRIDE;
+  mem_write(vm, regs + VOICE_ADDRESS, 0x4000);
+  mem_write(vm, regs + VOICE_LENGTH, 300);
+  mem_write(vm, regs + VOICE_VOLUME, 0x0C0);
+  mem_write(vm, regs + VOICE_RATE, 0x180);
+  cr_assert(eq(sz, calls, 0));
+  mem_write(vm, regs + VOICE_CONTROL, VOICE_PLAY | VOICE_LOOP);
+
+  cr_assert(eq(sz, calls, 1));
+  cr_assert(eq(u16, seen.voice, 2));
+  cr_assert(eq(ptr, (void*)seen.samples, vm->memory + 0x4000));
+  cr_assert(eq(sz, seen.length, 300));
+  cr_assert(eq(u16, seen.volume, 0x0C0));
+  cr_assert(eq(u16, seen.rate, 0x180));
+  cr_assert(eq(u16, seen.control, VOICE_PLAY | VOICE_LOOP));
+  cr_assert(eq(u16, mem_read(vm, regs + VOICE_RATE), 0x180));
+  vm_destroy(vm);
+}
+
+// NOLINTEND
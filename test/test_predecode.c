@@ -0,0 +1,130 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../src/interpreter.h"
+#include "../src/memory.h"
+#include "../src/predecode.h"
+#include "../src/utils.h"
+#include "../src/vm.h"
+#include "programs.h"
+
+// NOLINTBEGIN
+
+static vm_t* vm;
+
+static void setup(void) { vm = vm_create(NULL); }
+
+static void teardown(void) { vm_destroy(vm); }
+
+static void reset_vm(void) {
+  memset(vm->memory, 0, sizeof(vm->memory));
+  memset(vm->reg, 0, sizeof(vm->reg));
+  predecode_invalidate_range(vm, 0, MEMORY_MAX + 1);
+  vm->reg[R_PC] = 0x3000;
+  vm->reg[R_COND] = FL_ZRO;
+}
+
+// --- predecode_instr ---
+
+Test(predecode_instr, add_immediate_is_sign_extended, .init = setup,
+     .fini = teardown) {
+  decoded_t decoded = predecode_instr(0x3000, 0x127F);  // ADD R1, R1, #-1
+  cr_assert(eq(u8, decoded.handler, PD_ADD_IMM));
+  cr_assert(eq(u8, decoded.dr, R_R1));
+  cr_assert(eq(u8, decoded.sr1, R_R1));
+  cr_assert(eq(u16, decoded.imm, 0xFFFF));
+}
+
+Test(predecode_instr, branch_stores_absolute_target, .init = setup,
+     .fini = teardown) {
+  decoded_t decoded = predecode_instr(0x3004, 0x03FD);  // BRp #-3
+  cr_assert(eq(u8, decoded.handler, PD_BR));
+  cr_assert(eq(u8, decoded.sr2, FL_POS));
+  cr_assert(eq(u16, decoded.imm, 0x3002));
+}
+
+Test(predecode_instr, unconditional_branch, .init = setup, .fini = teardown) {
+  decoded_t decoded = predecode_instr(0x3000, 0x0E01);  // BRnzp #1
+  cr_assert(eq(u8, decoded.handler, PD_BR_ALWAYS));
+  cr_assert(eq(u16, decoded.imm, 0x3002));
+}
+
+Test(predecode_instr, trap_uses_reference_interpreter, .init = setup,
+     .fini = teardown) {
+  decoded_t decoded = predecode_instr(0x3000, 0xF025);  // HALT
+  cr_assert(eq(u8, decoded.handler, PD_REF));
+  cr_assert(eq(u16, decoded.instr, 0xF025));
+}
+
+// --- invalidation ---
+
+Test(predecode_invalidate, mem_write_marks_record_stale, .init = setup,
+     .fini = teardown) {
+  reset_vm();
+  vm->decode_cache[0x3000] = predecode_instr(0x3000, 0x127F);
+  mem_write(vm, 0x3000, 0x1021);
+  cr_assert(eq(u8, vm->decode_cache[0x3000].handler, PD_DECODE));
+}
+
+// --- run_predecoded ---
+
+Test(run_predecoded, runs_program_to_halt, .init = setup, .fini = teardown) {
+  reset_vm();
+  memcpy(vm->memory + 0x3000, sum_program, sizeof(sum_program));
+
+  int running = 1;
+  uint64_t retired = run_predecoded(vm, 1000, &running);
+
+  cr_assert(eq(int, running, 0));
+  cr_assert(eq(u64, retired, 34));
+  cr_assert(eq(u16, vm->memory[0x3007], 55));
+  cr_assert(eq(u16, vm->reg[R_R0], 55));
+}
+
+Test(run_predecoded, sees_self_modifying_code, .init = setup,
+     .fini = teardown) {
+  // Executes ADD R0, R0, #1 once, then overwrites it with ADD R0, R0, #2
+  // through ST and runs it again.
+  const uint16_t program[] = {
+      0x1021,  // x3000 ADD R0, R0, #1
+      0x1402,  // x3001 ADD R2, R0, R2  (R2 = R0 + R2)
+      0x2203,  // x3002 LD R1, #3       (R1 = ADD R0, R0, #2)
+      0x33FC,  // x3003 ST R1, #-4      (overwrite x3000)
+      0x0FFB,  // x3004 BRnzp #-5       (back to x3000)
+      0x0000,
+      0x1022,  // x3006 ADD R0, R0, #2
+  };
+  reset_vm();
+  memcpy(vm->memory + 0x3000, program, sizeof(program));
+
+  int running = 1;
+  // first pass and the rewritten x3000 + x3001
+  run_predecoded(vm, 7, &running);
+
+  cr_assert(eq(u16, vm->memory[0x3000], 0x1022));
+  cr_assert(eq(u16, vm->reg[R_R0], 3));
+  cr_assert(eq(u16, vm->reg[R_R2], 4));
+}
+
+Test(run_predecoded, image_load_invalidates_cache, .init = setup,
+     .fini = teardown) {
+  reset_vm();
+  vm->memory[0x3000] = 0x1021;  // ADD R0, R0, #1
+  int running = 1;
+  run_predecoded(vm, 1, &running);
+  cr_assert(eq(u16, vm->reg[R_R0], 1));
+
+  // Reload x3000 with ADD R0, R0, #5 through the image loader.
+  uint8_t image[] = {0x30, 0x00, 0x10, 0x25};
+  FILE* file = fmemopen(image, sizeof(image), "rb");
+  read_image_file(vm, file);
+  fclose(file);
+
+  vm->reg[R_PC] = 0x3000;
+  run_predecoded(vm, 1, &running);
+  cr_assert(eq(u16, vm->reg[R_R0], 6));
+}
+
+// NOLINTEND
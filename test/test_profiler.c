@@ -0,0 +1,161 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/profiler.h"
+#include "../src/utils.h"
+#include "../src/vm.h"
+
+// NOLINTBEGIN
+
+static char path[64];
+
+// Writes text to a temporary symbol file and loads it.
+static int load_symbols(const char* text) {
+  strcpy(path, "/tmp/test_profiler_XXXXXX");
+  int fd = mkstemp(path);
+  cr_assert(fd >= 0);
+  cr_assert(eq(sz, (size_t)write(fd, text, strlen(text)), strlen(text)));
+  close(fd);
+  int count = profiler_load_symbols(path);
+  unlink(path);
+  return count;
+}
+
+// The table lc3as writes next to an object file
+static const char* lc3as_table =
+    "// Symbol table\n"
+    "// Scope level 0:\n"
+    "//\tSymbol Name       Page Address\n"
+    "//\t----------------  ------------\n"
+    "//\tMAIN              3000\n"
+    "//\tSUB               3003\n"
+    "\n";
+
+// MAIN calls SUB once, which returns, then halts.
+static const uint16_t call_program[] = {
+    0x4802,  // x3000 JSR SUB
+    0xF025,  // x3001 HALT
+    0x0000,  // x3002
+    0x1021,  // x3003 SUB: ADD R0, R0, #1
+    0xC1C0,  // x3004 RET
+};
+
+static int quiet_get_char(void* ctx) {
+  (void)ctx;
+  return 'x';
+}
+
+static int quiet_put_char(void* ctx, int chr) {
+  (void)ctx;
+  return chr;
+}
+
+static int quiet_flush(void* ctx) {
+  (void)ctx;
+  return 0;
+}
+
+static void quiet_audio_sample(void* ctx, uint16_t sample) {
+  (void)ctx;
+  (void)sample;
+}
+
+// Profiles the call program to HALT and returns its folded stacks.
+static char* profile_calls(uint64_t interval) {
+  static char folded[512];
+  vm_io_t io = {quiet_get_char, quiet_put_char, quiet_flush,
+                quiet_audio_sample, NULL, NULL, NULL};
+  vm_t* vm = vm_create(&io);
+  memcpy(vm->memory + VM_PC_START, call_program, sizeof(call_program));
+  profiler_start(interval, 0);
+  int running = 1;
+  cr_assert(eq(u64, run_pc_profile(vm, 100, &running), 4));
+  cr_assert(eq(int, running, 0));
+  vm_destroy(vm);
+
+  memset(folded, 0, sizeof(folded));
+  FILE* out = fmemopen(folded, sizeof(folded) - 1, "w");
+  cr_assert(eq(int, profiler_write_folded(out), 1));
+  fclose(out);
+  return folded;
+}
+
+// --- profiler_load_symbols ---
+
+Test(profiler_load_symbols, reads_lc3as_tables) {
+  char name[PROFILER_NAME_MAX];
+
+  cr_assert(eq(int, load_symbols(lc3as_table), 2));
+
+  cr_assert(eq(str, (char*)profiler_describe(0x3000, name, sizeof(name)),
+               "MAIN"));
+  cr_assert(eq(str, (char*)profiler_describe(0x3002, name, sizeof(name)),
+               "MAIN+2"));
+  cr_assert(eq(str, (char*)profiler_describe(0x4000, name, sizeof(name)),
+               "SUB+4093"));
+  cr_assert(eq(str, (char*)profiler_describe(0x2FFF, name, sizeof(name)),
+               "x2FFF"));
+}
+
+Test(profiler_load_symbols, reads_plain_lines_and_keeps_first_alias) {
+  char name[PROFILER_NAME_MAX];
+
+  cr_assert(eq(int, load_symbols("START x3000\nBEGIN x3000\nEND xFFFF\n"), 2));
+
+  cr_assert(eq(str, (char*)profiler_describe(0x3000, name, sizeof(name)),
+               "START"));
+  cr_assert(eq(str, (char*)profiler_describe(0xFFFF, name, sizeof(name)),
+               "END"));
+}
+
+Test(profiler_load_symbols, fails_on_missing_file) {
+  cr_assert(eq(int, profiler_load_symbols("/nonexistent/player.sym"), -1));
+}
+
+// --- run_pc_profile ---
+
+Test(run_pc_profile, folds_calls_into_stacks) {
+  load_symbols(lc3as_table);
+
+  char* folded = profile_calls(1);
+
+  cr_assert(strstr(folded, "MAIN 2\n") != NULL, "%s", folded);
+  cr_assert(strstr(folded, "MAIN;SUB 2\n") != NULL, "%s", folded);
+  cr_assert(eq(u64, profiler_samples_at(0x3003), 1));
+  cr_assert(eq(u64, profiler_samples_at(0x3002), 0));
+}
+
+Test(run_pc_profile, samples_every_interval_by_address) {
+  load_symbols("");
+
+  char* folded = profile_calls(2);
+
+  /* the second and fourth instructions, SUB's ADD and the HALT */
+  cr_assert(strstr(folded, "x3000;x3003 1\n") != NULL, "%s", folded);
+  cr_assert(strstr(folded, "x3000;x3001 1\n") != NULL, "%s", folded);
+  cr_assert(eq(u64, profiler_samples_at(0x3000), 0));
+}
+
+Test(run_pc_profile, reports_hot_spots_by_symbol) {
+  load_symbols(lc3as_table);
+  profile_calls(1);
+  char report[1024] = {0};
+  FILE* out = fmemopen(report, sizeof(report) - 1, "w");
+
+  profiler_report(out, 10);
+  fclose(out);
+
+  cr_assert(strstr(report, "pc profile: 4 samples, one every 1 ") != NULL,
+            "%s", report);
+  cr_assert(strstr(report, "x3003  SUB\n") != NULL, "%s", report);
+  cr_assert(strstr(report, "by symbol:\n") != NULL, "%s", report);
+  cr_assert(strstr(report, "50.00%            2  SUB\n") != NULL, "%s",
+            report);
+}
+
+// NOLINTEND
@@ -0,0 +1,190 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/audio.h"
+#include "../src/memory.h"
+#include "../src/recorder.h"
+#include "../src/utils.h"
+#include "../src/vm.h"
+#include "../src/voice.h"
+
+// NOLINTBEGIN
+
+static char path[64];
+
+static void setup(void) {
+  strcpy(path, "/tmp/test_recorder_XXXXXX");
+  int fd = mkstemp(path);
+  cr_assert(fd >= 0);
+  close(fd);
+}
+
+static void teardown(void) { unlink(path); }
+
+// Reads the whole file at path, setting size.
+static uint8_t* slurp(size_t* size) {
+  FILE* file = fopen(path, "rb");
+  cr_assert(file != NULL);
+  fseek(file, 0, SEEK_END);
+  *size = (size_t)ftell(file);
+  fseek(file, 0, SEEK_SET);
+  uint8_t* bytes = malloc(*size);
+  cr_assert(eq(sz, fread(bytes, 1, *size, file), *size));
+  fclose(file);
+  return bytes;
+}
+
+static uint32_t le32(const uint8_t* bytes) {
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+         ((uint32_t)bytes[3] << 24);
+}
+
+static int16_t sample_at(const uint8_t* bytes, size_t index) {
+  const uint8_t* at = bytes + RECORDER_HEADER_BYTES + 2 * index;
+  return (int16_t)(at[0] | (at[1] << 8));
+}
+
+// --- recorder_write / recorder_close ---
+
+Test(recorder_close, writes_a_pcm_header, .init = setup, .fini = teardown) {
+  recorder_t* recorder = recorder_open(path, 12000, 0);
+  cr_assert(recorder != NULL);
+  const uint16_t samples[] = {1, 0xFFFF, 0x1234};
+  recorder_write(recorder, samples, 3);
+  cr_assert(eq(int, recorder_close(recorder), 1));
+
+  size_t size = 0;
+  uint8_t* bytes = slurp(&size);
+  cr_assert(eq(sz, size, RECORDER_HEADER_BYTES + 6));
+  cr_assert(eq(int, memcmp(bytes, "RIFF", 4), 0));
+  cr_assert(eq(u32, le32(bytes + 4), size - 8));
+  cr_assert(eq(int, memcmp(bytes + 8, "WAVEfmt ", 8), 0));
+  cr_assert(eq(u32, le32(bytes + 24), 12000));
+  cr_assert(eq(u32, le32(bytes + 28), 24000));
+  cr_assert(eq(int, memcmp(bytes + 36, "data", 4), 0));
+  cr_assert(eq(u32, le32(bytes + 40), 6));
+  cr_assert(eq(i16, sample_at(bytes, 0), 1));
+  cr_assert(eq(i16, sample_at(bytes, 1), -1));
+  cr_assert(eq(i16, sample_at(bytes, 2), 0x1234));
+  free(bytes);
+}
+
+Test(recorder_write, spans_chunks_and_stops_at_the_limit, .init = setup,
+     .fini = teardown) {
+  size_t limit = 3 * RECORDER_CHUNK + 5;
+  recorder_t* recorder = recorder_open(path, 12000, limit);
+  uint16_t samples[1000];
+  for (size_t sent = 0; sent < 2 * limit; sent += 1000) {
+    cr_assert(eq(int, recorder_done(recorder), sent >= limit));
+    for (size_t i = 0; i < 1000; ++i) {
+      samples[i] = (uint16_t)(sent + i);
+    }
+    recorder_write(recorder, samples, 1000);
+  }
+  cr_assert(eq(int, recorder_done(recorder), 1));
+  cr_assert(eq(int, recorder_close(recorder), 1));
+
+  size_t size = 0;
+  uint8_t* bytes = slurp(&size);
+  cr_assert(eq(sz, size, RECORDER_HEADER_BYTES + 2 * limit));
+  size_t wrong = 0;
+  for (size_t i = 0; i < limit; ++i) {
+    wrong += sample_at(bytes, i) != (int16_t)i;
+  }
+  cr_assert(eq(sz, wrong, 0));
+  free(bytes);
+}
+
+Test(recorder_io, mixes_voices_from_the_trigger, .init = setup,
+     .fini = teardown) {
+  recorder_t* recorder = recorder_open(path, 12000, 0);
+  vm_io_t io = recorder_io(recorder);
+  vm_t* vm = vm_create(&io);
+  vm->memory[0x4000] = 100;
+  vm->memory[0x4001] = 200;
+  uint16_t regs = MR_VOICE_BASE;
+  for (int i = 0; i < 3; ++i) {
+    mem_write(vm, MR_AUDIO_DATA, 1);
+  }
+  mem_write(vm, regs + VOICE_ADDRESS, 0x4000);
+  mem_write(vm, regs + VOICE_LENGTH, 2);
+  mem_write(vm, regs + VOICE_VOLUME, 0x100);
+  mem_write(vm, regs + VOICE_RATE, 0x100);
+  mem_write(vm, regs + VOICE_CONTROL, VOICE_PLAY);
+  for (int i = 0; i < 3; ++i) {
+    mem_write(vm, MR_AUDIO_DATA, 1);
+  }
+  vm_destroy(vm);
+  cr_assert(eq(int, recorder_close(recorder), 1));
+
+  size_t size = 0;
+  uint8_t* bytes = slurp(&size);
+  const int16_t expected[] = {1, 1, 1, 101, 201, 1};
+  for (size_t i = 0; i < 6; ++i) {
+    cr_assert(eq(i16, sample_at(bytes, i), expected[i]), "sample %zu", i);
+  }
+  free(bytes);
+}
+
+// --- rendering a player ---
+
+// Renders the default player over a ramp, returns the file's bytes.
+static uint8_t* render_ramp(size_t samples, size_t* size) {
+  recorder_t* recorder = recorder_open(path, AUDIO_FREQUENCY, samples);
+  vm_io_t io = recorder_io(recorder);
+  vm_t* vm = vm_create(&io);
+  cr_assert(eq(int, vm_load_image(vm, PLAYER_OBJ), 1));
+  for (size_t i = 0; i < samples; ++i) {
+    vm->memory[AUDIO_ADDRESS + i] = (uint16_t)(i * 7);
+  }
+  vm->reg[R_PC] = 0x1000;
+  while (vm->running && !recorder_done(recorder)) {
+    vm_run_for(vm, 1000);
+  }
+  vm_destroy(vm);
+  cr_assert(eq(int, recorder_close(recorder), 1));
+  return slurp(size);
+}
+
+Test(recorder_io, renders_the_player_reproducibly, .init = setup,
+     .fini = teardown) {
+  size_t first_size = 0;
+  uint8_t* first = render_ramp(5000, &first_size);
+  cr_assert(eq(sz, first_size, RECORDER_HEADER_BYTES + 2 * 5000));
+  size_t wrong = 0;
+  for (size_t i = 0; i < 5000; ++i) {
+    wrong += sample_at(first, i) != (int16_t)(i * 7);
+  }
+  cr_assert(eq(sz, wrong, 0));
+
+  size_t second_size = 0;
+  uint8_t* second = render_ramp(5000, &second_size);
+  cr_assert(eq(sz, second_size, first_size));
+  cr_assert(eq(int, memcmp(first, second, first_size), 0));
+  free(second);
+  free(first);
+}
+
+Test(recorder_io, renders_one_pass_of_the_clip, .init = setup,
+     .fini = teardown) {
+  vm_t* vm = vm_create(NULL);
+  size_t samples = recorder_pass_samples(vm);
+  vm_destroy(vm);
+  cr_assert(eq(sz, samples, 0xD740));
+
+  /* one more sample than a pass is the first one again */
+  size_t size = 0;
+  uint8_t* bytes = render_ramp(samples + 1, &size);
+  cr_assert(eq(sz, size, RECORDER_HEADER_BYTES + 2 * (samples + 1)));
+  cr_assert(eq(i16, sample_at(bytes, samples - 1),
+               (int16_t)((samples - 1) * 7)));
+  cr_assert(eq(i16, sample_at(bytes, samples), 0));
+  free(bytes);
+}
+
+// NOLINTEND
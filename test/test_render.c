@@ -0,0 +1,180 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../src/memory.h"
+#include "../src/render.h"
+#include "../src/utils.h"
+#include "../src/vm.h"
+
+// NOLINTBEGIN
+
+// --- palette_init ---
+
+Test(palette_init, classic_matches_original_colors) {
+  palette_t palette;
+  palette_init(&palette, PALETTE_CLASSIC);
+  for (uint32_t i = 0; i < PALETTE_SIZE; ++i) {
+    uint32_t expected = 0xFF000000U | (i << 16) | (i << 8) | i;
+    cr_assert(eq(u32, palette.colors[i], expected));
+  }
+}
+
+Test(palette_init, other_palettes_are_opaque_ramps) {
+  palette_t palette;
+  palette_init(&palette, PALETTE_GRAY);
+  cr_assert(eq(u32, palette.colors[0], 0x000000FF));
+  cr_assert(eq(u32, palette.colors[0x80], 0x808080FF));
+  cr_assert(eq(u32, palette.colors[0xFF], 0xFFFFFFFF));
+
+  palette_init(&palette, PALETTE_HEAT);
+  cr_assert(eq(u32, palette.colors[0], 0x000000FF));
+  cr_assert(eq(u32, palette.colors[0x55], 0xFF0000FF));
+  cr_assert(eq(u32, palette.colors[0xAA], 0xFFFF00FF));
+  cr_assert(eq(u32, palette.colors[0xFF], 0xFFFFFFFF));
+}
+
+// --- palette_parse ---
+
+Test(palette_parse, round_trips_names) {
+  for (int i = 0; i < PALETTE_COUNT; ++i) {
+    palette_id_t id = PALETTE_COUNT;
+    cr_assert(eq(int, palette_parse(palette_name((palette_id_t)i), &id), 1));
+    cr_assert(eq(int, id, i));
+  }
+  palette_id_t id = PALETTE_GRAY;
+  cr_assert(eq(int, palette_parse("sepia", &id), 0));
+  cr_assert(eq(int, id, PALETTE_GRAY));
+}
+
+// --- render_words ---
+
+Test(render_words, kernels_match_scalar) {
+  uint16_t words[77];
+  for (size_t i = 0; i < 77; ++i) {
+    words[i] = (uint16_t)(i * 0x3B1D + 7);
+  }
+  palette_t palette;
+  palette_init(&palette, PALETTE_HEAT);
+
+  for (int kernel = 0; kernel < RENDER_KERNEL_COUNT; ++kernel) {
+    if (!render_kernel_supported((render_kernel_t)kernel)) {
+      continue;
+    }
+    // every length exercises the SIMD tails and unaligned starts
+    for (size_t count = 0; count <= 76; ++count) {
+      uint32_t pixels[77];
+      pixels[count] = 0xDEADBEEF;
+      render_words((render_kernel_t)kernel, pixels, words + 1, count,
+                   &palette);
+      for (size_t i = 0; i < count; ++i) {
+        cr_assert(eq(u32, pixels[i], palette.colors[words[i + 1] >> 8]),
+                  "%s differs at %zu", render_kernel_name(kernel), i);
+      }
+      cr_assert(eq(u32, pixels[count], 0xDEADBEEF), "wrote past the end");
+    }
+  }
+}
+
+Test(render_words, best_kernel_is_supported) {
+  cr_assert(eq(int, render_kernel_supported(render_best_kernel()), 1));
+  cr_assert(eq(int, render_kernel_supported(RENDER_SCALAR), 1));
+}
+
+// --- render_memory_map ---
+
+Test(render_memory_map, honors_pitch) {
+  vm_t* vm = vm_create(NULL);
+  vm->memory[0] = 0x0100;
+  vm->memory[MEMORY_MAP_DIM] = 0x0200;
+  vm->memory[MEMORY_MAX] = 0xFF00;
+  palette_t palette;
+  palette_init(&palette, PALETTE_GRAY);
+
+  // one padding pixel at the end of every row
+  const size_t stride = MEMORY_MAP_DIM + 1;
+  static uint32_t pixels[(MEMORY_MAP_DIM + 1) * MEMORY_MAP_DIM];
+  memset(pixels, 0xAB, sizeof(pixels));
+  render_memory_map(vm, pixels, (int)(stride * sizeof(uint32_t)), &palette);
+
+  cr_assert(eq(u32, pixels[0], palette.colors[1]));
+  cr_assert(eq(u32, pixels[1], palette.colors[0]));
+  cr_assert(eq(u32, pixels[MEMORY_MAP_DIM], 0xABABABAB));
+  cr_assert(eq(u32, pixels[stride], palette.colors[2]));
+  cr_assert(eq(u32, pixels[stride * MEMORY_MAP_DIM - 2], 0xFFFFFFFF));
+  vm_destroy(vm);
+}
+
+// --- render_dirty_rows ---
+
+static uint32_t frame[MEMORY_MAP_DIM * MEMORY_MAP_DIM];
+
+static size_t redraw(vm_t* vm, const palette_t* palette,
+                     render_span_t* spans) {
+  return render_dirty_rows(vm->memory, vm->dirty_pages, frame, palette, spans);
+}
+
+Test(render_dirty_rows, first_frame_draws_everything) {
+  vm_t* vm = vm_create(NULL);
+  vm->memory[MEMORY_MAX] = 0xFF00;
+  palette_t palette;
+  palette_init(&palette, PALETTE_GRAY);
+  render_span_t spans[RENDER_MAX_SPANS];
+
+  cr_assert(eq(sz, redraw(vm, &palette, spans), 1));
+  cr_assert(eq(u16, spans[0].first_row, 0));
+  cr_assert(eq(u16, spans[0].rows, MEMORY_MAP_DIM));
+  cr_assert(eq(u32, frame[MEMORY_MAX], 0xFFFFFFFF));
+
+  // nothing written since, so nothing to upload
+  cr_assert(eq(sz, redraw(vm, &palette, spans), 0));
+  vm_destroy(vm);
+}
+
+Test(render_dirty_rows, redraws_only_written_rows) {
+  vm_t* vm = vm_create(NULL);
+  palette_t palette;
+  palette_init(&palette, PALETTE_GRAY);
+  render_span_t spans[RENDER_MAX_SPANS];
+  redraw(vm, &palette, spans);
+
+  // clean rows keep their old pixels even if memory changes behind the
+  // tracker's back, which shows they were not redrawn
+  vm->memory[0x0000] = 0x8000;
+  mem_write(vm, 0x0105, 0x1000);  // row 1
+  mem_write(vm, 0x02FF, 0x2000);  // row 2, merged with row 1
+  mem_write(vm, 0x4000, 0x3000);  // row 64, the second bitmap word
+  mem_write(vm, MR_AUDIO_DATA, 0xFFFF);  // a device, not memory
+
+  cr_assert(eq(sz, redraw(vm, &palette, spans), 2));
+  cr_assert(eq(u16, spans[0].first_row, 1));
+  cr_assert(eq(u16, spans[0].rows, 2));
+  cr_assert(eq(u16, spans[1].first_row, 0x40));
+  cr_assert(eq(u16, spans[1].rows, 1));
+  cr_assert(eq(u32, frame[0x0000], palette.colors[0]));
+  cr_assert(eq(u32, frame[0x0105], palette.colors[0x10]));
+  cr_assert(eq(u32, frame[0x02FF], palette.colors[0x20]));
+  cr_assert(eq(u32, frame[0x4000], palette.colors[0x30]));
+  cr_assert(eq(u32, frame[MR_AUDIO_DATA], palette.colors[0]));
+  vm_destroy(vm);
+}
+
+Test(render_dirty_rows, image_load_marks_its_pages) {
+  vm_t* vm = vm_create(NULL);
+  palette_t palette;
+  palette_init(&palette, PALETTE_GRAY);
+  render_span_t spans[RENDER_MAX_SPANS];
+  redraw(vm, &palette, spans);
+
+  // two words straddling the boundary between rows 0x30 and 0x31
+  const uint8_t image[] = {0x30, 0xFF, 0x12, 0x34, 0x56, 0x78};
+  read_image_bytes(vm, image, sizeof(image));
+
+  cr_assert(eq(sz, redraw(vm, &palette, spans), 1));
+  cr_assert(eq(u16, spans[0].first_row, 0x30));
+  cr_assert(eq(u16, spans[0].rows, 2));
+  vm_destroy(vm);
+}
+
+// NOLINTEND
@@ -0,0 +1,183 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../src/ring.h"
+
+// NOLINTBEGIN
+
+static ring_t* ring;
+
+static void setup(void) { ring = ring_create(8); }
+
+static void teardown(void) { ring_destroy(ring); }
+
+// --- ring_push / ring_pop_or_repeat ---
+
+Test(ring_push, keeps_order, .init = setup, .fini = teardown) {
+  for (uint16_t i = 1; i <= 5; ++i) {
+    cr_assert(eq(int, ring_push(ring, i), 1));
+  }
+  cr_assert(eq(sz, ring_size(ring), 5));
+
+  uint16_t out[5] = {0};
+  cr_assert(eq(sz, ring_pop_or_repeat(ring, out, 5), 5));
+  for (uint16_t i = 0; i < 5; ++i) {
+    cr_assert(eq(u16, out[i], i + 1));
+  }
+  cr_assert(eq(sz, ring_size(ring), 0));
+}
+
+Test(ring_pop_or_repeat, reads_across_the_wrap, .init = setup,
+     .fini = teardown) {
+  uint16_t out[8] = {0};
+  for (uint16_t i = 0; i < 6; ++i) {
+    ring_push(ring, i);
+  }
+  ring_pop_or_repeat(ring, out, 6);
+
+  // slots 6 and 7, then 0 to 3
+  for (uint16_t i = 100; i < 106; ++i) {
+    ring_push(ring, i);
+  }
+  cr_assert(eq(sz, ring_pop_or_repeat(ring, out, 6), 6));
+  for (uint16_t i = 0; i < 6; ++i) {
+    cr_assert(eq(u16, out[i], 100 + i));
+  }
+}
+
+Test(ring_push, counts_overruns_when_full, .init = setup, .fini = teardown) {
+  for (uint16_t i = 0; i < 8; ++i) {
+    cr_assert(eq(int, ring_push(ring, i), 1));
+  }
+  cr_assert(eq(int, ring_push(ring, 8), 0));
+  cr_assert(eq(int, ring_push(ring, 9), 0));
+  cr_assert(eq(u64, ring->overruns, 2));
+  cr_assert(eq(sz, ring_size(ring), 8));
+
+  // the dropped samples never show up
+  uint16_t out[8] = {0};
+  ring_pop_or_repeat(ring, out, 8);
+  cr_assert(eq(u16, out[7], 7));
+}
+
+Test(ring_push_buffer, wraps_and_drops_what_does_not_fit, .init = setup,
+     .fini = teardown) {
+  const uint16_t first[] = {1, 2, 3, 4, 5};
+  const uint16_t second[] = {6, 7, 8, 9, 10, 11};
+  uint16_t out[8] = {0};
+  cr_assert(eq(sz, ring_push_buffer(ring, first, 5), 5));
+  ring_pop_or_repeat(ring, out, 4);
+
+  // one sample left, so seven fit and the copy runs across the wrap
+  cr_assert(eq(sz, ring_push_buffer(ring, second, 6), 6));
+  cr_assert(eq(sz, ring_push_buffer(ring, first, 5), 1));
+  cr_assert(eq(u64, ring->overruns, 4));
+  cr_assert(eq(sz, ring_pop_or_repeat(ring, out, 8), 8));
+  const uint16_t expected[] = {5, 6, 7, 8, 9, 10, 11, 1};
+  for (int i = 0; i < 8; ++i) {
+    cr_assert(eq(u16, out[i], expected[i]));
+  }
+}
+
+Test(ring_pop_or_repeat, repeats_last_sample_on_underrun, .init = setup,
+     .fini = teardown) {
+  uint16_t out[4] = {0};
+  cr_assert(eq(sz, ring_pop_or_repeat(ring, out, 4), 0));
+  cr_assert(eq(u16, out[0], 0), "silence before the first sample");
+  cr_assert(eq(u64, ring->underruns, 4));
+
+  ring_push(ring, 40);
+  ring_push(ring, 41);
+  cr_assert(eq(sz, ring_pop_or_repeat(ring, out, 4), 2));
+  cr_assert(eq(u16, out[1], 41));
+  cr_assert(eq(u16, out[2], 41));
+  cr_assert(eq(u16, out[3], 41));
+  cr_assert(eq(u64, ring->underruns, 6));
+
+  // the level holds across callbacks until new samples arrive
+  cr_assert(eq(sz, ring_pop_or_repeat(ring, out, 1), 0));
+  cr_assert(eq(u16, out[0], 41));
+}
+
+// --- one producer and one consumer thread ---
+
+enum { SAMPLES = 100000 };
+
+static void* producer(void* arg) {
+  (void)arg;
+  for (uint32_t i = 0; i < SAMPLES; ++i) {
+    while (!ring_push(ring, (uint16_t)i)) {
+      sched_yield(); /* the consumer may share our core */
+    }
+  }
+  return NULL;
+}
+
+Test(ring_pop_or_repeat, keeps_sequence_across_threads, .init = setup,
+     .fini = teardown) {
+  pthread_t thread;
+  cr_assert(eq(int, pthread_create(&thread, NULL, producer, NULL), 0));
+
+  uint32_t expected = 0;
+  uint32_t misordered = 0;
+  uint16_t out[3];
+  while (expected < SAMPLES) {
+    size_t read = ring_pop_or_repeat(ring, out, 3);
+    if (read == 0) {
+      sched_yield();
+    }
+    for (size_t i = 0; i < read; ++i) {
+      misordered += out[i] != (uint16_t)expected++;
+    }
+  }
+  pthread_join(thread, NULL);
+  cr_assert(eq(u32, misordered, 0));
+  cr_assert(eq(sz, ring_size(ring), 0));
+}
+
+// --- ring_wait_below ---
+
+static void* slow_consumer(void* arg) {
+  (void)arg;
+  struct timespec pause = {.tv_sec = 0, .tv_nsec = 20000000};
+  nanosleep(&pause, NULL);
+  uint16_t out[2];
+  for (int i = 0; i < 3; ++i) {
+    ring_pop_or_repeat(ring, out, 2);
+  }
+  return NULL;
+}
+
+Test(ring_wait_below, sleeps_until_consumer_drains, .init = setup,
+     .fini = teardown) {
+  for (uint16_t i = 0; i < 8; ++i) {
+    ring_push(ring, i);
+  }
+  pthread_t thread;
+  cr_assert(eq(int, pthread_create(&thread, NULL, slow_consumer, NULL), 0));
+  cr_assert(eq(int, ring_wait_below(ring, 2, 5000), 1));
+  cr_assert(le(sz, ring_size(ring), 2));
+  cr_assert(eq(u64, ring->parks, 1));
+  pthread_join(thread, NULL);
+}
+
+Test(ring_wait_below, returns_at_once_when_drained, .init = setup,
+     .fini = teardown) {
+  ring_push(ring, 1);
+  cr_assert(eq(int, ring_wait_below(ring, 2, 5000), 1));
+}
+
+Test(ring_wait_below, gives_up_without_consumer, .init = setup,
+     .fini = teardown) {
+  for (uint16_t i = 0; i < 8; ++i) {
+    ring_push(ring, i);
+  }
+  cr_assert(eq(int, ring_wait_below(ring, 2, 10), 0));
+  cr_assert(eq(sz, ring_size(ring), 8));
+}
+
+// NOLINTEND
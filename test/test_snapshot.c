@@ -0,0 +1,143 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/memory.h"
+#include "../src/snapshot.h"
+#include "../src/vm.h"
+
+// NOLINTBEGIN
+
+static vm_t* vm;
+static snapshot_t* snapshot;
+static mem_view_t* view;
+
+static void setup(void) {
+  vm = vm_create(NULL);
+  snapshot = snapshot_create();
+  view = calloc(1, sizeof(mem_view_t));
+}
+
+static void teardown(void) {
+  free(view);
+  snapshot_destroy(snapshot);
+  vm_destroy(vm);
+}
+
+// --- snapshot_publish / snapshot_take ---
+
+Test(snapshot_take, nothing_before_first_publish, .init = setup,
+     .fini = teardown) {
+  cr_assert(eq(int, snapshot_take(snapshot, view, 0), 0));
+  cr_assert(eq(int, snapshot_take(snapshot, view, 5), 0));
+}
+
+Test(snapshot_take, copies_only_published_pages, .init = setup,
+     .fini = teardown) {
+  vm->memory[0x1234] = 7;
+  cr_assert(eq(int, snapshot_publish(snapshot, vm), 1));
+  cr_assert(eq(u64, vm->dirty_pages[0], 0), "publish clears the VM's bits");
+  cr_assert(eq(int, snapshot_take(snapshot, view, 0), 1));
+  cr_assert(eq(u16, view->memory[0x1234], 7));
+  cr_assert(eq(u64, view->dirty_pages[0], UINT64_MAX));
+  memset(view->dirty_pages, 0, sizeof(view->dirty_pages));
+
+  // a write the VM did not track is not copied, a tracked one is
+  vm->memory[0x1235] = 8;
+  mem_write(vm, 0x4000, 9);
+  snapshot_publish(snapshot, vm);
+  cr_assert(eq(int, snapshot_take(snapshot, view, 0), 1));
+  cr_assert(eq(u16, view->memory[0x1235], 0));
+  cr_assert(eq(u16, view->memory[0x4000], 9));
+  cr_assert(eq(u64, view->dirty_pages[0], 0));
+  cr_assert(eq(u64, view->dirty_pages[1], 1));
+
+  // taken already
+  cr_assert(eq(int, snapshot_take(snapshot, view, 0), 0));
+}
+
+Test(snapshot_take, accumulates_untaken_publishes, .init = setup,
+     .fini = teardown) {
+  snapshot_publish(snapshot, vm);
+  snapshot_take(snapshot, view, 0);
+  memset(view->dirty_pages, 0, sizeof(view->dirty_pages));
+
+  mem_write(vm, 0x0100, 1);
+  snapshot_publish(snapshot, vm);
+  mem_write(vm, 0x0300, 3);
+  snapshot_publish(snapshot, vm);
+
+  cr_assert(eq(int, snapshot_take(snapshot, view, 0), 1));
+  cr_assert(eq(u16, view->memory[0x0100], 1));
+  cr_assert(eq(u16, view->memory[0x0300], 3));
+  cr_assert(eq(u64, view->dirty_pages[0], 0xA));
+}
+
+Test(snapshot_publish, skips_while_renderer_holds_lock, .init = setup,
+     .fini = teardown) {
+  snapshot_publish(snapshot, vm);
+  mem_write(vm, 0x0100, 1);
+
+  pthread_mutex_lock(&snapshot->lock);
+  cr_assert(eq(int, snapshot_publish(snapshot, vm), 0));
+  pthread_mutex_unlock(&snapshot->lock);
+  cr_assert(eq(u64, snapshot->skipped, 1));
+  cr_assert(eq(u64, vm->dirty_pages[0], 2), "kept for the next publish");
+
+  cr_assert(eq(int, snapshot_publish(snapshot, vm), 1));
+  snapshot_take(snapshot, view, 0);
+  cr_assert(eq(u16, view->memory[0x0100], 1));
+}
+
+Test(snapshot_close, wakes_waiting_renderer, .init = setup,
+     .fini = teardown) {
+  cr_assert(eq(int, snapshot_closed(snapshot), 0));
+  snapshot_close(snapshot);
+  cr_assert(eq(int, snapshot_closed(snapshot), 1));
+  // returns at once instead of waiting out the timeout
+  cr_assert(eq(int, snapshot_take(snapshot, view, 60000), 0));
+}
+
+// --- consistency across threads ---
+
+enum { FRAMES = 2000 };
+
+// Writes the same counter to two distant pages, publishing after each pair,
+// like a VM that keeps both pages in step.
+static void* publisher(void* arg) {
+  (void)arg;
+  for (uint16_t frame = 1; frame <= FRAMES; ++frame) {
+    mem_write(vm, 0x1000, frame);
+    mem_write(vm, 0xE000, frame);
+    while (!snapshot_publish(snapshot, vm)) {
+    }
+  }
+  snapshot_close(snapshot);
+  return NULL;
+}
+
+Test(snapshot_take, views_are_consistent_across_threads, .init = setup,
+     .fini = teardown) {
+  pthread_t thread;
+  cr_assert(eq(int, pthread_create(&thread, NULL, publisher, NULL), 0));
+
+  uint16_t last = 0;
+  for (;;) {
+    int closed = snapshot_closed(snapshot);
+    if (snapshot_take(snapshot, view, 1)) {
+      cr_assert(eq(u16, view->memory[0x1000], view->memory[0xE000]),
+                "view mixes two frames");
+      cr_assert(ge(u16, view->memory[0x1000], last));
+      last = view->memory[0x1000];
+    } else if (closed) {
+      break; /* closed and drained */
+    }
+  }
+  pthread_join(thread, NULL);
+  cr_assert(eq(u16, view->memory[0x1000], FRAMES));
+}
+
+// NOLINTEND
@@ -0,0 +1,167 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/interpreter.h"
+#include "../src/jit.h"
+#include "../src/predecode.h"
+#include "../src/stats.h"
+#include "../src/threaded.h"
+#include "../src/utils.h"
+#include "../src/vm.h"
+#include "programs.h"
+
+// NOLINTBEGIN
+
+// Writes the JSON for a VM to a string.
+static char* json_for(const vm_t* vm, const stats_run_t* run) {
+  static char text[4096];
+  FILE* file = fmemopen(text, sizeof(text), "w");
+  cr_assert(file != NULL);
+  cr_assert(eq(int, stats_write_json(file, vm, run), 1));
+  fclose(file);
+  return text;
+}
+
+// --- stats_count_run ---
+
+Test(stats_count_run, counts_the_opcodes_of_a_straight_line) {
+  vm_t* vm = vm_create(NULL);
+  memcpy(vm->memory + VM_PC_START, sum_program, sizeof(sum_program));
+
+  stats_count_run(vm, VM_PC_START, 7);
+
+  cr_assert(eq(u64, vm->stats.opcodes[OP_AND], 1));
+  cr_assert(eq(u64, vm->stats.opcodes[OP_ADD], 3));
+  cr_assert(eq(u64, vm->stats.opcodes[OP_BR], 1));
+  cr_assert(eq(u64, vm->stats.opcodes[OP_ST], 1));
+  cr_assert(eq(u64, vm->stats.opcodes[OP_TRAP], 1));
+  vm_destroy(vm);
+}
+
+Test(stats_count_run, wraps_at_the_end_of_memory) {
+  vm_t* vm = vm_create(NULL);
+  vm->memory[MEMORY_MAX] = 0x1001;  // ADD
+  vm->memory[0] = 0xF025;           // TRAP
+
+  stats_count_run(vm, MEMORY_MAX, 2);
+
+  cr_assert(eq(u64, vm->stats.opcodes[OP_ADD], 1));
+  cr_assert(eq(u64, vm->stats.opcodes[OP_TRAP], 1));
+  vm_destroy(vm);
+}
+
+// --- stats_opcode_name ---
+
+Test(stats_opcode_name, names_every_opcode) {
+  cr_assert(eq(str, (char*)stats_opcode_name(OP_BR), "BR"));
+  cr_assert(eq(str, (char*)stats_opcode_name(OP_LDI), "LDI"));
+  cr_assert(eq(str, (char*)stats_opcode_name(OP_TRAP), "TRAP"));
+}
+
+// --- stats_write_json ---
+
+Test(stats_write_json, writes_one_object) {
+  vm_t* vm = vm_create(NULL);
+  vm->stats.traps[TRAP_HALT] = 1;
+  vm->stats.traps[0x42] = 2;
+  stats_run_t run = {"switch", 34, 0.5};
+
+  char* text = json_for(vm, &run);
+
+  cr_assert(eq(int, strncmp(text, "{\"engine\": \"switch\", ", 21), 0));
+  cr_assert(strstr(text, "\"instructions\": 34, ") != NULL);
+  cr_assert(eq(int, strcmp(text + strlen(text) - 2, "}\n"), 0));
+  if (STATS_ENABLED) {
+    cr_assert(strstr(text, "\"counters\": true") != NULL);
+    cr_assert(strstr(text, "\"traps\": {\"HALT\": 1, \"x42\": 2}") != NULL);
+  } else {
+    cr_assert(strstr(text, "\"counters\": false}") != NULL);
+  }
+  vm_destroy(vm);
+}
+
+#ifdef PVMPKIN_STATS
+
+static int quiet_get_char(void* ctx) {
+  (void)ctx;
+  return 'x';
+}
+
+static int quiet_put_char(void* ctx, int chr) {
+  (void)ctx;
+  return chr;
+}
+
+static int quiet_flush(void* ctx) {
+  (void)ctx;
+  return 0;
+}
+
+static void quiet_audio_sample(void* ctx, uint16_t sample) {
+  (void)ctx;
+  (void)sample;
+}
+
+static const vm_io_t quiet_io = {quiet_get_char, quiet_put_char, quiet_flush,
+                                 quiet_audio_sample, NULL, NULL, NULL};
+
+typedef uint64_t (*engine_fn)(vm_t* vm, uint64_t budget, int* running);
+
+// Runs the sum program to HALT and returns the VM's counters.
+static vm_stats_t run_sum(engine_fn run) {
+  vm_t* vm = vm_create(&quiet_io);
+  memcpy(vm->memory + VM_PC_START, sum_program, sizeof(sum_program));
+  int running = 1;
+  while (running) {
+    run(vm, 1000, &running);
+  }
+  vm_stats_t stats = vm->stats;
+  vm_destroy(vm);
+  return stats;
+}
+
+// --- engines ---
+
+Test(engines, count_the_sum_program_alike) {
+  const engine_fn engines[] = {run_instructions, run_threaded, run_predecoded,
+                               run_jit};
+  for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); ++i) {
+    vm_stats_t stats = run_sum(engines[i]);
+    cr_assert(eq(u64, stats.opcodes[OP_AND], 1), "engine %zu", i);
+    cr_assert(eq(u64, stats.opcodes[OP_ADD], 21), "engine %zu", i);
+    cr_assert(eq(u64, stats.opcodes[OP_BR], 10), "engine %zu", i);
+    cr_assert(eq(u64, stats.opcodes[OP_ST], 1), "engine %zu", i);
+    cr_assert(eq(u64, stats.opcodes[OP_TRAP], 1), "engine %zu", i);
+    cr_assert(eq(u64, stats.traps[TRAP_HALT], 1), "engine %zu", i);
+    cr_assert(eq(u64, stats.mem_writes, 1), "engine %zu", i);
+  }
+}
+
+Test(engines, count_device_accesses) {
+  vm_t* vm = vm_create(&quiet_io);
+  const uint16_t program[] = {
+      0xB001,  // x3000 STI R0, #1 (to MR_AUDIO_DATA)
+      0xF025,  // x3001 HALT
+      MR_AUDIO_DATA,
+  };
+  memcpy(vm->memory + VM_PC_START, program, sizeof(program));
+  int running = 1;
+
+  run_instructions(vm, 100, &running);
+
+  /* two fetches and the pointer, then the sample */
+  cr_assert(eq(u64, vm->stats.mem_reads, 3));
+  cr_assert(eq(u64, vm->stats.mmio_reads, 0));
+  cr_assert(eq(u64, vm->stats.mem_writes, 1));
+  cr_assert(eq(u64, vm->stats.mmio_writes, 1));
+  cr_assert(eq(u64, vm->stats.audio_samples, 1));
+  vm_destroy(vm);
+}
+
+#endif
+
+// NOLINTEND
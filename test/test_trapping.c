@@ -2,6 +2,7 @@
 #include <criterion/hooks.h>
 
 #include "../src/trapping.h"
+#include "../src/vm.h"
 #include "memory.h"
 
 const uint16_t PC_START = 0x3000;
@@ -10,18 +11,24 @@ const uint16_t HI_PAIR = 0x6948;            // 'H', 'i'
 const uint16_t EXCL_NEWLINE_PAIR = 0x0A21;  // '!', '\n'
 const size_t OUTPUT_BUFFER_SIZE = 5;        // For output buffer
 
-Test(trapping, test_trap_getc) {
-  reg[R_R0] = 0;  // Reset register
+static vm_t* vm;
+
+static void setup(void) { vm = vm_create(NULL); }
+
+static void teardown(void) { vm_destroy(vm); }
+
+Test(trapping, test_trap_getc, .init = setup, .fini = teardown) {
+  vm->reg[R_R0] = 0;  // Reset register
   FILE* input = fmemopen("A", 1, "r");
   stdin = input;
-  trap_getc();
-  cr_assert_eq(reg[R_R0], 'A', "trap_getc should store 'A' in R_R0");
+  trap_getc(vm);
+  cr_assert_eq(vm->reg[R_R0], 'A', "trap_getc should store 'A' in R_R0");
   if (fclose(input) != 0) {
     cr_assert_fail("Failed to close the input stream");
   }
 }
 
-Test(trapping, test_trap_out) {
+Test(trapping, test_trap_out, .init = setup, .fini = teardown) {
   FILE* output = tmpfile();
   if (!output) {
     cr_assert_fail("Failed to create temporary file for output");
@@ -29,8 +36,8 @@ Test(trapping, test_trap_out) {
 
   FILE* old_stdout = stdout;
   stdout = output;
-  reg[R_R0] = 'B';
-  trap_out();
+  vm->reg[R_R0] = 'B';
+  trap_out(vm);
 
   if (fflush(output) != 0) {
     cr_assert_fail("Failed to flush output stream");
@@ -53,7 +60,7 @@ Test(trapping, test_trap_out) {
   }
 }
 
-Test(trapping, test_trap_puts) {
+Test(trapping, test_trap_puts, .init = setup, .fini = teardown) {
   FILE* output = tmpfile();
   if (!output) {
     cr_assert_fail("Failed to create temporary file for output");
@@ -63,12 +70,12 @@ Test(trapping, test_trap_puts) {
   stdout = output;
 
   // Store "Hi\0" in memory at 0x3000
-  reg[R_R0] = PC_START;
-  memory[PC_START] = 'H';
-  memory[PC_START + 1] = 'i';
-  memory[PC_START + 2] = 0;
+  vm->reg[R_R0] = PC_START;
+  vm->memory[PC_START] = 'H';
+  vm->memory[PC_START + 1] = 'i';
+  vm->memory[PC_START + 2] = 0;
 
-  trap_puts();
+  trap_puts(vm);
 
   if (fflush(output) != 0) {
     cr_assert_fail("Failed to flush output stream");
@@ -93,7 +100,7 @@ Test(trapping, test_trap_puts) {
   }
 }
 
-Test(trapping, test_trap_in) {
+Test(trapping, test_trap_in, .init = setup, .fini = teardown) {
   FILE* input = fmemopen("C", 1, "r");
   if (!input) {
     cr_assert_fail("Failed to create input stream");
@@ -109,7 +116,7 @@ Test(trapping, test_trap_in) {
   }
   stdout = output;
 
-  trap_in();
+  trap_in(vm);
 
   if (fflush(output) != 0) {
     if (fclose(input) != 0) {
@@ -121,7 +128,7 @@ Test(trapping, test_trap_in) {
     cr_assert_fail("Failed to flush output stream");
   }
 
-  cr_assert_eq(reg[R_R0], 'C', "trap_in should store 'C' in R_R0");
+  cr_assert_eq(vm->reg[R_R0], 'C', "trap_in should store 'C' in R_R0");
 
   if (fclose(input) != 0) {
     if (fclose(output) != 0) {
@@ -135,7 +142,7 @@ Test(trapping, test_trap_in) {
   }
 }
 
-Test(trapping, test_trap_putsp) {
+Test(trapping, test_trap_putsp, .init = setup, .fini = teardown) {
   FILE* output = tmpfile();
   if (!output) {
     cr_assert_fail("Failed to create temporary file for output");
@@ -145,12 +152,12 @@ Test(trapping, test_trap_putsp) {
   stdout = output;
 
   // Memory layout for "Hi!\n" -> 'H' + 'i' = 0x6948, '!' + '\n' = 0x0A21
-  reg[R_R0] = PC_START;
-  memory[PC_START] = HI_PAIR;                // 'H', 'i'
-  memory[PC_START + 1] = EXCL_NEWLINE_PAIR;  // '!', '\n'
-  memory[PC_START + 2] = 0;                  // null terminator
+  vm->reg[R_R0] = PC_START;
+  vm->memory[PC_START] = HI_PAIR;                // 'H', 'i'
+  vm->memory[PC_START + 1] = EXCL_NEWLINE_PAIR;  // '!', '\n'
+  vm->memory[PC_START + 2] = 0;                  // null terminator
 
-  trap_putsp();
+  trap_putsp(vm);
 
   if (fflush(output) != 0) {
     stdout = old_stdout;
@@ -189,8 +196,8 @@ Test(trapping, test_trap_putsp) {
   }
 }
 
-Test(trapping, test_trap_halt) {
+Test(trapping, test_trap_halt, .init = setup, .fini = teardown) {
   int running = 1;
-  trap_halt(&running);
+  trap_halt(vm, &running);
   cr_assert_eq(running, 0, "trap_halt should set running to 0");
 }
@@ -0,0 +1,193 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/render.h"
+#include "../src/video.h"
+#include "../src/vm.h"
+
+// NOLINTBEGIN
+
+static char dir[64];
+static char path[128];
+
+static void setup(void) {
+  strcpy(dir, "/tmp/test_video_XXXXXX");
+  cr_assert(mkdtemp(dir) != NULL);
+}
+
+static void teardown(void) {
+  char command[128];
+  snprintf(command, sizeof(command), "rm -rf %s", dir);
+  system(command);
+}
+
+// Reads a whole file, setting size.
+static uint8_t* slurp(const char* name, size_t* size) {
+  FILE* file = fopen(name, "rb");
+  cr_assert(file != NULL, "%s", name);
+  fseek(file, 0, SEEK_END);
+  *size = (size_t)ftell(file);
+  fseek(file, 0, SEEK_SET);
+  uint8_t* bytes = malloc(*size);
+  cr_assert(eq(sz, fread(bytes, 1, *size, file), *size));
+  fclose(file);
+  return bytes;
+}
+
+static uint32_t be32(const uint8_t* bytes) {
+  return ((uint32_t)bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) |
+         bytes[3];
+}
+
+// Exports frames of a VM whose memory holds frame + address.
+static void export_frames(const char* name, size_t frames) {
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  video_t* video = video_open(path, PALETTE_GRAY);
+  cr_assert(video != NULL);
+  vm_t* vm = vm_create(NULL);
+  for (size_t frame = 0; frame < frames; ++frame) {
+    for (size_t i = 0; i <= MEMORY_MAX; ++i) {
+      vm->memory[i] = (uint16_t)((frame + i) << 8);
+    }
+    cr_assert(eq(int, video_capture(video, vm), 1));
+  }
+  vm_destroy(vm);
+  video_stats_t stats;
+  cr_assert(eq(int, video_close(video, &stats), 1));
+  cr_assert(eq(u64, stats.captured, frames));
+  cr_assert(eq(u64, stats.written, frames));
+  cr_assert(eq(u64, stats.dropped, 0));
+}
+
+// --- video_format_for ---
+
+Test(video_format_for, goes_by_the_extension) {
+  cr_assert(eq(int, video_format_for("map.y4m"), VIDEO_Y4M));
+  cr_assert(eq(int, video_format_for("frames/map.png"), VIDEO_PNG));
+  cr_assert(eq(int, video_format_for("map.rgba"), VIDEO_RAW));
+  cr_assert(eq(int, video_format_for("png"), VIDEO_RAW));
+}
+
+// --- video_open / video_capture / video_close ---
+
+Test(video_capture, writes_raw_frames_in_order, .init = setup,
+     .fini = teardown) {
+  export_frames("map.rgba", 3);
+  size_t size = 0;
+  uint8_t* bytes = slurp(path, &size);
+  size_t frame_bytes = 4 * MEMORY_MAP_DIM * MEMORY_MAP_DIM;
+  cr_assert(eq(sz, size, 3 * frame_bytes));
+
+  palette_t gray;
+  palette_init(&gray, PALETTE_GRAY);
+  size_t wrong = 0;
+  for (size_t frame = 0; frame < 3; ++frame) {
+    for (size_t i = 0; i <= MEMORY_MAX; i += 97) {
+      uint32_t color = gray.colors[(frame + i) & 0xFF];
+      wrong += be32(bytes + frame * frame_bytes + 4 * i) != color;
+    }
+  }
+  cr_assert(eq(sz, wrong, 0));
+  free(bytes);
+}
+
+Test(video_capture, writes_a_y4m_stream, .init = setup, .fini = teardown) {
+  export_frames("map.y4m", 2);
+  size_t size = 0;
+  uint8_t* bytes = slurp(path, &size);
+  const char header[] = "YUV4MPEG2 W256 H256 F60:1 Ip A1:1 C444\n";
+  size_t plane = MEMORY_MAP_DIM * MEMORY_MAP_DIM;
+  size_t frame_bytes = strlen("FRAME\n") + 3 * plane;
+  cr_assert(eq(sz, size, strlen(header) + 2 * frame_bytes));
+  cr_assert(eq(int, memcmp(bytes, header, strlen(header)), 0));
+
+  const uint8_t* first = bytes + strlen(header);
+  cr_assert(eq(int, memcmp(first, "FRAME\n", 6), 0));
+  const uint8_t* luma = first + 6;
+  cr_assert(eq(u8, luma[0], 16), "black");
+  cr_assert(eq(u8, luma[0xFF], 235), "white");
+  cr_assert(eq(u8, luma[3 * plane - 0xFF - 1], 128), "gray has no chroma");
+  const uint8_t* second = first + frame_bytes;
+  cr_assert(eq(int, memcmp(second, "FRAME\n", 6), 0));
+  cr_assert(eq(u8, second[6 + 0xFE], 235), "one step further along");
+  free(bytes);
+}
+
+Test(video_capture, numbers_png_files, .init = setup, .fini = teardown) {
+  export_frames("map.png", 2);
+  char name[160];
+  for (int frame = 0; frame < 2; ++frame) {
+    snprintf(name, sizeof(name), "%s/map_%06d.png", dir, frame);
+    cr_assert(eq(int, access(name, F_OK), 0), "%s", name);
+  }
+  snprintf(name, sizeof(name), "%s/map_000002.png", dir);
+  cr_assert(eq(int, access(name, F_OK), -1));
+}
+
+// --- video_write_png ---
+
+Test(video_write_png, stores_the_rows_uncompressed, .init = setup,
+     .fini = teardown) {
+  uint32_t* pixels = malloc(MEMORY_MAP_DIM * MEMORY_MAP_DIM * 4);
+  for (uint32_t i = 0; i < MEMORY_MAP_DIM * MEMORY_MAP_DIM; ++i) {
+    pixels[i] = (i * 2654435761U) | 0xFF;
+  }
+  snprintf(path, sizeof(path), "%s/one.png", dir);
+  FILE* file = fopen(path, "wb");
+  cr_assert(eq(int, video_write_png(file, pixels), 1));
+  fclose(file);
+
+  size_t size = 0;
+  uint8_t* bytes = slurp(path, &size);
+  const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  cr_assert(eq(int, memcmp(bytes, signature, 8), 0));
+  cr_assert(eq(u32, be32(bytes + 8), 13));
+  cr_assert(eq(int, memcmp(bytes + 12, "IHDR", 4), 0));
+  cr_assert(eq(u32, be32(bytes + 16), MEMORY_MAP_DIM));
+  cr_assert(eq(u32, be32(bytes + 20), MEMORY_MAP_DIM));
+  cr_assert(eq(u8, bytes[24], 8));
+  cr_assert(eq(u8, bytes[25], 2));
+
+  // walk the stored deflate blocks of the IDAT chunk back into rows
+  const uint8_t* idat = bytes + 8 + 12 + 13;
+  uint32_t length = be32(idat);
+  cr_assert(eq(int, memcmp(idat + 4, "IDAT", 4), 0));
+  const uint8_t* in = idat + 8 + 2;
+  size_t row_bytes = 1 + 3 * MEMORY_MAP_DIM;
+  uint8_t* raw = malloc(row_bytes * MEMORY_MAP_DIM);
+  size_t got = 0;
+  int final = 0;
+  while (!final) {
+    final = in[0] & 1;
+    size_t len = in[1] | (in[2] << 8);
+    cr_assert(eq(sz, len ^ 0xFFFF, (size_t)(in[3] | (in[4] << 8))));
+    memcpy(raw + got, in + 5, len);
+    got += len;
+    in += 5 + len;
+  }
+  cr_assert(eq(sz, got, row_bytes * MEMORY_MAP_DIM));
+  cr_assert(eq(ptr, (void*)(in + 4), (void*)(idat + 8 + length)));
+  size_t wrong = 0;
+  for (uint32_t y = 0; y < MEMORY_MAP_DIM; ++y) {
+    const uint8_t* row = raw + y * row_bytes;
+    wrong += row[0] != 0;
+    for (uint32_t x = 0; x < MEMORY_MAP_DIM; ++x) {
+      uint32_t pixel = pixels[y * MEMORY_MAP_DIM + x];
+      wrong += row[1 + 3 * x] != (uint8_t)(pixel >> 24);
+      wrong += row[2 + 3 * x] != (uint8_t)(pixel >> 16);
+      wrong += row[3 + 3 * x] != (uint8_t)(pixel >> 8);
+    }
+  }
+  cr_assert(eq(sz, wrong, 0));
+  cr_assert(eq(int, memcmp(idat + 12 + length + 4, "IEND", 4), 0));
+  free(raw);
+  free(bytes);
+  free(pixels);
+}
+
+// NOLINTEND
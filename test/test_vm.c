@@ -0,0 +1,150 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/utils.h"
+#include "../src/vm.h"
+#include "programs.h"
+
+// NOLINTBEGIN
+
+// Captures console output and audio samples instead of using the terminal.
+typedef struct {
+  char output[64];
+  size_t output_len;
+  uint16_t samples[8];
+  size_t num_samples;
+} capture_t;
+
+static int capture_get_char(void* ctx) {
+  (void)ctx;
+  return 'x';
+}
+
+static int capture_put_char(void* ctx, int chr) {
+  capture_t* capture = ctx;
+  capture->output[capture->output_len++] = (char)chr;
+  return chr;
+}
+
+static int capture_flush(void* ctx) {
+  (void)ctx;
+  return 0;
+}
+
+static void capture_audio_sample(void* ctx, uint16_t sample) {
+  capture_t* capture = ctx;
+  capture->samples[capture->num_samples++] = sample;
+}
+
+static vm_io_t capture_io(capture_t* capture) {
+  memset(capture, 0, sizeof(*capture));
+  return (vm_io_t){capture_get_char, capture_put_char, capture_flush,
+                   capture_audio_sample, capture, NULL, NULL};
+}
+
+static void load_sum_program(vm_t* vm) {
+  memcpy(vm->memory + VM_PC_START, sum_program, sizeof(sum_program));
+}
+
+// --- vm_create ---
+
+Test(vm_create, starts_at_default_pc) {
+  vm_t* vm = vm_create(NULL);
+  cr_assert(eq(u16, vm->reg[R_PC], VM_PC_START));
+  cr_assert(eq(u16, vm->reg[R_COND], FL_ZRO));
+  cr_assert(eq(int, vm->running, 1));
+  vm_destroy(vm);
+}
+
+// --- vm_run_for ---
+
+Test(vm_run_for, runs_to_halt) {
+  capture_t capture;
+  vm_io_t io = capture_io(&capture);
+  vm_t* vm = vm_create(&io);
+  load_sum_program(vm);
+
+  cr_assert(eq(u64, vm_run_for(vm, 1000), 34));
+  cr_assert(eq(int, vm->running, 0));
+  cr_assert(eq(u16, vm->memory[0x3007], 55));
+  cr_assert(eq(u64, vm_run_for(vm, 1000), 0));
+  cr_assert(eq(str, capture.output, "HALT"));
+  vm_destroy(vm);
+}
+
+Test(vm_run_for, instances_are_independent) {
+  capture_t capture;
+  vm_io_t io = capture_io(&capture);
+  vm_t* first = vm_create(&io);
+  vm_t* second = vm_create(&io);
+  load_sum_program(first);
+  load_sum_program(second);
+  second->memory[0x3001] = 0x1225;  // ADD R1, R0, #5
+
+  // interleave the two machines in small slices
+  while (first->running || second->running) {
+    vm_run_for(first, 3);
+    vm_run_for(second, 5);
+  }
+
+  cr_assert(eq(u16, first->reg[R_R0], 55));
+  cr_assert(eq(u16, second->reg[R_R0], 15));
+  cr_assert(eq(u16, second->memory[0x3007], 15));
+  vm_destroy(first);
+  vm_destroy(second);
+}
+
+// --- I/O callbacks ---
+
+Test(vm_io, traps_and_devices_use_callbacks) {
+  capture_t capture;
+  vm_io_t io = capture_io(&capture);
+  vm_t* vm = vm_create(&io);
+  const uint16_t program[] = {
+      0xF020,  // x3000 GETC
+      0xF021,  // x3001 OUT
+      0xB001,  // x3002 STI R0, #1 (to MR_AUDIO_DATA)
+      0xF025,  // x3003 HALT
+      MR_AUDIO_DATA,
+  };
+  memcpy(vm->memory + VM_PC_START, program, sizeof(program));
+
+  vm_run_for(vm, 100);
+
+  cr_assert(eq(str, capture.output, "xHALT"));
+  cr_assert(eq(sz, capture.num_samples, 1));
+  cr_assert(eq(u16, capture.samples[0], 'x'));
+  vm_destroy(vm);
+}
+
+// --- vm_load_image ---
+
+Test(vm_load_image, loads_obj_file) {
+  char path[] = "/tmp/test_vm_XXXXXX";
+  int fd = mkstemp(path);
+  cr_assert(fd >= 0);
+  const uint8_t image[] = {0x30, 0x00, 0x10, 0x25, 0xF0, 0x25};
+  cr_assert(eq(sz, (size_t)write(fd, image, sizeof(image)), sizeof(image)));
+  close(fd);
+
+  vm_t* vm = vm_create(NULL);
+  cr_assert(eq(int, vm_load_image(vm, path), 1));
+  unlink(path);
+
+  cr_assert(eq(u16, vm->memory[0x3000], 0x1025));
+  cr_assert(eq(u16, vm->memory[0x3001], 0xF025));
+  vm_destroy(vm);
+}
+
+Test(vm_load_image, missing_file_fails) {
+  vm_t* vm = vm_create(NULL);
+  cr_assert(eq(int, vm_load_image(vm, "/nonexistent/image.obj"), 0));
+  vm_destroy(vm);
+}
+
+// NOLINTEND
@@ -0,0 +1,287 @@
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/audio.h"
+#include "../src/utils.h"
+#include "../src/vm.h"
+#include "../src/wav.h"
+
+// NOLINTBEGIN
+
+#define PI 3.14159265358979323846
+#define S16 32768.0
+
+// A test signal: two tones, one on each channel if there are two
+typedef struct {
+  double left_hz, left_amp;
+  double right_hz, right_amp;
+} tones_t;
+
+static double tone(const tones_t* tones, uint16_t channel, double t) {
+  if (channel == 0) {
+    return tones->left_amp * sin(2 * PI * tones->left_hz * t);
+  }
+  return tones->right_amp * sin(2 * PI * tones->right_hz * t);
+}
+
+static void put16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+  put16(p, (uint16_t)v);
+  put16(p + 2, (uint16_t)(v >> 16));
+}
+
+// Builds a canonical 44-byte-header WAV file and returns its malloc'd bytes.
+static uint8_t* make_wav(uint16_t format, uint16_t channels, uint32_t rate,
+                         uint16_t bits, size_t frames, const tones_t* tones,
+                         size_t* size) {
+  size_t bytes_per = bits / 8;
+  size_t data = frames * channels * bytes_per;
+  *size = 44 + data;
+  uint8_t* wav = calloc(1, *size);
+  memcpy(wav, "RIFF", 4);
+  put32(wav + 4, (uint32_t)(*size - 8));
+  memcpy(wav + 8, "WAVEfmt ", 8);
+  put32(wav + 16, 16);
+  put16(wav + 20, format);
+  put16(wav + 22, channels);
+  put32(wav + 24, rate);
+  put32(wav + 28, (uint32_t)(rate * channels * bytes_per));
+  put16(wav + 32, (uint16_t)(channels * bytes_per));
+  put16(wav + 34, bits);
+  memcpy(wav + 36, "data", 4);
+  put32(wav + 40, (uint32_t)data);
+
+  uint8_t* p = wav + 44;
+  for (size_t f = 0; f < frames; ++f) {
+    for (uint16_t c = 0; c < channels; ++c) {
+      double v = tone(tones, c, (double)f / rate);
+      if (format == WAV_FORMAT_FLOAT) {
+        float x = (float)v;
+        memcpy(p, &x, 4);
+      } else if (bits == 8) {
+        p[0] = (uint8_t)lrint(v * 127 + 128);
+      } else if (bits == 16) {
+        put16(p, (uint16_t)(int16_t)lrint(v * 32767));
+      } else if (bits == 24) {
+        int32_t x = (int32_t)lrint(v * 8388607);
+        p[0] = (uint8_t)x;
+        p[1] = (uint8_t)(x >> 8);
+        p[2] = (uint8_t)(x >> 16);
+      } else {
+        put32(p, (uint32_t)(int32_t)lrint(v * 2147483647.0));
+      }
+      p += bytes_per;
+    }
+  }
+  return wav;
+}
+
+// Largest difference from a sine of amplitude amp, away from the edges the
+// filter smears into the padding.
+static double max_error(const uint16_t* out, size_t count, double hz,
+                        double amp) {
+  double worst = 0;
+  for (size_t n = 200; n + 200 < count; ++n) {
+    double expected = amp * WAV_GAIN * sin(2 * PI * hz * n / 12000) * S16;
+    double err = fabs((int16_t)out[n] - expected);
+    worst = err > worst ? err : worst;
+  }
+  return worst;
+}
+
+// --- wav_parse ---
+
+Test(wav_parse, reads_format_fields) {
+  tones_t silence = {0};
+  size_t size;
+  uint8_t* wav = make_wav(WAV_FORMAT_PCM, 2, 44100, 24, 100, &silence, &size);
+  wav_info_t info;
+  cr_assert(eq(int, wav_parse(wav, size, &info), 1));
+  cr_assert(eq(u16, info.format, WAV_FORMAT_PCM));
+  cr_assert(eq(u16, info.channels, 2));
+  cr_assert(eq(u32, info.rate, 44100));
+  cr_assert(eq(u16, info.bits, 24));
+  cr_assert(eq(sz, info.frames, 100));
+  cr_assert(eq(ptr, info.data, wav + 44));
+  free(wav);
+}
+
+Test(wav_parse, rejects_other_files) {
+  tones_t silence = {0};
+  size_t size;
+  uint8_t* wav = make_wav(WAV_FORMAT_PCM, 1, 8000, 16, 10, &silence, &size);
+  wav_info_t info;
+  cr_assert(eq(int, wav_parse(wav, 11, &info), 0), "truncated");
+  memcpy(wav + 8, "AVI ", 4);
+  cr_assert(eq(int, wav_parse(wav, size, &info), 0), "not WAVE");
+  memcpy(wav + 8, "WAVE", 4);
+  put16(wav + 20, 2); /* ADPCM */
+  cr_assert(eq(int, wav_parse(wav, size, &info), 0), "compressed");
+  put16(wav + 20, WAV_FORMAT_PCM);
+  put16(wav + 34, 12);
+  cr_assert(eq(int, wav_parse(wav, size, &info), 0), "odd sample size");
+  free(wav);
+}
+
+Test(wav_parse, skips_unknown_chunks_and_reads_extensible) {
+  // fmt (40 bytes, extensible) + an odd-sized LIST chunk + data
+  const size_t size = 12 + 48 + 8 + 3 + 1 + 8 + 4;
+  uint8_t wav[12 + 48 + 8 + 3 + 1 + 8 + 4] = {0};
+  memcpy(wav, "RIFFxxxxWAVEfmt ", 16);
+  put32(wav + 16, 40);
+  put16(wav + 20, WAV_FORMAT_EXTENSIBLE);
+  put16(wav + 22, 1);
+  put32(wav + 24, 16000);
+  put16(wav + 32, 4);
+  put16(wav + 34, 32);
+  put16(wav + 20 + 24, WAV_FORMAT_FLOAT); /* subformat GUID */
+  memcpy(wav + 60, "LIST", 4);
+  put32(wav + 64, 3);
+  memcpy(wav + 72, "data", 4);
+  put32(wav + 76, 0xFFFFFFFF); /* streamed, size unknown */
+
+  wav_info_t info;
+  cr_assert(eq(int, wav_parse(wav, size, &info), 1));
+  cr_assert(eq(u16, info.format, WAV_FORMAT_FLOAT));
+  cr_assert(eq(sz, info.frames, 1), "data cut to the file");
+}
+
+// --- wav_decode ---
+
+Test(wav_decode, downsamples_a_tone_with_the_chain_gain) {
+  tones_t tones = {1000, 0.5, 0, 0};
+  size_t size;
+  uint8_t* wav = make_wav(WAV_FORMAT_PCM, 1, 48000, 16, 48000, &tones, &size);
+  uint16_t* out = calloc(20000, sizeof(uint16_t));
+  cr_assert(eq(sz, wav_decode(wav, size, out, 20000, 12000), 12000));
+  cr_assert(le(dbl, max_error(out, 12000, 1000, 0.5), 0.001 * S16));
+  free(out);
+  free(wav);
+}
+
+Test(wav_decode, averages_channels_at_44100) {
+  tones_t tones = {500, 0.8, 500, 0.0};
+  size_t size;
+  uint8_t* wav = make_wav(WAV_FORMAT_PCM, 2, 44100, 24, 44100, &tones, &size);
+  uint16_t* out = calloc(20000, sizeof(uint16_t));
+  cr_assert(eq(sz, wav_decode(wav, size, out, 20000, 12000), 12000));
+  cr_assert(le(dbl, max_error(out, 12000, 500, 0.4), 0.001 * S16));
+  free(out);
+  free(wav);
+}
+
+Test(wav_decode, upsamples_8_bit_audio) {
+  tones_t tones = {440, 0.5, 0, 0};
+  size_t size;
+  uint8_t* wav = make_wav(WAV_FORMAT_PCM, 1, 8000, 8, 8000, &tones, &size);
+  uint16_t* out = calloc(20000, sizeof(uint16_t));
+  cr_assert(eq(sz, wav_decode(wav, size, out, 20000, 12000), 12000));
+  /* 8-bit input is only good to about 1/256 of full scale */
+  cr_assert(le(dbl, max_error(out, 12000, 440, 0.5), 0.01 * S16));
+  free(out);
+  free(wav);
+}
+
+Test(wav_decode, removes_tones_above_the_cutoff) {
+  tones_t tones = {7000, 0.9, 0, 0};
+  size_t size;
+  uint8_t* wav = make_wav(WAV_FORMAT_FLOAT, 1, 32000, 32, 32000, &tones, &size);
+  uint16_t* out = calloc(20000, sizeof(uint16_t));
+  cr_assert(eq(sz, wav_decode(wav, size, out, 20000, 12000), 12000));
+  cr_assert(le(dbl, max_error(out, 12000, 0, 0), 0.001 * S16),
+            "would alias to 5 kHz");
+  free(out);
+  free(wav);
+}
+
+Test(wav_decode, converts_whole_file_within_capacity) {
+  tones_t silence = {0};
+  size_t size;
+  uint8_t* wav = make_wav(WAV_FORMAT_PCM, 1, 8000, 16, 6 * 8000, &silence,
+                          &size);
+  cr_assert(eq(sz, wav_length(wav, size, 12000), 72000));
+  uint16_t* out = calloc(80000, sizeof(uint16_t));
+  cr_assert(eq(sz, wav_decode(wav, size, out, 80000, 12000), 72000));
+  cr_assert(eq(sz, wav_decode(wav, size, out, 1000, 12000), 1000));
+  free(out);
+  free(wav);
+}
+
+Test(wav_decode, short_capacity_matches_the_whole_decode) {
+  tones_t tones = {700, 0.6, 0, 0};
+  size_t size;
+  uint8_t* wav = make_wav(WAV_FORMAT_PCM, 1, 44100, 16, 44100, &tones, &size);
+  uint16_t* whole = calloc(12000, sizeof(uint16_t));
+  uint16_t* part = calloc(12000, sizeof(uint16_t));
+  cr_assert(eq(sz, wav_decode(wav, size, whole, 12000, 12000), 12000));
+  cr_assert(eq(sz, wav_decode(wav, size, part, 5000, 12000), 5000));
+  cr_assert(eq(int, memcmp(whole, part, 5000 * sizeof(uint16_t)), 0),
+            "input past the last stored sample must not matter");
+  free(part);
+  free(whole);
+  free(wav);
+}
+
+// --- against the ffmpeg chain it replaces ---
+
+Test(wav_decode, matches_ffmpeg_within_tolerance) {
+  // NOLINTNEXTLINE(cert-env33-c, concurrency-mt-unsafe)
+  if (system("ffmpeg -version > /dev/null 2>&1") != 0) {
+    cr_skip_test("ffmpeg is not installed");
+  }
+  tones_t tones = {300, 0.5, 1200, 0.3};
+  size_t size;
+  uint8_t* wav = make_wav(WAV_FORMAT_PCM, 2, 44100, 16, 2 * 44100, &tones,
+                          &size);
+  char path[] = "/tmp/test_wav_XXXXXX.wav";
+  int fd = mkstemps(path, 4);
+  cr_assert(fd >= 0);
+  cr_assert(eq(sz, (size_t)write(fd, wav, size), size));
+  close(fd);
+
+  vm_t* vm = vm_create(NULL);
+  FILE* pipe = open_audio_pipe(path, AUDIO_FFMPEG_ARGS);
+  cr_assert(pipe != NULL);
+  size_t theirs = read_words_stream(vm, pipe, AUDIO_ADDRESS);
+  cr_assert(eq(int, close_audio_pipe(pipe), 1));
+  uint16_t* ours = calloc(30000, sizeof(uint16_t));
+  size_t count = wav_decode(wav, size, ours, 30000, AUDIO_FREQUENCY);
+  cr_assert(le(sz, count > theirs ? count - theirs : theirs - count, 16));
+
+  // the filters differ in phase, so compare at the best small lag
+  const int16_t* ref = (const int16_t*)(vm->memory + AUDIO_ADDRESS);
+  size_t n = (count < theirs ? count : theirs) - 400;
+  double best = 0, ours_energy = 0, ref_energy = 0;
+  for (size_t i = 200; i < 200 + n; ++i) {
+    ours_energy += (double)(int16_t)ours[i] * (int16_t)ours[i];
+    ref_energy += (double)ref[i] * ref[i];
+  }
+  for (int lag = -4; lag <= 4; ++lag) {
+    double dot = 0;
+    for (size_t i = 200; i < 200 + n; ++i) {
+      dot += (double)(int16_t)ours[i] * ref[(size_t)((long)i + lag)];
+    }
+    double corr = dot / sqrt(ours_energy * ref_energy);
+    best = corr > best ? corr : best;
+  }
+  cr_assert(ge(dbl, best, 0.99), "correlation %f", best);
+  double db = 10 * log10(ours_energy / ref_energy);
+  cr_assert(le(dbl, fabs(db), 1.0), "level differs by %f dB", db);
+
+  free(ours);
+  vm_destroy(vm);
+  unlink(path);
+  free(wav);
+}
+
+// NOLINTEND